@@ -0,0 +1,601 @@
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tq/tq.h>
+
+#include "tq_audio_dec.h"
+#include "tq_handle_list.h"
+#include "tq_image_loader.h"
+#include "tq_mem.h"
+#include "tq_stream.h"
+
+//------------------------------------------------------------------------------
+// [tq_bench]
+// Microbenchmarks of the library internals. Each benchmark is
+// calibrated to run for about TARGET_TIME seconds, then measured
+// NUM_SAMPLES times; the median is reported.
+// Results are written as JSON to the file given with -o
+// (tq_bench.json by default), because the library logs to stdout.
+//
+// usage: tq_bench [-o output.json] [-f filter] [-r null|opengl|software]
+//                 [-a assets-directory]
+//------------------------------------------------------------------------------
+
+#define TARGET_TIME         0.1
+#define NUM_SAMPLES         5
+#define MAX_ITERATIONS      (1L << 30)
+#define NUM_ALIVE_ITEMS     256
+
+#ifndef TQ_BENCH_ASSETS_DIR
+#define TQ_BENCH_ASSETS_DIR "assets"
+#endif
+
+//------------------------------------------------------------------------------
+
+struct bench
+{
+    char const *name;
+    bool (*setup)(void);
+    void (*run)(long iterations);
+    void (*teardown)(void);
+};
+
+struct result
+{
+    char const *name;
+    long iterations;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+//------------------------------------------------------------------------------
+
+static char const *assets_dir = TQ_BENCH_ASSETS_DIR;
+
+static tq_texture texture;
+static tq_font font;
+
+static void *file_data;
+static size_t file_size;
+
+static unsigned char *wav_data;
+static size_t wav_size;
+
+static short samples[4096];
+
+//------------------------------------------------------------------------------
+// Utility functions
+
+static unsigned long get_allocation_count(void)
+{
+#if defined(TQ_COUNT_ALLOCATIONS)
+    return libtq_get_allocation_count();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Simple LCG, so that every run uses the same sequence.
+ */
+static unsigned int next_random(unsigned int *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static bool load_asset(char const *name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", assets_dir, name);
+
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        fprintf(stderr, "tq_bench: can't open %s\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    file_data = malloc(file_size);
+
+    if (!file_data || fread(file_data, 1, file_size, file) != file_size) {
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void free_asset(void)
+{
+    free(file_data);
+    file_data = NULL;
+    file_size = 0;
+}
+
+static void write_u16(unsigned char *dst, unsigned int value)
+{
+    dst[0] = value & 0xff;
+    dst[1] = (value >> 8) & 0xff;
+}
+
+static void write_u32(unsigned char *dst, unsigned long value)
+{
+    write_u16(dst, value & 0xffff);
+    write_u16(dst + 2, (value >> 16) & 0xffff);
+}
+
+/**
+ * One second of 16-bit stereo sine wave at 44100 Hz.
+ */
+static void generate_wav(void)
+{
+    int const num_frames = 44100;
+    size_t data_size = num_frames * 2 * sizeof(short);
+
+    wav_size = 44 + data_size;
+    wav_data = malloc(wav_size);
+
+    memcpy(wav_data + 0, "RIFF", 4);
+    write_u32(wav_data + 4, wav_size - 8);
+    memcpy(wav_data + 8, "WAVE", 4);
+    memcpy(wav_data + 12, "fmt ", 4);
+    write_u32(wav_data + 16, 16);
+    write_u16(wav_data + 20, 1);            // PCM
+    write_u16(wav_data + 22, 2);            // channels
+    write_u32(wav_data + 24, 44100);        // sample rate
+    write_u32(wav_data + 28, 44100 * 4);    // byte rate
+    write_u16(wav_data + 32, 4);            // block align
+    write_u16(wav_data + 34, 16);           // bits per sample
+    memcpy(wav_data + 36, "data", 4);
+    write_u32(wav_data + 40, data_size);
+
+    for (int i = 0; i < num_frames; i++) {
+        int value = (int) (sin(i * 440.0 * 6.2831853 / 44100.0) * 16000.0);
+
+        write_u16(wav_data + 44 + i * 4, (unsigned int) value & 0xffff);
+        write_u16(wav_data + 44 + i * 4 + 2, (unsigned int) value & 0xffff);
+    }
+}
+
+/**
+ * Decode the whole stream.
+ */
+static void decode_audio(void const *data, size_t size)
+{
+    libtq_stream *stream = libtq_open_memory_stream(data, size);
+    libtq_audio_dec *dec = libtq_open_audio_dec(stream);
+
+    if (dec) {
+        while (libtq_audio_dec_read(dec, samples, 4096) > 0) {
+        }
+
+        libtq_audio_dec_close(dec);
+    }
+
+    libtq_stream_close(stream);
+}
+
+//------------------------------------------------------------------------------
+// Sprite submission
+
+static bool setup_sprites(void)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/textures/moon.png", assets_dir);
+
+    texture = tq_load_texture_from_file(path);
+    return texture.id >= 0;
+}
+
+static void run_draw_texture(long iterations)
+{
+    for (long i = 0; i < iterations; i++) {
+        float x = (float) (i % 640);
+        float y = (float) ((i / 640) % 480);
+
+        tq_draw_texture(texture, (tq_rectf) { x, y, 32, 32 });
+    }
+
+    tq_process();
+}
+
+static void run_draw_sprites(long iterations)
+{
+    static tq_sprite_instance sprites[256];
+
+    for (int i = 0; i < 256; i++) {
+        sprites[i] = (tq_sprite_instance) {
+            .dst = { (float) (i * 3 % 640), (float) (i * 7 % 480), 32, 32 },
+            .uv = { 0, 0, 1, 1 },
+            .rotation = (float) i,
+            .tint = { 255, 255, 255, 255 },
+        };
+    }
+
+    // One operation is one sprite.
+    for (long i = 0; i < iterations; i += 256) {
+        int count = (iterations - i) < 256 ? (int) (iterations - i) : 256;
+        tq_draw_sprites(texture, sprites, count);
+    }
+
+    tq_process();
+}
+
+static void teardown_sprites(void)
+{
+    tq_delete_texture(texture);
+}
+
+//------------------------------------------------------------------------------
+// Text
+
+static bool setup_text(void)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/fonts/sansation.ttf", assets_dir);
+
+    font = tq_load_font_from_file(path, 20, TQ_FONT_NORMAL);
+
+    if (font.id < 0) {
+        return false;
+    }
+
+    // Warm up the glyph cache, only shaping and lookup are measured.
+    tq_draw_text(font, (tq_vec2f) { 0, 0 }, "The quick brown fox jumps over the lazy dog 0123456789");
+    tq_process();
+
+    return true;
+}
+
+static void run_draw_text(long iterations)
+{
+    for (long i = 0; i < iterations; i++) {
+        tq_draw_text(font, (tq_vec2f) { 10, 10 }, "The quick brown fox jumps over the lazy dog 0123456789");
+    }
+
+    tq_process();
+}
+
+static void teardown_text(void)
+{
+    tq_delete_font(font);
+}
+
+//------------------------------------------------------------------------------
+// Image decoding
+
+static bool setup_image(void)
+{
+    return load_asset("textures/glow.png");
+}
+
+static void run_load_image(long iterations)
+{
+    for (long i = 0; i < iterations; i++) {
+        libtq_stream *stream = libtq_open_memory_stream(file_data, file_size);
+        libtq_image *image = libtq_load_image(stream);
+
+        libtq_free(image);
+        libtq_stream_close(stream);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Audio decoding
+
+static bool setup_wav(void)
+{
+    generate_wav();
+    return true;
+}
+
+static void run_decode_wav(long iterations)
+{
+    for (long i = 0; i < iterations; i++) {
+        decode_audio(wav_data, wav_size);
+    }
+}
+
+static void teardown_wav(void)
+{
+    free(wav_data);
+    wav_data = NULL;
+}
+
+static bool setup_ogg(void)
+{
+    if (!load_asset("defense/turret_attack.ogg")) {
+        return false;
+    }
+
+    // Library may be built without Ogg Vorbis support.
+    libtq_stream *stream = libtq_open_memory_stream(file_data, file_size);
+    libtq_audio_dec *dec = libtq_open_audio_dec(stream);
+
+    if (dec) {
+        libtq_audio_dec_close(dec);
+    }
+
+    libtq_stream_close(stream);
+
+    if (!dec) {
+        free_asset();
+    }
+
+    return dec != NULL;
+}
+
+static void run_decode_ogg(long iterations)
+{
+    for (long i = 0; i < iterations; i++) {
+        decode_audio(file_data, file_size);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Streams
+
+static libtq_stream *bench_stream;
+
+static bool setup_memory_stream(void)
+{
+    if (!load_asset("music/ostrich.ogg")) {
+        return false;
+    }
+
+    bench_stream = libtq_open_memory_stream(file_data, file_size);
+    return bench_stream != NULL;
+}
+
+static bool setup_file_stream(void)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/music/ostrich.ogg", assets_dir);
+
+    bench_stream = libtq_open_file_stream(path);
+    return bench_stream != NULL;
+}
+
+/**
+ * Seek to a random position and read 256 bytes.
+ */
+static void run_stream_seek_read(long iterations)
+{
+    unsigned char buffer[256];
+    unsigned int state = 1;
+    intptr_t size = libtq_stream_size(bench_stream) - sizeof(buffer);
+
+    for (long i = 0; i < iterations; i++) {
+        libtq_stream_seek(bench_stream, next_random(&state) % size);
+        libtq_stream_read(bench_stream, buffer, sizeof(buffer));
+    }
+}
+
+static void teardown_stream(void)
+{
+    libtq_stream_close(bench_stream);
+    free_asset();
+}
+
+//------------------------------------------------------------------------------
+// Handle arrays
+
+struct item
+{
+    int value[4];
+};
+
+DECLARE_FLEXIBLE_ARRAY(item)
+
+static struct item_array items;
+
+static bool setup_handle_array(void)
+{
+    item_array_initialize(&items, 16, NULL);
+
+    // Typical case: some handles are alive all the time.
+    for (int i = 0; i < NUM_ALIVE_ITEMS; i++) {
+        item_array_add(&items, &(struct item) { { i } });
+    }
+
+    return true;
+}
+
+/**
+ * Add and remove a handle. Every 4th time, a handle in the middle
+ * is replaced as well, so the next free slot has to be found.
+ */
+static void run_handle_array(long iterations)
+{
+    unsigned int state = 1;
+
+    for (long i = 0; i < iterations; i++) {
+        int id = item_array_add(&items, &(struct item) { { (int) i } });
+
+        if (i % 4 == 0) {
+            item_array_remove(&items, next_random(&state) % NUM_ALIVE_ITEMS);
+            item_array_add(&items, &(struct item) { { (int) i } });
+        }
+
+        item_array_remove(&items, id);
+    }
+}
+
+static void teardown_handle_array(void)
+{
+    item_array_terminate(&items);
+}
+
+//------------------------------------------------------------------------------
+
+static struct bench const benches[] = {
+    { "graphics/draw_texture",      setup_sprites,          run_draw_texture,       teardown_sprites },
+    { "graphics/draw_sprites",      setup_sprites,          run_draw_sprites,       teardown_sprites },
+    { "text/draw_text",             setup_text,             run_draw_text,          teardown_text },
+    { "image/load_png_256x256",     setup_image,            run_load_image,         free_asset },
+    { "audio/decode_wav_1s",        setup_wav,              run_decode_wav,         teardown_wav },
+    { "audio/decode_ogg",           setup_ogg,              run_decode_ogg,         free_asset },
+    { "stream/memory_seek_read",    setup_memory_stream,    run_stream_seek_read,   teardown_stream },
+    { "stream/file_seek_read",      setup_file_stream,      run_stream_seek_read,   teardown_stream },
+    { "handle_array/add_remove",    setup_handle_array,     run_handle_array,       teardown_handle_array },
+};
+
+static double measure(struct bench const *bench, long iterations, unsigned long *allocations)
+{
+    unsigned long allocations_before = get_allocation_count();
+    double start = tq_get_time_highp();
+
+    bench->run(iterations);
+
+    double time = tq_get_time_highp() - start;
+    *allocations = get_allocation_count() - allocations_before;
+
+    return time;
+}
+
+static int compare_doubles(void const *a, void const *b)
+{
+    double x = *(double const *) a;
+    double y = *(double const *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void run_bench(struct bench const *bench, struct result *result)
+{
+    unsigned long allocations;
+    long iterations = 1;
+    double time = measure(bench, iterations, &allocations);
+
+    // Calibrate: grow iteration count until the run is long enough.
+    while (time < (TARGET_TIME / 10.0) && iterations < MAX_ITERATIONS) {
+        iterations *= 2;
+        time = measure(bench, iterations, &allocations);
+    }
+
+    if (time > 0.0 && time < TARGET_TIME) {
+        iterations = (long) (iterations * (TARGET_TIME / time));
+    }
+
+    double ns_per_op[NUM_SAMPLES];
+
+    for (int i = 0; i < NUM_SAMPLES; i++) {
+        ns_per_op[i] = measure(bench, iterations, &allocations) * 1.0e9 / iterations;
+    }
+
+    qsort(ns_per_op, NUM_SAMPLES, sizeof(double), compare_doubles);
+
+    result->name = bench->name;
+    result->iterations = iterations;
+    result->ns_per_op = ns_per_op[NUM_SAMPLES / 2];
+    result->allocs_per_op = (double) allocations / iterations;
+}
+
+static void write_json(FILE *file, struct result const *results, int count, char const *renderer)
+{
+    fprintf(file, "{\n");
+    fprintf(file, "  \"version\": \"%s\",\n", TQ_VERSION);
+    fprintf(file, "  \"renderer\": \"%s\",\n", renderer);
+    fprintf(file, "  \"benchmarks\": [\n");
+
+    for (int i = 0; i < count; i++) {
+        struct result const *result = &results[i];
+
+        fprintf(file, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f, ",
+            result->name, result->iterations, result->ns_per_op, 1.0e9 / result->ns_per_op);
+
+#if defined(TQ_COUNT_ALLOCATIONS)
+        fprintf(file, "\"allocs_per_op\": %.4f}", result->allocs_per_op);
+#else
+        fprintf(file, "\"allocs_per_op\": null}");
+#endif
+
+        fprintf(file, "%s\n", (i + 1) < count ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char const *output = "tq_bench.json";
+    char const *filter = NULL;
+    char const *renderer = "null";
+
+    for (int i = 1; (i + 1) < argc; i += 2) {
+        if (strcmp(argv[i], "-o") == 0) {
+            output = argv[i + 1];
+        } else if (strcmp(argv[i], "-f") == 0) {
+            filter = argv[i + 1];
+        } else if (strcmp(argv[i], "-r") == 0) {
+            renderer = argv[i + 1];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            assets_dir = argv[i + 1];
+        }
+    }
+
+    if (strcmp(renderer, "opengl") == 0) {
+        tq_set_renderer_type(TQ_RENDERER_OPENGL);
+    } else if (strcmp(renderer, "software") == 0) {
+        tq_set_renderer_type(TQ_RENDERER_SOFTWARE);
+    } else {
+        renderer = "null";
+        tq_set_renderer_type(TQ_RENDERER_NULL);
+    }
+
+    tq_set_headless(true);
+    tq_set_display_size((tq_vec2i) { 640, 480 });
+    tq_initialize();
+
+    int const num_benches = sizeof(benches) / sizeof(benches[0]);
+    struct result results[sizeof(benches) / sizeof(benches[0])];
+    int count = 0;
+
+    for (int i = 0; i < num_benches; i++) {
+        struct bench const *bench = &benches[i];
+
+        if (filter && !strstr(bench->name, filter)) {
+            continue;
+        }
+
+        if (!bench->setup()) {
+            fprintf(stderr, "tq_bench: skipping %s\n", bench->name);
+            continue;
+        }
+
+        run_bench(bench, &results[count]);
+        bench->teardown();
+
+        fprintf(stderr, "%-28s %12.1f ns/op %10.4f allocs/op\n", results[count].name,
+            results[count].ns_per_op, results[count].allocs_per_op);
+
+        count++;
+    }
+
+    tq_terminate();
+
+    FILE *file = fopen(output, "w");
+
+    if (!file) {
+        fprintf(stderr, "tq_bench: can't write %s\n", output);
+        return EXIT_FAILURE;
+    }
+
+    write_json(file, results, count, renderer);
+    fclose(file);
+
+    return EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
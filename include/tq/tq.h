@@ -118,6 +118,16 @@
  */
 #define TQ_FONT_BOLD                    (700)
 
+/**
+ * Maximum number of surface passes timed per frame.
+ */
+#define TQ_PASS_TIMING_LIMIT            (16)
+
+/**
+ * Number of recent frames used for frame time statistics.
+ */
+#define TQ_FRAME_TIME_WINDOW            (120)
+
 //------------------------------------------------------------------------------
 // Enumerations
 
@@ -299,6 +309,17 @@ typedef enum tq_channel_state
     TQ_CHANNEL_PLAYING,
 } tq_channel_state;
 
+/**
+ * Enumeration of renderer backends.
+ */
+typedef enum tq_renderer_type
+{
+    TQ_RENDERER_DEFAULT,
+    TQ_RENDERER_OPENGL,
+    TQ_RENDERER_SOFTWARE,
+    TQ_RENDERER_NULL,
+} tq_renderer_type;
+
 //------------------------------------------------------------------------------
 // Typedefs and structs
 
@@ -332,6 +353,11 @@ typedef struct { int id; } tq_music;
  */
 typedef struct { int id; } tq_channel;
 
+/**
+ * Command buffer identifier.
+ */
+typedef struct { int id; } tq_cmdbuf;
+
 /**
  * Two-dimensional vector of integer numbers.
  */
@@ -397,6 +423,48 @@ typedef struct tq_blend_mode
     tq_blend_equation alpha_equation;
 } tq_blend_mode;
 
+/**
+ * Sprite instance, see tq_draw_sprites().
+ */
+typedef struct tq_sprite_instance
+{
+    tq_rectf dst;           // destination rectangle
+    tq_rectf uv;            // texture region (normalized, from 0 to 1)
+    float rotation;         // rotation around the center in degrees
+    tq_color tint;          // texture color is multiplied by this
+} tq_sprite_instance;
+
+/**
+ * Rendering statistics of a single frame.
+ */
+typedef struct tq_frame_stats
+{
+    int batch_count;        // number of draw calls sent to the GPU
+    int vertex_count;       // vertices submitted with these draw calls
+    int state_changes;      // state changes and binds sent to the driver
+    int redundant_state_changes;    // ones skipped as redundant
+    int texture_binds;      // texture binds sent to the driver
+    int program_switches;   // shader program switches
+    int surface_switches;   // render target switches
+    int pooled_surface_count;       // surfaces kept by the temporary surface pool
+
+    long vertex_upload_bytes;       // bytes uploaded to vertex buffers
+    long texture_upload_bytes;      // bytes uploaded to textures
+
+    float frame_time_min;   // CPU frame time in milliseconds over the
+    float frame_time_avg;   // last TQ_FRAME_TIME_WINDOW frames
+    float frame_time_p99;
+
+    float gpu_time;         // GPU time of the whole frame in milliseconds
+    float canvas_time;      // GPU time of the final canvas blit
+    int pass_count;         // number of timed surface passes
+
+    struct {
+        int surface_id;     // surface handle (see tq_surface)
+        float time;         // GPU time in milliseconds
+    } passes[TQ_PASS_TIMING_LIMIT];
+} tq_frame_stats;
+
 /**
  * Main loop callback.
  */
@@ -427,6 +495,12 @@ typedef void (*tq_mouse_cursor_callback)(tq_vec2i cursor);
  */
 typedef void (*tq_mouse_wheel_callback)(tq_vec2i cursor, tq_vec2f wheel);
 
+/**
+ * Trace replay callback, called after each frame is presented.
+ * `time` is the duration of the frame in seconds.
+ */
+typedef void (*tq_trace_frame_callback)(int frame, double time);
+
 //------------------------------------------------------------------------------
 
 /**
@@ -476,6 +550,17 @@ TQ_API char const * TQ_CALL tq_get_title(void);
  */
 TQ_API void TQ_CALL tq_set_title(char const *title);
 
+/**
+ * Run without a window. Rendering goes to an offscreen buffer of
+ * display size, presenting does nothing and isn't limited by vsync,
+ * and no input events are received. Useful for benchmarks and tests.
+ * Can also be enabled with the TQ_HEADLESS=1 environment variable.
+ * Should be called before tq_initialize(). With the software renderer
+ * it works in any build; the OpenGL renderer needs a Linux build with
+ * TQ_USE_EGL.
+ */
+TQ_API void TQ_CALL tq_set_headless(bool headless);
+
 //----------------------------------------------------------
 // Keyboard
 
@@ -629,6 +714,56 @@ TQ_API void TQ_CALL tq_set_color_key(tq_color color);
  */
 TQ_API void TQ_CALL tq_set_antialiasing_level(int level);
 
+/**
+ * Enable or disable CPU-side vertex transform.
+ * If enabled, the transformation matrix is applied to vertices
+ * before they are sent to the renderer, so matrix changes are cheap
+ * and don't interrupt batching of draw calls.
+ * Disabled by default.
+ */
+TQ_API void TQ_CALL tq_set_cpu_transform_enabled(bool enabled);
+
+/**
+ * Check if CPU-side vertex transform is enabled.
+ */
+TQ_API bool TQ_CALL tq_is_cpu_transform_enabled(void);
+
+/**
+ * If enabled, textures loaded afterwards will have mipmaps.
+ * See tq_set_texture_mipmapped().
+ * Disabled by default.
+ */
+TQ_API void TQ_CALL tq_set_mipmaps_enabled(bool enabled);
+
+/**
+ * Enable packing of small textures into shared atlas pages.
+ * Images loaded afterwards by tq_load_texture_from_*() which are
+ * not larger than `size` in both dimensions are packed, so they
+ * can be drawn together without texture switches.
+ * Smooth and mipmap options of such textures affect the whole page.
+ * Pass 0 to disable. Disabled by default.
+ */
+TQ_API void TQ_CALL tq_set_texture_atlas_threshold(int size);
+
+/**
+ * Set padding around images in atlas pages created afterwards.
+ * Edge pixels are extruded into the padding, so linear filtering
+ * doesn't pick up neighbouring images. Maximum value is 16.
+ * Default value: 2.
+ */
+TQ_API void TQ_CALL tq_set_texture_atlas_padding(int padding);
+
+/**
+ * Select the renderer backend. Should be called before tq_initialize().
+ * The software renderer draws on the CPU using several threads and
+ * doesn't need a GPU or a GL context; its output is copied to the
+ * window, or can be read with tq_read_canvas_pixels().
+ * If the type is TQ_RENDERER_DEFAULT, the TQ_RENDERER environment
+ * variable is checked ("opengl", "software" or "null"), otherwise
+ * the platform default is used.
+ */
+TQ_API void TQ_CALL tq_set_renderer_type(tq_renderer_type type);
+
 //----------------------------------------------------------
 // Canvas
 
@@ -658,6 +793,22 @@ TQ_API tq_vec2i TQ_CALL tq_get_canvas_size(void);
  */
 TQ_API void TQ_CALL tq_set_canvas_size(tq_vec2i size);
 
+/**
+ * If enabled, and canvas size matches display size, and antialiasing
+ * is off, everything is drawn straight to the display without an
+ * intermediate surface, which saves a full-screen copy each frame.
+ * Contents of the display are undefined after tq_process(), so
+ * the application has to redraw the whole canvas every frame.
+ * Takes effect from the next frame.
+ * Disabled by default.
+ */
+TQ_API void TQ_CALL tq_set_direct_canvas_enabled(bool enabled);
+
+/**
+ * Check if direct drawing to the display is enabled.
+ */
+TQ_API bool TQ_CALL tq_is_direct_canvas_enabled(void);
+
 /**
  * Check if canvas is antialiased.
  */
@@ -669,6 +820,15 @@ TQ_API bool TQ_CALL tq_is_canvas_smooth(void);
  */
 TQ_API void TQ_CALL tq_set_canvas_smooth(bool smooth);
 
+/**
+ * Read what has been drawn to the canvas so far in the current frame.
+ * `pixels` should hold canvas width * height * 4 bytes. Pixels are
+ * written as RGBA, top row first.
+ * This function stalls the pipeline, so it's better not to call
+ * it every frame unless the software renderer is used.
+ */
+TQ_API void TQ_CALL tq_read_canvas_pixels(unsigned char *pixels);
+
 //----------------------------------------------------------
 // Views
 
@@ -804,6 +964,10 @@ TQ_API void TQ_CALL tq_set_outline_color(tq_color outline_color);
 
 /**
  * Load texture from a file.
+ * DDS and KTX files with BC1, BC3 or ETC2 data are uploaded
+ * without decompression if the GPU supports the format.
+ * Only the first mipmap level is used, and the color key
+ * doesn't apply to such textures.
  */
 TQ_API tq_texture TQ_CALL tq_load_texture_from_file(char const *path);
 
@@ -812,6 +976,21 @@ TQ_API tq_texture TQ_CALL tq_load_texture_from_file(char const *path);
  */
 TQ_API tq_texture TQ_CALL tq_load_texture_from_memory(uint8_t const *buffer, size_t length);
 
+/**
+ * Start loading texture from a file in background.
+ * Returns a handle right away; the image is decoded in a separate
+ * thread and uploaded during the next frames. Until then, drawing
+ * the texture does nothing and its size is 1x1.
+ */
+TQ_API tq_texture TQ_CALL tq_load_texture_async(char const *path);
+
+/**
+ * Check if a texture is loaded and can be drawn.
+ * Returns false while the texture is being loaded in background
+ * or if loading failed.
+ */
+TQ_API bool TQ_CALL tq_is_texture_ready(tq_texture texture);
+
 /**
  * Delete a texture from video memory.
  */
@@ -828,6 +1007,15 @@ TQ_API tq_vec2i TQ_CALL tq_get_texture_size(tq_texture texture);
  */
 TQ_API void TQ_CALL tq_set_texture_smooth(tq_texture texture, bool smooth);
 
+/**
+ * If enabled, texture will look less noisy when minified.
+ * Combined with smooth filtering, this gives trilinear filtering.
+ * Mip levels are rebuilt automatically when texture contents change.
+ * On OpenGL ES 2.0 this has effect only for power-of-two textures.
+ * Default value: disabled.
+ */
+TQ_API void TQ_CALL tq_set_texture_mipmapped(tq_texture texture, bool mipmapped);
+
 /**
  * Draw a texture inside a rectangle.
  */
@@ -839,6 +1027,12 @@ TQ_API void TQ_CALL tq_draw_texture(tq_texture texture, tq_rectf rect);
  */
 TQ_API void TQ_CALL tq_draw_subtexture(tq_texture texture, tq_rectf sub, tq_rectf rect);
 
+/**
+ * Draw a number of sprites using the same texture at once.
+ * Much faster than calling tq_draw_texture() for each sprite.
+ */
+TQ_API void TQ_CALL tq_draw_sprites(tq_texture texture, tq_sprite_instance const *sprites, int count);
+
 //----------------------------------------------------------
 // Surfaces
 
@@ -849,9 +1043,23 @@ TQ_API tq_surface TQ_CALL tq_create_surface(tq_vec2i size);
 
 /**
  * Delete a surface.
+ * Surfaces obtained by tq_acquire_temp_surface() can't be deleted.
  */
 TQ_API void TQ_CALL tq_delete_surface(tq_surface surface);
 
+/**
+ * Get a scratch surface of given size from the pool.
+ * Surfaces are reused between frames, so its contents are undefined.
+ * Surfaces that are not acquired for a few frames are deleted.
+ */
+TQ_API tq_surface TQ_CALL tq_acquire_temp_surface(tq_vec2i size);
+
+/**
+ * Return a surface obtained by tq_acquire_temp_surface() to the pool.
+ * It shouldn't be used after that.
+ */
+TQ_API void TQ_CALL tq_release_temp_surface(tq_surface surface);
+
 /**
  * Switch to surface. All subsequent rendering commands will affect
  * that surface.
@@ -960,6 +1168,138 @@ TQ_API void TQ_CALL tq_print_text(tq_font font, tq_vec2f position, char const *f
  */
 TQ_API void TQ_CALL tq_set_blend_mode(tq_blend_mode mode);
 
+//----------------------------------------------------------
+// Draw lists
+
+/**
+ * Start recording draw calls instead of sending them immediately.
+ * Recorded draw calls are sorted by layer and submitted in
+ * tq_end_draw_list(). Within a layer, a draw call is moved back
+ * to an earlier one with the same shader, texture and blend mode
+ * if it doesn't overlap anything drawn in between, so the picture
+ * stays the same with any blend mode. Points and lines are never
+ * moved past other draws.
+ * Changing surface or view, clearing, modifying textures
+ * submits what has been recorded so far.
+ * CPU-side vertex transform is forced on while recording.
+ */
+TQ_API void TQ_CALL tq_begin_draw_list(void);
+
+/**
+ * Sort and submit recorded draw calls and stop recording.
+ * It's called automatically at the end of the frame.
+ */
+TQ_API void TQ_CALL tq_end_draw_list(void);
+
+/**
+ * Set layer of subsequently recorded draw calls.
+ * Layers with lower values are drawn first.
+ * Valid range is [-32768, 32767]; layer is reset to 0
+ * by tq_begin_draw_list().
+ */
+TQ_API void TQ_CALL tq_set_draw_layer(int layer);
+
+//----------------------------------------------------------
+// Command buffers
+
+/**
+ * Start recording a command buffer.
+ * Unlike the rest of the drawing API, command buffers can be
+ * recorded from any thread: recording only stores the calls,
+ * it doesn't touch the renderer or the current draw state.
+ * A single buffer shouldn't be shared between threads.
+ * Returns a buffer with negative id if too many are in use.
+ */
+TQ_API tq_cmdbuf TQ_CALL tq_cmdbuf_begin(void);
+
+/**
+ * Finish recording and queue the buffer for drawing.
+ * Queued buffers are replayed on the main thread at the end of
+ * the frame, on top of everything drawn directly, in ascending
+ * order of `order`. Buffers with the same order are replayed in
+ * the order tq_cmdbuf_begin() was called for them, so to get the
+ * same result every frame either begin them on one thread or give
+ * them distinct orders. The handle can't be used after this.
+ */
+TQ_API void TQ_CALL tq_cmdbuf_submit(tq_cmdbuf cmdbuf, int order);
+
+/**
+ * Functions below record their immediate counterparts.
+ * Each buffer starts with identity transformation and with the
+ * colors and blend mode the main thread has at the end of the
+ * frame; its own state changes and matrix pushes don't outlive
+ * the buffer.
+ */
+TQ_API void TQ_CALL tq_cmdbuf_set_draw_color(tq_cmdbuf cmdbuf, tq_color draw_color);
+TQ_API void TQ_CALL tq_cmdbuf_set_outline_color(tq_cmdbuf cmdbuf, tq_color outline_color);
+TQ_API void TQ_CALL tq_cmdbuf_set_blend_mode(tq_cmdbuf cmdbuf, tq_blend_mode mode);
+TQ_API void TQ_CALL tq_cmdbuf_push_matrix(tq_cmdbuf cmdbuf);
+TQ_API void TQ_CALL tq_cmdbuf_pop_matrix(tq_cmdbuf cmdbuf);
+TQ_API void TQ_CALL tq_cmdbuf_translate_matrix(tq_cmdbuf cmdbuf, tq_vec2f translate);
+TQ_API void TQ_CALL tq_cmdbuf_scale_matrix(tq_cmdbuf cmdbuf, tq_vec2f scale);
+TQ_API void TQ_CALL tq_cmdbuf_rotate_matrix(tq_cmdbuf cmdbuf, float degrees);
+TQ_API void TQ_CALL tq_cmdbuf_draw_point(tq_cmdbuf cmdbuf, tq_vec2f position);
+TQ_API void TQ_CALL tq_cmdbuf_draw_line(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b);
+TQ_API void TQ_CALL tq_cmdbuf_draw_triangle(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b, tq_vec2f c);
+TQ_API void TQ_CALL tq_cmdbuf_draw_rectangle(tq_cmdbuf cmdbuf, tq_rectf rect);
+TQ_API void TQ_CALL tq_cmdbuf_draw_circle(tq_cmdbuf cmdbuf, tq_vec2f position, float radius);
+TQ_API void TQ_CALL tq_cmdbuf_outline_triangle(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b, tq_vec2f c);
+TQ_API void TQ_CALL tq_cmdbuf_outline_rectangle(tq_cmdbuf cmdbuf, tq_rectf rect);
+TQ_API void TQ_CALL tq_cmdbuf_outline_circle(tq_cmdbuf cmdbuf, tq_vec2f position, float radius);
+TQ_API void TQ_CALL tq_cmdbuf_fill_triangle(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b, tq_vec2f c);
+TQ_API void TQ_CALL tq_cmdbuf_fill_rectangle(tq_cmdbuf cmdbuf, tq_rectf rect);
+TQ_API void TQ_CALL tq_cmdbuf_fill_circle(tq_cmdbuf cmdbuf, tq_vec2f position, float radius);
+TQ_API void TQ_CALL tq_cmdbuf_draw_texture(tq_cmdbuf cmdbuf, tq_texture texture, tq_rectf rect);
+TQ_API void TQ_CALL tq_cmdbuf_draw_subtexture(tq_cmdbuf cmdbuf, tq_texture texture, tq_rectf sub, tq_rectf rect);
+TQ_API void TQ_CALL tq_cmdbuf_draw_sprites(tq_cmdbuf cmdbuf, tq_texture texture, tq_sprite_instance const *sprites, int count);
+TQ_API void TQ_CALL tq_cmdbuf_draw_text(tq_cmdbuf cmdbuf, tq_font font, tq_vec2f position, char const *text);
+
+//----------------------------------------------------------
+// Statistics
+
+/**
+ * Get rendering statistics of the previous frame.
+ * GPU timings are read without waiting for the GPU, so they
+ * describe a frame that finished a few frames ago.
+ * They are zero if the renderer can't measure them.
+ * Frame times are measured between calls to tq_process().
+ */
+TQ_API void TQ_CALL tq_get_frame_stats(tq_frame_stats *stats);
+
+//----------------------------------------------------------
+// Tracing
+
+/**
+ * Record every renderer call, along with vertex and pixel data,
+ * to a binary trace file. Recording lasts until tq_terminate().
+ * Can also be enabled with the TQ_TRACE environment variable
+ * which holds the path.
+ * Should be called before tq_initialize().
+ */
+TQ_API void TQ_CALL tq_set_trace_path(char const *path);
+
+/**
+ * Play a recorded trace against the current renderer as fast as
+ * possible, presenting each frame to the display. Display size
+ * is changed to the recorded one. Textures and surfaces created
+ * by the trace are deleted when it ends.
+ * Returns the number of played frames or -1 if the file can't
+ * be read, is truncated or corrupted.
+ */
+TQ_API int TQ_CALL tq_replay_trace(char const *path, tq_trace_frame_callback callback);
+
+//------------------------------------------------------------------------------
+// Profiling
+
+/**
+ * Write timing markers collected so far to a file in Chrome
+ * trace event format, which can be opened in Perfetto or
+ * chrome://tracing. Each thread keeps only its latest events.
+ * Markers are recorded only if the library is built with
+ * TQ_USE_PROFILER, otherwise this function returns false.
+ */
+TQ_API bool TQ_CALL tq_profiler_dump(char const *path);
+
 //------------------------------------------------------------------------------
 // Audio
 
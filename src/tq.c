@@ -27,6 +27,7 @@
 #include "tq_graphics.h"
 #include "tq_log.h"
 #include "tq_mem.h"
+#include "tq_profiler.h"
 #include "tq_text.h"
 
 #if defined(EMSCRIPTEN)
@@ -75,10 +76,16 @@ void tq_terminate(void)
 
 bool tq_process(void)
 {
+    TQ_PROFILE_BEGIN("tq_process");
+
     tq_process_graphics();
     tq_process_audio();
 
-    return tq_process_core();
+    bool running = tq_process_core();
+
+    TQ_PROFILE_END();
+
+    return running;
 }
 
 #if defined(EMSCRIPTEN)
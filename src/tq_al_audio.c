@@ -37,6 +37,7 @@
 #include "tq_error.h"
 #include "tq_mem.h"
 #include "tq_log.h"
+#include "tq_profiler.h"
 #include "tq_audio_dec.h"
 
 //------------------------------------------------------------------------------
@@ -500,6 +501,8 @@ static int music_main(void *data)
         return -1;
     }
 
+    TQ_PROFILE_THREAD("music");
+
     int loops_left = openal.channels.loop[channel_id];
 
     CHECK_AL(alSourcei(source, AL_BUFFER, 0));
@@ -551,6 +554,8 @@ static int music_main(void *data)
         ALint buffers_processed;
         CHECK_AL(alGetSourcei(source, AL_BUFFERS_PROCESSED, &buffers_processed));
 
+        TQ_PROFILE_BEGIN("music_stream");
+
         for (int n = 0; n < buffers_processed; n++) {
             ALuint buffer;
             CHECK_AL(alSourceUnqueueBuffers(source, 1, &buffer));
@@ -562,6 +567,8 @@ static int music_main(void *data)
             CHECK_AL(alSourceQueueBuffers(source, 1, &buffer));
         }
 
+        TQ_PROFILE_END();
+
         libtq_sleep(0.1);
     }
 
@@ -575,6 +582,8 @@ static int music_main(void *data)
     }
     libtq_unlock_mutex(openal.mutex);
 
+    TQ_PROFILE_THREAD_END();
+
     return 0;
 }
 
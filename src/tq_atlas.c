@@ -0,0 +1,410 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "tq_atlas.h"
+#include "tq_error.h"
+#include "tq_handle_list.h"
+#include "tq_log.h"
+#include "tq_mem.h"
+
+//------------------------------------------------------------------------------
+
+#define PAGE_SIZE                   1024
+#define DEFAULT_PADDING             2
+#define MAX_PADDING                 16
+
+//------------------------------------------------------------------------------
+
+/**
+ * Row of images of similar height.
+ */
+struct atlas_shelf
+{
+    int y;
+    int height;
+    int x;                      // next free position in the row
+};
+
+/**
+ * Shared texture that holds many small images.
+ * Space is allocated with a simple shelf packer and is not reused:
+ * the page is deleted when its last image is removed.
+ */
+struct atlas_page
+{
+    int texture_id;
+    int channels;
+    int padding;
+    struct atlas_shelf *shelves;
+    int shelf_count;
+    int shelf_capacity;
+    int next_y;                 // top of the free space below shelves
+    int image_count;
+};
+
+/**
+ * Image packed into a page. The rectangle doesn't include padding.
+ */
+struct atlas_image
+{
+    int page_id;
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+DECLARE_FLEXIBLE_ARRAY(atlas_page)
+DECLARE_FLEXIBLE_ARRAY(atlas_image)
+
+/**
+ * Private data for [atlas] module.
+ * Settings are kept between render context changes.
+ */
+struct tq_atlas_priv
+{
+    tq_renderer_impl *renderer;
+    bool initialized;
+
+    int threshold;
+    int padding;
+
+    struct atlas_page_array pages;
+    struct atlas_image_array images;
+};
+
+static struct tq_atlas_priv priv = {
+    .padding = DEFAULT_PADDING,
+};
+
+//------------------------------------------------------------------------------
+
+static void atlas_page_dtor(struct atlas_page *page)
+{
+    priv.renderer->delete_texture(page->texture_id);
+    libtq_free(page->shelves);
+}
+
+static struct atlas_shelf *add_shelf(struct atlas_page *page, int height)
+{
+    if (page->shelf_count == page->shelf_capacity) {
+        int next_capacity = page->shelf_capacity ? (page->shelf_capacity * 2) : 16;
+        struct atlas_shelf *next_shelves = libtq_realloc(page->shelves,
+            next_capacity * sizeof(struct atlas_shelf));
+
+        if (!next_shelves) {
+            libtq_out_of_memory();
+        }
+
+        page->shelves = next_shelves;
+        page->shelf_capacity = next_capacity;
+    }
+
+    struct atlas_shelf *shelf = &page->shelves[page->shelf_count++];
+
+    shelf->y = page->next_y;
+    shelf->height = height;
+    shelf->x = 0;
+
+    page->next_y += height;
+
+    return shelf;
+}
+
+/**
+ * Allocate a rectangle in the page. Returns false if there is no room.
+ * The shelf with the least wasted height is preferred.
+ */
+static bool allocate_rect(struct atlas_page *page, int width, int height, int *x, int *y)
+{
+    struct atlas_shelf *best = NULL;
+
+    for (int i = 0; i < page->shelf_count; i++) {
+        struct atlas_shelf *shelf = &page->shelves[i];
+
+        if (shelf->height < height || (shelf->x + width) > PAGE_SIZE) {
+            continue;
+        }
+
+        if (!best || shelf->height < best->height) {
+            best = shelf;
+        }
+    }
+
+    // Don't put small images in much taller rows
+    // while there is space for a new one.
+    bool room_for_shelf = (page->next_y + height) <= PAGE_SIZE && width <= PAGE_SIZE;
+
+    if (room_for_shelf && (!best || best->height > 2 * height)) {
+        best = add_shelf(page, height);
+    }
+
+    if (!best) {
+        return false;
+    }
+
+    *x = best->x;
+    *y = best->y;
+
+    best->x += width;
+
+    return true;
+}
+
+static int create_page(int channels)
+{
+    int texture_id = priv.renderer->create_texture(PAGE_SIZE, PAGE_SIZE, channels);
+
+    if (texture_id == -1) {
+        return -1;
+    }
+
+    struct atlas_page page = {
+        .texture_id = texture_id,
+        .channels = channels,
+        .padding = priv.padding,
+    };
+
+    libtq_log(0, "atlas: created page #%d (%dx%d, %d channels)\n",
+        texture_id, PAGE_SIZE, PAGE_SIZE, channels);
+
+    return atlas_page_array_add(&priv.pages, &page);
+}
+
+/**
+ * RGB images share pages with RGBA ones, so they can be drawn
+ * together. Other formats are sampled differently by renderers,
+ * so they get their own pages.
+ */
+static int get_page_channels(int channels)
+{
+    return (channels == 3) ? 4 : channels;
+}
+
+/**
+ * Copy image to a buffer with padding around it, converting it
+ * to the page format. Edge pixels are repeated in the padding area.
+ */
+static unsigned char *extrude_image(libtq_image const *image, int channels, int padding)
+{
+    int width = image->width + 2 * padding;
+    int height = image->height + 2 * padding;
+
+    unsigned char *pixels = libtq_malloc(width * height * channels);
+
+    if (!pixels) {
+        libtq_out_of_memory();
+    }
+
+    unsigned char *dst = pixels;
+
+    for (int y = 0; y < height; y++) {
+        int src_y = TQ_MIN(TQ_MAX(y - padding, 0), image->height - 1);
+
+        for (int x = 0; x < width; x++) {
+            int src_x = TQ_MIN(TQ_MAX(x - padding, 0), image->width - 1);
+            unsigned char const *src = image->pixels
+                + (src_y * image->width + src_x) * image->channels;
+
+            memcpy(dst, src, image->channels);
+
+            if (channels > image->channels) {
+                dst[3] = 255;
+            }
+
+            dst += channels;
+        }
+    }
+
+    return pixels;
+}
+
+static struct atlas_image *get_image(int texture_id)
+{
+    if (!(texture_id & TQ_ATLAS_TEXTURE_BIT)) {
+        return NULL;
+    }
+
+    int image_id = texture_id & ~TQ_ATLAS_TEXTURE_BIT;
+
+    if (!atlas_image_array_check(&priv.images, image_id)) {
+        return NULL;
+    }
+
+    return &priv.images.data[image_id];
+}
+
+//------------------------------------------------------------------------------
+
+void tq_initialize_atlas(tq_renderer_impl *renderer)
+{
+    priv.renderer = renderer;
+
+    atlas_page_array_initialize(&priv.pages, 4, atlas_page_dtor);
+    atlas_image_array_initialize(&priv.images, 64, NULL);
+
+    priv.initialized = true;
+}
+
+void tq_terminate_atlas(void)
+{
+    if (!priv.initialized) {
+        return;
+    }
+
+    atlas_image_array_terminate(&priv.images);
+    atlas_page_array_terminate(&priv.pages);
+
+    priv.initialized = false;
+}
+
+void tq_set_atlas_threshold(int size)
+{
+    priv.threshold = TQ_MIN(TQ_MAX(size, 0), PAGE_SIZE - 2 * MAX_PADDING);
+}
+
+void tq_set_atlas_padding(int padding)
+{
+    priv.padding = TQ_MIN(TQ_MAX(padding, 0), MAX_PADDING);
+}
+
+/**
+ * Pack image into one of the pages.
+ * Returns -1 if atlasing is disabled or the image is too large.
+ */
+int tq_add_image_to_atlas(libtq_image const *image)
+{
+    if (!priv.initialized || priv.threshold == 0) {
+        return -1;
+    }
+
+    if (image->width > priv.threshold || image->height > priv.threshold) {
+        return -1;
+    }
+
+    int channels = get_page_channels(image->channels);
+    int padded_width = image->width + 2 * priv.padding;
+    int padded_height = image->height + 2 * priv.padding;
+
+    int page_id = -1;
+    int x, y;
+
+    for (int i = 0; i < priv.pages.count; i++) {
+        if (!atlas_page_array_check(&priv.pages, i)) {
+            continue;
+        }
+
+        struct atlas_page *page = &priv.pages.data[i];
+
+        if (page->channels != channels || page->padding != priv.padding) {
+            continue;
+        }
+
+        if (allocate_rect(page, padded_width, padded_height, &x, &y)) {
+            page_id = i;
+            break;
+        }
+    }
+
+    if (page_id == -1) {
+        page_id = create_page(channels);
+
+        if (page_id == -1) {
+            return -1;
+        }
+
+        allocate_rect(&priv.pages.data[page_id], padded_width, padded_height, &x, &y);
+    }
+
+    struct atlas_page *page = &priv.pages.data[page_id];
+    unsigned char *pixels = extrude_image(image, channels, page->padding);
+
+    priv.renderer->update_texture(page->texture_id, x, y,
+        padded_width, padded_height, pixels);
+
+    libtq_free(pixels);
+
+    struct atlas_image entry = {
+        .page_id = page_id,
+        .x = x + page->padding,
+        .y = y + page->padding,
+        .width = image->width,
+        .height = image->height,
+    };
+
+    page->image_count++;
+
+    return TQ_ATLAS_TEXTURE_BIT | atlas_image_array_add(&priv.images, &entry);
+}
+
+void tq_remove_from_atlas(int texture_id)
+{
+    struct atlas_image *image = get_image(texture_id);
+
+    if (!image) {
+        return;
+    }
+
+    int page_id = image->page_id;
+
+    atlas_image_array_remove(&priv.images, texture_id & ~TQ_ATLAS_TEXTURE_BIT);
+
+    if (--priv.pages.data[page_id].image_count == 0) {
+        atlas_page_array_remove(&priv.pages, page_id);
+    }
+}
+
+/**
+ * Get page texture and normalized texture coordinates
+ * of an atlased texture. Returns false for other textures.
+ */
+bool tq_get_atlas_region(int texture_id, int *page_texture_id, tq_rectf *uv)
+{
+    struct atlas_image *image = get_image(texture_id);
+
+    if (!image) {
+        return false;
+    }
+
+    *page_texture_id = priv.pages.data[image->page_id].texture_id;
+
+    uv->x = image->x / (float) PAGE_SIZE;
+    uv->y = image->y / (float) PAGE_SIZE;
+    uv->w = image->width / (float) PAGE_SIZE;
+    uv->h = image->height / (float) PAGE_SIZE;
+
+    return true;
+}
+
+bool tq_get_atlas_texture_size(int texture_id, int *width, int *height)
+{
+    struct atlas_image *image = get_image(texture_id);
+
+    if (!image) {
+        return false;
+    }
+
+    *width = image->width;
+    *height = image->height;
+
+    return true;
+}
@@ -0,0 +1,52 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+#ifndef TQ_ATLAS_H_INC
+#define TQ_ATLAS_H_INC
+
+//------------------------------------------------------------------------------
+
+#include "tq_graphics.h"
+
+//------------------------------------------------------------------------------
+
+/**
+ * Identifiers of atlased textures have this bit set, so they
+ * never collide with identifiers of renderer textures.
+ */
+#define TQ_ATLAS_TEXTURE_BIT        (1 << 24)
+
+//------------------------------------------------------------------------------
+
+void tq_initialize_atlas(tq_renderer_impl *renderer);
+void tq_terminate_atlas(void);
+
+void tq_set_atlas_threshold(int size);
+void tq_set_atlas_padding(int padding);
+
+int tq_add_image_to_atlas(libtq_image const *image);
+void tq_remove_from_atlas(int texture_id);
+
+bool tq_get_atlas_region(int texture_id, int *page_texture_id, tq_rectf *uv);
+bool tq_get_atlas_texture_size(int texture_id, int *width, int *height);
+
+//------------------------------------------------------------------------------
+
+#endif // TQ_ATLAS_H_INC
@@ -24,6 +24,7 @@
 #include "tq_audio.h"
 #include "tq_error.h"
 #include "tq_log.h"
+#include "tq_profiler.h"
 
 //------------------------------------------------------------------------------
 
@@ -98,7 +99,9 @@ void tq_terminate_audio(void)
 
 void tq_process_audio(void)
 {
+    TQ_PROFILE_BEGIN("tq_process_audio");
     priv.impl.process();
+    TQ_PROFILE_END();
 }
 
 void tq_set_master_volume(float volume)
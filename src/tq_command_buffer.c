@@ -0,0 +1,647 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#include <string.h>
+
+#include "tq_command_buffer.h"
+#include "tq_core.h"
+#include "tq_error.h"
+#include "tq_graphics.h"
+#include "tq_log.h"
+#include "tq_mem.h"
+
+//------------------------------------------------------------------------------
+
+#define MAX_COMMAND_BUFFERS         256
+#define INITIAL_COMMAND_COUNT       256
+#define INITIAL_DATA_SIZE           4096
+#define DATA_ALIGNMENT              8
+
+//------------------------------------------------------------------------------
+
+enum
+{
+    BUFFER_FREE,
+    BUFFER_RECORDING,
+    BUFFER_SUBMITTED,
+};
+
+/**
+ * Kinds of recorded calls.
+ */
+enum
+{
+    COMMAND_SET_DRAW_COLOR,
+    COMMAND_SET_OUTLINE_COLOR,
+    COMMAND_SET_BLEND_MODE,
+    COMMAND_PUSH_MATRIX,
+    COMMAND_POP_MATRIX,
+    COMMAND_TRANSLATE_MATRIX,
+    COMMAND_SCALE_MATRIX,
+    COMMAND_ROTATE_MATRIX,
+    COMMAND_DRAW_POINT,
+    COMMAND_DRAW_LINE,
+    COMMAND_DRAW_TRIANGLE,
+    COMMAND_DRAW_RECTANGLE,
+    COMMAND_DRAW_CIRCLE,
+    COMMAND_OUTLINE_TRIANGLE,
+    COMMAND_OUTLINE_RECTANGLE,
+    COMMAND_OUTLINE_CIRCLE,
+    COMMAND_FILL_TRIANGLE,
+    COMMAND_FILL_RECTANGLE,
+    COMMAND_FILL_CIRCLE,
+    COMMAND_DRAW_TEXTURE,
+    COMMAND_DRAW_SUBTEXTURE,
+    COMMAND_DRAW_SPRITES,
+    COMMAND_DRAW_TEXT,
+};
+
+/**
+ * Recorded call with its arguments.
+ * Arrays and strings are stored in the data of the buffer.
+ */
+struct command
+{
+    int kind;
+    int id;                         // texture or font
+    int count;                      // number of sprites
+    size_t data_offset;
+
+    union {
+        tq_color color;
+        tq_blend_mode blend_mode;
+        tq_vec2f points[3];
+        tq_rectf rects[2];
+        float circle[3];            // x, y, radius
+        float degrees;
+    } args;
+};
+
+struct command_buffer
+{
+    int status;                     // one of BUFFER_* values
+    int order;
+    unsigned int creation;          // tq_cmdbuf_begin() call number
+
+    struct command *commands;
+    int command_count;
+    int command_capacity;
+
+    unsigned char *data;
+    size_t data_size;
+    size_t data_capacity;
+};
+
+/**
+ * Private data for [command buffer] module.
+ * Buffers are allocated once and reused, their addresses never
+ * change, so the recording thread can access its buffer without
+ * locking. The mutex only guards the status of buffers.
+ */
+struct tq_command_buffer_priv
+{
+    libtq_mutex mutex;
+    unsigned int creation;
+    struct command_buffer *buffers[MAX_COMMAND_BUFFERS];
+};
+
+static struct tq_command_buffer_priv priv;
+
+//------------------------------------------------------------------------------
+
+static struct command_buffer *get_recording_buffer(tq_cmdbuf cmdbuf)
+{
+    if (cmdbuf.id < 0 || cmdbuf.id >= MAX_COMMAND_BUFFERS) {
+        return NULL;
+    }
+
+    struct command_buffer *buffer = priv.buffers[cmdbuf.id];
+
+    if (!buffer || buffer->status != BUFFER_RECORDING) {
+        return NULL;
+    }
+
+    return buffer;
+}
+
+/**
+ * Append a command to the buffer.
+ * Returns NULL if the handle is not valid.
+ */
+static struct command *add_command(tq_cmdbuf cmdbuf, int kind)
+{
+    struct command_buffer *buffer = get_recording_buffer(cmdbuf);
+
+    if (!buffer) {
+        return NULL;
+    }
+
+    if (buffer->command_count == buffer->command_capacity) {
+        int next_capacity = TQ_MAX(INITIAL_COMMAND_COUNT, 2 * buffer->command_capacity);
+        struct command *next_commands = libtq_realloc(buffer->commands,
+            next_capacity * sizeof(struct command));
+
+        if (!next_commands) {
+            libtq_out_of_memory();
+        }
+
+        buffer->commands = next_commands;
+        buffer->command_capacity = next_capacity;
+    }
+
+    struct command *command = &buffer->commands[buffer->command_count++];
+
+    memset(command, 0, sizeof(*command));
+    command->kind = kind;
+
+    return command;
+}
+
+/**
+ * Copy an array or a string to the data of the buffer.
+ * Returns its offset.
+ */
+static size_t add_data(tq_cmdbuf cmdbuf, void const *data, size_t size)
+{
+    struct command_buffer *buffer = priv.buffers[cmdbuf.id];
+
+    size_t offset = ((buffer->data_size + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT) * DATA_ALIGNMENT;
+    size_t required = offset + size;
+
+    if (buffer->data_capacity < required) {
+        size_t next_capacity = TQ_MAX(INITIAL_DATA_SIZE, buffer->data_capacity);
+
+        while (next_capacity < required) {
+            next_capacity *= 2;
+        }
+
+        unsigned char *next_data = libtq_realloc(buffer->data, next_capacity);
+
+        if (!next_data) {
+            libtq_out_of_memory();
+        }
+
+        buffer->data = next_data;
+        buffer->data_capacity = next_capacity;
+    }
+
+    memcpy(buffer->data + offset, data, size);
+    buffer->data_size = required;
+
+    return offset;
+}
+
+static void add_points(tq_cmdbuf cmdbuf, int kind, int count, tq_vec2f const *points)
+{
+    struct command *command = add_command(cmdbuf, kind);
+
+    if (command) {
+        memcpy(command->args.points, points, count * sizeof(tq_vec2f));
+    }
+}
+
+static void add_rect(tq_cmdbuf cmdbuf, int kind, tq_rectf rect)
+{
+    struct command *command = add_command(cmdbuf, kind);
+
+    if (command) {
+        command->args.rects[0] = rect;
+    }
+}
+
+static void add_circle(tq_cmdbuf cmdbuf, int kind, tq_vec2f position, float radius)
+{
+    struct command *command = add_command(cmdbuf, kind);
+
+    if (command) {
+        command->args.circle[0] = position.x;
+        command->args.circle[1] = position.y;
+        command->args.circle[2] = radius;
+    }
+}
+
+/**
+ * Execute recorded calls with the immediate drawing API.
+ */
+static void replay_buffer(struct command_buffer *buffer)
+{
+    int matrix_depth = 0;
+
+    for (int i = 0; i < buffer->command_count; i++) {
+        struct command const *command = &buffer->commands[i];
+        tq_vec2f const *points = command->args.points;
+        tq_rectf const *rects = command->args.rects;
+        tq_vec2f position = { command->args.circle[0], command->args.circle[1] };
+        float radius = command->args.circle[2];
+
+        switch (command->kind) {
+        case COMMAND_SET_DRAW_COLOR:
+            tq_set_draw_color(command->args.color);
+            break;
+        case COMMAND_SET_OUTLINE_COLOR:
+            tq_set_outline_color(command->args.color);
+            break;
+        case COMMAND_SET_BLEND_MODE:
+            tq_set_blend_mode(command->args.blend_mode);
+            break;
+        case COMMAND_PUSH_MATRIX:
+            tq_push_matrix();
+            matrix_depth++;
+            break;
+        case COMMAND_POP_MATRIX:
+            if (matrix_depth > 0) {
+                tq_pop_matrix();
+                matrix_depth--;
+            }
+            break;
+        case COMMAND_TRANSLATE_MATRIX:
+            tq_translate_matrix(points[0]);
+            break;
+        case COMMAND_SCALE_MATRIX:
+            tq_scale_matrix(points[0]);
+            break;
+        case COMMAND_ROTATE_MATRIX:
+            tq_rotate_matrix(command->args.degrees);
+            break;
+        case COMMAND_DRAW_POINT:
+            tq_draw_point(points[0]);
+            break;
+        case COMMAND_DRAW_LINE:
+            tq_draw_line(points[0], points[1]);
+            break;
+        case COMMAND_DRAW_TRIANGLE:
+            tq_draw_triangle(points[0], points[1], points[2]);
+            break;
+        case COMMAND_DRAW_RECTANGLE:
+            tq_draw_rectangle(rects[0]);
+            break;
+        case COMMAND_DRAW_CIRCLE:
+            tq_draw_circle(position, radius);
+            break;
+        case COMMAND_OUTLINE_TRIANGLE:
+            tq_outline_triangle(points[0], points[1], points[2]);
+            break;
+        case COMMAND_OUTLINE_RECTANGLE:
+            tq_outline_rectangle(rects[0]);
+            break;
+        case COMMAND_OUTLINE_CIRCLE:
+            tq_outline_circle(position, radius);
+            break;
+        case COMMAND_FILL_TRIANGLE:
+            tq_fill_triangle(points[0], points[1], points[2]);
+            break;
+        case COMMAND_FILL_RECTANGLE:
+            tq_fill_rectangle(rects[0]);
+            break;
+        case COMMAND_FILL_CIRCLE:
+            tq_fill_circle(position, radius);
+            break;
+        case COMMAND_DRAW_TEXTURE:
+            tq_draw_texture((tq_texture) { command->id }, rects[0]);
+            break;
+        case COMMAND_DRAW_SUBTEXTURE:
+            tq_draw_subtexture((tq_texture) { command->id }, rects[0], rects[1]);
+            break;
+        case COMMAND_DRAW_SPRITES:
+            tq_draw_sprites((tq_texture) { command->id },
+                (tq_sprite_instance const *) (buffer->data + command->data_offset),
+                command->count);
+            break;
+        case COMMAND_DRAW_TEXT:
+            tq_draw_text((tq_font) { command->id }, points[0],
+                (char const *) (buffer->data + command->data_offset));
+            break;
+        }
+    }
+
+    while (matrix_depth-- > 0) {
+        tq_pop_matrix();
+    }
+}
+
+static int compare_buffers(void const *a, void const *b)
+{
+    struct command_buffer const *x = priv.buffers[*(int const *) a];
+    struct command_buffer const *y = priv.buffers[*(int const *) b];
+
+    if (x->order != y->order) {
+        return (x->order < y->order) ? -1 : 1;
+    }
+
+    // Difference stays correct when the counter wraps around.
+    int delta = (int) (x->creation - y->creation);
+
+    return (delta < 0) ? -1 : (delta > 0);
+}
+
+//------------------------------------------------------------------------------
+
+void tq_initialize_command_buffers(void)
+{
+    priv.mutex = libtq_create_mutex();
+    priv.creation = 0;
+}
+
+void tq_terminate_command_buffers(void)
+{
+    for (int i = 0; i < MAX_COMMAND_BUFFERS; i++) {
+        if (priv.buffers[i]) {
+            libtq_free(priv.buffers[i]->commands);
+            libtq_free(priv.buffers[i]->data);
+            libtq_free(priv.buffers[i]);
+        }
+    }
+
+    if (priv.mutex) {
+        libtq_destroy_mutex(priv.mutex);
+    }
+
+    memset(&priv, 0, sizeof(priv));
+}
+
+/**
+ * Draw submitted buffers to the canvas. Called once per frame
+ * on the main thread. Buffers which are still being recorded
+ * are left for the next frame.
+ */
+void tq_replay_command_buffers(tq_blend_mode blend_mode)
+{
+    int ids[MAX_COMMAND_BUFFERS];
+    int count = 0;
+
+    libtq_lock_mutex(priv.mutex);
+
+    for (int i = 0; i < MAX_COMMAND_BUFFERS; i++) {
+        if (priv.buffers[i] && priv.buffers[i]->status == BUFFER_SUBMITTED) {
+            ids[count++] = i;
+        }
+    }
+
+    libtq_unlock_mutex(priv.mutex);
+
+    if (count == 0) {
+        return;
+    }
+
+    qsort(ids, count, sizeof(int), compare_buffers);
+
+    tq_color draw_color = tq_get_draw_color();
+    tq_color outline_color = tq_get_outline_color();
+
+    tq_reset_surface();
+
+    for (int i = 0; i < count; i++) {
+        // Buffers are recorded without knowing the transformation
+        // the main thread ends up with, so they start from identity.
+        bool pushed = tq_push_identity_matrix();
+
+        replay_buffer(priv.buffers[ids[i]]);
+
+        if (pushed) {
+            tq_pop_matrix();
+        }
+
+        tq_set_draw_color(draw_color);
+        tq_set_outline_color(outline_color);
+        tq_set_blend_mode(blend_mode);
+    }
+
+    libtq_lock_mutex(priv.mutex);
+
+    for (int i = 0; i < count; i++) {
+        struct command_buffer *buffer = priv.buffers[ids[i]];
+
+        buffer->status = BUFFER_FREE;
+        buffer->command_count = 0;
+        buffer->data_size = 0;
+    }
+
+    libtq_unlock_mutex(priv.mutex);
+}
+
+//------------------------------------------------------------------------------
+// API entries
+
+tq_cmdbuf tq_cmdbuf_begin(void)
+{
+    int id = -1;
+
+    libtq_lock_mutex(priv.mutex);
+
+    for (int i = 0; i < MAX_COMMAND_BUFFERS; i++) {
+        if (!priv.buffers[i]) {
+            priv.buffers[i] = libtq_calloc(1, sizeof(struct command_buffer));
+
+            if (!priv.buffers[i]) {
+                libtq_out_of_memory();
+            }
+        }
+
+        if (priv.buffers[i]->status == BUFFER_FREE) {
+            priv.buffers[i]->status = BUFFER_RECORDING;
+            priv.buffers[i]->creation = priv.creation++;
+            id = i;
+            break;
+        }
+    }
+
+    libtq_unlock_mutex(priv.mutex);
+
+    if (id == -1) {
+        libtq_log(LIBTQ_LOG_ERROR, "Too many command buffers (max %d).\n", MAX_COMMAND_BUFFERS);
+    }
+
+    return (tq_cmdbuf) { .id = id };
+}
+
+void tq_cmdbuf_submit(tq_cmdbuf cmdbuf, int order)
+{
+    struct command_buffer *buffer = get_recording_buffer(cmdbuf);
+
+    if (!buffer) {
+        return;
+    }
+
+    libtq_lock_mutex(priv.mutex);
+
+    buffer->status = BUFFER_SUBMITTED;
+    buffer->order = order;
+
+    libtq_unlock_mutex(priv.mutex);
+}
+
+void tq_cmdbuf_set_draw_color(tq_cmdbuf cmdbuf, tq_color draw_color)
+{
+    struct command *command = add_command(cmdbuf, COMMAND_SET_DRAW_COLOR);
+
+    if (command) {
+        command->args.color = draw_color;
+    }
+}
+
+void tq_cmdbuf_set_outline_color(tq_cmdbuf cmdbuf, tq_color outline_color)
+{
+    struct command *command = add_command(cmdbuf, COMMAND_SET_OUTLINE_COLOR);
+
+    if (command) {
+        command->args.color = outline_color;
+    }
+}
+
+void tq_cmdbuf_set_blend_mode(tq_cmdbuf cmdbuf, tq_blend_mode mode)
+{
+    struct command *command = add_command(cmdbuf, COMMAND_SET_BLEND_MODE);
+
+    if (command) {
+        command->args.blend_mode = mode;
+    }
+}
+
+void tq_cmdbuf_push_matrix(tq_cmdbuf cmdbuf)
+{
+    add_command(cmdbuf, COMMAND_PUSH_MATRIX);
+}
+
+void tq_cmdbuf_pop_matrix(tq_cmdbuf cmdbuf)
+{
+    add_command(cmdbuf, COMMAND_POP_MATRIX);
+}
+
+void tq_cmdbuf_translate_matrix(tq_cmdbuf cmdbuf, tq_vec2f translate)
+{
+    add_points(cmdbuf, COMMAND_TRANSLATE_MATRIX, 1, &translate);
+}
+
+void tq_cmdbuf_scale_matrix(tq_cmdbuf cmdbuf, tq_vec2f scale)
+{
+    add_points(cmdbuf, COMMAND_SCALE_MATRIX, 1, &scale);
+}
+
+void tq_cmdbuf_rotate_matrix(tq_cmdbuf cmdbuf, float degrees)
+{
+    struct command *command = add_command(cmdbuf, COMMAND_ROTATE_MATRIX);
+
+    if (command) {
+        command->args.degrees = degrees;
+    }
+}
+
+void tq_cmdbuf_draw_point(tq_cmdbuf cmdbuf, tq_vec2f position)
+{
+    add_points(cmdbuf, COMMAND_DRAW_POINT, 1, &position);
+}
+
+void tq_cmdbuf_draw_line(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b)
+{
+    add_points(cmdbuf, COMMAND_DRAW_LINE, 2, (tq_vec2f[]) { a, b });
+}
+
+void tq_cmdbuf_draw_triangle(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b, tq_vec2f c)
+{
+    add_points(cmdbuf, COMMAND_DRAW_TRIANGLE, 3, (tq_vec2f[]) { a, b, c });
+}
+
+void tq_cmdbuf_draw_rectangle(tq_cmdbuf cmdbuf, tq_rectf rect)
+{
+    add_rect(cmdbuf, COMMAND_DRAW_RECTANGLE, rect);
+}
+
+void tq_cmdbuf_draw_circle(tq_cmdbuf cmdbuf, tq_vec2f position, float radius)
+{
+    add_circle(cmdbuf, COMMAND_DRAW_CIRCLE, position, radius);
+}
+
+void tq_cmdbuf_outline_triangle(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b, tq_vec2f c)
+{
+    add_points(cmdbuf, COMMAND_OUTLINE_TRIANGLE, 3, (tq_vec2f[]) { a, b, c });
+}
+
+void tq_cmdbuf_outline_rectangle(tq_cmdbuf cmdbuf, tq_rectf rect)
+{
+    add_rect(cmdbuf, COMMAND_OUTLINE_RECTANGLE, rect);
+}
+
+void tq_cmdbuf_outline_circle(tq_cmdbuf cmdbuf, tq_vec2f position, float radius)
+{
+    add_circle(cmdbuf, COMMAND_OUTLINE_CIRCLE, position, radius);
+}
+
+void tq_cmdbuf_fill_triangle(tq_cmdbuf cmdbuf, tq_vec2f a, tq_vec2f b, tq_vec2f c)
+{
+    add_points(cmdbuf, COMMAND_FILL_TRIANGLE, 3, (tq_vec2f[]) { a, b, c });
+}
+
+void tq_cmdbuf_fill_rectangle(tq_cmdbuf cmdbuf, tq_rectf rect)
+{
+    add_rect(cmdbuf, COMMAND_FILL_RECTANGLE, rect);
+}
+
+void tq_cmdbuf_fill_circle(tq_cmdbuf cmdbuf, tq_vec2f position, float radius)
+{
+    add_circle(cmdbuf, COMMAND_FILL_CIRCLE, position, radius);
+}
+
+void tq_cmdbuf_draw_texture(tq_cmdbuf cmdbuf, tq_texture texture, tq_rectf rect)
+{
+    struct command *command = add_command(cmdbuf, COMMAND_DRAW_TEXTURE);
+
+    if (command) {
+        command->id = texture.id;
+        command->args.rects[0] = rect;
+    }
+}
+
+void tq_cmdbuf_draw_subtexture(tq_cmdbuf cmdbuf, tq_texture texture, tq_rectf sub, tq_rectf rect)
+{
+    struct command *command = add_command(cmdbuf, COMMAND_DRAW_SUBTEXTURE);
+
+    if (command) {
+        command->id = texture.id;
+        command->args.rects[0] = sub;
+        command->args.rects[1] = rect;
+    }
+}
+
+void tq_cmdbuf_draw_sprites(tq_cmdbuf cmdbuf, tq_texture texture, tq_sprite_instance const *sprites, int count)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    struct command *command = add_command(cmdbuf, COMMAND_DRAW_SPRITES);
+
+    if (command) {
+        command->id = texture.id;
+        command->count = count;
+        command->data_offset = add_data(cmdbuf, sprites, count * sizeof(tq_sprite_instance));
+    }
+}
+
+void tq_cmdbuf_draw_text(tq_cmdbuf cmdbuf, tq_font font, tq_vec2f position, char const *text)
+{
+    struct command *command = add_command(cmdbuf, COMMAND_DRAW_TEXT);
+
+    if (command) {
+        command->id = font.id;
+        command->args.points[0] = position;
+        command->data_offset = add_data(cmdbuf, text, strlen(text) + 1);
+    }
+}
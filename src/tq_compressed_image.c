@@ -0,0 +1,676 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#include <string.h>
+
+#include "tq_compressed_image.h"
+#include "tq_log.h"
+#include "tq_mem.h"
+
+//------------------------------------------------------------------------------
+
+#define DDS_HEADER_SIZE             128     // including magic number
+#define DDS_DX10_HEADER_SIZE        20
+#define KTX_HEADER_SIZE             64
+
+// Larger images are rejected, so that size computations can't overflow.
+#define MAX_IMAGE_SIZE              16384
+
+#define DDS_FOURCC_DXT1             0x31545844
+#define DDS_FOURCC_DXT5             0x35545844
+#define DDS_FOURCC_DX10             0x30315844
+
+#define DXGI_FORMAT_BC1_UNORM       71
+#define DXGI_FORMAT_BC1_UNORM_SRGB  72
+#define DXGI_FORMAT_BC3_UNORM       77
+#define DXGI_FORMAT_BC3_UNORM_SRGB  78
+
+#define KTX_RGB_S3TC_DXT1           0x83F0
+#define KTX_RGBA_S3TC_DXT1          0x83F1
+#define KTX_RGBA_S3TC_DXT5          0x83F3
+#define KTX_ETC1_RGB8               0x8D64
+#define KTX_RGB8_ETC2               0x9274
+#define KTX_RGBA8_ETC2_EAC          0x9278
+
+//------------------------------------------------------------------------------
+
+static unsigned char const dds_magic[4] = {
+    'D', 'D', 'S', ' ',
+};
+
+static unsigned char const ktx_magic[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n',
+};
+
+/**
+ * ETC1/ETC2 intensity modifiers.
+ */
+static int const etc_modifiers[8][4] = {
+    {  2,   8,  -2,   -8 },
+    {  5,  17,  -5,  -17 },
+    {  9,  29,  -9,  -29 },
+    { 13,  42, -13,  -42 },
+    { 18,  60, -18,  -60 },
+    { 24,  80, -24,  -80 },
+    { 33, 106, -33, -106 },
+    { 47, 183, -47, -183 },
+};
+
+/**
+ * ETC2 distances for T and H modes.
+ */
+static int const etc_distances[8] = {
+    3, 6, 11, 16, 23, 32, 41, 64,
+};
+
+/**
+ * EAC alpha modifiers.
+ */
+static int const eac_modifiers[16][8] = {
+    { -3, -6,  -9, -15, 2, 5, 8, 14 },
+    { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5,  -8, -13, 1, 4, 7, 12 },
+    { -2, -4,  -6, -13, 1, 3, 5, 12 },
+    { -3, -6,  -8, -12, 2, 5, 7, 11 },
+    { -3, -7,  -9, -11, 2, 6, 8, 10 },
+    { -4, -7,  -8, -11, 3, 6, 7, 10 },
+    { -3, -5,  -8, -11, 2, 4, 7, 10 },
+    { -2, -6,  -8, -10, 1, 5, 7,  9 },
+    { -2, -5,  -8, -10, 1, 4, 7,  9 },
+    { -2, -4,  -8, -10, 1, 3, 7,  9 },
+    { -2, -5,  -7, -10, 1, 4, 6,  9 },
+    { -3, -4,  -7, -10, 2, 3, 6,  9 },
+    { -1, -2,  -3, -10, 0, 1, 2,  9 },
+    { -4, -6,  -8,  -9, 3, 5, 7,  8 },
+    { -3, -5,  -7,  -9, 2, 4, 6,  8 },
+};
+
+//------------------------------------------------------------------------------
+// Utility functions
+
+static uint32_t read_u32(unsigned char const *src, bool swap)
+{
+    if (swap) {
+        return ((uint32_t) src[0] << 24) | ((uint32_t) src[1] << 16)
+            | ((uint32_t) src[2] << 8) | (uint32_t) src[3];
+    }
+
+    return ((uint32_t) src[3] << 24) | ((uint32_t) src[2] << 16)
+        | ((uint32_t) src[1] << 8) | (uint32_t) src[0];
+}
+
+static uint64_t read_u64_be(unsigned char const *src)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | src[i];
+    }
+
+    return value;
+}
+
+static int get_bits(uint64_t value, int hi, int lo)
+{
+    return (int) ((value >> lo) & ((1u << (hi - lo + 1)) - 1));
+}
+
+static int clamp_byte(int value)
+{
+    return (value < 0) ? 0 : ((value > 255) ? 255 : value);
+}
+
+static int extend_4(int value)
+{
+    return (value << 4) | value;
+}
+
+static int extend_5(int value)
+{
+    return (value << 3) | (value >> 2);
+}
+
+static int extend_6(int value)
+{
+    return (value << 2) | (value >> 4);
+}
+
+static int extend_7(int value)
+{
+    return (value << 1) | (value >> 6);
+}
+
+static void set_pixel(unsigned char *dst, int r, int g, int b, int a)
+{
+    dst[0] = (unsigned char) clamp_byte(r);
+    dst[1] = (unsigned char) clamp_byte(g);
+    dst[2] = (unsigned char) clamp_byte(b);
+    dst[3] = (unsigned char) clamp_byte(a);
+}
+
+static int get_block_size(int format)
+{
+    switch (format) {
+    case LIBTQ_BC1_RGB:
+    case LIBTQ_BC1_RGBA:
+    case LIBTQ_ETC2_RGB:
+        return 8;
+    }
+
+    return 16;
+}
+
+//------------------------------------------------------------------------------
+// Container parsers
+
+static libtq_compressed_image *create_compressed_image(int width, int height,
+    int format, unsigned char const *data, size_t available)
+{
+    if (width <= 0 || height <= 0 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE) {
+        libtq_log(LIBTQ_ERROR, "Compressed image has invalid size: %dx%d\n", width, height);
+        return NULL;
+    }
+
+    size_t size = libtq_get_compressed_size(width, height, format);
+
+    if (size > available) {
+        libtq_log(LIBTQ_ERROR, "Compressed image is truncated.\n");
+        return NULL;
+    }
+
+    libtq_compressed_image *image = libtq_malloc(sizeof(libtq_compressed_image) + size);
+
+    if (!image) {
+        return NULL;
+    }
+
+    image->width = width;
+    image->height = height;
+    image->format = format;
+    image->size = size;
+    memcpy(image->data, data, size);
+
+    return image;
+}
+
+static libtq_compressed_image *load_dds(unsigned char const *buffer, size_t size)
+{
+    if (size < DDS_HEADER_SIZE) {
+        return NULL;
+    }
+
+    int height = (int) read_u32(buffer + 12, false);
+    int width = (int) read_u32(buffer + 16, false);
+    uint32_t fourcc = read_u32(buffer + 84, false);
+    size_t offset = DDS_HEADER_SIZE;
+    int format;
+
+    // Direct3D treats DXT1 as having 1-bit alpha.
+    if (fourcc == DDS_FOURCC_DXT1) {
+        format = LIBTQ_BC1_RGBA;
+    } else if (fourcc == DDS_FOURCC_DXT5) {
+        format = LIBTQ_BC3;
+    } else if (fourcc == DDS_FOURCC_DX10 && size >= DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE) {
+        uint32_t dxgi_format = read_u32(buffer + DDS_HEADER_SIZE, false);
+
+        if (dxgi_format == DXGI_FORMAT_BC1_UNORM || dxgi_format == DXGI_FORMAT_BC1_UNORM_SRGB) {
+            format = LIBTQ_BC1_RGBA;
+        } else if (dxgi_format == DXGI_FORMAT_BC3_UNORM || dxgi_format == DXGI_FORMAT_BC3_UNORM_SRGB) {
+            format = LIBTQ_BC3;
+        } else {
+            libtq_log(LIBTQ_ERROR, "Unsupported DXGI format in DDS file: %u\n", dxgi_format);
+            return NULL;
+        }
+
+        offset += DDS_DX10_HEADER_SIZE;
+    } else {
+        libtq_log(LIBTQ_ERROR, "Unsupported DDS pixel format: 0x%08x\n", fourcc);
+        return NULL;
+    }
+
+    return create_compressed_image(width, height, format, buffer + offset, size - offset);
+}
+
+static libtq_compressed_image *load_ktx(unsigned char const *buffer, size_t size)
+{
+    if (size < KTX_HEADER_SIZE + 4) {
+        return NULL;
+    }
+
+    // Endianness field is 0x04030201 if written in the native order.
+    bool swap = (read_u32(buffer + 12, false) != 0x04030201);
+
+    uint32_t gl_type = read_u32(buffer + 16, swap);
+    uint32_t gl_internal_format = read_u32(buffer + 28, swap);
+    int width = (int) read_u32(buffer + 36, swap);
+    int height = (int) read_u32(buffer + 40, swap);
+    uint32_t depth = read_u32(buffer + 44, swap);
+    uint32_t faces = read_u32(buffer + 52, swap);
+    size_t key_value_size = read_u32(buffer + 60, swap);
+    int format;
+
+    if (gl_type != 0 || depth > 1 || faces > 1) {
+        libtq_log(LIBTQ_ERROR, "Only 2D compressed KTX textures are supported.\n");
+        return NULL;
+    }
+
+    switch (gl_internal_format) {
+    case KTX_RGB_S3TC_DXT1:
+        format = LIBTQ_BC1_RGB;
+        break;
+    case KTX_RGBA_S3TC_DXT1:
+        format = LIBTQ_BC1_RGBA;
+        break;
+    case KTX_RGBA_S3TC_DXT5:
+        format = LIBTQ_BC3;
+        break;
+    case KTX_ETC1_RGB8:
+    case KTX_RGB8_ETC2:
+        format = LIBTQ_ETC2_RGB;
+        break;
+    case KTX_RGBA8_ETC2_EAC:
+        format = LIBTQ_ETC2_RGBA;
+        break;
+    default:
+        libtq_log(LIBTQ_ERROR, "Unsupported KTX internal format: 0x%04x\n", gl_internal_format);
+        return NULL;
+    }
+
+    size_t offset = KTX_HEADER_SIZE + key_value_size;
+
+    if (offset + 4 > size) {
+        return NULL;
+    }
+
+    size_t image_size = read_u32(buffer + offset, swap);
+    offset += 4;
+
+    if (image_size > size - offset) {
+        return NULL;
+    }
+
+    return create_compressed_image(width, height, format, buffer + offset, image_size);
+}
+
+//------------------------------------------------------------------------------
+// Block decoders
+// Each decoder writes 4x4 RGBA pixels, row by row.
+
+/**
+ * BC1 color block. BC3 blocks always use four colors.
+ * In three-color mode the fourth color is black, which is
+ * transparent only if the format has alpha.
+ */
+static void decode_bc1_block(unsigned char *dst, unsigned char const *src,
+    bool four_colors, bool has_alpha)
+{
+    int c0 = src[0] | (src[1] << 8);
+    int c1 = src[2] | (src[3] << 8);
+    uint32_t indices = read_u32(src + 4, false);
+
+    int colors[4][4];
+
+    colors[0][0] = extend_5((c0 >> 11) & 31);
+    colors[0][1] = extend_6((c0 >> 5) & 63);
+    colors[0][2] = extend_5(c0 & 31);
+    colors[0][3] = 255;
+
+    colors[1][0] = extend_5((c1 >> 11) & 31);
+    colors[1][1] = extend_6((c1 >> 5) & 63);
+    colors[1][2] = extend_5(c1 & 31);
+    colors[1][3] = 255;
+
+    for (int i = 0; i < 3; i++) {
+        if (four_colors || c0 > c1) {
+            colors[2][i] = (2 * colors[0][i] + colors[1][i]) / 3;
+            colors[3][i] = (colors[0][i] + 2 * colors[1][i]) / 3;
+        } else {
+            colors[2][i] = (colors[0][i] + colors[1][i]) / 2;
+            colors[3][i] = 0;
+        }
+    }
+
+    colors[2][3] = 255;
+    colors[3][3] = (four_colors || c0 > c1 || !has_alpha) ? 255 : 0;
+
+    for (int p = 0; p < 16; p++) {
+        int const *color = colors[(indices >> (2 * p)) & 3];
+        set_pixel(dst + 4 * p, color[0], color[1], color[2], color[3]);
+    }
+}
+
+static void decode_bc3_block(unsigned char *dst, unsigned char const *src)
+{
+    int alphas[8];
+
+    alphas[0] = src[0];
+    alphas[1] = src[1];
+
+    if (alphas[0] > alphas[1]) {
+        for (int i = 2; i < 8; i++) {
+            alphas[i] = ((8 - i) * alphas[0] + (i - 1) * alphas[1]) / 7;
+        }
+    } else {
+        for (int i = 2; i < 6; i++) {
+            alphas[i] = ((6 - i) * alphas[0] + (i - 1) * alphas[1]) / 5;
+        }
+
+        alphas[6] = 0;
+        alphas[7] = 255;
+    }
+
+    uint64_t indices = 0;
+
+    for (int i = 7; i >= 2; i--) {
+        indices = (indices << 8) | src[i];
+    }
+
+    decode_bc1_block(dst, src + 8, true, false);
+
+    for (int p = 0; p < 16; p++) {
+        dst[4 * p + 3] = (unsigned char) alphas[(indices >> (3 * p)) & 7];
+    }
+}
+
+/**
+ * ETC2 color block: ETC1 individual and differential modes,
+ * plus T, H and planar modes.
+ * Pixels are indexed column by column.
+ */
+static void decode_etc2_block(unsigned char *dst, unsigned char const *src)
+{
+    uint64_t block = read_u64_be(src);
+
+    int base[2][3];
+    int tables[2];
+    int paint[4][3];
+    bool paint_mode = false;
+
+    if (get_bits(block, 33, 33) == 0) {
+        for (int i = 0; i < 3; i++) {
+            base[0][i] = extend_4(get_bits(block, 63 - 8 * i, 60 - 8 * i));
+            base[1][i] = extend_4(get_bits(block, 59 - 8 * i, 56 - 8 * i));
+        }
+    } else {
+        int color[3];
+        int delta[3];
+
+        for (int i = 0; i < 3; i++) {
+            color[i] = get_bits(block, 63 - 8 * i, 59 - 8 * i);
+            delta[i] = get_bits(block, 58 - 8 * i, 56 - 8 * i);
+            delta[i] = (delta[i] >= 4) ? (delta[i] - 8) : delta[i];
+        }
+
+        int r = color[0] + delta[0];
+        int g = color[1] + delta[1];
+        int b = color[2] + delta[2];
+
+        if (r < 0 || r > 31) {
+            // T mode.
+            int c1[3] = {
+                extend_4((get_bits(block, 60, 59) << 2) | get_bits(block, 57, 56)),
+                extend_4(get_bits(block, 55, 52)),
+                extend_4(get_bits(block, 51, 48)),
+            };
+
+            int c2[3] = {
+                extend_4(get_bits(block, 47, 44)),
+                extend_4(get_bits(block, 43, 40)),
+                extend_4(get_bits(block, 39, 36)),
+            };
+
+            int d = etc_distances[(get_bits(block, 35, 34) << 1) | get_bits(block, 32, 32)];
+
+            for (int i = 0; i < 3; i++) {
+                paint[0][i] = c1[i];
+                paint[1][i] = c2[i] + d;
+                paint[2][i] = c2[i];
+                paint[3][i] = c2[i] - d;
+            }
+
+            paint_mode = true;
+        } else if (g < 0 || g > 31) {
+            // H mode.
+            int c1[3] = {
+                extend_4(get_bits(block, 62, 59)),
+                extend_4((get_bits(block, 58, 56) << 1) | get_bits(block, 52, 52)),
+                extend_4((get_bits(block, 51, 51) << 3) | get_bits(block, 49, 47)),
+            };
+
+            int c2[3] = {
+                extend_4(get_bits(block, 46, 43)),
+                extend_4(get_bits(block, 42, 39)),
+                extend_4(get_bits(block, 38, 35)),
+            };
+
+            int v1 = (c1[0] << 16) | (c1[1] << 8) | c1[2];
+            int v2 = (c2[0] << 16) | (c2[1] << 8) | c2[2];
+
+            int d = etc_distances[(get_bits(block, 34, 34) << 2)
+                | (get_bits(block, 32, 32) << 1) | (v1 >= v2)];
+
+            for (int i = 0; i < 3; i++) {
+                paint[0][i] = c1[i] + d;
+                paint[1][i] = c1[i] - d;
+                paint[2][i] = c2[i] + d;
+                paint[3][i] = c2[i] - d;
+            }
+
+            paint_mode = true;
+        } else if (b < 0 || b > 31) {
+            // Planar mode.
+            int o[3] = {
+                extend_6(get_bits(block, 62, 57)),
+                extend_7((get_bits(block, 56, 56) << 6) | get_bits(block, 54, 49)),
+                extend_6((get_bits(block, 48, 48) << 5) | (get_bits(block, 44, 43) << 3)
+                    | get_bits(block, 41, 39)),
+            };
+
+            int h[3] = {
+                extend_6((get_bits(block, 38, 34) << 1) | get_bits(block, 32, 32)),
+                extend_7(get_bits(block, 31, 25)),
+                extend_6(get_bits(block, 24, 19)),
+            };
+
+            int v[3] = {
+                extend_6(get_bits(block, 18, 13)),
+                extend_7(get_bits(block, 12, 6)),
+                extend_6(get_bits(block, 5, 0)),
+            };
+
+            for (int y = 0; y < 4; y++) {
+                for (int x = 0; x < 4; x++) {
+                    int c[3];
+
+                    for (int i = 0; i < 3; i++) {
+                        c[i] = (x * (h[i] - o[i]) + y * (v[i] - o[i]) + 4 * o[i] + 2) >> 2;
+                    }
+
+                    set_pixel(dst + 4 * (y * 4 + x), c[0], c[1], c[2], 255);
+                }
+            }
+
+            return;
+        } else {
+            for (int i = 0; i < 3; i++) {
+                base[0][i] = extend_5(color[i]);
+                base[1][i] = extend_5(color[i] + delta[i]);
+            }
+        }
+    }
+
+    tables[0] = get_bits(block, 39, 37);
+    tables[1] = get_bits(block, 36, 34);
+
+    bool flip = get_bits(block, 32, 32);
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int p = x * 4 + y;
+            int index = (get_bits(block, 16 + p, 16 + p) << 1) | get_bits(block, p, p);
+            unsigned char *pixel = dst + 4 * (y * 4 + x);
+
+            if (paint_mode) {
+                set_pixel(pixel, paint[index][0], paint[index][1], paint[index][2], 255);
+                continue;
+            }
+
+            int subblock = flip ? (y >= 2) : (x >= 2);
+            int modifier = etc_modifiers[tables[subblock]][index];
+
+            set_pixel(pixel,
+                base[subblock][0] + modifier,
+                base[subblock][1] + modifier,
+                base[subblock][2] + modifier,
+                255);
+        }
+    }
+}
+
+static void decode_etc2_rgba_block(unsigned char *dst, unsigned char const *src)
+{
+    uint64_t block = read_u64_be(src);
+
+    int base = get_bits(block, 63, 56);
+    int multiplier = get_bits(block, 55, 52);
+    int const *modifiers = eac_modifiers[get_bits(block, 51, 48)];
+
+    decode_etc2_block(dst, src + 8);
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int p = x * 4 + y;
+            int index = get_bits(block, 47 - 3 * p, 45 - 3 * p);
+
+            dst[4 * (y * 4 + x) + 3] = (unsigned char)
+                clamp_byte(base + modifiers[index] * multiplier);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+bool libtq_is_compressed_image(libtq_stream *stream)
+{
+    if (!stream) {
+        return false;
+    }
+
+    size_t size = libtq_stream_size(stream);
+    unsigned char const *buffer = libtq_stream_buffer(stream);
+
+    if (!buffer) {
+        return false;
+    }
+
+    return (size >= sizeof(dds_magic) && memcmp(buffer, dds_magic, sizeof(dds_magic)) == 0)
+        || (size >= sizeof(ktx_magic) && memcmp(buffer, ktx_magic, sizeof(ktx_magic)) == 0);
+}
+
+libtq_compressed_image *libtq_load_compressed_image(libtq_stream *stream)
+{
+    if (!libtq_is_compressed_image(stream)) {
+        return NULL;
+    }
+
+    size_t size = libtq_stream_size(stream);
+    unsigned char const *buffer = libtq_stream_buffer(stream);
+
+    libtq_compressed_image *image;
+
+    if (memcmp(buffer, dds_magic, sizeof(dds_magic)) == 0) {
+        image = load_dds(buffer, size);
+    } else {
+        image = load_ktx(buffer, size);
+    }
+
+    if (!image) {
+        libtq_log(LIBTQ_ERROR, "Failed to load compressed image from stream %s.\n",
+            libtq_stream_repr(stream));
+        return NULL;
+    }
+
+    libtq_log(LIBTQ_INFO, "Loaded %dx%d compressed image from stream %s.\n",
+        image->width, image->height, libtq_stream_repr(stream));
+
+    return image;
+}
+
+libtq_image *libtq_decompress_image(libtq_compressed_image const *image)
+{
+    libtq_image *result = libtq_create_image(image->width, image->height, LIBTQ_RGBA);
+
+    if (!result) {
+        return NULL;
+    }
+
+    int block_size = get_block_size(image->format);
+    int blocks_x = (image->width + 3) / 4;
+    int blocks_y = (image->height + 3) / 4;
+
+    unsigned char const *src = image->data;
+    unsigned char pixels[16 * 4];
+
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            switch (image->format) {
+            case LIBTQ_BC1_RGB:
+                decode_bc1_block(pixels, src, false, false);
+                break;
+            case LIBTQ_BC1_RGBA:
+                decode_bc1_block(pixels, src, false, true);
+                break;
+            case LIBTQ_BC3:
+                decode_bc3_block(pixels, src);
+                break;
+            case LIBTQ_ETC2_RGB:
+                decode_etc2_block(pixels, src);
+                break;
+            case LIBTQ_ETC2_RGBA:
+                decode_etc2_rgba_block(pixels, src);
+                break;
+            }
+
+            src += block_size;
+
+            // Blocks on the right and bottom edges may be cut.
+            int width = TQ_MIN(4, image->width - bx * 4);
+            int height = TQ_MIN(4, image->height - by * 4);
+
+            for (int y = 0; y < height; y++) {
+                unsigned char *dst = result->pixels
+                    + ((by * 4 + y) * image->width + bx * 4) * 4;
+
+                memcpy(dst, pixels + y * 16, width * 4);
+            }
+        }
+    }
+
+    return result;
+}
+
+size_t libtq_get_compressed_size(int width, int height, int format)
+{
+    size_t blocks_x = ((size_t) width + 3) / 4;
+    size_t blocks_y = ((size_t) height + 3) / 4;
+
+    return blocks_x * blocks_y * get_block_size(format);
+}
@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#ifndef TQ_COMPRESSED_IMAGE_H_INC
+#define TQ_COMPRESSED_IMAGE_H_INC
+
+//------------------------------------------------------------------------------
+
+#include "tq_image_loader.h"
+
+//------------------------------------------------------------------------------
+
+/**
+ * Block-compressed formats. Every format uses 4x4 pixel blocks.
+ * Values are stored in trace files, so new ones go to the end.
+ */
+enum
+{
+    LIBTQ_BC1_RGBA,             // a.k.a. DXT1, with 1-bit alpha
+    LIBTQ_BC3,                  // a.k.a. DXT5
+    LIBTQ_ETC2_RGB,             // also used for ETC1 data
+    LIBTQ_ETC2_RGBA,            // ETC2 color with EAC alpha
+    LIBTQ_BC1_RGB,              // DXT1 without alpha: no transparent pixels
+    LIBTQ_COMPRESSED_FORMAT_COUNT,
+};
+
+typedef struct libtq_compressed_image
+{
+    int width;
+    int height;
+    int format;
+    size_t size;
+    unsigned char data[];
+} libtq_compressed_image;
+
+/**
+ * Check if the stream contains a DDS or KTX file.
+ * Reading position is not changed.
+ */
+bool libtq_is_compressed_image(libtq_stream *stream);
+
+/**
+ * Load the first mipmap level of a DDS or KTX file.
+ */
+libtq_compressed_image *libtq_load_compressed_image(libtq_stream *stream);
+
+/**
+ * Decode compressed image to RGBA pixels.
+ * Used if the GPU doesn't support the format.
+ */
+libtq_image *libtq_decompress_image(libtq_compressed_image const *image);
+
+/**
+ * Get size in bytes of compressed data.
+ */
+size_t libtq_get_compressed_size(int width, int height, int format);
+
+//------------------------------------------------------------------------------
+
+#endif // TQ_COMPRESSED_IMAGE_H_INC
@@ -18,12 +18,14 @@
 // 3. This notice may not be removed or altered from any source distribution.
 //------------------------------------------------------------------------------
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "tq_core.h"
 #include "tq_graphics.h"
 #include "tq_log.h"
 #include "tq_math.h"
+#include "tq_profiler.h"
 
 //------------------------------------------------------------------------------
 // Declarations
@@ -40,6 +42,7 @@ typedef struct tq_core
 
     char                title[256];
     int                 key_autorepeat; /* -1: false, 0: undefined, 1: true */
+    bool                headless;
 
     double              prev_time;
     double              current_time;
@@ -90,6 +93,13 @@ static bool get_key_state(tq_key key)
     return (core.key_state[index] & mask);
 }
 
+static bool is_headless_requested(void)
+{
+    char const *value = getenv("TQ_HEADLESS");
+
+    return core.headless || (value && value[0] && strcmp(value, "0") != 0);
+}
+
 //------------------------------------------------------------------------------
 
 void tq_initialize_core(void)
@@ -119,6 +129,8 @@ void tq_initialize_core(void)
     core.clock.initialize();
     core.threads.initialize();
 
+    libtq_initialize_profiler();
+
     libtq_log(0, "tq library version " TQ_VERSION "\n");
 
     if (!core.display_width || !core.display_height) {
@@ -135,6 +147,20 @@ void tq_initialize_core(void)
         core.key_autorepeat = 1;
     }
 
+    // The software renderer doesn't need a GL context,
+    // so it can run headless in any build.
+    if (is_headless_requested()) {
+        if (tq_get_renderer_type() == TQ_RENDERER_SOFTWARE) {
+            libtq_construct_headless_display(&core.display);
+        } else {
+        #if defined(TQ_LINUX) && defined(TQ_USE_EGL)
+            libtq_construct_egl_display(&core.display);
+        #else
+            libtq_log(LIBTQ_LOG_WARNING, "Headless mode isn't supported by this build.\n");
+        #endif
+        }
+    }
+
     core.display.initialize();
 
     core.current_time = core.clock.get_time_highp();
@@ -148,6 +174,9 @@ void tq_initialize_core(void)
 void tq_terminate_core(void)
 {
     core.display.terminate();
+
+    libtq_terminate_profiler();
+
     core.threads.terminate();
     core.clock.terminate();
 
@@ -156,7 +185,12 @@ void tq_terminate_core(void)
 
 bool tq_process_core(void)
 {
+    TQ_PROFILE_BEGIN("tq_process_core");
+
+    // Includes waiting for vertical sync.
+    TQ_PROFILE_BEGIN("present");
     core.display.present();
+    TQ_PROFILE_END();
 
     core.prev_time = core.current_time;
     core.current_time = core.clock.get_time_highp();
@@ -170,7 +204,11 @@ bool tq_process_core(void)
 
     core.framerate_counter++;
 
-    return core.display.process_events();
+    bool running = core.display.process_events();
+
+    TQ_PROFILE_END();
+
+    return running;
 }
 
 //------------------------------------------------------------------------------
@@ -220,6 +258,19 @@ void tq_set_title(char const *title)
     }
 }
 
+/**
+ * API entry: tq_set_headless()
+ */
+void tq_set_headless(bool headless)
+{
+    if (core.display.initialize) {
+        libtq_log(LIBTQ_LOG_WARNING, "tq_set_headless() should be called before tq_initialize().\n");
+        return;
+    }
+
+    core.headless = headless;
+}
+
 //------------------------------------------------------------------------------
 
 /**
@@ -500,6 +551,31 @@ void libtq_unlock_mutex(libtq_mutex mutex)
     core.threads.unlock_mutex(mutex);
 }
 
+libtq_cond libtq_create_cond(void)
+{
+    return core.threads.create_cond();
+}
+
+void libtq_destroy_cond(libtq_cond cond)
+{
+    core.threads.destroy_cond(cond);
+}
+
+void libtq_wait_cond(libtq_cond cond, libtq_mutex mutex)
+{
+    core.threads.wait_cond(cond, mutex);
+}
+
+void libtq_signal_cond(libtq_cond cond)
+{
+    core.threads.signal_cond(cond);
+}
+
+void libtq_broadcast_cond(libtq_cond cond)
+{
+    core.threads.broadcast_cond(cond);
+}
+
 void *libtq_get_gl_proc_addr(char const *name)
 {
     return core.display.get_gl_proc_addr(name);
@@ -47,6 +47,7 @@ struct libtq_clock_impl
 
 typedef void *libtq_thread;
 typedef void *libtq_mutex;
+typedef void *libtq_cond;
 
 struct libtq_threads_impl
 {
@@ -63,6 +64,12 @@ struct libtq_threads_impl
     void            (*destroy_mutex)(libtq_mutex mutex);
     void            (*lock_mutex)(libtq_mutex mutex);
     void            (*unlock_mutex)(libtq_mutex mutex);
+
+    libtq_cond      (*create_cond)(void);
+    void            (*destroy_cond)(libtq_cond cond);
+    void            (*wait_cond)(libtq_cond cond, libtq_mutex mutex);
+    void            (*signal_cond)(libtq_cond cond);
+    void            (*broadcast_cond)(libtq_cond cond);
 };
 
 #if defined(TQ_WIN32)
@@ -102,6 +109,12 @@ struct libtq_display_impl
     void libtq_construct_android_display(struct libtq_display_impl *display);
 #endif
 
+#if defined(TQ_LINUX) && defined(TQ_USE_EGL)
+    void libtq_construct_egl_display(struct libtq_display_impl *display);
+#endif
+
+void libtq_construct_headless_display(struct libtq_display_impl *display);
+
 //------------------------------------------------------------------------------
 
 void            tq_initialize_core(void);
@@ -136,6 +149,12 @@ void            libtq_destroy_mutex(libtq_mutex mutex);
 void            libtq_lock_mutex(libtq_mutex mutex);
 void            libtq_unlock_mutex(libtq_mutex mutex);
 
+libtq_cond      libtq_create_cond(void);
+void            libtq_destroy_cond(libtq_cond cond);
+void            libtq_wait_cond(libtq_cond cond, libtq_mutex mutex);
+void            libtq_signal_cond(libtq_cond cond);
+void            libtq_broadcast_cond(libtq_cond cond);
+
 void            *libtq_get_gl_proc_addr(char const *name);
 bool            libtq_check_gl_ext(char const *name);
 
@@ -0,0 +1,229 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(TQ_WIN32)
+#   include <direct.h>
+#   include <process.h>
+#else
+#   include <sys/stat.h>
+#   include <sys/types.h>
+#   include <unistd.h>
+#endif
+
+#include "tq_disk_cache.h"
+#include "tq_error.h"
+#include "tq_log.h"
+#include "tq_mem.h"
+
+//------------------------------------------------------------------------------
+
+#define MAX_PATH_LENGTH             1024
+#define CACHE_DIRECTORY_NAME        "libtq"
+
+#define FNV_PRIME                   1099511628211ull
+
+//------------------------------------------------------------------------------
+
+static int make_directory(char const *path)
+{
+#if defined(TQ_WIN32)
+    return _mkdir(path);
+#else
+    return mkdir(path, 0755);
+#endif
+}
+
+static int get_process_id(void)
+{
+#if defined(TQ_WIN32)
+    return _getpid();
+#else
+    return (int) getpid();
+#endif
+}
+
+/**
+ * Get path to the cache directory of the library, creating it if needed.
+ * It's %LOCALAPPDATA%\libtq on Windows and $XDG_CACHE_HOME/libtq
+ * (or ~/.cache/libtq) elsewhere.
+ * Returns false if the cache is not available.
+ */
+static bool get_cache_directory(char *path, size_t size)
+{
+#if defined(TQ_ANDROID) || defined(TQ_EMSCRIPTEN)
+    return false;
+#else
+#   if defined(TQ_WIN32)
+    char const *base = getenv("LOCALAPPDATA");
+    int length = base ? snprintf(path, size, "%s", base) : -1;
+#   else
+    char const *base = getenv("XDG_CACHE_HOME");
+    int length;
+
+    if (base && base[0]) {
+        length = snprintf(path, size, "%s", base);
+    } else {
+        base = getenv("HOME");
+        length = base ? snprintf(path, size, "%s/.cache", base) : -1;
+
+        if (length > 0 && (size_t) length < size) {
+            make_directory(path);
+        }
+    }
+#   endif
+
+    if (length <= 0 || (size_t) length >= size) {
+        return false;
+    }
+
+    length = snprintf(path + length, size - length, "/%s", CACHE_DIRECTORY_NAME);
+
+    if (length <= 0 || (size_t) length >= size) {
+        return false;
+    }
+
+    // Fails if the directory exists, which is fine.
+    make_directory(path);
+
+    return true;
+#endif
+}
+
+static bool get_cache_file_path(char *path, size_t size, char const *name)
+{
+    if (!get_cache_directory(path, size)) {
+        return false;
+    }
+
+    size_t length = strlen(path);
+    int count = snprintf(path + length, size - length, "/%s", name);
+
+    return (count > 0) && ((size_t) count < (size - length));
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * FNV-1a hash. Pass LIBTQ_HASH_INIT as initial value.
+ */
+uint64_t libtq_hash_string(uint64_t hash, char const *str)
+{
+    while (*str) {
+        hash ^= (unsigned char) *str++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * Read the whole file from the cache directory.
+ * Returns NULL if the file doesn't exist; the caller should free the data.
+ */
+void *libtq_read_cache_file(char const *name, size_t *size)
+{
+    char path[MAX_PATH_LENGTH];
+
+    if (!get_cache_file_path(path, sizeof(path), name)) {
+        return NULL;
+    }
+
+    FILE *handle = fopen(path, "rb");
+
+    if (!handle) {
+        return NULL;
+    }
+
+    void *data = NULL;
+    long length = -1;
+
+    if (fseek(handle, 0, SEEK_END) == 0) {
+        length = ftell(handle);
+    }
+
+    if (length > 0 && fseek(handle, 0, SEEK_SET) == 0) {
+        data = libtq_malloc(length);
+
+        if (!data) {
+            libtq_out_of_memory();
+        }
+
+        if (fread(data, 1, length, handle) != (size_t) length) {
+            libtq_free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(handle);
+
+    if (data) {
+        *size = length;
+    }
+
+    return data;
+}
+
+/**
+ * Write data to a file in the cache directory.
+ * The file is written under a temporary name and then renamed,
+ * so other processes never see it half-written. Temporary name
+ * includes process id, so processes writing the same entry at the
+ * same time don't clobber each other's files.
+ */
+bool libtq_write_cache_file(char const *name, void const *data, size_t size)
+{
+    char path[MAX_PATH_LENGTH];
+    char temp_path[MAX_PATH_LENGTH + 32];
+
+    if (!get_cache_file_path(path, sizeof(path), name)) {
+        return false;
+    }
+
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, get_process_id());
+
+    FILE *handle = fopen(temp_path, "wb");
+
+    if (!handle) {
+        libtq_log(LIBTQ_LOG_WARNING, "Failed to write cache file %s.\n", path);
+        return false;
+    }
+
+    bool written = (fwrite(data, 1, size, handle) == size);
+
+    if (fclose(handle) != 0) {
+        written = false;
+    }
+
+#if defined(TQ_WIN32)
+    remove(path);
+#endif
+
+    if (!written || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        libtq_log(LIBTQ_LOG_WARNING, "Failed to write cache file %s.\n", path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,44 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+#ifndef TQ_DISK_CACHE_H_INC
+#define TQ_DISK_CACHE_H_INC
+
+//------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tq/tq.h"
+
+//------------------------------------------------------------------------------
+
+#define LIBTQ_HASH_INIT             14695981039346656037ull
+
+//------------------------------------------------------------------------------
+
+uint64_t libtq_hash_string(uint64_t hash, char const *str);
+
+void *libtq_read_cache_file(char const *name, size_t *size);
+bool libtq_write_cache_file(char const *name, void const *data, size_t size);
+
+//------------------------------------------------------------------------------
+
+#endif // TQ_DISK_CACHE_H_INC
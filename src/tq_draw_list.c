@@ -0,0 +1,806 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "tq_draw_list.h"
+#include "tq_error.h"
+#include "tq_math.h"
+#include "tq_mem.h"
+
+//------------------------------------------------------------------------------
+
+#define INITIAL_COMMAND_COUNT       256
+#define INITIAL_DATA_SIZE           4096
+#define INITIAL_MATRIX_COUNT        16
+#define INITIAL_BATCH_COUNT         64
+
+// How many commands back a command may be moved.
+#define MAX_COMMAND_LOOKBACK        256
+
+//------------------------------------------------------------------------------
+
+/**
+ * Kinds of recorded draw calls.
+ */
+enum
+{
+    COMMAND_SOLID,
+    COMMAND_COLORED,
+    COMMAND_TEXTURED,
+    COMMAND_QUADS,
+    COMMAND_FONT,
+    COMMAND_SPRITES,
+};
+
+/**
+ * Recorded draw call.
+ */
+struct command
+{
+    uint64_t key;                   // sort key: layer and batch
+    int kind;                       // one of COMMAND_* values
+    int mode;                       // primitive type (if applicable)
+    int primitive;                  // TQ_PRIMITIVE_* class, -1 for quads
+    int count;                      // number of vertices, quads or sprites
+    int data_offset;                // offset in the data array (in floats)
+    int texture_id;                 // bound texture
+    int matrix_id;                  // model-view matrix (-1 if identity)
+    bool has_color;                 // true if draw color was set
+    tq_color color;                 // draw color
+    tq_blend_mode blend_mode;       // blend mode
+    int batch_id;                   // batch the command is drawn in
+    float bounds[4];                // x0, y0, x1, y1
+};
+
+/**
+ * Group of commands which share renderer state, so the backend
+ * can draw them at once. Batches are drawn in order of creation.
+ */
+struct batch
+{
+    int layer;
+    int first_command;              // command which started the batch
+    int kind;
+    int primitive;                  // TQ_PRIMITIVE_* class, -1 for quads
+    int texture_id;
+    tq_blend_mode blend_mode;
+};
+
+/**
+ * Private data for [draw list] module.
+ */
+struct tq_draw_list_priv
+{
+    bool recording;                 // true between begin/end
+    tq_renderer_impl backend;       // the actual renderer
+
+    int layer;                      // current layer
+    int texture_id;                 // current texture
+    int matrix_id;                  // current model-view matrix
+    bool has_color;
+    tq_color color;                 // current draw color
+    tq_blend_mode blend_mode;       // current blend mode
+
+    struct command *commands;       // dynamic array of commands
+    int command_count;
+    int command_capacity;
+
+    uint32_t *order;                // sorted command indices
+    uint32_t *order_temp;           // scratch buffer for radix sort
+    int order_capacity;
+
+    float *data;                    // vertex data of all commands
+    int data_size;
+    int data_capacity;
+
+    float *matrices;                // model-view matrices (3x3)
+    int matrix_count;
+    int matrix_capacity;
+
+    struct batch *batches;          // batches in order of creation
+    int batch_count;
+    int batch_capacity;
+};
+
+static struct tq_draw_list_priv priv;
+
+//------------------------------------------------------------------------------
+
+static bool compare_color(tq_color a, tq_color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static bool compare_blend_mode(tq_blend_mode const *a, tq_blend_mode const *b)
+{
+    return (a->color_src_factor == b->color_src_factor)
+        && (a->color_dst_factor == b->color_dst_factor)
+        && (a->alpha_src_factor == b->alpha_src_factor)
+        && (a->alpha_dst_factor == b->alpha_dst_factor)
+        && (a->color_equation == b->color_equation)
+        && (a->alpha_equation == b->alpha_equation);
+}
+
+/**
+ * Grow dynamic array so it can hold at least `required` elements.
+ */
+static void *grow_array(void *array, int *capacity, int required, size_t element_size, int initial)
+{
+    if (*capacity >= required) {
+        return array;
+    }
+
+    int next_capacity = TQ_MAX(*capacity, initial);
+
+    while (next_capacity < required) {
+        next_capacity *= 2;
+    }
+
+    void *next_array = libtq_realloc(array, next_capacity * element_size);
+
+    if (!next_array) {
+        libtq_out_of_memory();
+    }
+
+    *capacity = next_capacity;
+    return next_array;
+}
+
+/**
+ * Build sort key of a command. Layer is the most significant
+ * part, then the batch. Radix sort is stable, so commands within
+ * a batch keep their order.
+ */
+static uint64_t make_key(int batch_id)
+{
+    return ((uint64_t) (priv.layer + 32768) << 48) | (uint32_t) batch_id;
+}
+
+/**
+ * Backends draw fans as triangles and loops as strips,
+ * so such primitives can be batched together.
+ */
+static int get_primitive_class(int kind, int mode)
+{
+    if (kind != COMMAND_SOLID && kind != COMMAND_COLORED && kind != COMMAND_TEXTURED) {
+        return -1;
+    }
+
+    switch (mode) {
+    case TQ_PRIMITIVE_TRIANGLES:
+    case TQ_PRIMITIVE_TRIANGLE_FAN:
+        return TQ_PRIMITIVE_TRIANGLES;
+    case TQ_PRIMITIVE_LINE_STRIP:
+    case TQ_PRIMITIVE_LINE_LOOP:
+        return TQ_PRIMITIVE_LINE_STRIP;
+    }
+
+    return TQ_PRIMITIVE_POINTS;
+}
+
+static void expand_bounds(float *bounds, float x, float y)
+{
+    bounds[0] = TQ_MIN(bounds[0], x);
+    bounds[1] = TQ_MIN(bounds[1], y);
+    bounds[2] = TQ_MAX(bounds[2], x);
+    bounds[3] = TQ_MAX(bounds[3], y);
+}
+
+static void add_sprite_bounds(float *bounds, tq_sprite_instance const *sprite, int matrix_id)
+{
+    float c = fabsf(cosf(TQ_DEG2RAD(sprite->rotation)));
+    float s = fabsf(sinf(TQ_DEG2RAD(sprite->rotation)));
+
+    float hw = 0.5f * sprite->dst.w;
+    float hh = 0.5f * sprite->dst.h;
+    float cx = sprite->dst.x + hw;
+    float cy = sprite->dst.y + hh;
+
+    // Half size of the box around the rotated sprite.
+    float ex = c * fabsf(hw) + s * fabsf(hh);
+    float ey = s * fabsf(hw) + c * fabsf(hh);
+
+    for (int corner = 0; corner < 4; corner++) {
+        float x = cx + ((corner & 1) ? ex : -ex);
+        float y = cy + ((corner & 2) ? ey : -ey);
+
+        if (matrix_id != -1) {
+            float const *m = &priv.matrices[9 * matrix_id];
+            float tx = m[0] * x + m[1] * y + m[2];
+            float ty = m[3] * x + m[4] * y + m[5];
+
+            x = tx;
+            y = ty;
+        }
+
+        expand_bounds(bounds, x, y);
+    }
+}
+
+/**
+ * Get bounding box of a command in the coordinates of the current
+ * projection. Points and lines are one pixel wide whatever the
+ * projection is, so they are treated as covering everything.
+ */
+static void get_command_bounds(struct command const *command, float *bounds)
+{
+    float const *data = priv.data + command->data_offset;
+    int stride = 0;
+    int count = command->count;
+
+    if (command->primitive != TQ_PRIMITIVE_TRIANGLES && command->primitive != -1) {
+        bounds[0] = bounds[1] = -FLT_MAX;
+        bounds[2] = bounds[3] = FLT_MAX;
+        return;
+    }
+
+    bounds[0] = bounds[1] = FLT_MAX;
+    bounds[2] = bounds[3] = -FLT_MAX;
+
+    switch (command->kind) {
+    case COMMAND_SOLID:
+        stride = 2;
+        break;
+    case COMMAND_COLORED:
+        stride = 6;
+        break;
+    case COMMAND_TEXTURED:
+        stride = 4;
+        break;
+    case COMMAND_QUADS:
+    case COMMAND_FONT:
+        stride = 4;
+        count = 4 * command->count;
+        break;
+    case COMMAND_SPRITES:
+        for (int i = 0; i < count; i++) {
+            add_sprite_bounds(bounds, (tq_sprite_instance const *) data + i, command->matrix_id);
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        expand_bounds(bounds, data[stride * i + 0], data[stride * i + 1]);
+    }
+}
+
+/**
+ * Edges may touch: rasterization rules don't let two primitives
+ * cover the same pixel through a shared edge.
+ */
+static bool is_overlapping(float const *a, float const *b)
+{
+    return !(a[2] <= b[0] || b[2] <= a[0] || a[3] <= b[1] || b[3] <= a[1]);
+}
+
+static bool is_same_batch(struct batch const *batch, struct command const *command)
+{
+    bool textured = (command->kind != COMMAND_SOLID) && (command->kind != COMMAND_COLORED);
+
+    return batch->kind == command->kind
+        && batch->primitive == command->primitive
+        && (!textured || batch->texture_id == command->texture_id)
+        && compare_blend_mode(&batch->blend_mode, &command->blend_mode);
+}
+
+/**
+ * Find a batch the command can join, or start a new one.
+ * Joining a batch moves the command in front of every batch
+ * created after it. That's fine if none of the commands in those
+ * batches overlap this one: their pixels don't depend on each
+ * other, so the result is the same whatever the blend mode is.
+ */
+static int assign_batch(int command_id)
+{
+    struct command const *command = &priv.commands[command_id];
+    int first = TQ_MAX(0, command_id - MAX_COMMAND_LOOKBACK);
+    int max_overlapping_batch = -1;
+
+    for (int i = command_id - 1; i >= first; i--) {
+        struct command const *other = &priv.commands[i];
+        struct batch const *batch = &priv.batches[other->batch_id];
+
+        if (batch->layer != priv.layer) {
+            continue;
+        }
+
+        if (is_overlapping(other->bounds, command->bounds)) {
+            max_overlapping_batch = TQ_MAX(max_overlapping_batch, other->batch_id);
+        }
+
+        if (batch->first_command != i) {
+            continue;
+        }
+
+        // Batches are created in order, so earlier ones are
+        // blocked by the overlapping command as well.
+        if (other->batch_id < max_overlapping_batch) {
+            break;
+        }
+
+        if (is_same_batch(batch, command)) {
+            return other->batch_id;
+        }
+    }
+
+    priv.batches = grow_array(priv.batches, &priv.batch_capacity,
+        priv.batch_count + 1, sizeof(struct batch), INITIAL_BATCH_COUNT);
+
+    struct batch *batch = &priv.batches[priv.batch_count];
+
+    batch->layer = priv.layer;
+    batch->first_command = command_id;
+    batch->kind = command->kind;
+    batch->primitive = command->primitive;
+    batch->texture_id = command->texture_id;
+    batch->blend_mode = command->blend_mode;
+
+    return priv.batch_count++;
+}
+
+/**
+ * Stable LSD radix sort of command indices by their keys.
+ * Bytes which are the same in all keys are skipped.
+ */
+static void sort_commands(void)
+{
+    int count = priv.command_count;
+
+    priv.order = grow_array(priv.order, &priv.order_capacity,
+        count, sizeof(uint32_t), INITIAL_COMMAND_COUNT);
+    priv.order_temp = libtq_realloc(priv.order_temp, priv.order_capacity * sizeof(uint32_t));
+
+    if (!priv.order_temp) {
+        libtq_out_of_memory();
+    }
+
+    for (int i = 0; i < count; i++) {
+        priv.order[i] = i;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        int offsets[256] = {0};
+
+        for (int i = 0; i < count; i++) {
+            offsets[(priv.commands[i].key >> shift) & 0xff]++;
+        }
+
+        if (offsets[(priv.commands[0].key >> shift) & 0xff] == count) {
+            continue;
+        }
+
+        int total = 0;
+
+        for (int d = 0; d < 256; d++) {
+            int n = offsets[d];
+            offsets[d] = total;
+            total += n;
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint32_t index = priv.order[i];
+            int digit = (priv.commands[index].key >> shift) & 0xff;
+            priv.order_temp[offsets[digit]++] = index;
+        }
+
+        uint32_t *swap = priv.order;
+        priv.order = priv.order_temp;
+        priv.order_temp = swap;
+    }
+}
+
+static void apply_matrix(int matrix_id, int *applied_matrix_id)
+{
+    if (matrix_id == *applied_matrix_id) {
+        return;
+    }
+
+    if (matrix_id == -1) {
+        float identity[9];
+        mat3_identity(identity);
+
+        priv.backend.update_model_view(identity);
+    } else {
+        priv.backend.update_model_view(&priv.matrices[9 * matrix_id]);
+    }
+
+    *applied_matrix_id = matrix_id;
+}
+
+/**
+ * Sort recorded commands and send them to the renderer.
+ * Called at the end of the list and whenever something happens that
+ * can't be reordered (surface change, clear, texture update, etc.)
+ */
+static void flush_commands(void)
+{
+    if (priv.command_count == 0) {
+        return;
+    }
+
+    sort_commands();
+
+    int applied_matrix_id = -1;
+    bool has_applied_color = false;
+    bool has_applied_blend_mode = false;
+    tq_color applied_color = {0};
+    tq_blend_mode applied_blend_mode = {0};
+
+    for (int i = 0; i < priv.command_count; i++) {
+        struct command *command = &priv.commands[priv.order[i]];
+        float const *data = priv.data + command->data_offset;
+
+        if (!has_applied_blend_mode || !compare_blend_mode(&applied_blend_mode, &command->blend_mode)) {
+            priv.backend.set_blend_mode(command->blend_mode);
+            applied_blend_mode = command->blend_mode;
+            has_applied_blend_mode = true;
+        }
+
+        if (command->kind == COMMAND_SOLID || command->kind == COMMAND_FONT) {
+            if (command->has_color && (!has_applied_color || !compare_color(applied_color, command->color))) {
+                priv.backend.set_draw_color(command->color);
+                applied_color = command->color;
+                has_applied_color = true;
+            }
+        }
+
+        if (command->kind != COMMAND_SOLID && command->kind != COMMAND_COLORED) {
+            priv.backend.bind_texture(command->texture_id);
+        }
+
+        apply_matrix(command->matrix_id, &applied_matrix_id);
+
+        switch (command->kind) {
+        case COMMAND_SOLID:
+            priv.backend.draw_solid(command->mode, data, command->count);
+            break;
+        case COMMAND_COLORED:
+            priv.backend.draw_colored(command->mode, data, command->count);
+            break;
+        case COMMAND_TEXTURED:
+            priv.backend.draw_textured(command->mode, data, command->count);
+            break;
+        case COMMAND_QUADS:
+            priv.backend.draw_quads(data, command->count);
+            break;
+        case COMMAND_FONT:
+            priv.backend.draw_font(data, command->count);
+            break;
+        case COMMAND_SPRITES:
+            priv.backend.draw_sprites_instanced((tq_sprite_instance const *) data, command->count);
+            break;
+        }
+    }
+
+    // Leave the renderer in the state the caller expects.
+
+    priv.backend.set_blend_mode(priv.blend_mode);
+
+    if (priv.has_color) {
+        priv.backend.set_draw_color(priv.color);
+    }
+
+    priv.backend.bind_texture(priv.texture_id);
+
+    if (priv.matrix_id == -1) {
+        apply_matrix(-1, &applied_matrix_id);
+    } else {
+        priv.backend.update_model_view(&priv.matrices[9 * priv.matrix_id]);
+        memcpy(priv.matrices, &priv.matrices[9 * priv.matrix_id], 9 * sizeof(float));
+        priv.matrix_id = 0;
+    }
+
+    priv.command_count = 0;
+    priv.data_size = 0;
+    priv.matrix_count = (priv.matrix_id == -1) ? 0 : 1;
+    priv.batch_count = 0;
+}
+
+/**
+ * Record a draw call, copying its data.
+ */
+static void add_command(int kind, int mode, void const *data, int count, int floats_per_item)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    priv.commands = grow_array(priv.commands, &priv.command_capacity,
+        priv.command_count + 1, sizeof(struct command), INITIAL_COMMAND_COUNT);
+
+    int size = floats_per_item * count;
+
+    priv.data = grow_array(priv.data, &priv.data_capacity,
+        priv.data_size + size, sizeof(float), INITIAL_DATA_SIZE);
+
+    struct command *command = &priv.commands[priv.command_count++];
+
+    command->kind = kind;
+    command->mode = mode;
+    command->primitive = get_primitive_class(kind, mode);
+    command->count = count;
+    command->data_offset = priv.data_size;
+    command->texture_id = priv.texture_id;
+    command->matrix_id = (kind == COMMAND_SPRITES) ? priv.matrix_id : -1;
+    command->has_color = priv.has_color;
+    command->color = priv.color;
+    command->blend_mode = priv.blend_mode;
+
+    memcpy(priv.data + priv.data_size, data, size * sizeof(float));
+    priv.data_size += size;
+
+    get_command_bounds(command, command->bounds);
+
+    command->batch_id = assign_batch(priv.command_count - 1);
+    command->key = make_key(command->batch_id);
+}
+
+//------------------------------------------------------------------------------
+// Recording renderer: state changes are tracked, draw calls are recorded,
+// everything that can't be reordered flushes the list first.
+
+static void update_projection(float const *mat4)
+{
+    flush_commands();
+    priv.backend.update_projection(mat4);
+}
+
+static void update_model_view(float const *mat3)
+{
+    // CPU transform is forced during recording, so this only
+    // happens around instanced sprites.
+    if (mat3[0] == 1.0f && mat3[1] == 0.0f && mat3[2] == 0.0f
+            && mat3[3] == 0.0f && mat3[4] == 1.0f && mat3[5] == 0.0f) {
+        priv.matrix_id = -1;
+        return;
+    }
+
+    priv.matrices = grow_array(priv.matrices, &priv.matrix_capacity,
+        9 * (priv.matrix_count + 1), sizeof(float), 9 * INITIAL_MATRIX_COUNT);
+
+    memcpy(&priv.matrices[9 * priv.matrix_count], mat3, 9 * sizeof(float));
+    priv.matrix_id = priv.matrix_count++;
+}
+
+static void delete_texture(int texture_id)
+{
+    flush_commands();
+    priv.backend.delete_texture(texture_id);
+}
+
+static void set_texture_smooth(int texture_id, bool smooth)
+{
+    flush_commands();
+    priv.backend.set_texture_smooth(texture_id, smooth);
+}
+
+static void set_texture_mipmapped(int texture_id, bool mipmapped)
+{
+    flush_commands();
+    priv.backend.set_texture_mipmapped(texture_id, mipmapped);
+}
+
+static void update_texture(int texture_id, int x_offset, int y_offset, int width, int height, unsigned char *pixels)
+{
+    flush_commands();
+    priv.backend.update_texture(texture_id, x_offset, y_offset, width, height, pixels);
+}
+
+static unsigned char *map_texture(int texture_id, int x_offset, int y_offset, int width, int height)
+{
+    flush_commands();
+    return priv.backend.map_texture(texture_id, x_offset, y_offset, width, height);
+}
+
+static void unmap_texture(void)
+{
+    priv.backend.unmap_texture();
+}
+
+static void resize_texture(int texture_id, int width, int height, int channels)
+{
+    flush_commands();
+    priv.backend.resize_texture(texture_id, width, height, channels);
+}
+
+static void upload_compressed_texture(int texture_id, int width, int height,
+    int format, void const *data, size_t size)
+{
+    flush_commands();
+    priv.backend.upload_compressed_texture(texture_id, width, height, format, data, size);
+}
+
+static void bind_texture(int texture_id)
+{
+    priv.texture_id = texture_id;
+}
+
+static int create_surface(int width, int height)
+{
+    flush_commands();
+    return priv.backend.create_surface(width, height);
+}
+
+static void delete_surface(int surface_id)
+{
+    flush_commands();
+    priv.backend.delete_surface(surface_id);
+}
+
+static void bind_surface(int surface_id)
+{
+    flush_commands();
+    priv.backend.bind_surface(surface_id);
+}
+
+static void set_draw_color(tq_color color)
+{
+    priv.color = color;
+    priv.has_color = true;
+}
+
+static void set_blend_mode(tq_blend_mode mode)
+{
+    priv.blend_mode = mode;
+}
+
+static void clear(void)
+{
+    flush_commands();
+    priv.backend.clear();
+}
+
+static void draw_solid(int mode, float const *data, int num_vertices)
+{
+    add_command(COMMAND_SOLID, mode, data, num_vertices, 2);
+}
+
+static void draw_colored(int mode, float const *data, int num_vertices)
+{
+    add_command(COMMAND_COLORED, mode, data, num_vertices, 6);
+}
+
+static void draw_textured(int mode, float const *data, int num_vertices)
+{
+    add_command(COMMAND_TEXTURED, mode, data, num_vertices, 4);
+}
+
+static void draw_quads(float const *data, int num_quads)
+{
+    add_command(COMMAND_QUADS, 0, data, num_quads, 16);
+}
+
+static void draw_font(float const *data, int num_quads)
+{
+    add_command(COMMAND_FONT, 0, data, num_quads, 16);
+}
+
+static void draw_sprites_instanced(tq_sprite_instance const *sprites, int count)
+{
+    add_command(COMMAND_SPRITES, 0, sprites, count, sizeof(tq_sprite_instance) / sizeof(float));
+}
+
+static void draw_canvas(float x0, float y0, float x1, float y1)
+{
+    flush_commands();
+    priv.backend.draw_canvas(x0, y0, x1, y1);
+}
+
+static void read_pixels(int surface_id, unsigned char *pixels)
+{
+    flush_commands();
+    priv.backend.read_pixels(surface_id, pixels);
+}
+
+//------------------------------------------------------------------------------
+
+void tq_terminate_draw_list(void)
+{
+    libtq_free(priv.commands);
+    libtq_free(priv.order);
+    libtq_free(priv.order_temp);
+    libtq_free(priv.data);
+    libtq_free(priv.matrices);
+    libtq_free(priv.batches);
+
+    memset(&priv, 0, sizeof(priv));
+}
+
+bool tq_is_draw_list_recording(void)
+{
+    return priv.recording;
+}
+
+/**
+ * Replace renderer functions with recording ones.
+ * Blend mode which is currently set should be passed since
+ * the renderer can't be asked for it.
+ */
+void tq_begin_draw_list_recording(tq_renderer_impl *renderer, tq_blend_mode blend_mode)
+{
+    if (priv.recording) {
+        return;
+    }
+
+    priv.recording = true;
+    priv.backend = *renderer;
+
+    priv.layer = 0;
+    priv.texture_id = -1;
+    priv.matrix_id = -1;
+    priv.has_color = false;
+    priv.blend_mode = blend_mode;
+
+    priv.command_count = 0;
+    priv.data_size = 0;
+    priv.matrix_count = 0;
+    priv.batch_count = 0;
+
+    renderer->update_projection = update_projection;
+    renderer->update_model_view = update_model_view;
+    renderer->delete_texture = delete_texture;
+    renderer->set_texture_smooth = set_texture_smooth;
+    renderer->set_texture_mipmapped = set_texture_mipmapped;
+    renderer->update_texture = update_texture;
+    renderer->map_texture = map_texture;
+    renderer->unmap_texture = unmap_texture;
+    renderer->resize_texture = resize_texture;
+    renderer->upload_compressed_texture = upload_compressed_texture;
+    renderer->bind_texture = bind_texture;
+    renderer->create_surface = create_surface;
+    renderer->delete_surface = delete_surface;
+    renderer->bind_surface = bind_surface;
+    renderer->set_draw_color = set_draw_color;
+    renderer->set_blend_mode = set_blend_mode;
+    renderer->clear = clear;
+    renderer->draw_solid = draw_solid;
+    renderer->draw_colored = draw_colored;
+    renderer->draw_textured = draw_textured;
+    renderer->draw_quads = draw_quads;
+    renderer->draw_font = draw_font;
+    renderer->draw_sprites_instanced = draw_sprites_instanced;
+    renderer->draw_canvas = draw_canvas;
+    renderer->read_pixels = read_pixels;
+}
+
+/**
+ * Submit recorded commands and restore original renderer.
+ */
+void tq_end_draw_list_recording(tq_renderer_impl *renderer)
+{
+    if (!priv.recording) {
+        return;
+    }
+
+    flush_commands();
+
+    *renderer = priv.backend;
+    priv.recording = false;
+}
+
+void tq_set_draw_list_layer(int layer)
+{
+    priv.layer = TQ_MAX(-32768, TQ_MIN(layer, 32767));
+}
+
+//------------------------------------------------------------------------------
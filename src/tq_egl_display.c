@@ -0,0 +1,345 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// tq library: headless EGL display implementation
+//------------------------------------------------------------------------------
+
+#if defined(TQ_LINUX) && defined(TQ_USE_EGL)
+
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "tq_core.h"
+#include "tq_error.h"
+#include "tq_graphics.h"
+#include "tq_log.h"
+
+//------------------------------------------------------------------------------
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#define GL_EXTENSIONS 0x1F03
+#define GL_NUM_EXTENSIONS 0x821D
+
+//------------------------------------------------------------------------------
+// Declarations
+
+/**
+ * There is no window: the context renders into a pbuffer which
+ * has the size of the display, so the default framebuffer still
+ * works for renderers.
+ */
+struct egl_display_priv
+{
+    EGLDisplay      display;
+    EGLConfig       config;
+    EGLContext      context;
+    EGLSurface      surface;
+};
+
+//------------------------------------------------------------------------------
+// Definitions
+
+static struct egl_display_priv egl;
+
+//------------------------------------------------------------------------------
+// Utility functions
+
+static bool has_extension(char const *list, char const *name)
+{
+    size_t length = strlen(name);
+
+    while (list && *list) {
+        if (strncmp(list, name, length) == 0 && (list[length] == ' ' || list[length] == '\0')) {
+            return true;
+        }
+
+        list = strchr(list, ' ');
+
+        if (list) {
+            list++;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Prefer Mesa's surfaceless platform: it needs neither X11 nor
+ * Wayland, and llvmpipe works with it on machines without a GPU.
+ */
+static EGLDisplay get_display(void)
+{
+    char const *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (has_extension(extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display
+            = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+        if (get_platform_display) {
+            EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                EGL_DEFAULT_DISPLAY, NULL);
+
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static EGLConfig choose_config(EGLint renderable_type)
+{
+    EGLint attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, renderable_type,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE,
+    };
+
+    EGLConfig configs[64];
+    EGLint count = 0;
+
+    if (!eglChooseConfig(egl.display, attribs, configs, 64, &count) || count < 1) {
+        libtq_error("Failed to find suitable EGL config: 0x%04x\n", eglGetError());
+    }
+
+    // Configs are sorted by color depth, so skip deeper ones.
+    for (EGLint n = 0; n < count; n++) {
+        EGLint red_size;
+        eglGetConfigAttrib(egl.display, configs[n], EGL_RED_SIZE, &red_size);
+
+        if (red_size == 8) {
+            return configs[n];
+        }
+    }
+
+    return configs[0];
+}
+
+static EGLSurface create_surface(int width, int height)
+{
+    EGLint attribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE,
+    };
+
+    EGLSurface surface = eglCreatePbufferSurface(egl.display, egl.config, attribs);
+
+    if (surface == EGL_NO_SURFACE) {
+        libtq_error("Failed to create EGL pbuffer: 0x%04x\n", eglGetError());
+    }
+
+    return surface;
+}
+
+//------------------------------------------------------------------------------
+
+static void initialize(void)
+{
+    egl.display = get_display();
+
+    EGLint major, minor;
+
+    if (egl.display == EGL_NO_DISPLAY || !eglInitialize(egl.display, &major, &minor)) {
+        libtq_error("Failed to initialize EGL: 0x%04x\n", eglGetError());
+    }
+
+    libtq_log(0, "EGL version: %d.%d (%s)\n", major, minor,
+        eglQueryString(egl.display, EGL_VENDOR));
+
+#if defined(TQ_USE_GLES2)
+    eglBindAPI(EGL_OPENGL_ES_API);
+    egl.config = choose_config(EGL_OPENGL_ES2_BIT);
+    int gl_versions[] = { 300, 200 };
+#else
+    eglBindAPI(EGL_OPENGL_API);
+    egl.config = choose_config(EGL_OPENGL_BIT);
+    int gl_versions[] = { 460, 450, 440, 430, 420, 410, 400, 330 };
+#endif
+
+    for (size_t n = 0; n < sizeof(gl_versions) / sizeof(gl_versions[0]); n++) {
+        EGLint attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, gl_versions[n] / 100,
+            EGL_CONTEXT_MINOR_VERSION, (gl_versions[n] % 100) / 10,
+#if !defined(TQ_USE_GLES2)
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#endif
+            EGL_NONE,
+        };
+
+        egl.context = eglCreateContext(egl.display, egl.config, EGL_NO_CONTEXT, attribs);
+
+        if (egl.context != EGL_NO_CONTEXT) {
+            libtq_log(0, "Created OpenGL context, version %d.%d\n",
+                attribs[1], attribs[3]);
+            break;
+        }
+    }
+
+    if (egl.context == EGL_NO_CONTEXT) {
+        libtq_error("Failed to create OpenGL context: 0x%04x\n", eglGetError());
+    }
+
+    tq_vec2i display_size = tq_get_display_size();
+    egl.surface = create_surface(display_size.x, display_size.y);
+
+    if (!eglMakeCurrent(egl.display, egl.surface, egl.surface, egl.context)) {
+        libtq_error("Failed to activate OpenGL context: 0x%04x\n", eglGetError());
+    }
+
+    tq_on_rc_create(1);
+
+    libtq_log(0, "Headless EGL display initialized.\n");
+}
+
+static void terminate(void)
+{
+    tq_on_rc_destroy();
+
+    eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(egl.display, egl.surface);
+    eglDestroyContext(egl.display, egl.context);
+    eglTerminate(egl.display);
+
+    egl.surface = EGL_NO_SURFACE;
+
+    libtq_log(0, "Headless EGL display terminated.\n");
+}
+
+/**
+ * Nothing is shown, so there is nothing to wait for: frames are
+ * not throttled by vsync.
+ */
+static void present(void)
+{
+}
+
+static bool process_events(void)
+{
+    return true;
+}
+
+/**
+ * Pbuffers can't be resized, so a new one is created.
+ */
+static void set_size(uint32_t width, uint32_t height)
+{
+    if (egl.surface == EGL_NO_SURFACE) {
+        return;
+    }
+
+    EGLSurface surface = create_surface(width, height);
+
+    eglMakeCurrent(egl.display, surface, surface, egl.context);
+    eglDestroySurface(egl.display, egl.surface);
+
+    egl.surface = surface;
+}
+
+static void set_title(char const *title)
+{
+}
+
+static void set_key_autorepeat_enabled(bool enabled)
+{
+}
+
+static void set_mouse_cursor_hidden(bool hidden)
+{
+}
+
+static void show_message_box(char const *title, char const *message)
+{
+    fprintf(stderr, "%s: %s\n", title, message);
+}
+
+static void *get_gl_proc_addr(char const *name)
+{
+    return (void *) eglGetProcAddress(name);
+}
+
+static bool check_gl_ext(char const *name)
+{
+#if defined(TQ_USE_GLES2)
+    typedef unsigned char const *(*get_string_proc)(unsigned int);
+
+    get_string_proc get_string = (get_string_proc) eglGetProcAddress("glGetString");
+
+    return get_string && has_extension((char const *) get_string(GL_EXTENSIONS), name);
+#else
+    typedef unsigned char const *(*get_stringi_proc)(unsigned int, unsigned int);
+    typedef void (*get_integerv_proc)(unsigned int, int *);
+
+    // Core profile doesn't allow querying extensions as a single string.
+    get_stringi_proc get_stringi = (get_stringi_proc) eglGetProcAddress("glGetStringi");
+    get_integerv_proc get_integerv = (get_integerv_proc) eglGetProcAddress("glGetIntegerv");
+
+    if (!get_stringi || !get_integerv) {
+        return false;
+    }
+
+    int count = 0;
+    get_integerv(GL_NUM_EXTENSIONS, &count);
+
+    for (int n = 0; n < count; n++) {
+        if (strcmp((char const *) get_stringi(GL_EXTENSIONS, n), name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+void libtq_construct_egl_display(struct libtq_display_impl *display)
+{
+    display->initialize                 = initialize;
+    display->terminate                  = terminate;
+    display->present                    = present;
+    display->process_events             = process_events;
+    display->set_size                   = set_size;
+    display->set_title                  = set_title;
+    display->set_key_autorepeat_enabled = set_key_autorepeat_enabled;
+    display->set_mouse_cursor_hidden    = set_mouse_cursor_hidden;
+    display->show_message_box           = show_message_box;
+    display->get_gl_proc_addr           = get_gl_proc_addr;
+    display->check_gl_ext               = check_gl_ext;
+}
+
+//------------------------------------------------------------------------------
+
+#endif // defined(TQ_LINUX) && defined(TQ_USE_EGL)
@@ -22,11 +22,15 @@
 
 //------------------------------------------------------------------------------
 
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <GL/glew.h>
 
+#include "tq_compressed_image.h"
 #include "tq_core.h"
+#include "tq_disk_cache.h"
 #include "tq_error.h"
 #include "tq_graphics.h"
 #include "tq_handle_list.h"
@@ -102,27 +106,6 @@ static char const *vs_src_standard =
     "    gl_Position = u_projection * u_modelView * position;\n"
     "}\n";
 
-/**
- * Backbuffer vertex shader source code.
- */
-static char const *vs_src_backbuf =
-    "attribute vec2 a_position;\n"
-    "attribute vec2 a_texCoord;\n"
-    "varying vec2 v_texCoord;\n"
-    "void main() {\n"
-    "    v_texCoord = a_texCoord;\n"
-    "    gl_Position = vec4(a_position, 0.0, 1.0);\n"
-    "}\n";
-
-/**
- * Solid mesh fragment shader source code.
- */
-static char const *fs_src_solid =
-    "uniform vec4 u_color;\n"
-    "void main() {\n"
-    "    gl_FragColor = u_color;\n"
-    "}\n";
-
 /**
  * Colored mesh fragment shader source code.
  */
@@ -136,28 +119,73 @@ static char const *fs_src_colored =
  * Textured mesh fragment shader source code.
  */
 static char const *fs_src_textured =
+    "varying vec4 v_color;\n"
     "varying vec2 v_texCoord;\n"
     "uniform sampler2D u_texture;\n"
     "void main() {\n"
-    "    gl_FragColor = texture2D(u_texture, v_texCoord);\n"
+    "    gl_FragColor = texture2D(u_texture, v_texCoord) * v_color;\n"
     "}\n";
 
 /**
  * Font mesh fragment shader source code.
  */
 static char const *fs_src_font =
+    "varying vec4 v_color;\n"
     "varying vec2 v_texCoord;\n"
     "uniform sampler2D u_texture;\n"
-    "uniform vec4 u_color;\n"
     "void main() {\n"
     "    vec4 texColor = texture2D(u_texture, v_texCoord);\n"
     "    float alpha = texColor.r;\n"
-    "    gl_FragColor = vec4(1.0, 1.0, 1.0, alpha) * u_color;\n"
+    "    gl_FragColor = vec4(1.0, 1.0, 1.0, alpha) * v_color;\n"
+    "}\n";
+
+/**
+ * Instanced sprite vertex shader source code.
+ * Each instance is a quad, its corner is derived from the vertex index.
+ */
+static char const *vs_src_sprite =
+    "#version 330 core\n"
+    "in vec4 a_rect;\n"
+    "in vec4 a_uvRect;\n"
+    "in float a_rotation;\n"
+    "in vec4 a_tint;\n"
+    "out vec4 v_color;\n"
+    "out vec2 v_texCoord;\n"
+    "uniform mat4 u_projection;\n"
+    "uniform mat4 u_modelView;\n"
+    "void main() {\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    vec2 offset = (corner - 0.5) * a_rect.zw;\n"
+    "    float c = cos(radians(a_rotation));\n"
+    "    float s = sin(radians(a_rotation));\n"
+    "    vec2 center = a_rect.xy + 0.5 * a_rect.zw;\n"
+    "    vec2 position = center + vec2(c * offset.x - s * offset.y, s * offset.x + c * offset.y);\n"
+    "    v_texCoord = a_uvRect.xy + corner * a_uvRect.zw;\n"
+    "    v_color = a_tint;\n"
+    "    gl_Position = u_projection * u_modelView * vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+/**
+ * Instanced sprite fragment shader source code.
+ */
+static char const *fs_src_sprite =
+    "#version 330 core\n"
+    "in vec4 v_color;\n"
+    "in vec2 v_texCoord;\n"
+    "out vec4 o_color;\n"
+    "uniform sampler2D u_texture;\n"
+    "void main() {\n"
+    "    o_color = texture(u_texture, v_texCoord) * v_color;\n"
     "}\n";
 
 //------------------------------------------------------------------------------
 
-#define DEFAULT_VBO_SIZE            256
+#define DEFAULT_RING_SECTION_SIZE   (48 * 8192)     // divisible by the vertex size
+#define NUM_RING_SECTIONS           3
+#define DEFAULT_BATCH_SIZE          1024
+#define MAX_BATCH_QUADS             16384           // limited by 16-bit indices
+#define NUM_TIMER_FRAMES            4
+#define MAX_TEXTURE_UNITS           4
 
 /**
  * Vertex attributes.
@@ -167,10 +195,14 @@ enum
     ATTRIB_POSITION,
     ATTRIB_COLOR,
     ATTRIB_TEXCOORD,
+    ATTRIB_RECT,                // per-instance attributes of sprites
+    ATTRIB_UV_RECT,
+    ATTRIB_ROTATION,
+    ATTRIB_TINT,
 };
 
 /**
- * Vertex formats.
+ * Layouts of vertex data passed to the renderer.
  */
 enum
 {
@@ -180,16 +212,20 @@ enum
     NUM_VERTEX_FORMATS,
 };
 
+/**
+ * Number of floats per vertex for each vertex format.
+ */
+static int const vertex_sizes[NUM_VERTEX_FORMATS] = { 2, 6, 4 };
+
 /**
  * Shader programs.
  */
 enum
 {
-    PROGRAM_SOLID,
     PROGRAM_COLORED,
     PROGRAM_TEXTURED,
     PROGRAM_FONT,
-    PROGRAM_BACKBUF,
+    PROGRAM_SPRITE,
     PROGRAM_COUNT,
 };
 
@@ -200,7 +236,6 @@ enum
 {
     UNIFORM_PROJECTION,
     UNIFORM_MODELVIEW,
-    UNIFORM_COLOR,
     UNIFORM_COUNT,
 };
 
@@ -209,7 +244,19 @@ enum
 struct gl_colors
 {
     GLfloat clear[4];
-    GLfloat draw[4];
+    GLubyte draw[4];
+};
+
+/**
+ * Vertex layout of all batched primitives, 16 bytes.
+ * Whatever the input format is, vertices are packed to this one,
+ * so a single vertex array serves every program.
+ */
+struct gl_vertex
+{
+    GLfloat x, y;
+    GLushort s, t;              // normalized texture coordinates
+    GLubyte color[4];           // normalized RGBA
 };
 
 struct gl_matrices
@@ -226,6 +273,10 @@ struct gl_texture
     GLenum format;
     int channels;
     bool smooth;
+    bool mipmapped;
+    bool dirty_mipmaps;
+    int surface_id;             // surface that renders to this texture, or -1
+    bool compressed;            // storage can't be updated with pixels
 };
 
 struct gl_surface
@@ -238,6 +289,7 @@ struct gl_surface
     GLuint ms_color_attachment;
 
     int samples;
+    bool needs_resolve;         // multisampled buffer has newer contents
 };
 
 struct gl_program
@@ -247,6 +299,27 @@ struct gl_program
     int dirty_uniform_bits;
 };
 
+/**
+ * Shadow copy of OpenGL bindings and state. Everything goes
+ * through it, so redundant calls never reach the driver.
+ */
+struct gl_cache
+{
+    GLuint draw_framebuffer;
+    GLuint read_framebuffer;
+    GLuint renderbuffer;
+    GLint viewport[4];
+    GLuint program;
+    GLuint vertex_array;
+    GLuint array_buffer;
+    GLuint pixel_unpack_buffer;
+    GLenum active_texture;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    bool blend;
+    GLenum blend_func[4];
+    GLenum blend_equation[2];
+};
+
 struct gl_state
 {
     int program_id;
@@ -255,20 +328,102 @@ struct gl_state
     tq_blend_mode blend_mode;
 };
 
+/**
+ * Consecutive draws that share the same state are accumulated
+ * in this batch and sent to OpenGL with a single draw call.
+ */
+struct gl_batch
+{
+    int program_id;
+    GLenum mode;
+    bool indexed;           // quads drawn with the shared index buffer
+    struct gl_vertex *data;
+    int capacity;           // in vertices
+    int num_vertices;
+};
+
+/**
+ * Streaming vertex buffer shared by all vertex formats.
+ * If ARB_buffer_storage is available, it is persistently mapped and
+ * split in three sections, one per frame, each guarded by a fence.
+ * Otherwise, it is a single section which is orphaned when it's full.
+ */
+struct gl_ring
+{
+    GLuint buffer;
+    bool persistent;
+    unsigned char *mapping;
+    GLsync fences[NUM_RING_SECTIONS];
+    int num_sections;
+    int section;
+    GLsizeiptr section_size;
+    GLsizeiptr offset;          // write position in the current section
+    GLsizeiptr frame_usage;     // bytes written during the current frame
+};
+
+/**
+ * GPU timer queries issued during one frame.
+ */
+struct gl_timer_frame
+{
+    bool pending;               // results are not read yet
+    bool canvas_timed;
+    GLuint canvas_query;
+    int pass_count;
+    GLuint pass_queries[TQ_PASS_TIMING_LIMIT];
+    int pass_surface_ids[TQ_PASS_TIMING_LIMIT];
+};
+
+/**
+ * Ring of timer query sets. Results are read a few frames later,
+ * only when they are already available, so the CPU never waits.
+ */
+struct gl_timers
+{
+    bool supported;
+    bool running;               // a query is active
+    bool armed;                 // a pass query starts with the next draw
+    int armed_surface_id;
+    int frame;                  // index of the current frame
+    struct gl_timer_frame frames[NUM_TIMER_FRAMES];
+};
+
 DECLARE_FLEXIBLE_ARRAY(gl_texture)
 DECLARE_FLEXIBLE_ARRAY(gl_surface)
 
+/**
+ * Header of a program binary file in the disk cache.
+ */
+struct program_binary_header
+{
+    char magic[4];
+    GLenum format;
+    GLsizei size;
+};
+
 struct libtq_gl_renderer_priv
 {
     int             antialiasing_level;
-
-    int             vertex_format;
-    GLuint          vao[NUM_VERTEX_FORMATS];
-    GLuint          vbo[NUM_VERTEX_FORMATS];
-    GLsizei         vbo_offset[NUM_VERTEX_FORMATS];
-    GLsizei         vbo_size[NUM_VERTEX_FORMATS];
+    bool            program_cache;      // program binaries are saved to disk
+    bool            invalidate_supported;
+    bool            compressed_formats[LIBTQ_COMPRESSED_FORMAT_COUNT];
+
+    GLuint          vao;
+    GLuint          quad_indices;
+    GLuint          unpack_buffer;      // staging buffer for mapped uploads
+    int             mapped_texture;     // texture that unpack_buffer is mapped for, or -1
+    GLint           mapped_rect[4];     // x, y, width, height
+    GLuint          sprite_vao;
+    struct gl_ring  ring;
 
     GLint           max_samples;
+
+    struct gl_batch batch;
+    struct gl_timers timers;
+
+    tq_frame_stats  stats;          // current frame
+    tq_frame_stats  last_stats;     // previous frame
+    tq_frame_stats  gpu_stats;      // latest available GPU timings
 };
 
 //------------------------------------------------------------------------------
@@ -278,6 +433,7 @@ static struct gl_matrices matrices;
 static struct gl_texture_array textures;
 static struct gl_program programs[PROGRAM_COUNT];
 static struct gl_state state;
+static struct gl_cache cache;
 static struct gl_surface_array surfaces;
 static struct libtq_gl_renderer_priv priv;
 
@@ -290,14 +446,6 @@ static void decode_color24(GLfloat *dst, tq_color color)
     dst[2] = color.b / 255.0f;
 }
 
-static void decode_color32(GLfloat *dst, tq_color color)
-{
-    dst[0] = color.r / 255.0f;
-    dst[1] = color.g / 255.0f;
-    dst[2] = color.b / 255.0f;
-    dst[3] = color.a / 255.0f;
-}
-
 /**
  * Get OpenGL render mode.
  */
@@ -338,6 +486,27 @@ static GLenum conv_texture_format(int channels)
     return GL_INVALID_ENUM;
 }
 
+/**
+ * Get OpenGL internal format of compressed texture.
+ */
+static GLenum conv_compressed_format(int format)
+{
+    switch (format) {
+    case LIBTQ_BC1_RGB:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case LIBTQ_BC1_RGBA:
+        return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case LIBTQ_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case LIBTQ_ETC2_RGB:
+        return GL_COMPRESSED_RGB8_ETC2;
+    case LIBTQ_ETC2_RGBA:
+        return GL_COMPRESSED_RGBA8_ETC2_EAC;
+    }
+
+    return GL_INVALID_ENUM;
+}
+
 static bool compare_blend_mode(tq_blend_mode const *a, tq_blend_mode const *b)
 {
     return (a->color_src_factor == b->color_src_factor)
@@ -377,20 +546,284 @@ static GLenum conv_blend_equation(tq_blend_equation equation)
     return GL_INVALID_ENUM;
 }
 
+//------------------------------------------------------------------------------
+// Shadow state
+
+/**
+ * Update counters of state changes.
+ * Returns true if the change is redundant and should be skipped.
+ */
+static bool is_redundant(bool redundant)
+{
+    if (redundant) {
+        priv.stats.redundant_state_changes++;
+    } else {
+        priv.stats.state_changes++;
+    }
+
+    return redundant;
+}
+
+/**
+ * Reset shadow state to OpenGL defaults.
+ * Viewport is unknown until it's set for the first time.
+ */
+static void reset_cache(void)
+{
+    memset(&cache, 0, sizeof(cache));
+
+    cache.viewport[2] = -1;
+    cache.viewport[3] = -1;
+    cache.active_texture = GL_TEXTURE0;
+    cache.blend_func[0] = GL_ONE;
+    cache.blend_func[1] = GL_ZERO;
+    cache.blend_func[2] = GL_ONE;
+    cache.blend_func[3] = GL_ZERO;
+    cache.blend_equation[0] = GL_FUNC_ADD;
+    cache.blend_equation[1] = GL_FUNC_ADD;
+}
+
+static void cache_bind_framebuffer(GLenum target, GLuint framebuffer)
+{
+    bool draw = (target != GL_READ_FRAMEBUFFER);
+    bool read = (target != GL_DRAW_FRAMEBUFFER);
+
+    if (is_redundant((!draw || cache.draw_framebuffer == framebuffer)
+            && (!read || cache.read_framebuffer == framebuffer))) {
+        return;
+    }
+
+    CHECK_GL(glBindFramebuffer(target, framebuffer));
+
+    if (draw) {
+        cache.draw_framebuffer = framebuffer;
+    }
+
+    if (read) {
+        cache.read_framebuffer = framebuffer;
+    }
+}
+
+static void cache_bind_renderbuffer(GLuint renderbuffer)
+{
+    if (is_redundant(cache.renderbuffer == renderbuffer)) {
+        return;
+    }
+
+    CHECK_GL(glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer));
+    cache.renderbuffer = renderbuffer;
+}
+
+static void cache_set_viewport(GLint x, GLint y, GLint width, GLint height)
+{
+    if (is_redundant(cache.viewport[0] == x && cache.viewport[1] == y
+            && cache.viewport[2] == width && cache.viewport[3] == height)) {
+        return;
+    }
+
+    CHECK_GL(glViewport(x, y, width, height));
+
+    cache.viewport[0] = x;
+    cache.viewport[1] = y;
+    cache.viewport[2] = width;
+    cache.viewport[3] = height;
+}
+
+static void cache_use_program(GLuint program)
+{
+    if (is_redundant(cache.program == program)) {
+        return;
+    }
+
+    CHECK_GL(glUseProgram(program));
+    cache.program = program;
+
+    priv.stats.program_switches++;
+}
+
+static void cache_bind_vertex_array(GLuint vertex_array)
+{
+    if (is_redundant(cache.vertex_array == vertex_array)) {
+        return;
+    }
+
+    CHECK_GL(glBindVertexArray(vertex_array));
+    cache.vertex_array = vertex_array;
+}
+
+/**
+ * Bind GL_ARRAY_BUFFER. Element array buffer binding belongs
+ * to the vertex array object, so it's not cached here.
+ */
+static void cache_bind_array_buffer(GLuint buffer)
+{
+    if (is_redundant(cache.array_buffer == buffer)) {
+        return;
+    }
+
+    CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+    cache.array_buffer = buffer;
+}
+
+/**
+ * Bind GL_PIXEL_UNPACK_BUFFER. While it's bound, pixel pointers
+ * passed to glTexImage2D() are offsets in the buffer, so it
+ * should be unbound as soon as the upload is done.
+ */
+static void cache_bind_pixel_unpack_buffer(GLuint buffer)
+{
+    if (is_redundant(cache.pixel_unpack_buffer == buffer)) {
+        return;
+    }
+
+    CHECK_GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer));
+    cache.pixel_unpack_buffer = buffer;
+}
+
+static void cache_bind_texture(GLuint unit, GLuint texture)
+{
+    if (is_redundant(cache.textures[unit] == texture)) {
+        return;
+    }
+
+    if (!is_redundant(cache.active_texture == GL_TEXTURE0 + unit)) {
+        CHECK_GL(glActiveTexture(GL_TEXTURE0 + unit));
+        cache.active_texture = GL_TEXTURE0 + unit;
+    }
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, texture));
+    cache.textures[unit] = texture;
+
+    priv.stats.texture_binds++;
+}
+
+static void cache_set_blend_enabled(bool enabled)
+{
+    if (is_redundant(cache.blend == enabled)) {
+        return;
+    }
+
+    if (enabled) {
+        CHECK_GL(glEnable(GL_BLEND));
+    } else {
+        CHECK_GL(glDisable(GL_BLEND));
+    }
+
+    cache.blend = enabled;
+}
+
+static void cache_set_blend_func(GLenum color_src, GLenum color_dst, GLenum alpha_src, GLenum alpha_dst)
+{
+    if (is_redundant(cache.blend_func[0] == color_src && cache.blend_func[1] == color_dst
+            && cache.blend_func[2] == alpha_src && cache.blend_func[3] == alpha_dst)) {
+        return;
+    }
+
+    CHECK_GL(glBlendFuncSeparate(color_src, color_dst, alpha_src, alpha_dst));
+
+    cache.blend_func[0] = color_src;
+    cache.blend_func[1] = color_dst;
+    cache.blend_func[2] = alpha_src;
+    cache.blend_func[3] = alpha_dst;
+}
+
+static void cache_set_blend_equation(GLenum color_equation, GLenum alpha_equation)
+{
+    if (is_redundant(cache.blend_equation[0] == color_equation
+            && cache.blend_equation[1] == alpha_equation)) {
+        return;
+    }
+
+    CHECK_GL(glBlendEquationSeparate(color_equation, alpha_equation));
+
+    cache.blend_equation[0] = color_equation;
+    cache.blend_equation[1] = alpha_equation;
+}
+
+/**
+ * Deleting a bound object resets its binding to zero,
+ * so the shadow state should forget about it too.
+ */
+static void cache_delete_texture(GLuint texture)
+{
+    for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        if (cache.textures[unit] == texture) {
+            cache.textures[unit] = 0;
+        }
+    }
+
+    CHECK_GL(glDeleteTextures(1, &texture));
+}
+
+static void cache_delete_framebuffer(GLuint framebuffer)
+{
+    if (cache.draw_framebuffer == framebuffer) {
+        cache.draw_framebuffer = 0;
+    }
+
+    if (cache.read_framebuffer == framebuffer) {
+        cache.read_framebuffer = 0;
+    }
+
+    CHECK_GL(glDeleteFramebuffers(1, &framebuffer));
+}
+
+static void cache_delete_renderbuffer(GLuint renderbuffer)
+{
+    if (cache.renderbuffer == renderbuffer) {
+        cache.renderbuffer = 0;
+    }
+
+    CHECK_GL(glDeleteRenderbuffers(1, &renderbuffer));
+}
+
+static void cache_delete_buffer(GLuint buffer)
+{
+    if (cache.array_buffer == buffer) {
+        cache.array_buffer = 0;
+    }
+
+    if (cache.pixel_unpack_buffer == buffer) {
+        cache.pixel_unpack_buffer = 0;
+    }
+
+    CHECK_GL(glDeleteBuffers(1, &buffer));
+}
+
+static void cache_delete_vertex_array(GLuint vertex_array)
+{
+    if (cache.vertex_array == vertex_array) {
+        cache.vertex_array = 0;
+    }
+
+    CHECK_GL(glDeleteVertexArrays(1, &vertex_array));
+}
+
+static void cache_delete_program(GLuint program)
+{
+    if (cache.program == program) {
+        cache.program = 0;
+    }
+
+    CHECK_GL(glDeleteProgram(program));
+}
+
+//------------------------------------------------------------------------------
+
 static void gl_texture_dtor(struct gl_texture *texture)
 {
-    CHECK_GL(glDeleteTextures(1, &texture->handle));
+    cache_delete_texture(texture->handle);
 }
 
 static void gl_surface_dtor(struct gl_surface *surface)
 {
-    CHECK_GL(glDeleteFramebuffers(1, &surface->framebuffer));
-    CHECK_GL(glDeleteRenderbuffers(1, &surface->depth));
+    cache_delete_framebuffer(surface->framebuffer);
+    cache_delete_renderbuffer(surface->depth);
     gl_texture_array_remove(&textures, surface->texture_id);
 
     if (surface->samples > 1) {
-        CHECK_GL(glDeleteFramebuffers(1, &surface->ms_framebuffer));
-        CHECK_GL(glDeleteRenderbuffers(1, &surface->ms_color_attachment));
+        cache_delete_framebuffer(surface->ms_framebuffer);
+        cache_delete_renderbuffer(surface->ms_color_attachment);
     }
 }
 
@@ -442,6 +875,14 @@ static GLuint link_program(GLuint vs, GLuint fs)
     CHECK_GL(glBindAttribLocation(handle, ATTRIB_POSITION, "a_position"));
     CHECK_GL(glBindAttribLocation(handle, ATTRIB_COLOR, "a_color"));
     CHECK_GL(glBindAttribLocation(handle, ATTRIB_TEXCOORD, "a_texCoord"));
+    CHECK_GL(glBindAttribLocation(handle, ATTRIB_RECT, "a_rect"));
+    CHECK_GL(glBindAttribLocation(handle, ATTRIB_UV_RECT, "a_uvRect"));
+    CHECK_GL(glBindAttribLocation(handle, ATTRIB_ROTATION, "a_rotation"));
+    CHECK_GL(glBindAttribLocation(handle, ATTRIB_TINT, "a_tint"));
+
+    if (priv.program_cache) {
+        CHECK_GL(glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    }
 
     CHECK_GL(glLinkProgram(handle));
 
@@ -461,114 +902,412 @@ static GLuint link_program(GLuint vs, GLuint fs)
     return handle;
 }
 
-static void set_vertex_pointers(int vertex_format)
+/**
+ * Cache file name depends on the driver and shader source.
+ */
+static void get_program_binary_name(char *name, size_t size, char const *vs_src, char const *fs_src)
 {
-    switch (vertex_format) {
-    case VERTEX_FORMAT_SOLID:
-        CHECK_GL(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
-            2 * sizeof(GLfloat), (void *) 0));
-        break;
-    case VERTEX_FORMAT_COLORED:
-        CHECK_GL(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
-            6 * sizeof(GLfloat), (void *) 0));
-        CHECK_GL(glVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE,
-            6 * sizeof(GLfloat), (void *) (2 * sizeof(float))));
-        break;
-    case VERTEX_FORMAT_TEXTURED:
-        CHECK_GL(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
-            4 * sizeof(GLfloat), (void *) 0));
-        CHECK_GL(glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE,
-            4 * sizeof(GLfloat), (void *) (2 * sizeof(float))));
-        break;
-    }
+    uint64_t hash = LIBTQ_HASH_INIT;
+
+    hash = libtq_hash_string(hash, (char const *) glGetString(GL_VENDOR));
+    hash = libtq_hash_string(hash, (char const *) glGetString(GL_RENDERER));
+    hash = libtq_hash_string(hash, (char const *) glGetString(GL_VERSION));
+    hash = libtq_hash_string(hash, vs_src);
+    hash = libtq_hash_string(hash, fs_src);
+
+    snprintf(name, size, "program-%016llx.bin", (unsigned long long) hash);
 }
 
-static void init_vertex_formats(void)
+/**
+ * Try to create program from a binary saved by a previous run.
+ * Returns 0 if there is no such binary or the driver rejects it.
+ */
+static GLuint load_program_binary(char const *name)
 {
-    CHECK_GL(glGenVertexArrays(NUM_VERTEX_FORMATS, priv.vao));
-    CHECK_GL(glGenBuffers(NUM_VERTEX_FORMATS, priv.vbo));
+    size_t size;
+    unsigned char *data = libtq_read_cache_file(name, &size);
 
-    CHECK_GL(glBindVertexArray(priv.vao[VERTEX_FORMAT_SOLID]));
-    CHECK_GL(glEnableVertexAttribArray(ATTRIB_POSITION));
-    CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, priv.vbo[VERTEX_FORMAT_SOLID]));
-    CHECK_GL(glBufferData(GL_ARRAY_BUFFER, DEFAULT_VBO_SIZE, NULL, GL_DYNAMIC_DRAW));
-    set_vertex_pointers(VERTEX_FORMAT_SOLID);
+    if (!data) {
+        return 0;
+    }
 
-    CHECK_GL(glBindVertexArray(priv.vao[VERTEX_FORMAT_COLORED]));
-    CHECK_GL(glEnableVertexAttribArray(ATTRIB_POSITION));
-    CHECK_GL(glEnableVertexAttribArray(ATTRIB_COLOR));
-    CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, priv.vbo[VERTEX_FORMAT_COLORED]));
-    CHECK_GL(glBufferData(GL_ARRAY_BUFFER, DEFAULT_VBO_SIZE, NULL, GL_DYNAMIC_DRAW));
-    set_vertex_pointers(VERTEX_FORMAT_COLORED);
+    struct program_binary_header header;
+    GLuint handle = 0;
 
-    CHECK_GL(glBindVertexArray(priv.vao[VERTEX_FORMAT_TEXTURED]));
-    CHECK_GL(glEnableVertexAttribArray(ATTRIB_POSITION));
-    CHECK_GL(glEnableVertexAttribArray(ATTRIB_TEXCOORD));
-    CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, priv.vbo[VERTEX_FORMAT_TEXTURED]));
-    CHECK_GL(glBufferData(GL_ARRAY_BUFFER, DEFAULT_VBO_SIZE, NULL, GL_DYNAMIC_DRAW));
-    set_vertex_pointers(VERTEX_FORMAT_TEXTURED);
+    if (size > sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
 
-    CHECK_GL(glBindVertexArray(0));
+        if (memcmp(header.magic, "TQPB", 4) == 0 && (size_t) header.size == size - sizeof(header)) {
+            CHECK_GL(handle = glCreateProgram());
 
-    priv.vertex_format = -1;
+            // Errors are expected here if the driver was updated,
+            // so they're not reported. Only one error flag is read,
+            // which is the one raised by this call: errors of the
+            // previous calls are already checked by CHECK_GL().
+            glProgramBinary(handle, header.format, data + sizeof(header), header.size);
+            glGetError();
 
-    for (int i = 0; i < NUM_VERTEX_FORMATS; i++) {
-        priv.vbo_offset[i] = 0;
-        priv.vbo_size[i] = DEFAULT_VBO_SIZE;
-    }
-}
+            GLint success;
+            CHECK_GL(glGetProgramiv(handle, GL_LINK_STATUS, &success));
 
-static void set_vertex_format(int vertex_format)
-{
-    if (priv.vertex_format == vertex_format) {
-        return;
+            if (!success) {
+                CHECK_GL(glDeleteProgram(handle));
+                handle = 0;
+            }
+        }
     }
 
-    CHECK_GL(glBindVertexArray(priv.vao[vertex_format]));
-    priv.vertex_format = vertex_format;
+    libtq_free(data);
+
+    return handle;
 }
 
-static GLsizei append_data_to_vbo(void const *data, size_t size)
+static void save_program_binary(GLuint handle, char const *name)
 {
-    int vbo = priv.vertex_format;
+    GLint length = 0;
+    CHECK_GL(glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &length));
 
-    GLsizei offset = priv.vbo_offset[vbo];
-    GLsizei required_vbo_size = offset + size;
+    if (length <= 0) {
+        return;
+    }
 
-    if (priv.vbo_size[vbo] < required_vbo_size) {
-        GLsizei next_vbo_size = priv.vbo_size[vbo];
+    struct program_binary_header header;
+    unsigned char *data = libtq_malloc(sizeof(header) + length);
 
-        while (next_vbo_size < required_vbo_size) {
-            next_vbo_size *= 2;
-        }
+    if (!data) {
+        libtq_out_of_memory();
+    }
 
-        GLuint prev_vbo = priv.vbo[vbo];
-        GLsizei prev_vbo_size = priv.vbo_size[vbo];
+    CHECK_GL(glGetProgramBinary(handle, length, &header.size, &header.format, data + sizeof(header)));
+    memcpy(header.magic, "TQPB", 4);
+    memcpy(data, &header, sizeof(header));
 
-        GLuint next_vbo;
-        CHECK_GL(glGenBuffers(1, &next_vbo));
-        CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, next_vbo));
-        CHECK_GL(glBufferData(GL_ARRAY_BUFFER, next_vbo_size, NULL, GL_DYNAMIC_DRAW));
+    // Don't try again if the cache directory is not writable.
+    if (!libtq_write_cache_file(name, data, sizeof(header) + header.size)) {
+        priv.program_cache = false;
+    }
+
+    libtq_free(data);
+}
+
+/**
+ * Get shader program from the disk cache, or build it from source.
+ * Shaders are compiled only when needed and may be shared
+ * between programs, so they're passed by pointer.
+ * Returns true if the program was taken from the cache.
+ */
+static bool create_program(GLuint *handle, char const *vs_src, GLuint *vs, char const *fs_src, GLuint *fs)
+{
+    char name[64];
+
+    if (priv.program_cache) {
+        get_program_binary_name(name, sizeof(name), vs_src, fs_src);
+        *handle = load_program_binary(name);
+
+        if (*handle) {
+            return true;
+        }
+    }
+
+    if (!*vs) {
+        *vs = compile_shader(GL_VERTEX_SHADER, vs_src);
+    }
+
+    if (!*fs) {
+        *fs = compile_shader(GL_FRAGMENT_SHADER, fs_src);
+    }
+
+    *handle = link_program(*vs, *fs);
+
+    if (*handle && priv.program_cache) {
+        save_program_binary(*handle, name);
+    }
+
+    return false;
+}
+
+static void set_vertex_pointers(void)
+{
+    GLsizei stride = sizeof(struct gl_vertex);
+
+    CHECK_GL(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
+        stride, (void *) offsetof(struct gl_vertex, x)));
+    CHECK_GL(glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+        stride, (void *) offsetof(struct gl_vertex, s)));
+    CHECK_GL(glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+        stride, (void *) offsetof(struct gl_vertex, color)));
+}
+
+/**
+ * Point per-instance attributes to sprite data in the streaming buffer.
+ */
+static void set_sprite_pointers(GLsizeiptr offset)
+{
+    GLsizei stride = sizeof(tq_sprite_instance);
+
+    cache_bind_array_buffer(priv.ring.buffer);
+
+    CHECK_GL(glVertexAttribPointer(ATTRIB_RECT, 4, GL_FLOAT, GL_FALSE,
+        stride, (void *) (offset + offsetof(tq_sprite_instance, dst))));
+    CHECK_GL(glVertexAttribPointer(ATTRIB_UV_RECT, 4, GL_FLOAT, GL_FALSE,
+        stride, (void *) (offset + offsetof(tq_sprite_instance, uv))));
+    CHECK_GL(glVertexAttribPointer(ATTRIB_ROTATION, 1, GL_FLOAT, GL_FALSE,
+        stride, (void *) (offset + offsetof(tq_sprite_instance, rotation))));
+    CHECK_GL(glVertexAttribPointer(ATTRIB_TINT, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+        stride, (void *) (offset + offsetof(tq_sprite_instance, tint))));
+}
+
+/**
+ * Allocate storage for the streaming vertex buffer and point
+ * all vertex arrays to it.
+ */
+static void create_ring(GLsizeiptr section_size)
+{
+    struct gl_ring *ring = &priv.ring;
+
+    ring->num_sections = ring->persistent ? NUM_RING_SECTIONS : 1;
+    ring->section = 0;
+    ring->section_size = section_size;
+    ring->offset = 0;
+    ring->frame_usage = 0;
+
+    GLsizeiptr size = section_size * ring->num_sections;
+
+    CHECK_GL(glGenBuffers(1, &ring->buffer));
+    cache_bind_array_buffer(ring->buffer);
+
+    if (ring->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        CHECK_GL(glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags));
+        ring->mapping = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+
+        if (!ring->mapping) {
+            libtq_error("Failed to map vertex buffer.\n");
+        }
+    } else {
+        CHECK_GL(glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW));
+        ring->mapping = NULL;
+    }
+
+    cache_bind_vertex_array(priv.vao);
+    set_vertex_pointers();
+    cache_bind_vertex_array(0);
+}
+
+static void delete_ring(void)
+{
+    struct gl_ring *ring = &priv.ring;
+
+    for (int i = 0; i < NUM_RING_SECTIONS; i++) {
+        if (ring->fences[i]) {
+            CHECK_GL(glDeleteSync(ring->fences[i]));
+            ring->fences[i] = 0;
+        }
+    }
+
+    if (ring->mapping) {
+        cache_bind_array_buffer(ring->buffer);
+        CHECK_GL(glUnmapBuffer(GL_ARRAY_BUFFER));
+        ring->mapping = NULL;
+    }
+
+    cache_delete_buffer(ring->buffer);
+}
+
+/**
+ * Mark the end of GPU usage of the current ring section.
+ */
+static void leave_ring_section(void)
+{
+    struct gl_ring *ring = &priv.ring;
+
+    if (ring->persistent) {
+        ring->fences[ring->section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+/**
+ * Start writing to the next ring section, waiting until the GPU
+ * is done with its previous contents.
+ */
+static void enter_next_ring_section(void)
+{
+    struct gl_ring *ring = &priv.ring;
+
+    ring->section = (ring->section + 1) % ring->num_sections;
+    ring->offset = 0;
+
+    if (!ring->persistent) {
+        // Orphan the buffer: the driver will give us fresh storage
+        // while the old one is still used by pending draw calls.
+        cache_bind_array_buffer(ring->buffer);
+        CHECK_GL(glBufferData(GL_ARRAY_BUFFER, ring->section_size, NULL, GL_STREAM_DRAW));
+        return;
+    }
+
+    GLsync fence = ring->fences[ring->section];
+
+    if (!fence) {
+        return;
+    }
+
+    while (true) {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+
+        if (result != GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+    }
+
+    CHECK_GL(glDeleteSync(fence));
+    ring->fences[ring->section] = 0;
+}
+
+/**
+ * Reallocate the ring so that a section can hold at least given
+ * amount of bytes.
+ */
+static void grow_ring(GLsizeiptr required_size)
+{
+    GLsizeiptr next_section_size = priv.ring.section_size;
+
+    while (next_section_size < required_size) {
+        next_section_size *= 2;
+    }
+
+    libtq_log(LIBTQ_LOG_INFO, "Growing vertex buffer: %d -> %d bytes per section.\n",
+        (int) priv.ring.section_size, (int) next_section_size);
+
+    delete_ring();
+    create_ring(next_section_size);
+}
+
+/**
+ * Fill the currently bound index buffer with indices of
+ * MAX_BATCH_QUADS quads: each quad is two triangles.
+ */
+static void init_quad_indices(void)
+{
+    GLushort *indices = libtq_malloc(6 * MAX_BATCH_QUADS * sizeof(GLushort));
+
+    if (!indices) {
+        libtq_out_of_memory();
+    }
+
+    for (int i = 0; i < MAX_BATCH_QUADS; i++) {
+        indices[6 * i + 0] = 4 * i + 0;
+        indices[6 * i + 1] = 4 * i + 1;
+        indices[6 * i + 2] = 4 * i + 2;
+        indices[6 * i + 3] = 4 * i + 0;
+        indices[6 * i + 4] = 4 * i + 2;
+        indices[6 * i + 5] = 4 * i + 3;
+    }
+
+    CHECK_GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * MAX_BATCH_QUADS * sizeof(GLushort),
+        indices, GL_STATIC_DRAW));
+
+    libtq_free(indices);
+}
+
+static void init_vertex_formats(void)
+{
+    CHECK_GL(glGenVertexArrays(1, &priv.vao));
+    CHECK_GL(glGenBuffers(1, &priv.quad_indices));
+
+    cache_bind_vertex_array(priv.vao);
+    CHECK_GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv.quad_indices));
+    init_quad_indices();
+
+    CHECK_GL(glEnableVertexAttribArray(ATTRIB_POSITION));
+    CHECK_GL(glEnableVertexAttribArray(ATTRIB_TEXCOORD));
+    CHECK_GL(glEnableVertexAttribArray(ATTRIB_COLOR));
 
-        CHECK_GL(glBindBuffer(GL_COPY_READ_BUFFER, prev_vbo));
-        CHECK_GL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER,
-            0, 0, prev_vbo_size));
-        CHECK_GL(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    CHECK_GL(glGenVertexArrays(1, &priv.sprite_vao));
+    cache_bind_vertex_array(priv.sprite_vao);
 
-        CHECK_GL(glDeleteBuffers(1, &prev_vbo));
+    for (int attrib = ATTRIB_RECT; attrib <= ATTRIB_TINT; attrib++) {
+        CHECK_GL(glEnableVertexAttribArray(attrib));
+        CHECK_GL(glVertexAttribDivisor(attrib, 1));
+    }
 
-        set_vertex_pointers(priv.vertex_format);
+    priv.ring.persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
 
-        priv.vbo[vbo] = next_vbo;
-        priv.vbo_size[vbo] = next_vbo_size;
+    if (priv.ring.persistent) {
+        libtq_log(0, "Using persistently mapped vertex buffer.\n");
     }
 
-    CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, priv.vbo[vbo]));
-    CHECK_GL(glBufferSubData(GL_ARRAY_BUFFER, offset, size, data));
-    
-    priv.vbo_offset[vbo] += size;
+    create_ring(DEFAULT_RING_SECTION_SIZE);
+}
+
+static void terminate_vertex_formats(void)
+{
+    delete_ring();
 
-    return offset;
+    cache_delete_vertex_array(priv.vao);
+    cache_delete_vertex_array(priv.sprite_vao);
+    CHECK_GL(glDeleteBuffers(1, &priv.quad_indices));
+}
+
+/**
+ * Copy data to the streaming buffer.
+ * Returns offset of the data in the buffer.
+ */
+static GLsizeiptr write_to_ring(void const *data, GLsizeiptr size, GLsizeiptr alignment)
+{
+    struct gl_ring *ring = &priv.ring;
+
+    if (size > ring->section_size) {
+        // Shouldn't happen normally, since batches are limited
+        // by the section size.
+        grow_ring(size);
+    }
+
+    GLsizeiptr offset = ((ring->offset + alignment - 1) / alignment) * alignment;
+
+    if (offset + size > ring->section_size) {
+        leave_ring_section();
+        enter_next_ring_section();
+        offset = 0;
+    }
+
+    GLsizeiptr base = ring->section * ring->section_size + offset;
+
+    if (ring->persistent) {
+        memcpy(ring->mapping + base, data, size);
+    } else {
+        cache_bind_array_buffer(ring->buffer);
+
+        GLbitfield flags = GL_MAP_WRITE_BIT
+            | GL_MAP_INVALIDATE_RANGE_BIT
+            | GL_MAP_UNSYNCHRONIZED_BIT;
+
+        void *dst = glMapBufferRange(GL_ARRAY_BUFFER, base, size, flags);
+
+        if (dst) {
+            memcpy(dst, data, size);
+            CHECK_GL(glUnmapBuffer(GL_ARRAY_BUFFER));
+        }
+    }
+
+    ring->frame_usage += (offset - ring->offset) + size;
+    ring->offset = offset + size;
+
+    priv.stats.vertex_upload_bytes += size;
+
+    return base;
+}
+
+/**
+ * Copy packed vertices to the streaming buffer.
+ * Returns index of the first vertex to be passed to glDrawArrays().
+ */
+static GLint append_vertices(struct gl_vertex const *data, int num_vertices)
+{
+    GLsizeiptr stride = sizeof(struct gl_vertex);
+    GLsizeiptr offset = write_to_ring(data, stride * num_vertices, stride);
+
+    return (GLint) (offset / stride);
 }
 
 /**
@@ -587,48 +1326,539 @@ static void apply_uniforms(void)
         CHECK_GL(glUniformMatrix4fv(location[UNIFORM_MODELVIEW], 1, GL_TRUE, matrices.mv));
     }
 
-    if (bits & (1 << UNIFORM_COLOR)) {
-        CHECK_GL(glUniform4fv(location[UNIFORM_COLOR], 1, colors.draw));
+    programs[state.program_id].dirty_uniform_bits = 0;
+}
+
+/**
+ * Switch to different shader.
+ */
+static void set_program_id(int program_id)
+{
+    if (state.program_id == program_id) {
+        return;
+    }
+
+    state.program_id = program_id;
+
+    if (program_id == -1) {
+        cache_use_program(0);
+        return;
+    }
+
+    cache_use_program(programs[program_id].handle);
+
+    if (programs[program_id].dirty_uniform_bits) {
+        apply_uniforms();
+    }
+}
+
+/**
+ * Mark uniform for change.
+ * This is needed so we don't have to update uniforms
+ * for each shader. Only when shader is activated, the pending
+ * uniform changes will take effect.
+ */
+static void set_dirty_uniform(int program_id, int uniform_id)
+{
+    programs[program_id].dirty_uniform_bits |= (1 << uniform_id);
+
+    if (state.program_id == program_id) {
+        apply_uniforms();
+    }
+}
+
+static void init_timers(void)
+{
+    priv.timers.supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    priv.timers.running = false;
+    priv.timers.armed = false;
+    priv.timers.frame = 0;
+
+    if (!priv.timers.supported) {
+        libtq_log(0, "GPU timer queries are not supported.\n");
+        return;
+    }
+
+    for (int i = 0; i < NUM_TIMER_FRAMES; i++) {
+        struct gl_timer_frame *frame = &priv.timers.frames[i];
+
+        CHECK_GL(glGenQueries(1, &frame->canvas_query));
+        CHECK_GL(glGenQueries(TQ_PASS_TIMING_LIMIT, frame->pass_queries));
+
+        frame->pending = false;
+        frame->canvas_timed = false;
+        frame->pass_count = 0;
+    }
+}
+
+static void terminate_timers(void)
+{
+    if (!priv.timers.supported) {
+        return;
+    }
+
+    if (priv.timers.running) {
+        CHECK_GL(glEndQuery(GL_TIME_ELAPSED));
+        priv.timers.running = false;
+    }
+
+    for (int i = 0; i < NUM_TIMER_FRAMES; i++) {
+        struct gl_timer_frame *frame = &priv.timers.frames[i];
+
+        CHECK_GL(glDeleteQueries(1, &frame->canvas_query));
+        CHECK_GL(glDeleteQueries(TQ_PASS_TIMING_LIMIT, frame->pass_queries));
+    }
+}
+
+/**
+ * Stop the running query, if any.
+ */
+static void end_timer_query(void)
+{
+    if (!priv.timers.running) {
+        return;
+    }
+
+    CHECK_GL(glEndQuery(GL_TIME_ELAPSED));
+    priv.timers.running = false;
+}
+
+/**
+ * Prepare timing of a surface pass. The query is started lazily
+ * by the first draw or clear, so empty passes aren't timed.
+ * A pass lasts until the next call to bind_surface() or
+ * draw_canvas(), or until the end of the frame.
+ * Passes to the default framebuffer aren't timed.
+ */
+static void arm_pass_timer(int surface_id)
+{
+    end_timer_query();
+
+    priv.timers.armed = priv.timers.supported && (surface_id != -1);
+    priv.timers.armed_surface_id = surface_id;
+}
+
+static void start_pass_timer(void)
+{
+    if (!priv.timers.armed) {
+        return;
+    }
+
+    priv.timers.armed = false;
+
+    struct gl_timer_frame *frame = &priv.timers.frames[priv.timers.frame];
+
+    if (frame->pass_count == TQ_PASS_TIMING_LIMIT) {
+        return;
+    }
+
+    CHECK_GL(glBeginQuery(GL_TIME_ELAPSED, frame->pass_queries[frame->pass_count]));
+
+    frame->pass_surface_ids[frame->pass_count] = priv.timers.armed_surface_id;
+    frame->pass_count++;
+
+    priv.timers.running = true;
+}
+
+static void begin_canvas_timer(void)
+{
+    end_timer_query();
+    priv.timers.armed = false;
+
+    if (!priv.timers.supported) {
+        return;
+    }
+
+    struct gl_timer_frame *frame = &priv.timers.frames[priv.timers.frame];
+
+    CHECK_GL(glBeginQuery(GL_TIME_ELAPSED, frame->canvas_query));
+
+    frame->canvas_timed = true;
+    priv.timers.running = true;
+}
+
+static float get_query_time(GLuint query)
+{
+    GLuint64 nanoseconds = 0;
+    CHECK_GL(glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds));
+
+    return (float) (nanoseconds / 1.0e6);
+}
+
+/**
+ * Read results of finished frames, from oldest to newest.
+ * Stops at the first frame whose queries are still in flight.
+ */
+static void collect_timer_results(void)
+{
+    for (int i = 1; i <= NUM_TIMER_FRAMES; i++) {
+        struct gl_timer_frame *frame = &priv.timers.frames[(priv.timers.frame + i) % NUM_TIMER_FRAMES];
+
+        if (!frame->pending) {
+            continue;
+        }
+
+        GLuint last_query;
+
+        if (frame->canvas_timed) {
+            last_query = frame->canvas_query;
+        } else if (frame->pass_count > 0) {
+            last_query = frame->pass_queries[frame->pass_count - 1];
+        } else {
+            frame->pending = false;
+            continue;
+        }
+
+        GLuint available = GL_FALSE;
+        CHECK_GL(glGetQueryObjectuiv(last_query, GL_QUERY_RESULT_AVAILABLE, &available));
+
+        if (!available) {
+            break;
+        }
+
+        tq_frame_stats *stats = &priv.gpu_stats;
+
+        stats->canvas_time = frame->canvas_timed ? get_query_time(frame->canvas_query) : 0.0f;
+        stats->gpu_time = stats->canvas_time;
+        stats->pass_count = frame->pass_count;
+
+        for (int j = 0; j < frame->pass_count; j++) {
+            stats->passes[j].surface_id = frame->pass_surface_ids[j];
+            stats->passes[j].time = get_query_time(frame->pass_queries[j]);
+            stats->gpu_time += stats->passes[j].time;
+        }
+
+        frame->pending = false;
+    }
+}
+
+/**
+ * Finish timing of the current frame and start the next one.
+ * Results that weren't read in time are discarded.
+ */
+static void advance_timer_frame(void)
+{
+    if (!priv.timers.supported) {
+        return;
+    }
+
+    end_timer_query();
+
+    priv.timers.frames[priv.timers.frame].pending = true;
+    collect_timer_results();
+
+    priv.timers.frame = (priv.timers.frame + 1) % NUM_TIMER_FRAMES;
+
+    struct gl_timer_frame *frame = &priv.timers.frames[priv.timers.frame];
+
+    frame->pending = false;
+    frame->canvas_timed = false;
+    frame->pass_count = 0;
+
+    arm_pass_timer(state.bound_surface_id);
+}
+
+static GLuint get_surface_framebuffer(int surface_id)
+{
+    if (!gl_surface_array_check(&surfaces, surface_id)) {
+        return 0;
+    }
+
+    if (surfaces.data[surface_id].samples > 1) {
+        return surfaces.data[surface_id].ms_framebuffer;
+    }
+
+    return surfaces.data[surface_id].framebuffer;
+}
+
+/**
+ * Copy contents of the multisampled buffer to the surface texture.
+ * This is done only when the texture is going to be sampled,
+ * and only if something was drawn since the last resolve.
+ */
+static void resolve_surface(int surface_id)
+{
+    struct gl_surface *surface = &surfaces.data[surface_id];
+
+    if (!surface->needs_resolve) {
+        return;
+    }
+
+    int width = textures.data[surface->texture_id].width;
+    int height = textures.data[surface->texture_id].height;
+
+    cache_bind_framebuffer(GL_DRAW_FRAMEBUFFER, surface->framebuffer);
+    cache_bind_framebuffer(GL_READ_FRAMEBUFFER, surface->ms_framebuffer);
+
+    CHECK_GL(glBlitFramebuffer(
+        0, 0, width, height,
+        0, 0, width, height,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST
+    ));
+
+    surface->needs_resolve = false;
+
+    cache_bind_framebuffer(GL_FRAMEBUFFER, get_surface_framebuffer(state.bound_surface_id));
+}
+
+/**
+ * Should be called before anything is drawn to the render target.
+ */
+static void touch_render_target(void)
+{
+    int surface_id = state.bound_surface_id;
+
+    if (surface_id == -1) {
+        return;
+    }
+
+    struct gl_surface *surface = &surfaces.data[surface_id];
+    struct gl_texture *texture = &textures.data[surface->texture_id];
+
+    surface->needs_resolve = (surface->samples > 1);
+    texture->dirty_mipmaps = texture->mipmapped;
+}
+
+/**
+ * Bind the current texture, if it's not bound yet.
+ */
+static void apply_texture(void)
+{
+    int texture_id = state.bound_texture_id;
+
+    if (!gl_texture_array_check(&textures, texture_id)) {
+        cache_bind_texture(0, 0);
+        return;
+    }
+
+    struct gl_texture *texture = &textures.data[texture_id];
+
+    cache_bind_texture(0, texture->handle);
+
+    if (texture->surface_id != -1) {
+        resolve_surface(texture->surface_id);
+    }
+
+    // Mip levels are rebuilt only when the texture is going to be
+    // sampled, so several updates in a row cost one regeneration.
+    if (texture->dirty_mipmaps) {
+        CHECK_GL(glGenerateMipmap(GL_TEXTURE_2D));
+        texture->dirty_mipmaps = false;
+    }
+}
+
+/**
+ * Send accumulated vertices to OpenGL.
+ * Should be called before any change of the OpenGL state
+ * the pending batch depends on.
+ */
+static void flush_batch(void)
+{
+    struct gl_batch *batch = &priv.batch;
+
+    if (batch->num_vertices == 0) {
+        return;
+    }
+
+    set_program_id(batch->program_id);
+
+    if (batch->program_id != PROGRAM_COLORED) {
+        apply_texture();
+    }
+
+    // The vertex buffer may be reallocated while appending,
+    // so the vertex array is bound afterwards.
+    GLint start = append_vertices(batch->data, batch->num_vertices);
+    cache_bind_vertex_array(priv.vao);
+
+    start_pass_timer();
+    touch_render_target();
+
+    if (batch->indexed) {
+        CHECK_GL(glDrawElementsBaseVertex(batch->mode, 6 * (batch->num_vertices / 4),
+            GL_UNSIGNED_SHORT, (void *) 0, start));
+    } else {
+        CHECK_GL(glDrawArrays(batch->mode, start, batch->num_vertices));
+    }
+
+    priv.stats.batch_count++;
+    priv.stats.vertex_count += batch->num_vertices;
+
+    batch->num_vertices = 0;
+}
+
+/**
+ * Reserve space for vertices in the batch, flushing it first
+ * if it was started with different parameters.
+ */
+static struct gl_vertex *reserve_batch(int program_id, GLenum mode, bool indexed, int num_vertices)
+{
+    struct gl_batch *batch = &priv.batch;
+
+    if (batch->num_vertices > 0) {
+        if (batch->program_id != program_id
+                || batch->mode != mode
+                || batch->indexed != indexed) {
+            flush_batch();
+        } else if (indexed && (batch->num_vertices + num_vertices) > 4 * MAX_BATCH_QUADS) {
+            flush_batch();
+        }
+    }
+
+    int required_size = batch->num_vertices + num_vertices;
+
+    // Keep the batch small enough to fit in the streaming buffer.
+    if (batch->num_vertices > 0) {
+        if ((GLsizeiptr) (required_size * sizeof(struct gl_vertex)) > priv.ring.section_size) {
+            flush_batch();
+            required_size = num_vertices;
+        }
+    }
+
+    batch->program_id = program_id;
+    batch->mode = mode;
+    batch->indexed = indexed;
+
+    if (batch->capacity < required_size) {
+        int next_capacity = batch->capacity;
+
+        while (next_capacity < required_size) {
+            next_capacity *= 2;
+        }
+
+        struct gl_vertex *next_data = libtq_realloc(batch->data, next_capacity * sizeof(struct gl_vertex));
+
+        if (!next_data) {
+            libtq_out_of_memory();
+        }
+
+        batch->data = next_data;
+        batch->capacity = next_capacity;
+    }
+
+    struct gl_vertex *dst = batch->data + batch->num_vertices;
+    batch->num_vertices = required_size;
+
+    return dst;
+}
+
+static GLubyte pack_unorm8(float value)
+{
+    return (GLubyte) (TQ_MAX(0.0f, TQ_MIN(value, 1.0f)) * 255.0f + 0.5f);
+}
+
+static GLushort pack_unorm16(float value)
+{
+    return (GLushort) (TQ_MAX(0.0f, TQ_MIN(value, 1.0f)) * 65535.0f + 0.5f);
+}
+
+/**
+ * Convert vertices of the given input format to the packed layout.
+ * Vertices without color of their own get the given one.
+ */
+static void pack_vertices(struct gl_vertex *dst, int vertex_format,
+    float const *src, int num_vertices, GLubyte const *color)
+{
+    int stride = vertex_sizes[vertex_format];
+
+    for (int i = 0; i < num_vertices; i++, src += stride) {
+        dst[i].x = src[0];
+        dst[i].y = src[1];
+
+        if (vertex_format == VERTEX_FORMAT_TEXTURED) {
+            dst[i].s = pack_unorm16(src[2]);
+            dst[i].t = pack_unorm16(src[3]);
+        } else {
+            dst[i].s = 0;
+            dst[i].t = 0;
+        }
+
+        if (vertex_format == VERTEX_FORMAT_COLORED) {
+            for (int j = 0; j < 4; j++) {
+                dst[i].color[j] = pack_unorm8(src[2 + j]);
+            }
+        } else {
+            memcpy(dst[i].color, color, 4);
+        }
     }
-
-    programs[state.program_id].dirty_uniform_bits = 0;
 }
 
 /**
- * Switch to different shader.
+ * Append a primitive to the batch.
+ * Strips, loops and fans can't be merged, so they are converted
+ * to independent lines and triangles.
  */
-static void set_program_id(int program_id)
+static void append_primitive(int vertex_format, int program_id, int mode,
+    float const *data, int num_vertices, GLubyte const *color)
 {
-    if (state.program_id == program_id) {
-        return;
-    }
+    int stride = vertex_sizes[vertex_format];
+    struct gl_vertex *dst;
 
-    state.program_id = program_id;
+    switch (mode) {
+    case TQ_PRIMITIVE_POINTS:
+        if (num_vertices < 1) {
+            return;
+        }
 
-    if (program_id == -1) {
-        CHECK_GL(glUseProgram(0));
-        return;
-    }
+        dst = reserve_batch(program_id, GL_POINTS, false, num_vertices);
+        pack_vertices(dst, vertex_format, data, num_vertices, color);
+        break;
+    case TQ_PRIMITIVE_LINE_STRIP:
+    case TQ_PRIMITIVE_LINE_LOOP:
+        if (num_vertices < 2) {
+            return;
+        }
 
-    CHECK_GL(glUseProgram(programs[program_id].handle));
+        int num_lines = (mode == TQ_PRIMITIVE_LINE_LOOP) ? num_vertices : (num_vertices - 1);
+        dst = reserve_batch(program_id, GL_LINES, false, 2 * num_lines);
 
-    if (programs[program_id].dirty_uniform_bits) {
-        apply_uniforms();
+        for (int i = 0; i < num_lines; i++) {
+            pack_vertices(dst, vertex_format, data + stride * i, 1, color);
+            pack_vertices(dst + 1, vertex_format, data + stride * ((i + 1) % num_vertices), 1, color);
+            dst += 2;
+        }
+        break;
+    case TQ_PRIMITIVE_TRIANGLES:
+        if (num_vertices < 3) {
+            return;
+        }
+
+        dst = reserve_batch(program_id, GL_TRIANGLES, false, num_vertices);
+        pack_vertices(dst, vertex_format, data, num_vertices, color);
+        break;
+    case TQ_PRIMITIVE_TRIANGLE_FAN:
+        if (num_vertices < 3) {
+            return;
+        }
+
+        dst = reserve_batch(program_id, GL_TRIANGLES, false, 3 * (num_vertices - 2));
+        pack_vertices(dst, vertex_format, data, 1, color);
+
+        for (int i = 1; i < num_vertices - 1; i++) {
+            dst[3 * (i - 1)] = dst[0];
+            pack_vertices(dst + 3 * (i - 1) + 1, vertex_format, data + stride * i, 2, color);
+        }
+        break;
     }
 }
 
 /**
- * Mark uniform for change.
- * This is needed so we don't have to update uniforms
- * for each shader. Only when shader is activated, the pending
- * uniform changes will take effect.
+ * Append quads to the batch. Each quad consists of 4 vertices
+ * which are drawn as two triangles: (0, 1, 2) and (0, 2, 3).
  */
-static void set_dirty_uniform(int program_id, int uniform_id)
+static void append_quads(int vertex_format, int program_id,
+    float const *data, int num_quads, GLubyte const *color)
 {
-    programs[program_id].dirty_uniform_bits |= (1 << uniform_id);
+    int quad_size = 4 * vertex_sizes[vertex_format];
 
-    if (state.program_id == program_id) {
-        apply_uniforms();
+    while (num_quads > 0) {
+        int count = TQ_MIN(num_quads, MAX_BATCH_QUADS);
+
+        struct gl_vertex *dst = reserve_batch(program_id, GL_TRIANGLES, true, 4 * count);
+        pack_vertices(dst, vertex_format, data, 4 * count, color);
+
+        data += count * quad_size;
+        num_quads -= count;
     }
 }
 
@@ -639,10 +1869,23 @@ static void set_dirty_uniform(int program_id, int uniform_id)
  */
 static void initialize(void)
 {
-    if (glewInit()) {
+    GLenum glew_status = glewInit();
+
+    // Without GLX (e.g. in a headless EGL context) GLEW still loads
+    // GL entry points, but then complains about missing GLX display.
+    // This error code only exists since GLEW 2.2.
+#if defined(GLEW_ERROR_NO_GLX_DISPLAY)
+    if (glew_status == GLEW_ERROR_NO_GLX_DISPLAY) {
+        glew_status = GLEW_OK;
+    }
+#endif
+
+    if (glew_status != GLEW_OK) {
         libtq_error("Failed to initialize GLEW.\n");
     }
 
+    reset_cache();
+
     mat4_identity(matrices.proj);
     mat4_identity(matrices.mv);
 
@@ -651,33 +1894,63 @@ static void initialize(void)
 
     init_vertex_formats();
 
+    priv.batch.data = libtq_malloc(DEFAULT_BATCH_SIZE * sizeof(struct gl_vertex));
+
+    if (!priv.batch.data) {
+        libtq_out_of_memory();
+    }
+
+    priv.batch.capacity = DEFAULT_BATCH_SIZE;
+    priv.batch.num_vertices = 0;
+
     state.program_id = -1;
 
-    GLuint vs_standard = compile_shader(GL_VERTEX_SHADER, vs_src_standard);
-    GLuint vs_backbuf = compile_shader(GL_VERTEX_SHADER, vs_src_backbuf);
-    GLuint fs_solid = compile_shader(GL_FRAGMENT_SHADER, fs_src_solid);
-    GLuint fs_colored = compile_shader(GL_FRAGMENT_SHADER, fs_src_colored);
-    GLuint fs_textured = compile_shader(GL_FRAGMENT_SHADER, fs_src_textured);
-    GLuint fs_font = compile_shader(GL_FRAGMENT_SHADER, fs_src_font);
+    /**
+     * Build shader programs.
+     */
+
+    double shader_setup_start = tq_get_time_highp();
+
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+        GLint num_formats = 0;
+        CHECK_GL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats));
+
+        priv.program_cache = (num_formats > 0);
+    }
+
+    GLuint vs_standard = 0;
+    GLuint fs_colored = 0;
+    GLuint fs_textured = 0;
+    GLuint fs_font = 0;
+    GLuint vs_sprite = 0;
+    GLuint fs_sprite = 0;
+
+    int num_cached_programs = 0;
 
-    programs[PROGRAM_SOLID].handle = link_program(vs_standard, fs_solid);
-    programs[PROGRAM_COLORED].handle = link_program(vs_standard, fs_colored);
-    programs[PROGRAM_TEXTURED].handle = link_program(vs_standard, fs_textured);
-    programs[PROGRAM_FONT].handle = link_program(vs_standard, fs_font);
-    programs[PROGRAM_BACKBUF].handle = link_program(vs_backbuf, fs_textured);
+    num_cached_programs += create_program(&programs[PROGRAM_COLORED].handle,
+        vs_src_standard, &vs_standard, fs_src_colored, &fs_colored);
+    num_cached_programs += create_program(&programs[PROGRAM_TEXTURED].handle,
+        vs_src_standard, &vs_standard, fs_src_textured, &fs_textured);
+    num_cached_programs += create_program(&programs[PROGRAM_FONT].handle,
+        vs_src_standard, &vs_standard, fs_src_font, &fs_font);
+    num_cached_programs += create_program(&programs[PROGRAM_SPRITE].handle,
+        vs_src_sprite, &vs_sprite, fs_src_sprite, &fs_sprite);
 
     for (int i = 0; i < PROGRAM_COUNT; i++) {
         programs[i].uniforms[UNIFORM_PROJECTION] = glGetUniformLocation(programs[i].handle, "u_projection");
         programs[i].uniforms[UNIFORM_MODELVIEW] = glGetUniformLocation(programs[i].handle, "u_modelView");
-        programs[i].uniforms[UNIFORM_COLOR] = glGetUniformLocation(programs[i].handle, "u_color");
         programs[i].dirty_uniform_bits = 2147483647; // totally not a magic number
     }
 
     glDeleteShader(vs_standard);
-    glDeleteShader(vs_backbuf);
-    glDeleteShader(fs_solid);
+    glDeleteShader(fs_colored);
     glDeleteShader(fs_textured);
     glDeleteShader(fs_font);
+    glDeleteShader(vs_sprite);
+    glDeleteShader(fs_sprite);
+
+    libtq_log(0, "Shader setup took %.2f ms (%d of %d programs loaded from cache).\n",
+        (tq_get_time_highp() - shader_setup_start) * 1000.0, num_cached_programs, PROGRAM_COUNT);
 
     state.bound_texture_id = -1;
     state.bound_surface_id = -1;
@@ -687,9 +1960,9 @@ static void initialize(void)
      * Reset OpenGL state.
      */
 
-    CHECK_GL(glEnable(GL_BLEND));
-    CHECK_GL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
-    CHECK_GL(glBlendEquation(GL_FUNC_ADD));
+    cache_set_blend_enabled(true);
+    cache_set_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    cache_set_blend_equation(GL_FUNC_ADD, GL_FUNC_ADD);
 
     CHECK_GL(glDisable(GL_CULL_FACE));
     CHECK_GL(glDisable(GL_DEPTH_TEST));
@@ -700,8 +1973,21 @@ static void initialize(void)
 
     CHECK_GL(glGetIntegerv(GL_MAX_SAMPLES, &priv.max_samples));
 
+    priv.invalidate_supported = GLEW_VERSION_4_3 || GLEW_ARB_invalidate_subdata;
+
+    priv.compressed_formats[LIBTQ_BC1_RGB] = GLEW_EXT_texture_compression_s3tc;
+    priv.compressed_formats[LIBTQ_BC1_RGBA] = GLEW_EXT_texture_compression_s3tc;
+    priv.compressed_formats[LIBTQ_BC3] = GLEW_EXT_texture_compression_s3tc;
+    priv.compressed_formats[LIBTQ_ETC2_RGB] = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
+    priv.compressed_formats[LIBTQ_ETC2_RGBA] = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
+
     priv.antialiasing_level = 0;
 
+    CHECK_GL(glGenBuffers(1, &priv.unpack_buffer));
+    priv.mapped_texture = -1;
+
+    init_timers();
+
     /**
      * Initialization is done.
      */
@@ -717,12 +2003,18 @@ static void initialize(void)
  */
 static void terminate(void)
 {
+    terminate_timers();
+    cache_delete_buffer(priv.unpack_buffer);
+
     for (int i = 0; i < PROGRAM_COUNT; i++) {
-        CHECK_GL(glDeleteProgram(programs[i].handle));
+        cache_delete_program(programs[i].handle);
     }
 
     gl_surface_array_terminate(&surfaces);
     gl_texture_array_terminate(&textures);
+
+    terminate_vertex_formats();
+    libtq_free(priv.batch.data);
 }
 
 /**
@@ -730,14 +2022,30 @@ static void terminate(void)
  */
 static void process(void)
 {
+    flush_batch();
     CHECK_GL(glFlush());
 }
 
 static void post_process(void)
 {
-    for (int i = 0; i < NUM_VERTEX_FORMATS; i++) {
-        priv.vbo_offset[i] = 0;
+    flush_batch();
+
+    // Each frame starts in a new section of the streaming buffer.
+    // If the last frame didn't fit in one section, grow the buffer
+    // now rather than in the middle of the next frame.
+    if (priv.ring.frame_usage > priv.ring.section_size) {
+        grow_ring(priv.ring.frame_usage);
+    } else {
+        leave_ring_section();
+        enter_next_ring_section();
     }
+
+    priv.ring.frame_usage = 0;
+
+    advance_timer_frame();
+
+    priv.last_stats = priv.stats;
+    memset(&priv.stats, 0, sizeof(priv.stats));
 }
 
 int request_antialiasing_level(int level)
@@ -756,6 +2064,7 @@ int request_antialiasing_level(int level)
  */
 static void update_projection(float const *mat4)
 {
+    flush_batch();
     mat4_copy(matrices.proj, mat4);
 
     for (int i = 0; i < PROGRAM_COUNT; i++) {
@@ -774,6 +2083,7 @@ static void update_model_view(float const *mat3)
     // (Note 2: OpenGL's own matrices are not used here, since I handle
     //  this in the "tq::graphics" module independently of renderer).
 
+    flush_batch();
     mat4_expand(matrices.mv, mat3);
 
     for (int i = 0; i < PROGRAM_COUNT; i++) {
@@ -794,11 +2104,13 @@ static int create_texture(int width, int height, int channels)
         return -1;
     }
 
+    flush_batch();
+
     struct gl_texture texture;
     texture.format = conv_texture_format(channels);
 
     CHECK_GL(glGenTextures(1, &texture.handle));
-    CHECK_GL(glBindTexture(GL_TEXTURE_2D, texture.handle));
+    cache_bind_texture(0, texture.handle);
 
     CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
     CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
@@ -811,11 +2123,12 @@ static int create_texture(int width, int height, int channels)
     texture.height = height;
     texture.channels = channels;
     texture.smooth = false;
+    texture.mipmapped = false;
+    texture.dirty_mipmaps = false;
+    texture.surface_id = -1;
+    texture.compressed = false;
 
-    int texture_id = gl_texture_array_add(&textures, &texture);
-
-    state.bound_texture_id = texture_id;
-    return texture_id;
+    return gl_texture_array_add(&textures, &texture);
 }
 
 /**
@@ -823,9 +2136,30 @@ static int create_texture(int width, int height, int channels)
  */
 static void delete_texture(int texture_id)
 {
+    flush_batch();
     gl_texture_array_remove(&textures, texture_id);
 }
 
+/**
+ * Set filtering parameters according to texture flags.
+ * Trilinear filtering is used for smooth mipmapped textures.
+ */
+static void apply_texture_filter(struct gl_texture *texture)
+{
+    GLenum min_filter;
+    GLenum mag_filter = texture->smooth ? GL_LINEAR : GL_NEAREST;
+
+    if (texture->mipmapped) {
+        min_filter = texture->smooth ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST;
+    } else {
+        min_filter = mag_filter;
+    }
+
+    cache_bind_texture(0, texture->handle);
+    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter));
+    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter));
+}
+
 static bool is_texture_smooth(int texture_id)
 {
     if (!gl_texture_array_check(&textures, texture_id)) {
@@ -845,12 +2179,32 @@ static void set_texture_smooth(int texture_id, bool smooth)
         return;
     }
 
-    CHECK_GL(glBindTexture(GL_TEXTURE_2D, textures.data[texture_id].handle));
-    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, smooth ? GL_LINEAR : GL_NEAREST));
-    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, smooth ? GL_LINEAR : GL_NEAREST));
+    flush_batch();
 
     textures.data[texture_id].smooth = smooth;
-    state.bound_texture_id = texture_id;
+    apply_texture_filter(&textures.data[texture_id]);
+}
+
+static void set_texture_mipmapped(int texture_id, bool mipmapped)
+{
+    if (!gl_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    if (textures.data[texture_id].mipmapped == mipmapped) {
+        return;
+    }
+
+    // Mipmaps can't be generated for compressed textures.
+    if (textures.data[texture_id].compressed) {
+        return;
+    }
+
+    flush_batch();
+
+    textures.data[texture_id].mipmapped = mipmapped;
+    textures.data[texture_id].dirty_mipmaps = mipmapped;
+    apply_texture_filter(&textures.data[texture_id]);
 }
 
 static void get_texture_size(int texture_id, int *width, int *height)
@@ -871,32 +2225,195 @@ static void update_texture(int texture_id, int x_offset, int y_offset, int width
         return;
     }
 
-    glBindTexture(GL_TEXTURE_2D, textures.data[texture_id].handle);
+    if (textures.data[texture_id].compressed) {
+        return;
+    }
+
+    flush_batch();
+
+    struct gl_texture *texture = &textures.data[texture_id];
+
+    cache_bind_texture(0, texture->handle);
 
     if (x_offset == 0 && y_offset == 0 && width == -1 && height == -1) {
-        glTexImage2D(GL_TEXTURE_2D, 0, textures.data[texture_id].format,
-            textures.data[texture_id].width, textures.data[texture_id].height, 0,
-            textures.data[texture_id].format, GL_UNSIGNED_BYTE, pixels);
+        CHECK_GL(glTexImage2D(GL_TEXTURE_2D, 0, texture->format,
+            texture->width, texture->height, 0,
+            texture->format, GL_UNSIGNED_BYTE, pixels));
+
+        width = texture->width;
+        height = texture->height;
     } else {
-        glTexSubImage2D(GL_TEXTURE_2D, 0, x_offset, y_offset, width, height,
-            textures.data[texture_id].format, GL_UNSIGNED_BYTE, pixels);
+        CHECK_GL(glTexSubImage2D(GL_TEXTURE_2D, 0, x_offset, y_offset, width, height,
+            texture->format, GL_UNSIGNED_BYTE, pixels));
     }
 
-    state.bound_texture_id = texture_id;
+    if (pixels) {
+        priv.stats.texture_upload_bytes += (long) width * height * texture->channels;
+    }
+
+    texture->dirty_mipmaps = texture->mipmapped;
 }
 
-static void bind_texture(int texture_id)
+/**
+ * Map the staging buffer, so that the caller can write the pixels
+ * of a texture region without an intermediate copy. Rows are
+ * tightly packed. Nothing else should be called until the buffer
+ * is unmapped by unmap_texture().
+ */
+static unsigned char *map_texture(int texture_id, int x_offset, int y_offset, int width, int height)
 {
-    if (state.bound_texture_id == texture_id) {
+    if (!gl_texture_array_check(&textures, texture_id)) {
+        return NULL;
+    }
+
+    if (textures.data[texture_id].compressed) {
+        return NULL;
+    }
+
+    flush_batch();
+
+    GLsizeiptr size = (GLsizeiptr) width * height * textures.data[texture_id].channels;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+    // The buffer is orphaned each time to avoid waiting for
+    // the previous upload to finish.
+    cache_bind_pixel_unpack_buffer(priv.unpack_buffer);
+    CHECK_GL(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+
+    unsigned char *mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+
+    if (!mapping) {
+        cache_bind_pixel_unpack_buffer(0);
+        return NULL;
+    }
+
+    priv.mapped_texture = texture_id;
+    priv.mapped_rect[0] = x_offset;
+    priv.mapped_rect[1] = y_offset;
+    priv.mapped_rect[2] = width;
+    priv.mapped_rect[3] = height;
+
+    return mapping;
+}
+
+/**
+ * Unmap the staging buffer and transfer its contents to the texture.
+ * The driver is free to do it asynchronously.
+ */
+static void unmap_texture(void)
+{
+    if (priv.mapped_texture == -1) {
         return;
     }
 
-    if (!gl_texture_array_check(&textures, texture_id)) {
-        CHECK_GL(glBindTexture(GL_TEXTURE_2D, 0));
+    struct gl_texture *texture = &textures.data[priv.mapped_texture];
+    GLint const *rect = priv.mapped_rect;
+
+    if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        // Buffer contents were lost, the texture is updated next time.
+        libtq_log(LIBTQ_LOG_WARNING, "Texture staging buffer was corrupted.\n");
     } else {
-        CHECK_GL(glBindTexture(GL_TEXTURE_2D, textures.data[texture_id].handle));
+        cache_bind_texture(0, texture->handle);
+
+        // While the buffer is bound, the pixel pointer is an offset in it.
+        CHECK_GL(glTexSubImage2D(GL_TEXTURE_2D, 0, rect[0], rect[1], rect[2], rect[3],
+            texture->format, GL_UNSIGNED_BYTE, NULL));
+
+        priv.stats.texture_upload_bytes += (long) rect[2] * rect[3] * texture->channels;
+        texture->dirty_mipmaps = texture->mipmapped;
+    }
+
+    cache_bind_pixel_unpack_buffer(0);
+    priv.mapped_texture = -1;
+}
+
+/**
+ * Reallocate texture storage with new size and format.
+ * Contents become undefined.
+ */
+static void resize_texture(int texture_id, int width, int height, int channels)
+{
+    if (!gl_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    if ((width < 0) || (height < 0) || (channels < 1) || (channels > 4)) {
+        return;
+    }
+
+    flush_batch();
+
+    struct gl_texture *texture = &textures.data[texture_id];
+
+    texture->format = conv_texture_format(channels);
+    texture->width = width;
+    texture->height = height;
+    texture->channels = channels;
+    texture->compressed = false;
+
+    cache_bind_texture(0, texture->handle);
+
+    CHECK_GL(glTexImage2D(GL_TEXTURE_2D, 0, texture->format,
+        width, height, 0, texture->format,
+        GL_UNSIGNED_BYTE, NULL));
+
+    texture->dirty_mipmaps = texture->mipmapped;
+}
+
+static bool is_compressed_format_supported(int format)
+{
+    if ((format < 0) || (format >= LIBTQ_COMPRESSED_FORMAT_COUNT)) {
+        return false;
+    }
+
+    return priv.compressed_formats[format];
+}
+
+/**
+ * Replace texture storage with compressed data.
+ * Such texture can't be updated or mipmapped afterwards.
+ */
+static void upload_compressed_texture(int texture_id, int width, int height,
+    int format, void const *data, size_t size)
+{
+    if (!gl_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    if (!is_compressed_format_supported(format)) {
+        return;
+    }
+
+    flush_batch();
+
+    struct gl_texture *texture = &textures.data[texture_id];
+
+    texture->format = GL_RGBA;
+    texture->width = width;
+    texture->height = height;
+    texture->channels = 4;
+    texture->mipmapped = false;
+    texture->dirty_mipmaps = false;
+    texture->compressed = true;
+
+    cache_bind_texture(0, texture->handle);
+
+    CHECK_GL(glCompressedTexImage2D(GL_TEXTURE_2D, 0, conv_compressed_format(format),
+        width, height, 0, (GLsizei) size, data));
+
+    priv.stats.texture_upload_bytes += size;
+
+    apply_texture_filter(texture);
+}
+
+static void bind_texture(int texture_id)
+{
+    if (state.bound_texture_id == texture_id) {
+        return;
     }
 
+    // Texture is actually bound right before the next draw call.
+    flush_batch();
     state.bound_texture_id = texture_id;
 }
 
@@ -905,21 +2422,24 @@ static void bind_texture(int texture_id)
  */
 static int create_surface(int width, int height)
 {
+    flush_batch();
+
     struct gl_surface surface = {0};
 
     surface.samples = priv.antialiasing_level;
 
     CHECK_GL(glGenRenderbuffers(1, &surface.depth));
-    CHECK_GL(glBindRenderbuffer(GL_RENDERBUFFER, surface.depth));
+    cache_bind_renderbuffer(surface.depth);
     CHECK_GL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height));
 
     surface.texture_id = create_texture(width, height, LIBTQ_RGBA);
     set_texture_smooth(surface.texture_id, true);
+    cache_bind_texture(0, textures.data[surface.texture_id].handle);
     CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
     CHECK_GL(glGenFramebuffers(1, &surface.framebuffer));
-    CHECK_GL(glBindFramebuffer(GL_FRAMEBUFFER, surface.framebuffer));
+    cache_bind_framebuffer(GL_FRAMEBUFFER, surface.framebuffer);
 
     CHECK_GL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
         GL_RENDERBUFFER, surface.depth));
@@ -934,12 +2454,12 @@ static int create_surface(int width, int height)
 
     if (surface.samples > 1) {
         CHECK_GL(glGenRenderbuffers(1, &surface.ms_color_attachment));
-        CHECK_GL(glBindRenderbuffer(GL_RENDERBUFFER, surface.ms_color_attachment));
+        cache_bind_renderbuffer(surface.ms_color_attachment);
         CHECK_GL(glRenderbufferStorageMultisample(GL_RENDERBUFFER, surface.samples,
             GL_RGBA8, width, height));
 
         CHECK_GL(glGenFramebuffers(1, &surface.ms_framebuffer));
-        CHECK_GL(glBindFramebuffer(GL_FRAMEBUFFER, surface.ms_framebuffer));
+        cache_bind_framebuffer(GL_FRAMEBUFFER, surface.ms_framebuffer);
 
         CHECK_GL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
             GL_RENDERBUFFER, surface.ms_color_attachment));
@@ -952,8 +2472,13 @@ static int create_surface(int width, int height)
     }
 
     int surface_id = gl_surface_array_add(&surfaces, &surface);
+    textures.data[surface.texture_id].surface_id = surface_id;
 
+    // New surface stays bound and becomes the render target.
+    cache_set_viewport(0, 0, width, height);
     state.bound_surface_id = surface_id;
+    arm_pass_timer(surface_id);
+
     return surface_id;
 }
 
@@ -962,6 +2487,7 @@ static int create_surface(int width, int height)
  */
 static void delete_surface(int surface_id)
 {
+    flush_batch();
     gl_surface_array_remove(&surfaces, surface_id);
 }
 
@@ -988,43 +2514,43 @@ static void bind_surface(int surface_id)
         return;
     }
 
-    if (prev_surface_id != -1 && (surfaces.data[prev_surface_id].samples > 1)) {
-        GLuint prev_framebuffer = surfaces.data[prev_surface_id].framebuffer;
-        GLuint prev_ms_framebuffer = surfaces.data[prev_surface_id].ms_framebuffer;
+    flush_batch();
 
-        CHECK_GL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_framebuffer));
-        CHECK_GL(glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_ms_framebuffer));
+    priv.stats.surface_switches++;
 
-        int prev_width = textures.data[surfaces.data[prev_surface_id].texture_id].width;
-        int prev_height = textures.data[surfaces.data[prev_surface_id].texture_id].height;
+    // Multisampled surfaces are resolved later, when (and if)
+    // their textures are sampled.
+    // Depth buffer is never read, so its contents can be dropped
+    // instead of being written back to memory.
+    if (gl_surface_array_check(&surfaces, prev_surface_id) && priv.invalidate_supported) {
+        GLenum attachment = GL_DEPTH_ATTACHMENT;
 
-        CHECK_GL(glBlitFramebuffer(
-            0, 0, prev_width, prev_height,
-            0, 0, prev_width, prev_height,
-            GL_COLOR_BUFFER_BIT, GL_NEAREST
-        ));
+        if (surfaces.data[prev_surface_id].samples <= 1) {
+            // Surface creation may have bound another framebuffer since,
+            // and a deleted surface has nothing left to invalidate.
+            cache_bind_framebuffer(GL_FRAMEBUFFER, surfaces.data[prev_surface_id].framebuffer);
+            CHECK_GL(glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, &attachment));
+        }
     }
 
-    GLuint framebuffer;
+    end_timer_query();
+
+    GLuint framebuffer = get_surface_framebuffer(surface_id);
     tq_vec2i display_size;
 
     if (!gl_surface_array_check(&surfaces, surface_id)) {
-        framebuffer = 0;
         display_size = tq_get_display_size();
     } else {
-        if (surfaces.data[surface_id].samples > 1) {
-            framebuffer = surfaces.data[surface_id].ms_framebuffer;
-        } else {
-            framebuffer = surfaces.data[surface_id].framebuffer;
-        }
         display_size.x = textures.data[surfaces.data[surface_id].texture_id].width;
         display_size.y = textures.data[surfaces.data[surface_id].texture_id].height;
     }
 
-    CHECK_GL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
-    CHECK_GL(glViewport(0, 0, display_size.x, display_size.y));
+    cache_bind_framebuffer(GL_FRAMEBUFFER, framebuffer);
+    cache_set_viewport(0, 0, display_size.x, display_size.y);
 
     state.bound_surface_id = surface_id;
+
+    arm_pass_timer(surface_id);
 }
 
 static void set_clear_color(tq_color clear_color)
@@ -1035,15 +2561,11 @@ static void set_clear_color(tq_color clear_color)
 
 static void set_draw_color(tq_color draw_color)
 {
-    decode_color32(colors.draw, draw_color);
-
-    for (int i = 0; i < PROGRAM_COUNT; i++) {
-        programs[i].dirty_uniform_bits |= (1 << UNIFORM_COLOR);
-    }
-
-    if (state.program_id != -1) {
-        apply_uniforms();
-    }
+    // Draw color goes to vertices, so there is nothing to flush.
+    colors.draw[0] = draw_color.r;
+    colors.draw[1] = draw_color.g;
+    colors.draw[2] = draw_color.b;
+    colors.draw[3] = draw_color.a;
 }
 
 static void set_blend_mode(tq_blend_mode mode)
@@ -1052,93 +2574,197 @@ static void set_blend_mode(tq_blend_mode mode)
         return;
     }
 
-    CHECK_GL(glBlendFuncSeparate(
+    flush_batch();
+
+    cache_set_blend_func(
         conv_blend_factor(mode.color_src_factor),
         conv_blend_factor(mode.color_dst_factor),
         conv_blend_factor(mode.alpha_src_factor),
         conv_blend_factor(mode.alpha_dst_factor)
-    ));
+    );
 
-    CHECK_GL(glBlendEquationSeparate(
+    cache_set_blend_equation(
         conv_blend_equation(mode.color_equation),
         conv_blend_equation(mode.alpha_equation)
-    ));
+    );
 
     state.blend_mode = mode;
 }
 
 static void clear(void)
 {
+    flush_batch();
+    start_pass_timer();
+
+    // Previous contents of the surface are discarded anyway,
+    // so tell the driver not to load them.
+    if (state.bound_surface_id != -1 && priv.invalidate_supported) {
+        GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+        int count = (surfaces.data[state.bound_surface_id].samples > 1) ? 1 : 2;
+
+        CHECK_GL(glInvalidateFramebuffer(GL_FRAMEBUFFER, count, attachments));
+    }
+
+    touch_render_target();
     CHECK_GL(glClear(GL_COLOR_BUFFER_BIT));
 }
 
+static GLubyte const white[4] = { 255, 255, 255, 255 };
+
 static void draw_solid(int mode, float const *data, int num_vertices)
 {
-    set_vertex_format(VERTEX_FORMAT_SOLID);
-    set_program_id(PROGRAM_SOLID);
-
-    GLsizei offset = append_data_to_vbo(data, 2 * sizeof(float) * num_vertices);
-    GLint start = offset / sizeof(float) / 2;
-
-    CHECK_GL(glDrawArrays(conv_mode(mode), start, num_vertices));
+    append_primitive(VERTEX_FORMAT_SOLID, PROGRAM_COLORED, mode, data, num_vertices, colors.draw);
 }
 
 static void draw_colored(int mode, float const *data, int num_vertices)
 {
-    set_vertex_format(VERTEX_FORMAT_COLORED);
-    set_program_id(PROGRAM_COLORED);
-
-    GLsizei offset = append_data_to_vbo(data, 6 * sizeof(float) * num_vertices);
-    GLint start = offset / sizeof(float) / 6;
-
-    CHECK_GL(glDrawArrays(conv_mode(mode), start, num_vertices));
+    append_primitive(VERTEX_FORMAT_COLORED, PROGRAM_COLORED, mode, data, num_vertices, NULL);
 }
 
 static void draw_textured(int mode, float const *data, int num_vertices)
 {
-    set_vertex_format(VERTEX_FORMAT_TEXTURED);
-    set_program_id(PROGRAM_TEXTURED);
+    append_primitive(VERTEX_FORMAT_TEXTURED, PROGRAM_TEXTURED, mode, data, num_vertices, white);
+}
 
-    GLsizei offset = append_data_to_vbo(data, 4 * sizeof(float) * num_vertices);
-    GLint start = offset / sizeof(float) / 4;
+static void draw_quads(float const *data, int num_quads)
+{
+    append_quads(VERTEX_FORMAT_TEXTURED, PROGRAM_TEXTURED, data, num_quads, white);
+}
 
-    CHECK_GL(glDrawArrays(conv_mode(mode), start, num_vertices));
+static void draw_font(float const *data, int num_quads)
+{
+    append_quads(VERTEX_FORMAT_TEXTURED, PROGRAM_FONT, data, num_quads, colors.draw);
 }
 
-static void draw_font(float const *data, int num_vertices)
+/**
+ * Draw sprites with one instanced draw call per streaming buffer
+ * section: the per-instance data is uploaded as is.
+ */
+static void draw_sprites_instanced(tq_sprite_instance const *sprites, int count)
 {
-    set_vertex_format(VERTEX_FORMAT_TEXTURED);
-    set_program_id(PROGRAM_FONT);
+    flush_batch();
+
+    set_program_id(PROGRAM_SPRITE);
+    apply_texture();
+
+    cache_bind_vertex_array(priv.sprite_vao);
+
+    start_pass_timer();
+    touch_render_target();
 
-    GLsizei offset = append_data_to_vbo(data, 4 * sizeof(float) * num_vertices);
-    GLint start = offset / sizeof(float) / 4;
+    int max_count = priv.ring.section_size / sizeof(tq_sprite_instance);
 
-    CHECK_GL(glDrawArrays(GL_TRIANGLES, start, num_vertices));
+    while (count > 0) {
+        int n = TQ_MIN(count, max_count);
+
+        GLsizeiptr offset = write_to_ring(sprites, n * sizeof(tq_sprite_instance), sizeof(GLfloat));
+        set_sprite_pointers(offset);
+
+        CHECK_GL(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n));
+        priv.stats.batch_count++;
+        priv.stats.vertex_count += 4 * n;
+
+        sprites += n;
+        count -= n;
+    }
 }
 
+/**
+ * Copy the canvas surface to the default framebuffer.
+ * The canvas texture is expected to be bound, and the destination
+ * rectangle is given in normalized device coordinates.
+ */
 static void draw_canvas(float x0, float y0, float x1, float y1)
 {
-    CHECK_GL(glDisable(GL_BLEND));
-    CHECK_GL(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
-    CHECK_GL(glClear(GL_COLOR_BUFFER_BIT));
+    flush_batch();
 
-    set_vertex_format(VERTEX_FORMAT_TEXTURED);
-    set_program_id(PROGRAM_BACKBUF);
+    int texture_id = state.bound_texture_id;
 
-    float data[] = {
-        x0, y0, 0.0f, 0.0f,
-        x1, y0, 1.0f, 0.0f,
-        x1, y1, 1.0f, 1.0f,
-        x0, y1, 0.0f, 1.0f,
-    };
+    if (!gl_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    struct gl_texture *texture = &textures.data[texture_id];
 
-    GLsizei offset = append_data_to_vbo(data, 16 * sizeof(float));
-    GLint start = offset / sizeof(float) / 4;
+    if (!gl_surface_array_check(&surfaces, texture->surface_id)) {
+        return;
+    }
 
-    CHECK_GL(glDrawArrays(GL_TRIANGLE_FAN, start, 4));
+    begin_canvas_timer();
 
-    CHECK_GL(glEnable(GL_BLEND));
-    CHECK_GL(glClearColor(colors.clear[0], colors.clear[1], colors.clear[2], 1.0f));
+    tq_vec2i display_size = tq_get_display_size();
+
+    GLint dst_x0 = (GLint) (0.5f + (x0 + 1.0f) * 0.5f * display_size.x);
+    GLint dst_y0 = (GLint) (0.5f + (y0 + 1.0f) * 0.5f * display_size.y);
+    GLint dst_x1 = (GLint) (0.5f + (x1 + 1.0f) * 0.5f * display_size.x);
+    GLint dst_y1 = (GLint) (0.5f + (y1 + 1.0f) * 0.5f * display_size.y);
+
+    // Letterbox bars.
+    if (dst_x0 > 0 || dst_y0 > 0 || dst_x1 < display_size.x || dst_y1 < display_size.y) {
+        CHECK_GL(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
+        CHECK_GL(glClear(GL_COLOR_BUFFER_BIT));
+        CHECK_GL(glClearColor(colors.clear[0], colors.clear[1], colors.clear[2], 1.0f));
+    }
+
+    bool scaled = (dst_x1 - dst_x0 != texture->width) || (dst_y1 - dst_y0 != texture->height);
+
+    resolve_surface(texture->surface_id);
+
+    cache_bind_framebuffer(GL_READ_FRAMEBUFFER, surfaces.data[texture->surface_id].framebuffer);
+    cache_bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    CHECK_GL(glBlitFramebuffer(
+        0, 0, texture->width, texture->height,
+        dst_x0, dst_y0, dst_x1, dst_y1,
+        GL_COLOR_BUFFER_BIT, (scaled && texture->smooth) ? GL_LINEAR : GL_NEAREST
+    ));
+
+    cache_bind_framebuffer(GL_FRAMEBUFFER, 0);
+
+    end_timer_query();
+}
+
+/**
+ * Read contents of a surface (or the default framebuffer, if the id
+ * is invalid) as RGBA, bottom row first.
+ */
+static void read_pixels(int surface_id, unsigned char *pixels)
+{
+    flush_batch();
+
+    GLuint framebuffer = 0;
+    tq_vec2i size = tq_get_display_size();
+
+    if (gl_surface_array_check(&surfaces, surface_id)) {
+        struct gl_texture *texture = &textures.data[surfaces.data[surface_id].texture_id];
+
+        resolve_surface(surface_id);
+
+        framebuffer = surfaces.data[surface_id].framebuffer;
+        size.x = texture->width;
+        size.y = texture->height;
+    }
+
+    cache_bind_framebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    CHECK_GL(glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+}
+
+static void get_stats(tq_frame_stats *stats)
+{
+    stats->batch_count = priv.last_stats.batch_count;
+    stats->vertex_count = priv.last_stats.vertex_count;
+    stats->state_changes = priv.last_stats.state_changes;
+    stats->redundant_state_changes = priv.last_stats.redundant_state_changes;
+    stats->texture_binds = priv.last_stats.texture_binds;
+    stats->program_switches = priv.last_stats.program_switches;
+    stats->surface_switches = priv.last_stats.surface_switches;
+    stats->vertex_upload_bytes = priv.last_stats.vertex_upload_bytes;
+    stats->texture_upload_bytes = priv.last_stats.texture_upload_bytes;
+
+    stats->gpu_time = priv.gpu_stats.gpu_time;
+    stats->canvas_time = priv.gpu_stats.canvas_time;
+    stats->pass_count = priv.gpu_stats.pass_count;
+    memcpy(stats->passes, priv.gpu_stats.passes, sizeof(stats->passes));
 }
 
 //------------------------------------------------------------------------------
@@ -1164,8 +2790,14 @@ void tq_construct_gl_renderer(tq_renderer_impl *impl)
         .delete_texture = delete_texture,
         .is_texture_smooth = is_texture_smooth,
         .set_texture_smooth = set_texture_smooth,
+        .set_texture_mipmapped = set_texture_mipmapped,
         .get_texture_size = get_texture_size,
         .update_texture = update_texture,
+        .map_texture = map_texture,
+        .unmap_texture = unmap_texture,
+        .resize_texture = resize_texture,
+        .is_compressed_format_supported = is_compressed_format_supported,
+        .upload_compressed_texture = upload_compressed_texture,
         .bind_texture = bind_texture,
 
         .create_surface = create_surface,
@@ -1181,8 +2813,13 @@ void tq_construct_gl_renderer(tq_renderer_impl *impl)
         .draw_solid = draw_solid,
         .draw_colored = draw_colored,
         .draw_textured = draw_textured,
+        .draw_quads = draw_quads,
         .draw_font = draw_font,
+        .draw_sprites_instanced = draw_sprites_instanced,
         .draw_canvas = draw_canvas,
+        .read_pixels = read_pixels,
+
+        .get_stats = get_stats,
     };
 }
 
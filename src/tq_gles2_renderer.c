@@ -22,10 +22,12 @@
 
 //------------------------------------------------------------------------------
 
+#include <math.h>
 #include <string.h>
 
 #include <GLES2/gl2.h>
 
+#include "tq_compressed_image.h"
 #include "tq_core.h"
 #include "tq_graphics.h"
 #include "tq_handle_list.h"
@@ -35,6 +37,28 @@
 
 //------------------------------------------------------------------------------
 
+// Compressed formats aren't part of the core GLES2 headers.
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT     0x83F0
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT    0x83F1
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT    0x83F3
+#endif
+
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2             0x9274
+#endif
+
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC        0x9278
+#endif
+
 //------------------------------------------------------------------------------
 // OpenGL ES debug stuff
 
@@ -159,9 +183,24 @@ static char const *fs_src_font =
     "    gl_FragColor = vec4(1.0, 1.0, 1.0, alpha) * u_color;\n"
     "}\n";
 
+/**
+ * Tinted sprite fragment shader source code.
+ */
+static char const *fs_src_sprite =
+    "precision mediump float;\n"
+    "varying vec4 v_color;\n"
+    "varying vec2 v_texCoord;\n"
+    "uniform sampler2D u_texture;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(u_texture, v_texCoord) * v_color;\n"
+    "}\n";
+
 //------------------------------------------------------------------------------
 
-#define DEFAULT_VBO_SIZE            256
+#define STREAM_BUFFER_SIZE          (48 * 8192)     // divisible by all vertex sizes
+#define DEFAULT_BATCH_SIZE          1024
+#define MAX_BATCH_QUADS             16384           // limited by 16-bit indices
+#define MAX_TEXTURE_UNITS           4
 
 /**
  * Vertex attributes.
@@ -171,6 +210,7 @@ enum
     ATTRIB_POSITION,
     ATTRIB_COLOR,
     ATTRIB_TEXCOORD,
+    NUM_ATTRIBS,
 };
 
 /**
@@ -181,9 +221,25 @@ enum
     VERTEX_FORMAT_SOLID,        // (x, y)
     VERTEX_FORMAT_COLORED,      // (x, y), (r, g, b, a)
     VERTEX_FORMAT_TEXTURED,     // (x, y), (s, t)
+    VERTEX_FORMAT_SPRITE,       // (x, y), (s, t), (r, g, b, a)
     NUM_VERTEX_FORMATS,
 };
 
+/**
+ * Enabled vertex attributes of each vertex format.
+ */
+static unsigned int const vertex_attribs[NUM_VERTEX_FORMATS] = {
+    (1 << ATTRIB_POSITION),
+    (1 << ATTRIB_POSITION) | (1 << ATTRIB_COLOR),
+    (1 << ATTRIB_POSITION) | (1 << ATTRIB_TEXCOORD),
+    (1 << ATTRIB_POSITION) | (1 << ATTRIB_COLOR) | (1 << ATTRIB_TEXCOORD),
+};
+
+/**
+ * Number of floats per vertex of each vertex format.
+ */
+static int const vertex_sizes[NUM_VERTEX_FORMATS] = { 2, 6, 4, 8 };
+
 /**
  * Shader programs.
  */
@@ -193,6 +249,7 @@ enum
     PROGRAM_COLORED,
     PROGRAM_TEXTURED,
     PROGRAM_FONT,
+    PROGRAM_SPRITE,
     PROGRAM_BACKBUF,
     PROGRAM_COUNT,
 };
@@ -218,6 +275,9 @@ struct gles2_texture
     GLenum format;
     int channels;
     bool smooth;
+    bool mipmapped;
+    bool dirty_mipmaps;
+    bool compressed;            // storage can't be updated with pixels
 };
 
 DECLARE_FLEXIBLE_ARRAY(gles2_texture)
@@ -231,6 +291,34 @@ struct gles2_surface
 
 DECLARE_FLEXIBLE_ARRAY(gles2_surface)
 
+/**
+ * Consecutive draws that share the same state are accumulated
+ * in this batch and sent to OpenGL ES with a single draw call.
+ */
+struct gles2_batch
+{
+    int vertex_format;
+    int program_id;
+    GLenum mode;
+    bool indexed;           // quads drawn with the shared index buffer
+    GLfloat *data;
+    int size;               // number of floats in data
+    int capacity;
+    int num_vertices;
+};
+
+/**
+ * Streaming vertex buffer shared by all vertex formats.
+ * It's orphaned when it's full, so the driver never has to wait
+ * until previous draw calls are done with it.
+ */
+struct gles2_stream
+{
+    GLuint buffer;
+    GLsizeiptr size;
+    GLsizeiptr offset;      // write position
+};
+
 struct gles2_program
 {
     GLuint handle;
@@ -238,6 +326,25 @@ struct gles2_program
     int dirty_uniform_bits;
 };
 
+/**
+ * Shadow copy of OpenGL ES bindings and state. Everything goes
+ * through it, so redundant calls never reach the driver.
+ */
+struct gles2_cache
+{
+    GLuint framebuffer;
+    GLuint renderbuffer;
+    GLint viewport[4];
+    GLuint program;
+    GLuint array_buffer;
+    unsigned int attribs;           // bit mask of enabled vertex attributes
+    GLenum active_texture;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    bool blend;
+    GLenum blend_func[4];
+    GLenum blend_equation[2];
+};
+
 struct libtq_gles2_renderer_priv
 {
     int vertex_format;
@@ -257,6 +364,16 @@ struct libtq_gles2_renderer_priv
     struct gles2_surface_array surfaces;
 
     struct gles2_program programs[PROGRAM_COUNT];
+    struct gles2_cache cache;
+
+    GLuint quad_indices;            // static index buffer for quads
+    bool compressed_formats[LIBTQ_COMPRESSED_FORMAT_COUNT];
+
+    struct gles2_stream stream;
+    struct gles2_batch batch;
+
+    tq_frame_stats stats;           // current frame
+    tq_frame_stats last_stats;      // previous frame
 };
 
 //------------------------------------------------------------------------------
@@ -301,6 +418,27 @@ static GLenum conv_mode(int mode)
     return GL_INVALID_ENUM;
 }
 
+/**
+ * Get OpenGL ES internal format of compressed texture.
+ */
+static GLenum conv_compressed_format(int format)
+{
+    switch (format) {
+    case LIBTQ_BC1_RGB:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case LIBTQ_BC1_RGBA:
+        return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case LIBTQ_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case LIBTQ_ETC2_RGB:
+        return GL_COMPRESSED_RGB8_ETC2;
+    case LIBTQ_ETC2_RGBA:
+        return GL_COMPRESSED_RGBA8_ETC2_EAC;
+    }
+
+    return GL_INVALID_ENUM;
+}
+
 /**
  * Get OpenGL ES texture format.
  */
@@ -381,12 +519,250 @@ static GLenum conv_blend_equation(tq_blend_equation equation)
     return GL_INVALID_ENUM;
 }
 
+//------------------------------------------------------------------------------
+// Shadow state
+
+/**
+ * Update counters of state changes.
+ * Returns true if the change is redundant and should be skipped.
+ */
+static bool is_redundant(bool redundant)
+{
+    if (redundant) {
+        priv.stats.redundant_state_changes++;
+    } else {
+        priv.stats.state_changes++;
+    }
+
+    return redundant;
+}
+
+/**
+ * Reset shadow state to OpenGL ES defaults.
+ * Viewport is unknown until it's set for the first time.
+ */
+static void reset_cache(void)
+{
+    struct gles2_cache *cache = &priv.cache;
+
+    memset(cache, 0, sizeof(*cache));
+
+    cache->viewport[2] = -1;
+    cache->viewport[3] = -1;
+    cache->active_texture = GL_TEXTURE0;
+    cache->blend_func[0] = GL_ONE;
+    cache->blend_func[1] = GL_ZERO;
+    cache->blend_func[2] = GL_ONE;
+    cache->blend_func[3] = GL_ZERO;
+    cache->blend_equation[0] = GL_FUNC_ADD;
+    cache->blend_equation[1] = GL_FUNC_ADD;
+}
+
+static void cache_bind_framebuffer(GLuint framebuffer)
+{
+    if (is_redundant(priv.cache.framebuffer == framebuffer)) {
+        return;
+    }
+
+    CHECK_GLES2(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+    priv.cache.framebuffer = framebuffer;
+}
+
+static void cache_bind_renderbuffer(GLuint renderbuffer)
+{
+    if (is_redundant(priv.cache.renderbuffer == renderbuffer)) {
+        return;
+    }
+
+    CHECK_GLES2(glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer));
+    priv.cache.renderbuffer = renderbuffer;
+}
+
+static void cache_set_viewport(GLint x, GLint y, GLint width, GLint height)
+{
+    GLint *viewport = priv.cache.viewport;
+
+    if (is_redundant(viewport[0] == x && viewport[1] == y
+            && viewport[2] == width && viewport[3] == height)) {
+        return;
+    }
+
+    CHECK_GLES2(glViewport(x, y, width, height));
+
+    viewport[0] = x;
+    viewport[1] = y;
+    viewport[2] = width;
+    viewport[3] = height;
+}
+
+static void cache_use_program(GLuint program)
+{
+    if (is_redundant(priv.cache.program == program)) {
+        return;
+    }
+
+    CHECK_GLES2(glUseProgram(program));
+    priv.cache.program = program;
+
+    priv.stats.program_switches++;
+}
+
+static void cache_bind_array_buffer(GLuint buffer)
+{
+    if (is_redundant(priv.cache.array_buffer == buffer)) {
+        return;
+    }
+
+    CHECK_GLES2(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+    priv.cache.array_buffer = buffer;
+}
+
+/**
+ * Enable vertex attributes from the mask and disable the rest.
+ */
+static void cache_set_attribs(unsigned int attribs)
+{
+    for (int attrib = 0; attrib < NUM_ATTRIBS; attrib++) {
+        unsigned int bit = (1 << attrib);
+
+        if (is_redundant((priv.cache.attribs & bit) == (attribs & bit))) {
+            continue;
+        }
+
+        if (attribs & bit) {
+            CHECK_GLES2(glEnableVertexAttribArray(attrib));
+        } else {
+            CHECK_GLES2(glDisableVertexAttribArray(attrib));
+        }
+    }
+
+    priv.cache.attribs = attribs;
+}
+
+static void cache_bind_texture(GLuint unit, GLuint texture)
+{
+    struct gles2_cache *cache = &priv.cache;
+
+    if (is_redundant(cache->textures[unit] == texture)) {
+        return;
+    }
+
+    if (!is_redundant(cache->active_texture == GL_TEXTURE0 + unit)) {
+        CHECK_GLES2(glActiveTexture(GL_TEXTURE0 + unit));
+        cache->active_texture = GL_TEXTURE0 + unit;
+    }
+
+    CHECK_GLES2(glBindTexture(GL_TEXTURE_2D, texture));
+    cache->textures[unit] = texture;
+
+    priv.stats.texture_binds++;
+}
+
+static void cache_set_blend_enabled(bool enabled)
+{
+    if (is_redundant(priv.cache.blend == enabled)) {
+        return;
+    }
+
+    if (enabled) {
+        CHECK_GLES2(glEnable(GL_BLEND));
+    } else {
+        CHECK_GLES2(glDisable(GL_BLEND));
+    }
+
+    priv.cache.blend = enabled;
+}
+
+static void cache_set_blend_func(GLenum color_src, GLenum color_dst, GLenum alpha_src, GLenum alpha_dst)
+{
+    GLenum *func = priv.cache.blend_func;
+
+    if (is_redundant(func[0] == color_src && func[1] == color_dst
+            && func[2] == alpha_src && func[3] == alpha_dst)) {
+        return;
+    }
+
+    CHECK_GLES2(glBlendFuncSeparate(color_src, color_dst, alpha_src, alpha_dst));
+
+    func[0] = color_src;
+    func[1] = color_dst;
+    func[2] = alpha_src;
+    func[3] = alpha_dst;
+}
+
+static void cache_set_blend_equation(GLenum color_equation, GLenum alpha_equation)
+{
+    GLenum *equation = priv.cache.blend_equation;
+
+    if (is_redundant(equation[0] == color_equation && equation[1] == alpha_equation)) {
+        return;
+    }
+
+    CHECK_GLES2(glBlendEquationSeparate(color_equation, alpha_equation));
+
+    equation[0] = color_equation;
+    equation[1] = alpha_equation;
+}
+
+/**
+ * Deleting a bound object resets its binding to zero,
+ * so the shadow state should forget about it too.
+ */
+static void cache_delete_texture(GLuint texture)
+{
+    for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        if (priv.cache.textures[unit] == texture) {
+            priv.cache.textures[unit] = 0;
+        }
+    }
+
+    CHECK_GLES2(glDeleteTextures(1, &texture));
+}
+
+static void cache_delete_framebuffer(GLuint framebuffer)
+{
+    if (priv.cache.framebuffer == framebuffer) {
+        priv.cache.framebuffer = 0;
+    }
+
+    CHECK_GLES2(glDeleteFramebuffers(1, &framebuffer));
+}
+
+static void cache_delete_renderbuffer(GLuint renderbuffer)
+{
+    if (priv.cache.renderbuffer == renderbuffer) {
+        priv.cache.renderbuffer = 0;
+    }
+
+    CHECK_GLES2(glDeleteRenderbuffers(1, &renderbuffer));
+}
+
+static void cache_delete_buffer(GLuint buffer)
+{
+    if (priv.cache.array_buffer == buffer) {
+        priv.cache.array_buffer = 0;
+    }
+
+    CHECK_GLES2(glDeleteBuffers(1, &buffer));
+}
+
+static void cache_delete_program(GLuint program)
+{
+    if (priv.cache.program == program) {
+        priv.cache.program = 0;
+    }
+
+    CHECK_GLES2(glDeleteProgram(program));
+}
+
+//------------------------------------------------------------------------------
+
 /**
  * Texture array item destructor.
  */
 static void gles2_texture_dtor(struct gles2_texture *texture)
 {
-    CHECK_GLES2(glDeleteTextures(1, &texture->handle));
+    cache_delete_texture(texture->handle);
 }
 
 /**
@@ -394,8 +770,8 @@ static void gles2_texture_dtor(struct gles2_texture *texture)
  */
 static void gles2_surface_dtor(struct gles2_surface *surface)
 {
-    CHECK_GLES2(glDeleteFramebuffers(1, &surface->framebuffer));
-    CHECK_GLES2(glDeleteRenderbuffers(1, &surface->depth));
+    cache_delete_framebuffer(surface->framebuffer);
+    cache_delete_renderbuffer(surface->depth);
     gles2_texture_array_remove(&priv.textures, surface->texture_id);
 }
 
@@ -475,49 +851,79 @@ static void set_vertex_format(int vertex_format)
     }
 
     priv.vertex_format = vertex_format;
-
-    switch (vertex_format) {
-    case VERTEX_FORMAT_SOLID:
-        CHECK_GLES2(glEnableVertexAttribArray(ATTRIB_POSITION));
-        CHECK_GLES2(glDisableVertexAttribArray(ATTRIB_COLOR));
-        CHECK_GLES2(glDisableVertexAttribArray(ATTRIB_TEXCOORD));
-        break;
-    case VERTEX_FORMAT_COLORED:
-        CHECK_GLES2(glEnableVertexAttribArray(ATTRIB_POSITION));
-        CHECK_GLES2(glEnableVertexAttribArray(ATTRIB_COLOR));
-        CHECK_GLES2(glDisableVertexAttribArray(ATTRIB_TEXCOORD));
-        break;
-    case VERTEX_FORMAT_TEXTURED:
-        CHECK_GLES2(glEnableVertexAttribArray(ATTRIB_POSITION));
-        CHECK_GLES2(glDisableVertexAttribArray(ATTRIB_COLOR));
-        CHECK_GLES2(glEnableVertexAttribArray(ATTRIB_TEXCOORD));
-        break;
-    }
+    cache_set_attribs(vertex_attribs[vertex_format]);
 }
 
 /**
- * Set vertex pointers according to the current vertex format.
+ * Point vertex attributes of the current vertex format
+ * to the given offset in the streaming buffer.
+ * There is no base vertex in OpenGL ES 2.0, so this is done
+ * before each draw call.
  */
-static void set_vertex_pointers(float const *data)
+static void set_vertex_pointers(GLsizeiptr offset)
 {
+    GLsizei stride = vertex_sizes[priv.vertex_format] * sizeof(GLfloat);
+    GLfloat const *data = (GLfloat const *) offset;
+
+    cache_bind_array_buffer(priv.stream.buffer);
+
     switch (priv.vertex_format) {
     case VERTEX_FORMAT_SOLID:
         CHECK_GLES2(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
-            2 * sizeof(GLfloat), data));
+            stride, data));
         break;
     case VERTEX_FORMAT_COLORED:
         CHECK_GLES2(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
-            6 * sizeof(GLfloat), data));
+            stride, data));
         CHECK_GLES2(glVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE,
-            6 * sizeof(GLfloat), data + 2));
+            stride, data + 2));
         break;
     case VERTEX_FORMAT_TEXTURED:
         CHECK_GLES2(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
-            4 * sizeof(GLfloat), data));
+            stride, data));
         CHECK_GLES2(glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE,
-            4 * sizeof(GLfloat), data + 2));
+            stride, data + 2));
         break;
+    case VERTEX_FORMAT_SPRITE:
+        CHECK_GLES2(glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
+            stride, data));
+        CHECK_GLES2(glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE,
+            stride, data + 2));
+        CHECK_GLES2(glVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE,
+            stride, data + 4));
+        break;
+    }
+}
+
+/**
+ * Copy vertex data to the streaming buffer.
+ * Returns offset of the data in the buffer.
+ */
+static GLsizeiptr write_to_stream(void const *data, GLsizeiptr size)
+{
+    struct gles2_stream *stream = &priv.stream;
+
+    cache_bind_array_buffer(stream->buffer);
+
+    if ((stream->offset + size) > stream->size) {
+        while (stream->size < size) {
+            stream->size *= 2;
+        }
+
+        // Orphan the buffer: the driver will give us fresh storage
+        // while the old one is still used by pending draw calls.
+        CHECK_GLES2(glBufferData(GL_ARRAY_BUFFER, stream->size, NULL, GL_STREAM_DRAW));
+        stream->offset = 0;
     }
+
+    GLsizeiptr offset = stream->offset;
+
+    CHECK_GLES2(glBufferSubData(GL_ARRAY_BUFFER, offset, size, data));
+    stream->offset += size;
+
+    priv.stats.vertex_upload_bytes += size;
+
+    return offset;
 }
 
 /**
@@ -557,11 +963,11 @@ static void set_program_id(int program_id)
     priv.program_id = program_id;
 
     if (program_id == -1) {
-        CHECK_GLES2(glUseProgram(0));
+        cache_use_program(0);
         return;
     }
 
-    CHECK_GLES2(glUseProgram(priv.programs[program_id].handle));
+    cache_use_program(priv.programs[program_id].handle);
 
     if (priv.programs[program_id].dirty_uniform_bits) {
         apply_uniforms();
@@ -583,10 +989,229 @@ static void set_dirty_uniform(int program_id, int uniform_id)
     }
 }
 
+/**
+ * OpenGL ES 2.0 doesn't support mipmaps for NPOT textures,
+ * such textures are sampled from the base level only.
+ */
+static bool has_mipmaps(struct gles2_texture const *texture)
+{
+    if (!texture->mipmapped) {
+        return false;
+    }
+
+    return ((texture->width & (texture->width - 1)) == 0)
+        && ((texture->height & (texture->height - 1)) == 0);
+}
+
+/**
+ * Bind the current texture, if it's not bound yet.
+ */
+static void apply_texture(void)
+{
+    int texture_id = priv.texture_id;
+
+    if (!gles2_texture_array_check(&priv.textures, texture_id)) {
+        cache_bind_texture(0, 0);
+        return;
+    }
+
+    struct gles2_texture *texture = &priv.textures.data[texture_id];
+
+    cache_bind_texture(0, texture->handle);
+
+    // Mip levels are rebuilt lazily, right before sampling.
+    if (texture->dirty_mipmaps) {
+        if (has_mipmaps(texture)) {
+            CHECK_GLES2(glGenerateMipmap(GL_TEXTURE_2D));
+        }
+
+        texture->dirty_mipmaps = false;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Batching
+
+/**
+ * Send accumulated vertices to OpenGL ES.
+ * Should be called before any change of the state
+ * the pending batch depends on.
+ */
+static void flush_batch(void)
+{
+    struct gles2_batch *batch = &priv.batch;
+
+    if (batch->num_vertices == 0) {
+        return;
+    }
+
+    set_vertex_format(batch->vertex_format);
+    set_program_id(batch->program_id);
+
+    if (batch->program_id != PROGRAM_SOLID && batch->program_id != PROGRAM_COLORED) {
+        apply_texture();
+    }
+
+    set_vertex_pointers(write_to_stream(batch->data, batch->size * sizeof(GLfloat)));
+
+    if (batch->indexed) {
+        CHECK_GLES2(glDrawElements(batch->mode, 6 * (batch->num_vertices / 4),
+            GL_UNSIGNED_SHORT, (void *) 0));
+    } else {
+        CHECK_GLES2(glDrawArrays(batch->mode, 0, batch->num_vertices));
+    }
+
+    priv.stats.batch_count++;
+    priv.stats.vertex_count += batch->num_vertices;
+
+    batch->size = 0;
+    batch->num_vertices = 0;
+}
+
+/**
+ * Reserve space for vertices in the batch, flushing it first
+ * if it was started with different parameters.
+ */
+static GLfloat *reserve_batch(int vertex_format, int program_id, GLenum mode, bool indexed, int num_vertices)
+{
+    struct gles2_batch *batch = &priv.batch;
+
+    if (batch->num_vertices > 0) {
+        if (batch->vertex_format != vertex_format
+                || batch->program_id != program_id
+                || batch->mode != mode
+                || batch->indexed != indexed) {
+            flush_batch();
+        } else if (indexed && (batch->num_vertices + num_vertices) > 4 * MAX_BATCH_QUADS) {
+            flush_batch();
+        }
+    }
+
+    int required_size = batch->size + vertex_sizes[vertex_format] * num_vertices;
+
+    // Keep the batch small enough to fit in the streaming buffer.
+    if (batch->num_vertices > 0) {
+        if ((GLsizeiptr) (required_size * sizeof(GLfloat)) > priv.stream.size) {
+            flush_batch();
+            required_size = vertex_sizes[vertex_format] * num_vertices;
+        }
+    }
+
+    batch->vertex_format = vertex_format;
+    batch->program_id = program_id;
+    batch->mode = mode;
+    batch->indexed = indexed;
+
+    if (batch->capacity < required_size) {
+        int next_capacity = batch->capacity;
+
+        while (next_capacity < required_size) {
+            next_capacity *= 2;
+        }
+
+        GLfloat *next_data = libtq_realloc(batch->data, next_capacity * sizeof(GLfloat));
+
+        if (!next_data) {
+            libtq_out_of_memory();
+        }
+
+        batch->data = next_data;
+        batch->capacity = next_capacity;
+    }
+
+    GLfloat *dst = batch->data + batch->size;
+
+    batch->size = required_size;
+    batch->num_vertices += num_vertices;
+
+    return dst;
+}
+
+/**
+ * Append a primitive to the batch.
+ * Strips, loops and fans can't be merged, so they are converted
+ * to independent lines and triangles.
+ */
+static void append_primitive(int vertex_format, int program_id, int mode, float const *data, int num_vertices)
+{
+    int stride = vertex_sizes[vertex_format];
+    size_t vertex_size = stride * sizeof(GLfloat);
+
+    GLfloat *dst;
+
+    switch (mode) {
+    case TQ_PRIMITIVE_POINTS:
+        if (num_vertices < 1) {
+            return;
+        }
+
+        dst = reserve_batch(vertex_format, program_id, GL_POINTS, false, num_vertices);
+        memcpy(dst, data, num_vertices * vertex_size);
+        break;
+    case TQ_PRIMITIVE_LINE_STRIP:
+    case TQ_PRIMITIVE_LINE_LOOP:
+        if (num_vertices < 2) {
+            return;
+        }
+
+        int num_lines = (mode == TQ_PRIMITIVE_LINE_LOOP) ? num_vertices : (num_vertices - 1);
+        dst = reserve_batch(vertex_format, program_id, GL_LINES, false, 2 * num_lines);
+
+        for (int i = 0; i < num_lines; i++) {
+            memcpy(dst, data + stride * i, vertex_size);
+            memcpy(dst + stride, data + stride * ((i + 1) % num_vertices), vertex_size);
+            dst += 2 * stride;
+        }
+        break;
+    case TQ_PRIMITIVE_TRIANGLES:
+        if (num_vertices < 3) {
+            return;
+        }
+
+        dst = reserve_batch(vertex_format, program_id, GL_TRIANGLES, false, num_vertices);
+        memcpy(dst, data, num_vertices * vertex_size);
+        break;
+    case TQ_PRIMITIVE_TRIANGLE_FAN:
+        if (num_vertices < 3) {
+            return;
+        }
+
+        dst = reserve_batch(vertex_format, program_id, GL_TRIANGLES, false, 3 * (num_vertices - 2));
+
+        for (int i = 1; i < num_vertices - 1; i++) {
+            memcpy(dst, data, vertex_size);
+            memcpy(dst + stride, data + stride * i, 2 * vertex_size);
+            dst += 3 * stride;
+        }
+        break;
+    }
+}
+
+/**
+ * Append quads to the batch. Each quad consists of 4 vertices
+ * which are drawn as two triangles: (0, 1, 2) and (0, 2, 3).
+ */
+static void append_quads(int vertex_format, int program_id, float const *data, int num_quads)
+{
+    int quad_size = 4 * vertex_sizes[vertex_format];
+
+    while (num_quads > 0) {
+        int count = TQ_MIN(num_quads, MAX_BATCH_QUADS);
+
+        GLfloat *dst = reserve_batch(vertex_format, program_id, GL_TRIANGLES, true, 4 * count);
+        memcpy(dst, data, count * quad_size * sizeof(GLfloat));
+
+        data += count * quad_size;
+        num_quads -= count;
+    }
+}
+
 //------------------------------------------------------------------------------
 
 static void initialize(void)
 {
+    reset_cache();
+
     mat4_identity(priv.projection);
     mat4_identity(priv.model_view);
 
@@ -596,17 +1221,60 @@ static void initialize(void)
     priv.vertex_format = -1;
     priv.program_id = -1;
 
+    GLushort *quad_indices = libtq_malloc(6 * MAX_BATCH_QUADS * sizeof(GLushort));
+
+    if (!quad_indices) {
+        libtq_out_of_memory();
+    }
+
+    for (int i = 0; i < MAX_BATCH_QUADS; i++) {
+        quad_indices[6 * i + 0] = 4 * i + 0;
+        quad_indices[6 * i + 1] = 4 * i + 1;
+        quad_indices[6 * i + 2] = 4 * i + 2;
+        quad_indices[6 * i + 3] = 4 * i + 0;
+        quad_indices[6 * i + 4] = 4 * i + 2;
+        quad_indices[6 * i + 5] = 4 * i + 3;
+    }
+
+    // Without vertex array objects, element array buffer binding
+    // is global, so it's bound once and stays bound.
+    CHECK_GLES2(glGenBuffers(1, &priv.quad_indices));
+    CHECK_GLES2(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv.quad_indices));
+    CHECK_GLES2(glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * MAX_BATCH_QUADS * sizeof(GLushort),
+        quad_indices, GL_STATIC_DRAW));
+
+    libtq_free(quad_indices);
+
+    priv.stream.size = STREAM_BUFFER_SIZE;
+    priv.stream.offset = 0;
+
+    CHECK_GLES2(glGenBuffers(1, &priv.stream.buffer));
+    cache_bind_array_buffer(priv.stream.buffer);
+    CHECK_GLES2(glBufferData(GL_ARRAY_BUFFER, priv.stream.size, NULL, GL_STREAM_DRAW));
+
+    priv.batch.data = libtq_malloc(DEFAULT_BATCH_SIZE * sizeof(GLfloat));
+
+    if (!priv.batch.data) {
+        libtq_out_of_memory();
+    }
+
+    priv.batch.size = 0;
+    priv.batch.capacity = DEFAULT_BATCH_SIZE;
+    priv.batch.num_vertices = 0;
+
     GLuint vs_standard = compile_shader(GL_VERTEX_SHADER, vs_src_standard);
     GLuint vs_backbuf = compile_shader(GL_VERTEX_SHADER, vs_src_backbuf);
     GLuint fs_solid = compile_shader(GL_FRAGMENT_SHADER, fs_src_solid);
     GLuint fs_colored = compile_shader(GL_FRAGMENT_SHADER, fs_src_colored);
     GLuint fs_textured = compile_shader(GL_FRAGMENT_SHADER, fs_src_textured);
     GLuint fs_font = compile_shader(GL_FRAGMENT_SHADER, fs_src_font);
+    GLuint fs_sprite = compile_shader(GL_FRAGMENT_SHADER, fs_src_sprite);
 
     priv.programs[PROGRAM_SOLID].handle = link_program(vs_standard, fs_solid);
     priv.programs[PROGRAM_COLORED].handle = link_program(vs_standard, fs_colored);
     priv.programs[PROGRAM_TEXTURED].handle = link_program(vs_standard, fs_textured);
     priv.programs[PROGRAM_FONT].handle = link_program(vs_standard, fs_font);
+    priv.programs[PROGRAM_SPRITE].handle = link_program(vs_standard, fs_sprite);
     priv.programs[PROGRAM_BACKBUF].handle = link_program(vs_backbuf, fs_textured);
 
     for (int i = 0; i < PROGRAM_COUNT; i++) {
@@ -623,6 +1291,7 @@ static void initialize(void)
     glDeleteShader(fs_solid);
     glDeleteShader(fs_textured);
     glDeleteShader(fs_font);
+    glDeleteShader(fs_sprite);
 
     priv.texture_id = -1;
     priv.surface_id = -1;
@@ -632,15 +1301,26 @@ static void initialize(void)
      * Reset OpenGL state.
      */
 
-    CHECK_GLES2(glEnable(GL_BLEND));
-    CHECK_GLES2(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
-    CHECK_GLES2(glBlendEquation(GL_FUNC_ADD));
+    cache_set_blend_enabled(true);
+    cache_set_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    cache_set_blend_equation(GL_FUNC_ADD, GL_FUNC_ADD);
 
     CHECK_GLES2(glDisable(GL_CULL_FACE));
     CHECK_GLES2(glDisable(GL_DEPTH_TEST));
 
     CHECK_GLES2(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
 
+    // ETC2 is mandatory since OpenGL ES 3.0.
+    char const *version = (char const *) glGetString(GL_VERSION);
+    bool es3 = version && (strncmp(version, "OpenGL ES 3", 11) == 0);
+    bool s3tc = libtq_check_gl_ext("GL_EXT_texture_compression_s3tc");
+
+    priv.compressed_formats[LIBTQ_BC1_RGB] = s3tc;
+    priv.compressed_formats[LIBTQ_BC1_RGBA] = s3tc;
+    priv.compressed_formats[LIBTQ_BC3] = s3tc;
+    priv.compressed_formats[LIBTQ_ETC2_RGB] = es3;
+    priv.compressed_formats[LIBTQ_ETC2_RGBA] = es3;
+
     /**
      * Initialization is done.
      */
@@ -654,20 +1334,28 @@ static void initialize(void)
 static void terminate(void)
 {
     for (int i = 0; i < PROGRAM_COUNT; i++) {
-        CHECK_GLES2(glDeleteProgram(priv.programs[i].handle));
+        cache_delete_program(priv.programs[i].handle);
     }
 
     gles2_surface_array_terminate(&priv.surfaces);
     gles2_texture_array_terminate(&priv.textures);
+
+    cache_delete_buffer(priv.stream.buffer);
+    CHECK_GLES2(glDeleteBuffers(1, &priv.quad_indices));
+
+    libtq_free(priv.batch.data);
 }
 
 static void process(void)
 {
+    flush_batch();
     CHECK_GLES2(glFlush());
 }
 
 static void post_process(void)
 {
+    priv.last_stats = priv.stats;
+    memset(&priv.stats, 0, sizeof(priv.stats));
 }
 
 static int request_antialiasing_level(int level)
@@ -677,6 +1365,7 @@ static int request_antialiasing_level(int level)
 
 static void update_projection(float const *mat4)
 {
+    flush_batch();
     mat4_copy(priv.projection, mat4);
 
     for (int i = 0; i < PROGRAM_COUNT; i++) {
@@ -692,6 +1381,7 @@ static void update_model_view(float const *mat3)
     // (Note 2: OpenGL's own matrices are not used here, since I handle
     //  this in the "tq::graphics" module independently of renderer).
 
+    flush_batch();
     mat4_expand(priv.model_view, mat3);
 
     for (int i = 0; i < PROGRAM_COUNT; i++) {
@@ -716,8 +1406,10 @@ static int create_texture(int width, int height, int channels)
         return -1;
     }
 
+    flush_batch();
+
     CHECK_GLES2(glGenTextures(1, &texture.handle));
-    CHECK_GLES2(glBindTexture(GL_TEXTURE_2D, texture.handle));
+    cache_bind_texture(0, texture.handle);
 
     CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
     CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
@@ -730,18 +1422,39 @@ static int create_texture(int width, int height, int channels)
     texture.height = height;
     texture.channels = channels;
     texture.smooth = false;
+    texture.mipmapped = false;
+    texture.dirty_mipmaps = false;
+    texture.compressed = false;
 
-    int texture_id = gles2_texture_array_add(&priv.textures, &texture);
-    priv.texture_id = texture_id;
-
-    return texture_id;
+    return gles2_texture_array_add(&priv.textures, &texture);
 }
 
 static void delete_texture(int texture_id)
 {
+    flush_batch();
     gles2_texture_array_remove(&priv.textures, texture_id);
 }
 
+/**
+ * Set filtering parameters according to texture flags.
+ * Trilinear filtering is used for smooth mipmapped textures.
+ */
+static void apply_texture_filter(struct gles2_texture *texture)
+{
+    GLenum min_filter;
+    GLenum mag_filter = texture->smooth ? GL_LINEAR : GL_NEAREST;
+
+    if (has_mipmaps(texture)) {
+        min_filter = texture->smooth ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST;
+    } else {
+        min_filter = mag_filter;
+    }
+
+    cache_bind_texture(0, texture->handle);
+    CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter));
+    CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter));
+}
+
 static bool is_texture_smooth(int texture_id)
 {
     if (!gles2_texture_array_check(&priv.textures, texture_id)) {
@@ -761,12 +1474,32 @@ static void set_texture_smooth(int texture_id, bool smooth)
         return;
     }
 
-    CHECK_GLES2(glBindTexture(GL_TEXTURE_2D, priv.textures.data[texture_id].handle));
-    CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, smooth ? GL_LINEAR : GL_NEAREST));
-    CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, smooth ? GL_LINEAR : GL_NEAREST));
+    flush_batch();
 
     priv.textures.data[texture_id].smooth = smooth;
-    priv.texture_id = texture_id;
+    apply_texture_filter(&priv.textures.data[texture_id]);
+}
+
+static void set_texture_mipmapped(int texture_id, bool mipmapped)
+{
+    if (!gles2_texture_array_check(&priv.textures, texture_id)) {
+        return;
+    }
+
+    if (priv.textures.data[texture_id].mipmapped == mipmapped) {
+        return;
+    }
+
+    // Mipmaps can't be generated for compressed textures.
+    if (priv.textures.data[texture_id].compressed) {
+        return;
+    }
+
+    flush_batch();
+
+    priv.textures.data[texture_id].mipmapped = mipmapped;
+    priv.textures.data[texture_id].dirty_mipmaps = mipmapped;
+    apply_texture_filter(&priv.textures.data[texture_id]);
 }
 
 static void get_texture_size(int texture_id, int *width, int *height)
@@ -787,52 +1520,163 @@ static void update_texture(int texture_id, int x_offset, int y_offset, int width
         return;
     }
 
+    if (priv.textures.data[texture_id].compressed) {
+        return;
+    }
+
+    flush_batch();
+
     struct gles2_texture *texture = &priv.textures.data[texture_id];
 
-    CHECK_GLES2(glBindTexture(GL_TEXTURE_2D, texture->handle));
+    cache_bind_texture(0, texture->handle);
 
     if (x_offset == 0 && y_offset == 0 && width == -1 && height == -1) {
         CHECK_GLES2(glTexImage2D(GL_TEXTURE_2D, 0, texture->format,
             texture->width, texture->height, 0,
             texture->format, GL_UNSIGNED_BYTE, pixels));
+
+        width = texture->width;
+        height = texture->height;
     } else {
         CHECK_GLES2(glTexSubImage2D(GL_TEXTURE_2D, 0, x_offset, y_offset, width, height,
             texture->format, GL_UNSIGNED_BYTE, pixels));
     }
 
-    priv.texture_id = texture_id;
+    if (pixels) {
+        priv.stats.texture_upload_bytes += (long) width * height * texture->channels;
+    }
+
+    texture->dirty_mipmaps = texture->mipmapped;
 }
 
-static void bind_texture(int texture_id)
+/**
+ * GLES2 has no pixel unpack buffers, callers use update_texture().
+ */
+static unsigned char *map_texture(int texture_id, int x_offset, int y_offset, int width, int height)
 {
-    if (priv.texture_id == texture_id) {
+    return NULL;
+}
+
+static void unmap_texture(void)
+{
+}
+
+/**
+ * Reallocate texture storage with new size and format.
+ * Contents become undefined.
+ */
+static void resize_texture(int texture_id, int width, int height, int channels)
+{
+    if (!gles2_texture_array_check(&priv.textures, texture_id)) {
+        return;
+    }
+
+    GLenum format = conv_texture_format(channels);
+
+    if ((width < 0) || (height < 0) || (format == GL_INVALID_ENUM)) {
         return;
     }
 
+    flush_batch();
+
+    struct gles2_texture *texture = &priv.textures.data[texture_id];
+
+    texture->format = format;
+    texture->width = width;
+    texture->height = height;
+    texture->channels = channels;
+    texture->compressed = false;
+
+    cache_bind_texture(0, texture->handle);
+
+    CHECK_GLES2(glTexImage2D(GL_TEXTURE_2D, 0, texture->format,
+        width, height, 0, texture->format,
+        GL_UNSIGNED_BYTE, NULL));
+
+    // New size may make mipmaps (un)available.
+    if (texture->mipmapped) {
+        texture->dirty_mipmaps = true;
+        apply_texture_filter(texture);
+    }
+}
+
+static bool is_compressed_format_supported(int format)
+{
+    if ((format < 0) || (format >= LIBTQ_COMPRESSED_FORMAT_COUNT)) {
+        return false;
+    }
+
+    return priv.compressed_formats[format];
+}
+
+/**
+ * Replace texture storage with compressed data.
+ * Such texture can't be updated or mipmapped afterwards.
+ */
+static void upload_compressed_texture(int texture_id, int width, int height,
+    int format, void const *data, size_t size)
+{
     if (!gles2_texture_array_check(&priv.textures, texture_id)) {
-        CHECK_GLES2(glBindTexture(GL_TEXTURE_2D, 0));
-    } else {
-        CHECK_GLES2(glBindTexture(GL_TEXTURE_2D, priv.textures.data[texture_id].handle));
+        return;
+    }
+
+    if (!is_compressed_format_supported(format)) {
+        return;
+    }
+
+    flush_batch();
+
+    struct gles2_texture *texture = &priv.textures.data[texture_id];
+
+    texture->format = GL_RGBA;
+    texture->width = width;
+    texture->height = height;
+    texture->channels = 4;
+    texture->mipmapped = false;
+    texture->dirty_mipmaps = false;
+    texture->compressed = true;
+
+    cache_bind_texture(0, texture->handle);
+
+    CHECK_GLES2(glCompressedTexImage2D(GL_TEXTURE_2D, 0, conv_compressed_format(format),
+        width, height, 0, (GLsizei) size, data));
+
+    priv.stats.texture_upload_bytes += size;
+
+    apply_texture_filter(texture);
+}
+
+/**
+ * Texture is actually bound right before the next draw call.
+ */
+static void bind_texture(int texture_id)
+{
+    if (priv.texture_id == texture_id) {
+        return;
     }
 
+    flush_batch();
     priv.texture_id = texture_id;
 }
 
 static int create_surface(int width, int height)
 {
+    flush_batch();
+
     struct gles2_surface surface = {0};
 
     CHECK_GLES2(glGenRenderbuffers(1, &surface.depth));
-    CHECK_GLES2(glBindRenderbuffer(GL_RENDERBUFFER, surface.depth));
+    cache_bind_renderbuffer(surface.depth);
     CHECK_GLES2(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height));
 
     surface.texture_id = create_texture(width, height, LIBTQ_RGBA);
     set_texture_smooth(surface.texture_id, true);
+    cache_bind_texture(0, priv.textures.data[surface.texture_id].handle);
     CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     CHECK_GLES2(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
     CHECK_GLES2(glGenFramebuffers(1, &surface.framebuffer));
-    CHECK_GLES2(glBindFramebuffer(GL_FRAMEBUFFER, surface.framebuffer));
+    cache_bind_framebuffer(surface.framebuffer);
 
     CHECK_GLES2(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
         GL_RENDERBUFFER, surface.depth));
@@ -847,12 +1691,16 @@ static int create_surface(int width, int height)
 
     int surface_id = gles2_surface_array_add(&priv.surfaces, &surface);
 
+    // New surface stays bound and becomes the render target.
+    cache_set_viewport(0, 0, width, height);
     priv.surface_id = surface_id;
+
     return surface_id;
 }
 
 static void delete_surface(int surface_id)
 {
+    flush_batch();
     gles2_surface_array_remove(&priv.surfaces, surface_id);
 }
 
@@ -873,6 +1721,17 @@ static void bind_surface(int surface_id)
         return;
     }
 
+    flush_batch();
+
+    priv.stats.surface_switches++;
+
+    if (gles2_surface_array_check(&priv.surfaces, prev_surface_id)) {
+        // Contents of the surface have changed.
+        struct gles2_texture *prev_texture =
+            &priv.textures.data[priv.surfaces.data[prev_surface_id].texture_id];
+        prev_texture->dirty_mipmaps = prev_texture->mipmapped;
+    }
+
     struct gles2_surface *surface = &priv.surfaces.data[surface_id];
 
     GLuint framebuffer;
@@ -887,8 +1746,8 @@ static void bind_surface(int surface_id)
         display_size.y = priv.textures.data[surface->texture_id].height;
     }
 
-    CHECK_GLES2(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
-    CHECK_GLES2(glViewport(0, 0, display_size.x, display_size.y));
+    cache_bind_framebuffer(framebuffer);
+    cache_set_viewport(0, 0, display_size.x, display_size.y);
 
     priv.surface_id = surface_id;
 }
@@ -907,7 +1766,17 @@ static void set_clear_color(tq_color color)
 
 static void set_draw_color(tq_color color)
 {
-    decode_color32(priv.draw_color, color);
+    GLfloat draw_color[4];
+    decode_color32(draw_color, color);
+
+    // Draw color is set before every primitive, so don't break
+    // the batch if it stays the same.
+    if (memcmp(priv.draw_color, draw_color, sizeof(draw_color)) == 0) {
+        return;
+    }
+
+    flush_batch();
+    memcpy(priv.draw_color, draw_color, sizeof(draw_color));
 
     for (int i = 0; i < PROGRAM_COUNT; i++) {
         priv.programs[i].dirty_uniform_bits |= (1 << UNIFORM_COLOR);
@@ -924,71 +1793,113 @@ static void set_blend_mode(tq_blend_mode mode)
         return;
     }
 
-    CHECK_GLES2(glBlendFuncSeparate(
+    flush_batch();
+
+    cache_set_blend_func(
         conv_blend_factor(mode.color_src_factor),
         conv_blend_factor(mode.color_dst_factor),
         conv_blend_factor(mode.alpha_src_factor),
         conv_blend_factor(mode.alpha_dst_factor)
-    ));
+    );
 
-    CHECK_GLES2(glBlendEquationSeparate(
+    cache_set_blend_equation(
         conv_blend_equation(mode.color_equation),
         conv_blend_equation(mode.alpha_equation)
-    ));
+    );
 
     priv.blend_mode = mode;
 }
 
 static void clear(void)
 {
+    flush_batch();
     CHECK_GLES2(glClear(GL_COLOR_BUFFER_BIT));
 }
 
 static void draw_solid(int mode, float const *data, int num_vertices)
 {
-    set_vertex_format(VERTEX_FORMAT_SOLID);
-    set_vertex_pointers(data);
-    set_program_id(PROGRAM_SOLID);
-
-    CHECK_GLES2(glDrawArrays(conv_mode(mode), 0, num_vertices));
+    append_primitive(VERTEX_FORMAT_SOLID, PROGRAM_SOLID, mode, data, num_vertices);
 }
 
 static void draw_colored(int mode, float const *data, int num_vertices)
 {
-    set_vertex_format(VERTEX_FORMAT_COLORED);
-    set_vertex_pointers(data);
-    set_program_id(PROGRAM_COLORED);
-
-    CHECK_GLES2(glDrawArrays(conv_mode(mode), 0, num_vertices));
+    append_primitive(VERTEX_FORMAT_COLORED, PROGRAM_COLORED, mode, data, num_vertices);
 }
 
 static void draw_textured(int mode, float const *data, int num_vertices)
 {
-    set_vertex_format(VERTEX_FORMAT_TEXTURED);
-    set_vertex_pointers(data);
-    set_program_id(PROGRAM_TEXTURED);
+    append_primitive(VERTEX_FORMAT_TEXTURED, PROGRAM_TEXTURED, mode, data, num_vertices);
+}
 
-    CHECK_GLES2(glDrawArrays(conv_mode(mode), 0, num_vertices));
+static void draw_quads(float const *data, int num_quads)
+{
+    append_quads(VERTEX_FORMAT_TEXTURED, PROGRAM_TEXTURED, data, num_quads);
 }
 
-static void draw_font(float const *data, int num_vertices)
+static void draw_font(float const *data, int num_quads)
 {
-    set_vertex_format(VERTEX_FORMAT_TEXTURED);
-    set_vertex_pointers(data);
-    set_program_id(PROGRAM_FONT);
+    append_quads(VERTEX_FORMAT_TEXTURED, PROGRAM_FONT, data, num_quads);
+}
 
-    CHECK_GLES2(glDrawArrays(GL_TRIANGLES, 0, num_vertices));
+/**
+ * There is no instancing in OpenGL ES 2.0, so sprites are
+ * expanded to quads right into the batch.
+ */
+static void draw_sprites_instanced(tq_sprite_instance const *sprites, int count)
+{
+    while (count > 0) {
+        int n = TQ_MIN(count, MAX_BATCH_QUADS);
+        GLfloat *v = reserve_batch(VERTEX_FORMAT_SPRITE, PROGRAM_SPRITE, GL_TRIANGLES, true, 4 * n);
+
+        for (int i = 0; i < n; i++) {
+            tq_sprite_instance const *sprite = &sprites[i];
+
+            float c = cosf(RADIANS(sprite->rotation));
+            float s = sinf(RADIANS(sprite->rotation));
+
+            float hw = 0.5f * sprite->dst.w;
+            float hh = 0.5f * sprite->dst.h;
+            float cx = sprite->dst.x + hw;
+            float cy = sprite->dst.y + hh;
+
+            GLfloat color[4];
+            decode_color32(color, sprite->tint);
+
+            for (int k = 0; k < 4; k++) {
+                float u = (k == 1 || k == 2) ? 1.0f : 0.0f;
+                float t = (k >= 2) ? 1.0f : 0.0f;
+
+                float dx = (2.0f * u - 1.0f) * hw;
+                float dy = (2.0f * t - 1.0f) * hh;
+
+                *v++ = cx + c * dx - s * dy;
+                *v++ = cy + s * dx + c * dy;
+                *v++ = sprite->uv.x + u * sprite->uv.w;
+                *v++ = sprite->uv.y + t * sprite->uv.h;
+                *v++ = color[0];
+                *v++ = color[1];
+                *v++ = color[2];
+                *v++ = color[3];
+            }
+        }
+
+        sprites += n;
+        count -= n;
+    }
 }
 
 static void draw_canvas(float x0, float y0, float x1, float y1)
 {
-    CHECK_GLES2(glDisable(GL_BLEND));
+    flush_batch();
+
+    cache_set_blend_enabled(false);
 
     CHECK_GLES2(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
     CHECK_GLES2(glClear(GL_COLOR_BUFFER_BIT));
 
     set_vertex_format(VERTEX_FORMAT_TEXTURED);
     set_program_id(PROGRAM_BACKBUF);
+    apply_texture();
 
     float data[] = {
         x0, y0, 0.0f, 0.0f,
@@ -997,11 +1908,13 @@ static void draw_canvas(float x0, float y0, float x1, float y1)
         x0, y1, 0.0f, 1.0f,
     };
 
-    set_vertex_pointers(data);
+    set_vertex_pointers(write_to_stream(data, sizeof(data)));
 
     CHECK_GLES2(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+    priv.stats.batch_count++;
+    priv.stats.vertex_count += 4;
 
-    CHECK_GLES2(glEnable(GL_BLEND));
+    cache_set_blend_enabled(true);
     CHECK_GLES2(glClearColor(
         priv.clear_color[0],
         priv.clear_color[1],
@@ -1010,6 +1923,45 @@ static void draw_canvas(float x0, float y0, float x1, float y1)
     ));
 }
 
+/**
+ * Read contents of a surface (or the default framebuffer, if the id
+ * is invalid) as RGBA, bottom row first.
+ */
+static void read_pixels(int surface_id, unsigned char *pixels)
+{
+    flush_batch();
+
+    GLuint framebuffer = 0;
+    tq_vec2i size = tq_get_display_size();
+
+    if (gles2_surface_array_check(&priv.surfaces, surface_id)) {
+        struct gles2_surface *surface = &priv.surfaces.data[surface_id];
+
+        framebuffer = surface->framebuffer;
+        size.x = priv.textures.data[surface->texture_id].width;
+        size.y = priv.textures.data[surface->texture_id].height;
+    }
+
+    GLuint bound_framebuffer = priv.cache.framebuffer;
+
+    cache_bind_framebuffer(framebuffer);
+    CHECK_GLES2(glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+    cache_bind_framebuffer(bound_framebuffer);
+}
+
+static void get_stats(tq_frame_stats *stats)
+{
+    stats->batch_count = priv.last_stats.batch_count;
+    stats->vertex_count = priv.last_stats.vertex_count;
+    stats->state_changes = priv.last_stats.state_changes;
+    stats->redundant_state_changes = priv.last_stats.redundant_state_changes;
+    stats->texture_binds = priv.last_stats.texture_binds;
+    stats->program_switches = priv.last_stats.program_switches;
+    stats->surface_switches = priv.last_stats.surface_switches;
+    stats->vertex_upload_bytes = priv.last_stats.vertex_upload_bytes;
+    stats->texture_upload_bytes = priv.last_stats.texture_upload_bytes;
+}
+
 //------------------------------------------------------------------------------
 // Module constructor
 
@@ -1030,8 +1982,14 @@ void tq_construct_gles2_renderer(tq_renderer_impl *impl)
         .delete_texture = delete_texture,
         .is_texture_smooth = is_texture_smooth,
         .set_texture_smooth = set_texture_smooth,
+        .set_texture_mipmapped = set_texture_mipmapped,
         .get_texture_size = get_texture_size,
         .update_texture = update_texture,
+        .map_texture = map_texture,
+        .unmap_texture = unmap_texture,
+        .resize_texture = resize_texture,
+        .is_compressed_format_supported = is_compressed_format_supported,
+        .upload_compressed_texture = upload_compressed_texture,
         .bind_texture = bind_texture,
 
         .create_surface = create_surface,
@@ -1047,8 +2005,13 @@ void tq_construct_gles2_renderer(tq_renderer_impl *impl)
         .draw_solid = draw_solid,
         .draw_colored = draw_colored,
         .draw_textured = draw_textured,
+        .draw_quads = draw_quads,
         .draw_font = draw_font,
+        .draw_sprites_instanced = draw_sprites_instanced,
         .draw_canvas = draw_canvas,
+        .read_pixels = read_pixels,
+
+        .get_stats = get_stats,
     };
 }
 
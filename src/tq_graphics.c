@@ -19,20 +19,30 @@
 //------------------------------------------------------------------------------
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "tq_atlas.h"
+#include "tq_command_buffer.h"
+#include "tq_compressed_image.h"
 #include "tq_core.h"
+#include "tq_draw_list.h"
 #include "tq_error.h"
 #include "tq_graphics.h"
 #include "tq_math.h"
 #include "tq_mem.h"
+#include "tq_profiler.h"
 #include "tq_log.h"
 #include "tq_stream.h"
+#include "tq_surface_pool.h"
 #include "tq_text.h"
+#include "tq_texture_loader.h"
+#include "tq_trace.h"
 
 //------------------------------------------------------------------------------
 
 #define MAX_MATRICES 32
+#define SPRITE_CHUNK_SIZE 256
 
 enum
 {
@@ -64,6 +74,19 @@ struct graphics
     int canvas_width;
     int canvas_height;
     float canvas_aspect_ratio;
+    bool canvas_smooth;
+    bool direct_canvas;
+};
+
+/**
+ * Ring of recent frame times in milliseconds.
+ */
+struct frame_times
+{
+    float samples[TQ_FRAME_TIME_WINDOW];
+    int count;
+    int next;
+    double last_time;
 };
 
 struct tq_graphics_priv
@@ -73,17 +96,54 @@ struct tq_graphics_priv
     bool color_key_enabled;
     tq_color color_key;
     int antialiasing_level;
+    bool cpu_transform;
+    bool requested_cpu_transform;
+    bool mipmaps_enabled;
+    tq_blend_mode blend_mode;
+    tq_renderer_type renderer_type;
+    char trace_path[256];
 };
 
-static struct graphics graphics;
+static struct graphics graphics = {
+    .canvas_surface_id = -1,
+    .canvas_smooth = true,
+};
 static struct tq_renderer_impl renderer;
 static struct matrices matrices;
 static struct color colors[COLOR_COUNT];
+static struct frame_times frame_times;
 static struct tq_graphics_priv priv;
 
 //------------------------------------------------------------------------------
 // Utility functions
 
+/**
+ * Time between two calls of this function is the frame time.
+ */
+static void record_frame_time(void)
+{
+    double time = tq_get_time_highp();
+
+    if (frame_times.last_time > 0.0) {
+        frame_times.samples[frame_times.next] = (float) ((time - frame_times.last_time) * 1000.0);
+        frame_times.next = (frame_times.next + 1) % TQ_FRAME_TIME_WINDOW;
+
+        if (frame_times.count < TQ_FRAME_TIME_WINDOW) {
+            frame_times.count++;
+        }
+    }
+
+    frame_times.last_time = time;
+}
+
+static int compare_floats(void const *a, void const *b)
+{
+    float x = *(float const *) a;
+    float y = *(float const *) b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
 static void make_projection(float *dst, float x, float y, float w, float h, float rotation)
 {
     float left      = x - (w / 2.0f);
@@ -123,6 +183,25 @@ static float *make_circle(float x, float y, float radius, int count)
     return data;
 }
 
+static bool is_identity(float const *mat3)
+{
+    return mat3[0] == 1.0f && mat3[1] == 0.0f && mat3[2] == 0.0f
+        && mat3[3] == 0.0f && mat3[4] == 1.0f && mat3[5] == 0.0f;
+}
+
+/**
+ * Send the current model-view matrix to the renderer, unless
+ * vertices are transformed on the CPU.
+ */
+static void upload_model_view(void)
+{
+    if (priv.cpu_transform) {
+        return;
+    }
+
+    renderer.update_model_view(matrices.model_view[matrices.current_model_view]);
+}
+
 static float const *get_inverse_projection(void)
 {
     if (matrices.dirty_inverse_projection) {
@@ -133,38 +212,197 @@ static float const *get_inverse_projection(void)
     return matrices.inverse_projection;
 }
 
+/**
+ * Create texture from compressed data, which is uploaded as is.
+ */
+static int create_compressed_texture(libtq_compressed_image const *compressed)
+{
+    int texture_id = renderer.create_texture(1, 1, LIBTQ_RGBA);
+
+    if (texture_id == -1) {
+        return -1;
+    }
+
+    renderer.upload_compressed_texture(texture_id, compressed->width, compressed->height,
+        compressed->format, compressed->data, compressed->size);
+
+    return texture_id;
+}
+
 static int load_texture(libtq_stream *stream)
 {
     libtq_image *image;
 
-    if (priv.color_key_enabled) {
-        image = libtq_load_image_with_key(stream, priv.color_key);
+    if (libtq_is_compressed_image(stream)) {
+        // Color key isn't applied to compressed textures.
+        libtq_compressed_image *compressed = libtq_load_compressed_image(stream);
+        libtq_stream_close(stream);
+
+        if (!compressed) {
+            return -1;
+        }
+
+        if (renderer.is_compressed_format_supported(compressed->format)) {
+            int texture_id = create_compressed_texture(compressed);
+            libtq_free(compressed);
+            return texture_id;
+        }
+
+        image = libtq_decompress_image(compressed);
+        libtq_free(compressed);
     } else {
-        image = libtq_load_image(stream);
-    }
+        if (priv.color_key_enabled) {
+            image = libtq_load_image_with_key(stream, priv.color_key);
+        } else {
+            image = libtq_load_image(stream);
+        }
 
-    libtq_stream_close(stream);
+        libtq_stream_close(stream);
+    }
 
     if (!image) {
         return -1;
     }
 
-    int texture_id = renderer.create_texture(image->width, image->height, image->channels);
+    int texture_id = tq_add_image_to_atlas(image);
 
     if (texture_id == -1) {
-        libtq_free(image);
-        return -1;
+        texture_id = renderer.create_texture(image->width, image->height, image->channels);
+
+        if (texture_id == -1) {
+            libtq_free(image);
+            return -1;
+        }
+
+        renderer.update_texture(texture_id, 0, 0, -1, -1, image->pixels);
     }
 
-    renderer.update_texture(texture_id, 0, 0, -1, -1, image->pixels);
     libtq_free(image);
 
+    if (priv.mipmaps_enabled) {
+        tq_set_texture_mipmapped((tq_texture) { texture_id }, true);
+    }
+
     return texture_id;
 }
 
+/**
+ * Get renderer texture that should be bound to draw the texture,
+ * and the region of it in normalized coordinates.
+ * Only atlased textures differ from renderer ones.
+ */
+static int resolve_texture(int texture_id, tq_rectf *uv)
+{
+    int page_texture_id;
+
+    if (tq_get_atlas_region(texture_id, &page_texture_id, uv)) {
+        return page_texture_id;
+    }
+
+    *uv = (tq_rectf) { 0.0f, 0.0f, 1.0f, 1.0f };
+
+    return texture_id;
+}
+
+/**
+ * Canvas surface is needed unless direct drawing is enabled.
+ * Even then, it's needed if the canvas has to be scaled or antialiased.
+ * Otherwise everything is drawn straight to the display.
+ */
+static bool is_canvas_surface_needed(void)
+{
+    tq_vec2i display_size = tq_get_display_size();
+
+    return !graphics.direct_canvas
+        || graphics.canvas_width != display_size.x
+        || graphics.canvas_height != display_size.y
+        || priv.antialiasing_level > 1;
+}
+
+/**
+ * Create or delete the canvas surface if it's (not) needed anymore.
+ * Surface id -1 means that the canvas is the display itself.
+ */
+static void update_canvas_surface(void)
+{
+    bool needed = is_canvas_surface_needed();
+
+    if (needed == (graphics.canvas_surface_id != -1)) {
+        return;
+    }
+
+    if (!needed) {
+        tq_release_pooled_surface(graphics.canvas_surface_id);
+        graphics.canvas_surface_id = -1;
+        return;
+    }
+
+    graphics.canvas_surface_id = tq_acquire_pooled_surface(
+        graphics.canvas_width,
+        graphics.canvas_height,
+        priv.antialiasing_level
+    );
+
+    int texture_id = renderer.get_surface_texture_id(graphics.canvas_surface_id);
+    renderer.set_texture_smooth(texture_id, graphics.canvas_smooth);
+}
+
+/**
+ * Copy the canvas surface to the display, keeping its aspect ratio.
+ */
+static void present_canvas(void)
+{
+    int canvas_texture_id = renderer.get_surface_texture_id(graphics.canvas_surface_id);
+
+    renderer.bind_surface(-1);
+    renderer.bind_texture(canvas_texture_id);
+
+    float canvas_aspect_ratio = graphics.canvas_aspect_ratio;
+    float display_aspect_ratio = libtq_get_display_aspect_ratio();
+
+    float x0, x1, y0, y1;
+
+    if (display_aspect_ratio > graphics.canvas_aspect_ratio) {
+        x0 = -(canvas_aspect_ratio / display_aspect_ratio);
+        x1 = +(canvas_aspect_ratio / display_aspect_ratio);
+        y0 = -1.0f;
+        y1 = +1.0f;
+    } else {
+        x0 = -1.0f;
+        x1 = +1.0f;
+        y0 = -(display_aspect_ratio / canvas_aspect_ratio);
+        y1 = +(display_aspect_ratio / canvas_aspect_ratio);
+    }
+
+    renderer.draw_canvas(x0, y0, x1, y1);
+}
+
 //------------------------------------------------------------------------------
 
-void tq_initialize_graphics(void)
+/**
+ * Pick renderer type from the TQ_RENDERER environment variable.
+ */
+static tq_renderer_type get_env_renderer_type(void)
+{
+    char const *value = getenv("TQ_RENDERER");
+
+    if (!value) {
+        return TQ_RENDERER_DEFAULT;
+    }
+
+    if (strcmp(value, "opengl") == 0) {
+        return TQ_RENDERER_OPENGL;
+    } else if (strcmp(value, "software") == 0) {
+        return TQ_RENDERER_SOFTWARE;
+    } else if (strcmp(value, "null") == 0) {
+        return TQ_RENDERER_NULL;
+    }
+
+    libtq_log(LIBTQ_LOG_WARNING, "Unknown TQ_RENDERER value: %s\n", value);
+    return TQ_RENDERER_DEFAULT;
+}
+
+static void construct_default_renderer(void)
 {
 #if defined(TQ_ANDROID) || defined(TQ_EMSCRIPTEN) || defined(TQ_USE_GLES2)
     tq_construct_gles2_renderer(&renderer);
@@ -173,6 +411,49 @@ void tq_initialize_graphics(void)
 #else
     tq_construct_null_renderer(&renderer);
 #endif
+}
+
+/**
+ * Renderer type selected by the user or the environment.
+ * Displays use it to decide whether to create a GL context.
+ */
+tq_renderer_type tq_get_renderer_type(void)
+{
+    if (priv.renderer_type == TQ_RENDERER_DEFAULT) {
+        return get_env_renderer_type();
+    }
+
+    return priv.renderer_type;
+}
+
+/**
+ * Read the default framebuffer, rows bottom-up.
+ * Used by displays that present the software renderer output.
+ */
+void tq_read_display_pixels(unsigned char *pixels)
+{
+    renderer.read_pixels(-1, pixels);
+}
+
+void tq_initialize_graphics(void)
+{
+    switch (tq_get_renderer_type()) {
+    case TQ_RENDERER_SOFTWARE:
+        tq_construct_soft_renderer(&renderer);
+        break;
+    case TQ_RENDERER_NULL:
+        tq_construct_null_renderer(&renderer);
+        break;
+    default:
+        construct_default_renderer();
+        break;
+    }
+
+    char const *trace_path = priv.trace_path[0] ? priv.trace_path : getenv("TQ_TRACE");
+
+    if (trace_path && trace_path[0]) {
+        tq_begin_trace_recording(&renderer, trace_path);
+    }
 
     tq_vec2i display_size = tq_get_display_size();
 
@@ -197,8 +478,13 @@ void tq_initialize_graphics(void)
     tq_set_draw_color(tq_c24(0, 255, 255));
     tq_set_outline_color(tq_c24(255, 0, 255));
 
+    memset(&frame_times, 0, sizeof(frame_times));
+
+    priv.blend_mode = TQ_BLEND_MODE_ALPHA;
     priv.ready = true;
 
+    tq_initialize_command_buffers();
+
     if (priv.active_rc > 0) {
         tq_on_rc_create(priv.active_rc);
     }
@@ -206,48 +492,54 @@ void tq_initialize_graphics(void)
 
 void tq_terminate_graphics(void)
 {
+    tq_end_draw_list();
+    tq_terminate_draw_list();
+    tq_terminate_command_buffers();
+
     if (priv.active_rc > 0) {
         tq_on_rc_destroy();
     }
 
+    tq_end_trace_recording(&renderer);
+
     priv.ready = false;
 }
 
 void tq_process_graphics(void)
 {
-    renderer.process();
+    TQ_PROFILE_BEGIN("tq_process_graphics");
 
-    int canvas_texture_id = renderer.get_surface_texture_id(graphics.canvas_surface_id);
+    record_frame_time();
 
-    renderer.bind_surface(-1);
-    renderer.bind_texture(canvas_texture_id);
+    // Command buffers are replayed before the draw list is
+    // submitted, so they are sorted along with it.
+    tq_replay_command_buffers(priv.blend_mode);
 
-    float canvas_aspect_ratio = graphics.canvas_aspect_ratio;
-    float display_aspect_ratio = libtq_get_display_aspect_ratio();
+    tq_end_draw_list();
+    tq_process_texture_loader();
 
-    float x0, x1, y0, y1;
+    TQ_PROFILE_BEGIN("renderer.process");
+    renderer.process();
+    TQ_PROFILE_END();
 
-    if (display_aspect_ratio > graphics.canvas_aspect_ratio) {
-        x0 = -(canvas_aspect_ratio / display_aspect_ratio);
-        x1 = +(canvas_aspect_ratio / display_aspect_ratio);
-        y0 = -1.0f;
-        y1 = +1.0f;
-    } else {
-        x0 = -1.0f;
-        x1 = +1.0f;
-        y0 = -(display_aspect_ratio / canvas_aspect_ratio);
-        y1 = +(display_aspect_ratio / canvas_aspect_ratio);
+    if (graphics.canvas_surface_id != -1) {
+        present_canvas();
     }
 
-    renderer.draw_canvas(x0, y0, x1, y1);
+    // Display may have been resized during this frame.
+    update_canvas_surface();
+    tq_process_surface_pool();
+
     renderer.bind_surface(graphics.canvas_surface_id);
 
     mat3_identity(matrices.model_view[0]);
-    renderer.update_model_view(matrices.model_view[0]);
-
     matrices.current_model_view = 0;
 
+    upload_model_view();
+
     renderer.post_process();
+
+    TQ_PROFILE_END();
 }
 
 tq_vec2i tq_conv_display_coord(tq_vec2i coord)
@@ -299,8 +591,80 @@ void tq_set_antialiasing_level(int level)
     }
 }
 
+void tq_set_renderer_type(tq_renderer_type type)
+{
+    if (priv.ready) {
+        libtq_log(LIBTQ_LOG_WARNING, "tq_set_renderer_type() should be called before tq_initialize().\n");
+        return;
+    }
+
+    priv.renderer_type = type;
+}
+
+void tq_set_trace_path(char const *path)
+{
+    if (priv.ready) {
+        libtq_log(LIBTQ_LOG_WARNING, "tq_set_trace_path() should be called before tq_initialize().\n");
+        return;
+    }
+
+    strncpy(priv.trace_path, path, sizeof(priv.trace_path) - 1);
+}
+
+void tq_set_cpu_transform_enabled(bool enabled)
+{
+    if (tq_is_draw_list_recording()) {
+        priv.requested_cpu_transform = enabled;
+        return;
+    }
+
+    if (priv.cpu_transform == enabled) {
+        return;
+    }
+
+    priv.cpu_transform = enabled;
+
+    if (priv.active_rc == 0) {
+        return;
+    }
+
+    if (enabled) {
+        float identity[9];
+        mat3_identity(identity);
+
+        renderer.update_model_view(identity);
+    } else {
+        upload_model_view();
+    }
+}
+
+bool tq_is_cpu_transform_enabled(void)
+{
+    if (tq_is_draw_list_recording()) {
+        return priv.requested_cpu_transform;
+    }
+
+    return priv.cpu_transform;
+}
+
+void tq_set_mipmaps_enabled(bool enabled)
+{
+    priv.mipmaps_enabled = enabled;
+}
+
+void tq_set_texture_atlas_threshold(int size)
+{
+    tq_set_atlas_threshold(size);
+}
+
+void tq_set_texture_atlas_padding(int padding)
+{
+    tq_set_atlas_padding(padding);
+}
+
 void tq_set_blend_mode(tq_blend_mode mode)
 {
+    priv.blend_mode = mode;
     renderer.set_blend_mode(mode);
 }
 
@@ -338,23 +702,60 @@ void tq_set_canvas_size(tq_vec2i size)
     graphics.canvas_aspect_ratio = (float) size.x / (float) size.y;
 
     if (priv.ready && priv.active_rc > 0) {
-        renderer.delete_surface(graphics.canvas_surface_id);
-        graphics.canvas_surface_id = renderer.create_surface(size.x, size.y);
+        if (graphics.canvas_surface_id != -1) {
+            tq_release_pooled_surface(graphics.canvas_surface_id);
+            graphics.canvas_surface_id = -1;
+        }
+
+        update_canvas_surface();
+        renderer.bind_surface(graphics.canvas_surface_id);
     }
 
     make_default_projection(matrices.default_projection, size.x, size.y);
 }
 
+void tq_set_direct_canvas_enabled(bool enabled)
+{
+    graphics.direct_canvas = enabled;
+}
+
+bool tq_is_direct_canvas_enabled(void)
+{
+    return graphics.direct_canvas;
+}
+
 bool tq_is_canvas_smooth(void)
 {
-    int texture_id = renderer.get_surface_texture_id(graphics.canvas_surface_id);
-    return renderer.is_texture_smooth(texture_id);
+    return graphics.canvas_smooth;
 }
 
 void tq_set_canvas_smooth(bool smooth)
 {
-    int texture_id = renderer.get_surface_texture_id(graphics.canvas_surface_id);
-    renderer.set_texture_smooth(texture_id, smooth);
+    graphics.canvas_smooth = smooth;
+
+    if (graphics.canvas_surface_id != -1) {
+        int texture_id = renderer.get_surface_texture_id(graphics.canvas_surface_id);
+        renderer.set_texture_smooth(texture_id, smooth);
+    }
+}
+
+void tq_read_canvas_pixels(unsigned char *pixels)
+{
+    renderer.read_pixels(graphics.canvas_surface_id, pixels);
+
+    // Renderers return rows bottom-up, flip them in place.
+    size_t pitch = graphics.canvas_width * 4;
+
+    for (int y = 0; y < graphics.canvas_height / 2; y++) {
+        unsigned char *a = pixels + y * pitch;
+        unsigned char *b = pixels + (graphics.canvas_height - y - 1) * pitch;
+
+        for (size_t x = 0; x < pitch; x++) {
+            unsigned char t = a[x];
+            a[x] = b[x];
+            b[x] = t;
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -408,7 +809,7 @@ void tq_push_matrix(void)
     mat3_copy(matrices.model_view[index + 1], matrices.model_view[index]);
 
     matrices.current_model_view++;
-    renderer.update_model_view(matrices.model_view[matrices.current_model_view]);
+    upload_model_view();
 }
 
 void tq_pop_matrix(void)
@@ -418,28 +819,28 @@ void tq_pop_matrix(void)
     }
 
     matrices.current_model_view--;
-    renderer.update_model_view(matrices.model_view[matrices.current_model_view]);
+    upload_model_view();
 }
 
 void tq_translate_matrix(tq_vec2f v)
 {
     int index = matrices.current_model_view;
     mat3_translate(matrices.model_view[index], v.x, v.y);
-    renderer.update_model_view(matrices.model_view[index]);
+    upload_model_view();
 }
 
 void tq_scale_matrix(tq_vec2f v)
 {
     int index = matrices.current_model_view;
     mat3_scale(matrices.model_view[index], v.x, v.y);
-    renderer.update_model_view(matrices.model_view[index]);
+    upload_model_view();
 }
 
 void tq_rotate_matrix(float degrees)
 {
     int index = matrices.current_model_view;
     mat3_rotate(matrices.model_view[index], RADIANS(degrees));
-    renderer.update_model_view(matrices.model_view[index]);
+    upload_model_view();
 }
 
 void tq_translate_matrix_f(float x, float y)
@@ -465,6 +866,8 @@ void tq_draw_point(tq_vec2f position)
         position.x, position.y,
     };
 
+    tq_transform_vertices(data, 1, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_POINTS, data, 1);
 }
@@ -476,6 +879,8 @@ void tq_draw_line(tq_vec2f a, tq_vec2f b)
         b.x, b.y,
     };
 
+    tq_transform_vertices(data, 2, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_LINE_STRIP, data, 2);
 }
@@ -488,6 +893,8 @@ void tq_draw_triangle(tq_vec2f a, tq_vec2f b, tq_vec2f c)
         c.x, c.y,
     };
 
+    tq_transform_vertices(data, 3, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_TRIANGLE_FAN, data, 3);
 
@@ -504,6 +911,8 @@ void tq_draw_rectangle(tq_rectf rect)
         rect.x,             rect.y + rect.h,
     };
 
+    tq_transform_vertices(data, 4, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_TRIANGLE_FAN, data, 4);
 
@@ -520,6 +929,8 @@ void tq_draw_circle(tq_vec2f position, float radius)
         return;
     }
 
+    tq_transform_vertices(data, precision, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_TRIANGLE_FAN, data, precision - 1);
 
@@ -537,6 +948,8 @@ void tq_outline_triangle(tq_vec2f a, tq_vec2f b, tq_vec2f c)
         c.x, c.y,
     };
 
+    tq_transform_vertices(data, 3, 2);
+
     renderer.set_draw_color(colors[COLOR_OUTLINE].value);
     renderer.draw_solid(TQ_PRIMITIVE_LINE_LOOP, data, 3);
 }
@@ -550,6 +963,8 @@ void tq_outline_rectangle(tq_rectf rect)
         rect.x,             rect.y + rect.h,
     };
 
+    tq_transform_vertices(data, 4, 2);
+
     renderer.set_draw_color(colors[COLOR_OUTLINE].value);
     renderer.draw_solid(TQ_PRIMITIVE_LINE_LOOP, data, 4);
 }
@@ -563,6 +978,8 @@ void tq_outline_circle(tq_vec2f position, float radius)
         return;
     }
 
+    tq_transform_vertices(data, precision, 2);
+
     renderer.set_draw_color(colors[COLOR_OUTLINE].value);
     renderer.draw_solid(TQ_PRIMITIVE_LINE_LOOP, data, precision);
 
@@ -577,6 +994,8 @@ void tq_fill_triangle(tq_vec2f a, tq_vec2f b, tq_vec2f c)
         c.x, c.y,
     };
 
+    tq_transform_vertices(data, 3, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_TRIANGLE_FAN, data, 3);
 }
@@ -590,6 +1009,8 @@ void tq_fill_rectangle(tq_rectf rect)
         rect.x,             rect.y + rect.h,
     };
 
+    tq_transform_vertices(data, 4, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_TRIANGLE_FAN, data, 4);
 }
@@ -603,6 +1024,8 @@ void tq_fill_circle(tq_vec2f position, float radius)
         return;
     }
 
+    tq_transform_vertices(data, precision - 1, 2);
+
     renderer.set_draw_color(colors[COLOR_DRAW].value);
     renderer.draw_solid(TQ_PRIMITIVE_TRIANGLE_FAN, data, precision - 1);
 
@@ -728,46 +1151,99 @@ tq_texture tq_load_texture_from_memory(uint8_t const *buffer, size_t size)
     return (tq_texture) { load_texture(libtq_open_memory_stream(buffer, size)) };
 }
 
+tq_texture tq_load_texture_async(char const *path)
+{
+    int texture_id = tq_load_texture_in_background(path,
+        priv.color_key_enabled, priv.color_key);
+
+    if (texture_id != -1 && priv.mipmaps_enabled) {
+        renderer.set_texture_mipmapped(texture_id, true);
+    }
+
+    return (tq_texture) { texture_id };
+}
+
+bool tq_is_texture_ready(tq_texture texture)
+{
+    return !tq_is_texture_pending(texture.id);
+}
+
 void tq_delete_texture(tq_texture texture)
 {
+    if (texture.id & TQ_ATLAS_TEXTURE_BIT) {
+        tq_remove_from_atlas(texture.id);
+        return;
+    }
+
+    tq_cancel_texture_loading(texture.id);
     renderer.delete_texture(texture.id);
 }
 
 tq_vec2i tq_get_texture_size(tq_texture texture)
 {
     tq_vec2i size;
-    renderer.get_texture_size(texture.id, &size.x, &size.y);
+
+    if (!tq_get_atlas_texture_size(texture.id, &size.x, &size.y)) {
+        renderer.get_texture_size(texture.id, &size.x, &size.y);
+    }
 
     return size;
 }
 
 void tq_set_texture_smooth(tq_texture texture, bool smooth)
 {
-    renderer.set_texture_smooth(texture.id, smooth);
+    tq_rectf uv;
+    renderer.set_texture_smooth(resolve_texture(texture.id, &uv), smooth);
+}
+
+void tq_set_texture_mipmapped(tq_texture texture, bool mipmapped)
+{
+    tq_rectf uv;
+    renderer.set_texture_mipmapped(resolve_texture(texture.id, &uv), mipmapped);
 }
 
 void tq_draw_texture(tq_texture texture, tq_rectf rect)
 {
+    if (tq_is_texture_pending(texture.id)) {
+        return;
+    }
+
+    tq_rectf uv;
+    int texture_id = resolve_texture(texture.id, &uv);
+
+    float as = uv.x;
+    float at = uv.y;
+    float bs = uv.x + uv.w;
+    float bt = uv.y + uv.h;
+
     float data[] = {
-        rect.x,             rect.y,             0.0f,   0.0f,
-        rect.x + rect.w,    rect.y,             1.0f,   0.0f,
-        rect.x + rect.w,    rect.y + rect.h,    1.0f,   1.0f,
-        rect.x,             rect.y + rect.h,    0.0f,   1.0f,
+        rect.x,             rect.y,             as,     at,
+        rect.x + rect.w,    rect.y,             bs,     at,
+        rect.x + rect.w,    rect.y + rect.h,    bs,     bt,
+        rect.x,             rect.y + rect.h,    as,     bt,
     };
 
-    renderer.bind_texture(texture.id);
-    renderer.draw_textured(TQ_PRIMITIVE_TRIANGLE_FAN, data, 4);
+    tq_transform_vertices(data, 4, 4);
+
+    renderer.bind_texture(texture_id);
+    renderer.draw_quads(data, 1);
 }
 
 void tq_draw_subtexture(tq_texture texture, tq_rectf sub, tq_rectf rect)
 {
-    int u, v;
-    renderer.get_texture_size(texture.id, &u, &v);
+    if (tq_is_texture_pending(texture.id)) {
+        return;
+    }
+
+    tq_rectf uv;
+    int texture_id = resolve_texture(texture.id, &uv);
 
-    float as = sub.x / u;
-    float at = sub.y / v;
-    float bs = (sub.x + sub.w) / u;
-    float bt = (sub.y + sub.h) / v;
+    tq_vec2i size = tq_get_texture_size(texture);
+
+    float as = uv.x + uv.w * (sub.x / size.x);
+    float at = uv.y + uv.h * (sub.y / size.y);
+    float bs = uv.x + uv.w * ((sub.x + sub.w) / size.x);
+    float bt = uv.y + uv.h * ((sub.y + sub.h) / size.y);
 
     float data[] = {
         rect.x,             rect.y,             as,     at,
@@ -776,8 +1252,10 @@ void tq_draw_subtexture(tq_texture texture, tq_rectf sub, tq_rectf rect)
         rect.x,             rect.y + rect.h,    as,     bt,
     };
 
-    renderer.bind_texture(texture.id);
-    renderer.draw_textured(TQ_PRIMITIVE_TRIANGLE_FAN, data, 4);
+    tq_transform_vertices(data, 4, 4);
+
+    renderer.bind_texture(texture_id);
+    renderer.draw_quads(data, 1);
 }
 
 void tq_draw_texture_f(tq_texture texture, float x, float y, float w, float h)
@@ -797,6 +1275,59 @@ void tq_draw_subtexture_f(tq_texture texture,
     tq_draw_subtexture(texture, sub, rect);
 }
 
+void tq_draw_sprites(tq_texture texture, tq_sprite_instance const *sprites, int count)
+{
+    if (count <= 0 || tq_is_texture_pending(texture.id)) {
+        return;
+    }
+
+    tq_rectf uv;
+    int texture_id = resolve_texture(texture.id, &uv);
+
+    renderer.bind_texture(texture_id);
+
+    // Instances are transformed on the GPU, so the model-view
+    // matrix has to be uploaded temporarily.
+    float const *model_view = matrices.model_view[matrices.current_model_view];
+    bool upload_matrix = priv.cpu_transform && !is_identity(model_view);
+
+    if (upload_matrix) {
+        renderer.update_model_view(model_view);
+    }
+
+    if (texture_id == texture.id) {
+        renderer.draw_sprites_instanced(sprites, count);
+    } else {
+        // Texture regions of atlased textures are remapped
+        // to the atlas page, piece by piece.
+        tq_sprite_instance chunk[SPRITE_CHUNK_SIZE];
+
+        while (count > 0) {
+            int n = TQ_MIN(count, SPRITE_CHUNK_SIZE);
+
+            for (int i = 0; i < n; i++) {
+                chunk[i] = sprites[i];
+                chunk[i].uv.x = uv.x + uv.w * sprites[i].uv.x;
+                chunk[i].uv.y = uv.y + uv.h * sprites[i].uv.y;
+                chunk[i].uv.w = uv.w * sprites[i].uv.w;
+                chunk[i].uv.h = uv.h * sprites[i].uv.h;
+            }
+
+            renderer.draw_sprites_instanced(chunk, n);
+
+            sprites += n;
+            count -= n;
+        }
+    }
+
+    if (upload_matrix) {
+        float identity[9];
+        mat3_identity(identity);
+
+        renderer.update_model_view(identity);
+    }
+}
+
 //------------------------------------------------------------------------------
 // API entries: surfaces
 
@@ -809,9 +1340,28 @@ tq_surface tq_create_surface(tq_vec2i size)
 
 void tq_delete_surface(tq_surface surface)
 {
+    // The pool would delete or hand out this surface again.
+    if (tq_is_pooled_surface(surface.id)) {
+        libtq_log(LIBTQ_LOG_WARNING, "tq_delete_surface: surface %d belongs to the temporary "
+            "surface pool, use tq_release_temp_surface() instead.\n", surface.id);
+        return;
+    }
+
     renderer.delete_surface(surface.id);
 }
 
+tq_surface tq_acquire_temp_surface(tq_vec2i size)
+{
+    return (tq_surface) {
+        tq_acquire_pooled_surface(size.x, size.y, priv.antialiasing_level),
+    };
+}
+
+void tq_release_temp_surface(tq_surface surface)
+{
+    tq_release_pooled_surface(surface.id);
+}
+
 void tq_set_surface(tq_surface surface)
 {
     renderer.bind_surface(surface.id);
@@ -841,6 +1391,124 @@ tq_texture tq_get_surface_texture(tq_surface surface)
 }
 
 //------------------------------------------------------------------------------
+// API entries: draw lists
+
+void tq_begin_draw_list(void)
+{
+    if (tq_is_draw_list_recording()) {
+        return;
+    }
+
+    priv.requested_cpu_transform = priv.cpu_transform;
+    tq_set_cpu_transform_enabled(true);
+
+    tq_begin_draw_list_recording(&renderer, priv.blend_mode);
+}
+
+void tq_end_draw_list(void)
+{
+    if (!tq_is_draw_list_recording()) {
+        return;
+    }
+
+    tq_end_draw_list_recording(&renderer);
+    tq_set_cpu_transform_enabled(priv.requested_cpu_transform);
+}
+
+void tq_set_draw_layer(int layer)
+{
+    tq_set_draw_list_layer(layer);
+}
+
+//------------------------------------------------------------------------------
+// API entries: statistics
+
+void tq_get_frame_stats(tq_frame_stats *stats)
+{
+    memset(stats, 0, sizeof(tq_frame_stats));
+    renderer.get_stats(stats);
+
+    stats->pooled_surface_count = tq_get_surface_pool_size();
+
+    if (frame_times.count == 0) {
+        return;
+    }
+
+    float sorted[TQ_FRAME_TIME_WINDOW];
+    float sum = 0.0f;
+
+    memcpy(sorted, frame_times.samples, frame_times.count * sizeof(float));
+    qsort(sorted, frame_times.count, sizeof(float), compare_floats);
+
+    for (int i = 0; i < frame_times.count; i++) {
+        sum += sorted[i];
+    }
+
+    // Nearest-rank percentile.
+    int p99 = (99 * frame_times.count + 99) / 100 - 1;
+
+    stats->frame_time_min = sorted[0];
+    stats->frame_time_avg = sum / frame_times.count;
+    stats->frame_time_p99 = sorted[p99];
+}
+
+//------------------------------------------------------------------------------
+// API entries: tracing
+
+int tq_replay_trace(char const *path, tq_trace_frame_callback callback)
+{
+    return tq_replay_trace_file(&renderer, path, callback);
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Apply the current model-view matrix to vertices if CPU transform
+ * is enabled. Position should be the first two floats of a vertex.
+ */
+void tq_transform_vertices(float *data, int num_vertices, int stride)
+{
+    if (!priv.cpu_transform) {
+        return;
+    }
+
+    float const *m = matrices.model_view[matrices.current_model_view];
+
+    if (is_identity(m)) {
+        return;
+    }
+
+    for (int i = 0; i < num_vertices; i++) {
+        float x = data[0];
+        float y = data[1];
+
+        data[0] = m[0] * x + m[1] * y + m[2];
+        data[1] = m[3] * x + m[4] * y + m[5];
+
+        data += stride;
+    }
+}
+
+/**
+ * Push identity matrix, so that following draws don't depend on
+ * the transformation left by the caller. Returns false and pushes
+ * nothing if the matrix stack is full.
+ */
+bool tq_push_identity_matrix(void)
+{
+    int index = matrices.current_model_view;
+
+    if (index == (MAX_MATRICES - 1)) {
+        return false;
+    }
+
+    mat3_identity(matrices.model_view[index + 1]);
+
+    matrices.current_model_view++;
+    upload_model_view();
+
+    return true;
+}
 
 void tq_on_rc_create(int rc)
 {
@@ -851,18 +1519,20 @@ void tq_on_rc_create(int rc)
     }
 
     renderer.initialize();
+    tq_initialize_surface_pool(&renderer);
 
     priv.antialiasing_level = renderer.request_antialiasing_level(priv.antialiasing_level);
 
-    graphics.canvas_surface_id = renderer.create_surface(
-        graphics.canvas_width,
-        graphics.canvas_height
-    );
+    graphics.canvas_surface_id = -1;
+    update_canvas_surface();
+    renderer.bind_surface(graphics.canvas_surface_id);
 
     renderer.update_projection(matrices.projection);
-    renderer.update_model_view(matrices.model_view[0]);
+    upload_model_view();
 
     tq_initialize_text(&renderer);
+    tq_initialize_texture_loader(&renderer);
+    tq_initialize_atlas(&renderer);
 }
 
 void tq_on_rc_destroy(void)
@@ -873,7 +1543,10 @@ void tq_on_rc_destroy(void)
 
     priv.active_rc = 0;
 
+    tq_terminate_atlas();
+    tq_terminate_texture_loader();
     tq_terminate_text();
+    tq_terminate_surface_pool();
     renderer.terminate();
 }
 
@@ -53,8 +53,14 @@ typedef struct tq_renderer_impl
     void    (*delete_texture)(int32_t texture_id);
     bool    (*is_texture_smooth)(int texture_id);
     void    (*set_texture_smooth)(int texture_id, bool smooth);
+    void    (*set_texture_mipmapped)(int texture_id, bool mipmapped);
     void    (*get_texture_size)(int texture_id, int *width, int *height);
     void    (*update_texture)(int texture_id, int x_offset, int y_offset, int width, int height, unsigned char *pixels);
+    unsigned char *(*map_texture)(int texture_id, int x_offset, int y_offset, int width, int height);
+    void    (*unmap_texture)(void);
+    void    (*resize_texture)(int texture_id, int width, int height, int channels);
+    bool    (*is_compressed_format_supported)(int format);
+    void    (*upload_compressed_texture)(int texture_id, int width, int height, int format, void const *data, size_t size);
     void    (*bind_texture)(int texture_id);
 
     int     (*create_surface)(int width, int height);
@@ -70,8 +76,13 @@ typedef struct tq_renderer_impl
     void    (*draw_solid)(int mode, float const *data, int num_vertices);
     void    (*draw_colored)(int mode, float const *data, int num_vertices);
     void    (*draw_textured)(int mode, float const *data, int num_vertices);
-    void    (*draw_font)(float const *data, int num_vertices);
+    void    (*draw_quads)(float const *data, int num_quads);
+    void    (*draw_font)(float const *data, int num_quads);
+    void    (*draw_sprites_instanced)(tq_sprite_instance const *sprites, int count);
     void    (*draw_canvas)(float x0, float y0, float x1, float y1);
+    void    (*read_pixels)(int surface_id, unsigned char *pixels);
+
+    void    (*get_stats)(tq_frame_stats *stats);
 } tq_renderer_impl;
 
 #if defined(TQ_WIN32) || defined(TQ_LINUX)
@@ -82,6 +93,7 @@ typedef struct tq_renderer_impl
     void tq_construct_gles2_renderer(tq_renderer_impl *impl);
 #endif
 
+void tq_construct_soft_renderer(tq_renderer_impl *impl);
 void tq_construct_null_renderer(tq_renderer_impl *impl);
 
 //------------------------------------------------------------------------------
@@ -90,7 +102,12 @@ void tq_initialize_graphics(void);
 void tq_terminate_graphics(void);
 void tq_process_graphics(void);
 
+tq_renderer_type tq_get_renderer_type(void);
+void tq_read_display_pixels(unsigned char *pixels);
+
 tq_vec2i tq_conv_display_coord(tq_vec2i coord);
+void tq_transform_vertices(float *data, int num_vertices, int stride);
+bool tq_push_identity_matrix(void);
 
 void tq_on_rc_create(int rc);
 void tq_on_rc_destroy(void);
@@ -31,6 +31,7 @@
 #include "tq_graphics.h"
 #include "tq_image_loader.h"
 #include "tq_log.h"
+#include "tq_profiler.h"
 
 //------------------------------------------------------------------------------
 // Input stream adapter for stbi
@@ -148,6 +149,8 @@ libtq_image *libtq_load_image(libtq_stream *stream)
     int height;
     int channels;
 
+    TQ_PROFILE_BEGIN("libtq_load_image");
+
     unsigned char *pixels = stbi_load_from_callbacks(
         &(stbi_io_callbacks) {
             .read = stream_read,
@@ -157,6 +160,8 @@ libtq_image *libtq_load_image(libtq_stream *stream)
         stream, &width, &height, &channels, 0
     );
 
+    TQ_PROFILE_END();
+
     if (!pixels) {
         libtq_log(LIBTQ_LOG_ERROR, "stbi image loader error: %s\n", stbi_failure_reason());
         return NULL;
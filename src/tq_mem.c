@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#if defined(TQ_COUNT_ALLOCATIONS)
+
+//------------------------------------------------------------------------------
+
+#include "tq_mem.h"
+
+//------------------------------------------------------------------------------
+
+static unsigned long allocation_count;
+
+//------------------------------------------------------------------------------
+
+void *libtq_counted_malloc(size_t size)
+{
+    allocation_count++;
+    return malloc(size);
+}
+
+void *libtq_counted_calloc(size_t nmemb, size_t size)
+{
+    allocation_count++;
+    return calloc(nmemb, size);
+}
+
+void *libtq_counted_realloc(void *ptr, size_t size)
+{
+    allocation_count++;
+    return realloc(ptr, size);
+}
+
+unsigned long libtq_get_allocation_count(void)
+{
+    return allocation_count;
+}
+
+//------------------------------------------------------------------------------
+
+#endif // defined(TQ_COUNT_ALLOCATIONS)
@@ -29,6 +29,28 @@
 // This doesn't have much sense at this point.
 // But at some point in the future this will help a lot.
 
+#if defined(TQ_COUNT_ALLOCATIONS)
+
+// Allocation counting, used by benchmarks.
+// Counter isn't atomic, so allocations made by other threads
+// at the same time may be missed.
+
+void *libtq_counted_malloc(size_t size);
+void *libtq_counted_calloc(size_t nmemb, size_t size);
+void *libtq_counted_realloc(void *ptr, size_t size);
+unsigned long libtq_get_allocation_count(void);
+
+#define libtq_malloc(size) \
+    libtq_counted_malloc(size)
+
+#define libtq_calloc(nmemb, size) \
+    libtq_counted_calloc(nmemb, size)
+
+#define libtq_realloc(ptr, size) \
+    libtq_counted_realloc(ptr, size)
+
+#else
+
 #define libtq_malloc(size) \
     malloc(size)
 
@@ -38,6 +60,8 @@
 #define libtq_realloc(ptr, size) \
     realloc(ptr, size)
 
+#endif // defined(TQ_COUNT_ALLOCATIONS)
+
 #define libtq_free(ptr) \
     free(ptr)
 
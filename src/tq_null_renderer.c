@@ -36,9 +36,17 @@ static int      create_texture(int width, int height, int channels);
 static void     delete_texture(int texture_id);
 static bool     is_texture_smooth(int texture_id);
 static void     set_texture_smooth(int texture_id, bool smooth);
+static void     set_texture_mipmapped(int texture_id, bool mipmapped);
 static void     get_texture_size(int texture_id, int *width, int *height);
 static void     update_texture(int texture_id, int x_offset, int y_offset,
                                int width, int height, unsigned char *pixels);
+static unsigned char *map_texture(int texture_id, int x_offset, int y_offset,
+                                  int width, int height);
+static void     unmap_texture(void);
+static void     resize_texture(int texture_id, int width, int height, int channels);
+static bool     is_compressed_format_supported(int format);
+static void     upload_compressed_texture(int texture_id, int width, int height,
+                                          int format, void const *data, size_t size);
 static void     bind_texture(int texture_id);
 
 static int      create_surface(int width, int height);
@@ -54,8 +62,13 @@ static void     clear(void);
 static void     draw_solid(int mode, float const *data, int num_vertices);
 static void     draw_colored(int mode, float const *data, int num_vertices);
 static void     draw_textured(int mode, float const *data, int num_vertices);
-static void     draw_font(float const *data, int num_vertices);
+static void     draw_quads(float const *data, int num_quads);
+static void     draw_font(float const *data, int num_quads);
+static void     draw_sprites_instanced(tq_sprite_instance const *sprites, int count);
 static void     draw_canvas(float x0, float y0, float x1, float y1);
+static void     read_pixels(int surface_id, unsigned char *pixels);
+
+static void     get_stats(tq_frame_stats *stats);
 
 //------------------------------------------------------------------------------
 
@@ -106,6 +119,10 @@ void set_texture_smooth(int texture_id, bool smooth)
 {
 }
 
+void set_texture_mipmapped(int texture_id, bool mipmapped)
+{
+}
+
 void get_texture_size(int texture_id, int *width, int *height)
 {
 }
@@ -115,6 +132,30 @@ void update_texture(int texture_id, int x_offset, int y_offset,
 {
 }
 
+unsigned char *map_texture(int texture_id, int x_offset, int y_offset,
+                           int width, int height)
+{
+    return NULL;
+}
+
+void unmap_texture(void)
+{
+}
+
+void resize_texture(int texture_id, int width, int height, int channels)
+{
+}
+
+bool is_compressed_format_supported(int format)
+{
+    return false;
+}
+
+void upload_compressed_texture(int texture_id, int width, int height,
+                               int format, void const *data, size_t size)
+{
+}
+
 void bind_texture(int texture_id)
 {
 }
@@ -165,7 +206,15 @@ void draw_textured(int mode, float const *data, int num_vertices)
 {
 }
 
-void draw_font(float const *data, int num_vertices)
+void draw_quads(float const *data, int num_quads)
+{
+}
+
+void draw_font(float const *data, int num_quads)
+{
+}
+
+void draw_sprites_instanced(tq_sprite_instance const *sprites, int count)
 {
 }
 
@@ -173,6 +222,14 @@ void draw_canvas(float x0, float y0, float x1, float y1)
 {
 }
 
+void read_pixels(int surface_id, unsigned char *pixels)
+{
+}
+
+void get_stats(tq_frame_stats *stats)
+{
+}
+
 //------------------------------------------------------------------------------
 
 void tq_construct_null_renderer(tq_renderer_impl *impl)
@@ -190,8 +247,16 @@ void tq_construct_null_renderer(tq_renderer_impl *impl)
         .delete_texture         = delete_texture,
         .is_texture_smooth      = is_texture_smooth,
         .set_texture_smooth     = set_texture_smooth,
+        .set_texture_mipmapped  = set_texture_mipmapped,
         .get_texture_size       = get_texture_size,
         .update_texture         = update_texture,
+        .map_texture            = map_texture,
+        .unmap_texture          = unmap_texture,
+        .resize_texture         = resize_texture,
+        .is_compressed_format_supported
+                                = is_compressed_format_supported,
+        .upload_compressed_texture
+                                = upload_compressed_texture,
         .bind_texture           = bind_texture,
         .create_surface         = create_surface,
         .delete_surface         = delete_surface,
@@ -204,8 +269,12 @@ void tq_construct_null_renderer(tq_renderer_impl *impl)
         .draw_solid             = draw_solid,
         .draw_colored           = draw_colored,
         .draw_textured          = draw_textured,
+        .draw_quads             = draw_quads,
         .draw_font              = draw_font,
+        .draw_sprites_instanced = draw_sprites_instanced,
         .draw_canvas            = draw_canvas,
+        .read_pixels            = read_pixels,
+        .get_stats              = get_stats,
     };
 }
 
@@ -33,22 +33,41 @@
 
 //------------------------------------------------------------------------------
 
+/**
+ * Thread info is shared between the thread itself and the caller
+ * of wait_thread() or detach_thread(), so it's freed by whoever
+ * releases it last.
+ */
 struct thread_info
 {
-    pthread_t   thread;
-    char const  *name;
-    int         (*func)(void *);
-    void        *data;
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    int             refs;
+    char const      *name;
+    int             (*func)(void *);
+    void            *data;
 };
 
 //------------------------------------------------------------------------------
 
+static void release_thread_info(struct thread_info *info)
+{
+    pthread_mutex_lock(&info->mutex);
+    int refs = --info->refs;
+    pthread_mutex_unlock(&info->mutex);
+
+    if (refs == 0) {
+        pthread_mutex_destroy(&info->mutex);
+        free(info);
+    }
+}
+
 static void *thread_main(void *arg)
 {
     struct thread_info *info = (struct thread_info *) arg;
     int retval = info->func(info->data);
 
-    free(info);
+    release_thread_info(info);
 
     return (void *) ((intptr_t) retval);
 }
@@ -83,6 +102,9 @@ static libtq_thread create_thread(char const *name, int (*func)(void *), void *d
         libtq_out_of_memory();
     }
 
+    pthread_mutex_init(&info->mutex, NULL);
+
+    info->refs = 2;
     info->name = name;
     info->func = func;
     info->data = data;
@@ -91,6 +113,7 @@ static libtq_thread create_thread(char const *name, int (*func)(void *), void *d
 
     if (status != 0) {
         libtq_log(LIBTQ_LOG_ERROR, "Error occured while attempting to create thread.\n");
+        pthread_mutex_destroy(&info->mutex);
         free(info);
 
         return NULL;
@@ -111,6 +134,8 @@ static void detach_thread(libtq_thread thread)
     if (status != 0) {
         libtq_log(LIBTQ_LOG_ERROR, "Failed to detach thread \"%s\".\n", info->name);
     }
+
+    release_thread_info(info);
 }
 
 static int wait_thread(libtq_thread thread)
@@ -124,6 +149,8 @@ static int wait_thread(libtq_thread thread)
         libtq_log(LIBTQ_LOG_ERROR, "Failed to join thread \"%s\".\n", info->name);
     }
 
+    release_thread_info(info);
+
     return (int) ((intptr_t) retval);
 }
 
@@ -165,6 +192,49 @@ static void unlock_mutex(libtq_mutex mutex)
     pthread_mutex_unlock((pthread_mutex_t *) mutex);
 }
 
+static libtq_cond create_cond(void)
+{
+    pthread_cond_t *cond = malloc(sizeof(pthread_cond_t));
+
+    if (!cond) {
+        libtq_out_of_memory();
+    }
+
+    int status = pthread_cond_init(cond, NULL);
+
+    if (status != 0) {
+        libtq_error("Failed to create condition variable, error code: %d", status);
+    }
+
+    return (libtq_cond) cond;
+}
+
+static void destroy_cond(libtq_cond cond)
+{
+    int status = pthread_cond_destroy((pthread_cond_t *) cond);
+
+    if (status != 0) {
+        libtq_log(LIBTQ_LOG_ERROR, "Failed to destroy condition variable, error code: %d", status);
+    }
+
+    free(cond);
+}
+
+static void wait_cond(libtq_cond cond, libtq_mutex mutex)
+{
+    pthread_cond_wait((pthread_cond_t *) cond, (pthread_mutex_t *) mutex);
+}
+
+static void signal_cond(libtq_cond cond)
+{
+    pthread_cond_signal((pthread_cond_t *) cond);
+}
+
+static void broadcast_cond(libtq_cond cond)
+{
+    pthread_cond_broadcast((pthread_cond_t *) cond);
+}
+
 //------------------------------------------------------------------------------
 
 void libtq_construct_posix_threads(struct libtq_threads_impl *threads)
@@ -180,6 +250,11 @@ void libtq_construct_posix_threads(struct libtq_threads_impl *threads)
         .destroy_mutex          = destroy_mutex,
         .lock_mutex             = lock_mutex,
         .unlock_mutex           = unlock_mutex,
+        .create_cond            = create_cond,
+        .destroy_cond           = destroy_cond,
+        .wait_cond              = wait_cond,
+        .signal_cond            = signal_cond,
+        .broadcast_cond         = broadcast_cond,
     };
 }
 
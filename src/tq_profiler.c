@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tq_core.h"
+#include "tq_log.h"
+#include "tq_mem.h"
+#include "tq_profiler.h"
+
+//------------------------------------------------------------------------------
+
+#if defined(TQ_USE_PROFILER)
+
+//------------------------------------------------------------------------------
+
+#if defined(_MSC_VER)
+#   define THREAD_LOCAL __declspec(thread)
+#else
+#   define THREAD_LOCAL __thread
+#endif
+
+#define MAX_THREADS         32
+#define MAX_DEPTH           32
+#define RING_SIZE           16384
+
+//------------------------------------------------------------------------------
+
+struct profile_event
+{
+    char const *name;
+    double start;
+    double duration;
+};
+
+/**
+ * Each thread writes only to its own buffer, so markers don't
+ * need any locking. The oldest events are overwritten when the
+ * ring is full. Only complete events are stored, so overwriting
+ * never leaves an unmatched begin or end behind.
+ * When a thread ends, its buffer is handed to the next new thread,
+ * which keeps appending to the same ring.
+ */
+struct profile_buffer
+{
+    bool in_use;
+    char const *thread_name;
+
+    int depth;
+    char const *open_names[MAX_DEPTH];
+    double open_times[MAX_DEPTH];
+
+    unsigned long head;
+    struct profile_event events[RING_SIZE];
+};
+
+struct profiler
+{
+    libtq_mutex mutex;
+    unsigned int generation;
+    double epoch;
+
+    int num_buffers;
+    struct profile_buffer *buffers[MAX_THREADS];
+    bool exhausted;
+};
+
+//------------------------------------------------------------------------------
+
+static struct profiler profiler;
+
+/**
+ * Generation is bumped on every initialization, so buffer
+ * pointers left over from a previous run are never reused.
+ */
+static THREAD_LOCAL struct profile_buffer *thread_buffer;
+static THREAD_LOCAL unsigned int thread_generation;
+
+//------------------------------------------------------------------------------
+
+static struct profile_buffer *get_thread_buffer(void)
+{
+    if (!profiler.mutex) {
+        return NULL;
+    }
+
+    if (thread_buffer && thread_generation == profiler.generation) {
+        return thread_buffer;
+    }
+
+    struct profile_buffer *buffer = NULL;
+
+    libtq_lock_mutex(profiler.mutex);
+    {
+        for (int i = 0; i < profiler.num_buffers; i++) {
+            if (!profiler.buffers[i]->in_use) {
+                buffer = profiler.buffers[i];
+                break;
+            }
+        }
+
+        if (!buffer && profiler.num_buffers < MAX_THREADS) {
+            buffer = libtq_calloc(1, sizeof(struct profile_buffer));
+
+            if (buffer) {
+                profiler.buffers[profiler.num_buffers++] = buffer;
+            }
+        }
+
+        if (buffer) {
+            buffer->in_use = true;
+            buffer->thread_name = NULL;
+            buffer->depth = 0;
+        } else if (!profiler.exhausted) {
+            libtq_log(LIBTQ_LOG_WARNING, "Profiler: too many threads, "
+                "markers of new threads are ignored.\n");
+            profiler.exhausted = true;
+        }
+    }
+    libtq_unlock_mutex(profiler.mutex);
+
+    thread_buffer = buffer;
+    thread_generation = profiler.generation;
+
+    return buffer;
+}
+
+static double get_timestamp(void)
+{
+    return tq_get_time_highp() - profiler.epoch;
+}
+
+//------------------------------------------------------------------------------
+
+void libtq_initialize_profiler(void)
+{
+    profiler.mutex = libtq_create_mutex();
+    profiler.generation++;
+    profiler.epoch = tq_get_time_highp();
+
+    libtq_profile_thread("main");
+}
+
+void libtq_terminate_profiler(void)
+{
+    for (int i = 0; i < profiler.num_buffers; i++) {
+        libtq_free(profiler.buffers[i]);
+    }
+
+    libtq_destroy_mutex(profiler.mutex);
+
+    profiler.mutex = NULL;
+    profiler.num_buffers = 0;
+    profiler.exhausted = false;
+}
+
+void libtq_profile_thread(char const *name)
+{
+    struct profile_buffer *buffer = get_thread_buffer();
+
+    if (buffer) {
+        buffer->thread_name = name;
+    }
+}
+
+/**
+ * Give the buffer of the calling thread back to the profiler.
+ * Its events are kept until another thread overwrites them.
+ */
+void libtq_profile_thread_end(void)
+{
+    if (!profiler.mutex || !thread_buffer || thread_generation != profiler.generation) {
+        return;
+    }
+
+    libtq_lock_mutex(profiler.mutex);
+    {
+        thread_buffer->in_use = false;
+    }
+    libtq_unlock_mutex(profiler.mutex);
+
+    thread_buffer = NULL;
+}
+
+void libtq_profile_begin(char const *name)
+{
+    struct profile_buffer *buffer = get_thread_buffer();
+
+    if (!buffer) {
+        return;
+    }
+
+    if (buffer->depth < MAX_DEPTH) {
+        buffer->open_names[buffer->depth] = name;
+        buffer->open_times[buffer->depth] = get_timestamp();
+    }
+
+    buffer->depth++;
+}
+
+void libtq_profile_end(void)
+{
+    struct profile_buffer *buffer = get_thread_buffer();
+
+    if (!buffer || buffer->depth == 0) {
+        return;
+    }
+
+    buffer->depth--;
+
+    if (buffer->depth >= MAX_DEPTH) {
+        return;
+    }
+
+    double start = buffer->open_times[buffer->depth];
+    struct profile_event *event = &buffer->events[buffer->head % RING_SIZE];
+
+    event->name = buffer->open_names[buffer->depth];
+    event->start = start;
+    event->duration = get_timestamp() - start;
+
+    buffer->head++;
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * API entry: tq_profiler_dump()
+ * Other threads keep recording while the file is written;
+ * at worst their latest event is torn.
+ */
+bool tq_profiler_dump(char const *path)
+{
+    if (!profiler.mutex) {
+        libtq_log(LIBTQ_LOG_WARNING, "tq_profiler_dump: library isn't initialized.\n");
+        return false;
+    }
+
+    FILE *file = fopen(path, "w");
+
+    if (!file) {
+        libtq_log(LIBTQ_LOG_ERROR, "tq_profiler_dump: can't open %s for writing.\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool first = true;
+
+    libtq_lock_mutex(profiler.mutex);
+
+    for (int tid = 0; tid < profiler.num_buffers; tid++) {
+        struct profile_buffer *buffer = profiler.buffers[tid];
+
+        if (buffer->thread_name) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", tid, buffer->thread_name);
+            first = false;
+        }
+
+        unsigned long head = buffer->head;
+        unsigned long count = (head < RING_SIZE) ? head : RING_SIZE;
+
+        for (unsigned long n = head - count; n < head; n++) {
+            struct profile_event const *event = &buffer->events[n % RING_SIZE];
+
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n", event->name, tid,
+                event->start * 1000000.0, event->duration * 1000000.0);
+            first = false;
+        }
+    }
+
+    libtq_unlock_mutex(profiler.mutex);
+
+    fprintf(file, "\n]}\n");
+
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+
+    if (!ok) {
+        libtq_log(LIBTQ_LOG_ERROR, "tq_profiler_dump: failed to write %s.\n", path);
+    }
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+#else
+
+//------------------------------------------------------------------------------
+
+void libtq_initialize_profiler(void)
+{
+}
+
+void libtq_terminate_profiler(void)
+{
+}
+
+/**
+ * API entry: tq_profiler_dump()
+ */
+bool tq_profiler_dump(char const *path)
+{
+    libtq_log(LIBTQ_LOG_WARNING, "tq_profiler_dump: profiler isn't enabled in this build.\n");
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+#endif // defined(TQ_USE_PROFILER)
@@ -0,0 +1,66 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#ifndef TQ_PROFILER_H_INC
+#define TQ_PROFILER_H_INC
+
+//------------------------------------------------------------------------------
+// Scoped timing markers. Every TQ_PROFILE_BEGIN() must be matched
+// by TQ_PROFILE_END() on the same thread. Names must be string
+// literals, since only pointers are stored.
+// Short-lived threads should call TQ_PROFILE_THREAD_END() before
+// exiting, so their buffers can be reused by other threads.
+// Markers compile to nothing unless TQ_USE_PROFILER is defined.
+
+void libtq_initialize_profiler(void);
+void libtq_terminate_profiler(void);
+
+#if defined(TQ_USE_PROFILER)
+
+void libtq_profile_thread(char const *name);
+void libtq_profile_thread_end(void);
+void libtq_profile_begin(char const *name);
+void libtq_profile_end(void);
+
+#define TQ_PROFILE_THREAD(name) \
+    libtq_profile_thread(name)
+
+#define TQ_PROFILE_THREAD_END() \
+    libtq_profile_thread_end()
+
+#define TQ_PROFILE_BEGIN(name) \
+    libtq_profile_begin(name)
+
+#define TQ_PROFILE_END() \
+    libtq_profile_end()
+
+#else
+
+#define TQ_PROFILE_THREAD(name)
+#define TQ_PROFILE_THREAD_END()
+#define TQ_PROFILE_BEGIN(name)
+#define TQ_PROFILE_END()
+
+#endif // defined(TQ_USE_PROFILER)
+
+//------------------------------------------------------------------------------
+
+#endif // TQ_PROFILER_H_INC
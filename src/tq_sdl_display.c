@@ -42,6 +42,11 @@ struct sdl_display_priv
     SDL_Window      *window;
     SDL_GLContext   gl_context;
     bool            key_autorepeat;
+
+    // Software renderer output is copied here and blitted
+    // to the window surface, there is no GL context then.
+    bool            software;
+    SDL_Surface     *framebuffer;
 };
 
 //------------------------------------------------------------------------------
@@ -170,6 +175,70 @@ static tq_mouse_button mouse_button_conv(int button)
     return TQ_TOTAL_MOUSE_BUTTONS;
 }
 
+/**
+ * Create a plain window for the software renderer.
+ */
+static void create_software_window(tq_vec2i display_size)
+{
+    sdl.window = SDL_CreateWindow(
+        tq_get_title(),
+        SDL_WINDOWPOS_CENTERED,
+        SDL_WINDOWPOS_CENTERED,
+        display_size.x, display_size.y,
+        SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN
+    );
+
+    if (!sdl.window) {
+        libtq_error("Failed to create SDL window: %s", SDL_GetError());
+    }
+
+    sdl.gl_context = NULL;
+    sdl.framebuffer = NULL;
+}
+
+/**
+ * Copy the software framebuffer to the window.
+ */
+static void present_software_framebuffer(void)
+{
+    tq_vec2i size = tq_get_display_size();
+
+    if (!sdl.framebuffer || sdl.framebuffer->w != size.x || sdl.framebuffer->h != size.y) {
+        SDL_FreeSurface(sdl.framebuffer);
+        sdl.framebuffer = SDL_CreateRGBSurfaceWithFormat(0, size.x, size.y, 32, SDL_PIXELFORMAT_RGBA32);
+
+        if (!sdl.framebuffer) {
+            libtq_error("Failed to create SDL surface: %s", SDL_GetError());
+        }
+    }
+
+    SDL_Surface *window_surface = SDL_GetWindowSurface(sdl.window);
+
+    if (!window_surface) {
+        return;
+    }
+
+    unsigned char *pixels = sdl.framebuffer->pixels;
+    int pitch = sdl.framebuffer->pitch;
+
+    tq_read_display_pixels(pixels);
+
+    // Rows come bottom-up, flip them in place.
+    for (int y = 0; y < size.y / 2; y++) {
+        unsigned char *a = pixels + y * pitch;
+        unsigned char *b = pixels + (size.y - y - 1) * pitch;
+
+        for (int x = 0; x < pitch; x++) {
+            unsigned char t = a[x];
+            a[x] = b[x];
+            b[x] = t;
+        }
+    }
+
+    SDL_BlitSurface(sdl.framebuffer, NULL, window_surface, NULL);
+    SDL_UpdateWindowSurface(sdl.window);
+}
+
 //------------------------------------------------------------------------------
 
 static void initialize(void)
@@ -180,6 +249,21 @@ static void initialize(void)
 
     tq_vec2i display_size = tq_get_display_size();
 
+    sdl.software = (tq_get_renderer_type() == TQ_RENDERER_SOFTWARE);
+
+    if (sdl.software) {
+        create_software_window(display_size);
+        tq_on_rc_create(1);
+
+        SDL_ShowWindow(sdl.window);
+        SDL_SetWindowMinimumSize(sdl.window, 256, 256);
+
+        sdl.key_autorepeat = tq_is_key_autorepeat_enabled();
+
+        libtq_log(0, "SDL window initialized for software rendering.\n");
+        return;
+    }
+
 #if defined(TQ_EMSCRIPTEN) || defined(TQ_USE_GLES2)
     int gl_versions[] = { 300, 200 };
 #else
@@ -246,7 +330,13 @@ static void terminate(void)
 {
     tq_on_rc_destroy();
 
-    SDL_GL_DeleteContext(sdl.gl_context);
+    if (sdl.software) {
+        SDL_FreeSurface(sdl.framebuffer);
+        sdl.framebuffer = NULL;
+    } else {
+        SDL_GL_DeleteContext(sdl.gl_context);
+    }
+
     SDL_DestroyWindow(sdl.window);
 
     libtq_log(0, "SDL window terminated.\n");
@@ -254,6 +344,11 @@ static void terminate(void)
 
 static void present(void)
 {
+    if (sdl.software) {
+        present_software_framebuffer();
+        return;
+    }
+
     SDL_GL_SwapWindow(sdl.window);
 }
 
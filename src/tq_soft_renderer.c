@@ -0,0 +1,1663 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define TQ_SOFT_SSE2
+    #include <emmintrin.h>
+#endif
+
+#include "tq_core.h"
+#include "tq_error.h"
+#include "tq_graphics.h"
+#include "tq_handle_list.h"
+#include "tq_log.h"
+#include "tq_math.h"
+#include "tq_mem.h"
+
+//------------------------------------------------------------------------------
+
+#define TILE_SIZE                   64
+#define NUM_WORKERS                 4               // including the calling thread
+#define MIN_PARALLEL_TILES          4
+#define MIN_PARALLEL_PRIMITIVES     32
+#define SUBPIXEL_BITS               8
+#define SUBPIXEL_ONE                (1 << SUBPIXEL_BITS)
+#define GUARD_BAND                  4096.0f         // clipping margin around the target
+#define MAX_CLIP_VERTICES           8
+#define INITIAL_PRIMITIVE_COUNT     256
+#define INITIAL_VERTEX_COUNT        256
+
+/**
+ * Pixel shading programs, same as in the OpenGL renderer.
+ */
+enum
+{
+    PROGRAM_COLORED,
+    PROGRAM_TEXTURED,
+    PROGRAM_FONT,
+};
+
+enum
+{
+    PRIMITIVE_CLEAR,
+    PRIMITIVE_TRIANGLE,
+};
+
+/**
+ * Attributes interpolated across triangles.
+ */
+enum
+{
+    ATTRIB_S,
+    ATTRIB_T,
+    ATTRIB_R,
+    ATTRIB_G,
+    ATTRIB_B,
+    ATTRIB_A,
+    ATTRIB_COUNT,
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * Texels are always stored as RGBA, missing channels are filled
+ * the way OpenGL does it. The first row corresponds to t = 0.
+ */
+struct soft_texture
+{
+    int width;
+    int height;
+    int channels;
+    unsigned char *pixels;
+    bool smooth;
+    bool mipmapped;             // stored, but only the base level is sampled
+    int surface_id;             // surface that renders to this texture, or -1
+};
+
+struct soft_surface
+{
+    int texture_id;
+};
+
+/**
+ * Vertex in window coordinates. Color is in [0, 255] range.
+ */
+struct soft_vertex
+{
+    float x, y;
+    float attribs[ATTRIB_COUNT];
+};
+
+/**
+ * Clear command or a triangle ready for rasterization.
+ * Edge functions are evaluated in fixed point, so adjacent triangles
+ * never overlap or leave gaps; attributes are planes in floating point.
+ */
+struct soft_primitive
+{
+    int kind;
+    int program_id;
+    int texture_id;
+    tq_blend_mode blend_mode;
+    bool flat;                  // color is the same across the triangle
+    unsigned char color[4];     // clear color or color of a flat triangle
+
+    int64_t edge_a[3];          // E(x, y) = a * x + b * y + c,
+    int64_t edge_b[3];          // pixel is covered if E >= 0
+    int64_t edge_c[3];          // for all three edges (fill rule included)
+
+    int min_x, min_y;           // bounding box in pixels, inclusive
+    int max_x, max_y;
+
+    float origin_x, origin_y;
+    float attribs[ATTRIB_COUNT];
+    float attribs_dx[ATTRIB_COUNT];
+    float attribs_dy[ATTRIB_COUNT];
+};
+
+/**
+ * Indices of primitives touching a tile, in submission order.
+ */
+struct soft_bin
+{
+    int *primitives;
+    int count;
+    int capacity;
+};
+
+DECLARE_FLEXIBLE_ARRAY(soft_texture)
+DECLARE_FLEXIBLE_ARRAY(soft_surface)
+
+struct tq_soft_renderer_priv
+{
+    float projection[16];
+    float model_view[16];
+    float transform[16];        // projection * model-view
+
+    unsigned char clear_color[4];
+    unsigned char draw_color[4];
+    tq_blend_mode blend_mode;
+    int bound_texture_id;
+    int bound_surface_id;
+
+    unsigned char *display;     // default framebuffer
+    int display_width;
+    int display_height;
+
+    struct soft_primitive *primitives;
+    int primitive_count;
+    int primitive_capacity;
+
+    struct soft_vertex *vertices;   // scratch space for vertex processing
+    int vertex_capacity;
+
+    struct soft_bin *bins;
+    int bin_capacity;
+
+    // Target of primitives being rasterized.
+    unsigned char *target;
+    int target_width;
+    int target_height;
+    int tiles_x;
+    int tiles_y;
+
+    libtq_mutex mutex;
+    int next_tile;              // next tile to be taken by a worker
+
+    // Workers live as long as the renderer and sleep between flushes.
+    libtq_thread workers[NUM_WORKERS - 1];
+    int worker_count;
+    libtq_cond work_cond;       // signaled when a new flush begins
+    libtq_cond done_cond;       // signaled when the last worker finishes
+    unsigned int generation;    // incremented on each parallel flush
+    int busy_workers;
+    bool quit;
+
+    tq_frame_stats stats;
+    tq_frame_stats last_stats;
+};
+
+//------------------------------------------------------------------------------
+
+static struct soft_texture_array textures;
+static struct soft_surface_array surfaces;
+static struct tq_soft_renderer_priv priv;
+
+//------------------------------------------------------------------------------
+// Utility functions
+
+static void *grow_array(void *array, int *capacity, int required, size_t element_size, int initial)
+{
+    if (*capacity >= required) {
+        return array;
+    }
+
+    int next_capacity = TQ_MAX(*capacity, initial);
+
+    while (next_capacity < required) {
+        next_capacity *= 2;
+    }
+
+    void *next_array = libtq_realloc(array, next_capacity * element_size);
+
+    if (!next_array) {
+        libtq_out_of_memory();
+    }
+
+    *capacity = next_capacity;
+    return next_array;
+}
+
+static int64_t floor_div(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return ((n % d) != 0 && (n < 0)) ? (q - 1) : q;
+}
+
+static int64_t ceil_div(int64_t n, int64_t d)
+{
+    return -floor_div(-n, d);
+}
+
+/**
+ * x / 255, rounded to nearest. Exact for x in [0, 65535 - 383].
+ */
+static int div255(int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static unsigned char to_byte(float value)
+{
+    if (value <= 0.0f) {
+        return 0;
+    }
+
+    if (value >= 255.0f) {
+        return 255;
+    }
+
+    return (unsigned char) (value + 0.5f);
+}
+
+static bool compare_blend_mode(tq_blend_mode const *a, tq_blend_mode const *b)
+{
+    return (a->color_src_factor == b->color_src_factor)
+        && (a->color_dst_factor == b->color_dst_factor)
+        && (a->alpha_src_factor == b->alpha_src_factor)
+        && (a->alpha_dst_factor == b->alpha_dst_factor)
+        && (a->color_equation == b->color_equation)
+        && (a->alpha_equation == b->alpha_equation);
+}
+
+static void soft_texture_dtor(struct soft_texture *texture)
+{
+    libtq_free(texture->pixels);
+}
+
+static void soft_surface_dtor(struct soft_surface *surface)
+{
+    soft_texture_array_remove(&textures, surface->texture_id);
+}
+
+/**
+ * Convert pixel data with given number of channels to RGBA.
+ */
+static void expand_pixels(unsigned char *dst, unsigned char const *src, int count, int channels)
+{
+    for (int i = 0; i < count; i++, dst += 4, src += channels) {
+        dst[0] = src[0];
+        dst[1] = (channels > 1) ? src[1] : 0;
+        dst[2] = (channels > 2) ? src[2] : 0;
+        dst[3] = (channels > 3) ? src[3] : 255;
+    }
+}
+
+/**
+ * Make sure the default framebuffer matches the display size.
+ * Its contents are lost when it's resized.
+ */
+static void update_display(void)
+{
+    tq_vec2i size = tq_get_display_size();
+
+    if (priv.display && size.x == priv.display_width && size.y == priv.display_height) {
+        return;
+    }
+
+    libtq_free(priv.display);
+
+    priv.display = libtq_calloc((size_t) TQ_MAX(1, size.x) * TQ_MAX(1, size.y), 4);
+
+    if (!priv.display) {
+        libtq_out_of_memory();
+    }
+
+    priv.display_width = size.x;
+    priv.display_height = size.y;
+}
+
+/**
+ * Get pixels and size of the bound surface or the display.
+ */
+static unsigned char *get_target(int *width, int *height)
+{
+    if (soft_surface_array_check(&surfaces, priv.bound_surface_id)) {
+        struct soft_texture *texture = &textures.data[surfaces.data[priv.bound_surface_id].texture_id];
+
+        *width = texture->width;
+        *height = texture->height;
+
+        return texture->pixels;
+    }
+
+    update_display();
+
+    *width = priv.display_width;
+    *height = priv.display_height;
+
+    return priv.display;
+}
+
+//------------------------------------------------------------------------------
+// Pixel processing
+
+static void sample_texture(struct soft_texture const *texture, float s, float t, unsigned char *texel)
+{
+    int w = texture->width;
+    int h = texture->height;
+
+    if (!texture->smooth) {
+        int x = TQ_MAX(0, TQ_MIN((int) floorf(s * w), w - 1));
+        int y = TQ_MAX(0, TQ_MIN((int) floorf(t * h), h - 1));
+
+        memcpy(texel, texture->pixels + 4 * (y * w + x), 4);
+        return;
+    }
+
+    float u = s * w - 0.5f;
+    float v = t * h - 0.5f;
+    float u0 = floorf(u);
+    float v0 = floorf(v);
+
+    int wu = (int) ((u - u0) * 256.0f + 0.5f);
+    int wv = (int) ((v - v0) * 256.0f + 0.5f);
+
+    int x0 = TQ_MAX(0, TQ_MIN((int) u0, w - 1));
+    int y0 = TQ_MAX(0, TQ_MIN((int) v0, h - 1));
+    int x1 = TQ_MAX(0, TQ_MIN((int) u0 + 1, w - 1));
+    int y1 = TQ_MAX(0, TQ_MIN((int) v0 + 1, h - 1));
+
+    unsigned char const *p00 = texture->pixels + 4 * (y0 * w + x0);
+    unsigned char const *p10 = texture->pixels + 4 * (y0 * w + x1);
+    unsigned char const *p01 = texture->pixels + 4 * (y1 * w + x0);
+    unsigned char const *p11 = texture->pixels + 4 * (y1 * w + x1);
+
+    for (int k = 0; k < 4; k++) {
+        int top = p00[k] * (256 - wu) + p10[k] * wu;
+        int bottom = p01[k] * (256 - wu) + p11[k] * wu;
+
+        texel[k] = (unsigned char) ((top * (256 - wv) + bottom * wv + 32768) >> 16);
+    }
+}
+
+static int get_blend_factor(tq_blend_factor factor, unsigned char const *src,
+    unsigned char const *dst, int channel)
+{
+    switch (factor) {
+    case TQ_BLEND_ZERO:                 return 0;
+    case TQ_BLEND_ONE:                  return 255;
+    case TQ_BLEND_SRC_COLOR:            return src[channel];
+    case TQ_BLEND_ONE_MINUS_SRC_COLOR:  return 255 - src[channel];
+    case TQ_BLEND_DST_COLOR:            return dst[channel];
+    case TQ_BLEND_ONE_MINUS_DST_COLOR:  return 255 - dst[channel];
+    case TQ_BLEND_SRC_ALPHA:            return src[3];
+    case TQ_BLEND_ONE_MINUS_SRC_ALPHA:  return 255 - src[3];
+    case TQ_BLEND_DST_ALPHA:            return dst[3];
+    case TQ_BLEND_ONE_MINUS_DST_ALPHA:  return 255 - dst[3];
+    }
+
+    return 0;
+}
+
+static unsigned char apply_blend_equation(tq_blend_equation equation, int src, int dst)
+{
+    int x;
+
+    switch (equation) {
+    case TQ_BLEND_SUB:
+        x = src - dst;
+        break;
+    case TQ_BLEND_REV_SUB:
+        x = dst - src;
+        break;
+    default:
+        x = src + dst;
+        break;
+    }
+
+    return (unsigned char) div255(TQ_MAX(0, TQ_MIN(x, 255 * 255)));
+}
+
+/**
+ * Blend a single pixel with any blend mode.
+ */
+static void blend_pixel(unsigned char *dst, unsigned char const *src, tq_blend_mode const *mode)
+{
+    unsigned char result[4];
+
+    for (int k = 0; k < 3; k++) {
+        int s = src[k] * get_blend_factor(mode->color_src_factor, src, dst, k);
+        int d = dst[k] * get_blend_factor(mode->color_dst_factor, src, dst, k);
+
+        result[k] = apply_blend_equation(mode->color_equation, s, d);
+    }
+
+    int s = src[3] * get_blend_factor(mode->alpha_src_factor, src, dst, 3);
+    int d = dst[3] * get_blend_factor(mode->alpha_dst_factor, src, dst, 3);
+
+    result[3] = apply_blend_equation(mode->alpha_equation, s, d);
+
+    memcpy(dst, result, 4);
+}
+
+/**
+ * Blend a span of pixels with a constant color using the standard
+ * alpha blend mode. This is what most fills come down to.
+ * Results are the same as of blend_pixel().
+ */
+static void blend_span_alpha(unsigned char *dst, int count, unsigned char const *color)
+{
+    int alpha = color[3];
+    int inv_alpha = 255 - alpha;
+    int terms[4];
+
+    for (int k = 0; k < 4; k++) {
+        terms[k] = color[k] * alpha + 128;
+    }
+
+#if defined(TQ_SOFT_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i factor = _mm_set1_epi16((short) inv_alpha);
+    __m128i term = _mm_setr_epi16(
+        (short) terms[0], (short) terms[1], (short) terms[2], (short) terms[3],
+        (short) terms[0], (short) terms[1], (short) terms[2], (short) terms[3]);
+
+    // Products fit in 16 bits: d * (255 - a) + s * a + 128 <= 65153.
+    for (; count >= 4; count -= 4, dst += 16) {
+        __m128i pixels = _mm_loadu_si128((__m128i const *) dst);
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, factor), term);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, factor), term);
+
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i *) dst, _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; count > 0; count--, dst += 4) {
+        for (int k = 0; k < 4; k++) {
+            int x = dst[k] * inv_alpha + terms[k];
+            dst[k] = (unsigned char) ((x + (x >> 8)) >> 8);
+        }
+    }
+}
+
+static void fill_span(unsigned char *dst, int count, unsigned char const *color)
+{
+    uint32_t value;
+    memcpy(&value, color, 4);
+
+#if defined(TQ_SOFT_SSE2)
+    __m128i pixels = _mm_set1_epi32((int) value);
+
+    for (; count >= 4; count -= 4, dst += 16) {
+        _mm_storeu_si128((__m128i *) dst, pixels);
+    }
+#endif
+
+    for (; count > 0; count--, dst += 4) {
+        memcpy(dst, &value, 4);
+    }
+}
+
+/**
+ * Shade and blend a horizontal run of covered pixels.
+ */
+static void shade_span(struct soft_primitive const *primitive, unsigned char *dst, int x, int y, int count)
+{
+    static tq_blend_mode const alpha_mode = TQ_BLEND_MODE_ALPHA;
+    bool alpha_blend = compare_blend_mode(&primitive->blend_mode, &alpha_mode);
+
+    if (primitive->program_id == PROGRAM_COLORED && primitive->flat) {
+        if (alpha_blend) {
+            blend_span_alpha(dst, count, primitive->color);
+        } else {
+            for (int i = 0; i < count; i++) {
+                blend_pixel(dst + 4 * i, primitive->color, &primitive->blend_mode);
+            }
+        }
+
+        return;
+    }
+
+    struct soft_texture const *texture = NULL;
+
+    if (primitive->program_id != PROGRAM_COLORED
+            && soft_texture_array_check(&textures, primitive->texture_id)) {
+        texture = &textures.data[primitive->texture_id];
+    }
+
+    float dx = (x + 0.5f) - primitive->origin_x;
+    float dy = (y + 0.5f) - primitive->origin_y;
+    float attribs[ATTRIB_COUNT];
+
+    for (int k = 0; k < ATTRIB_COUNT; k++) {
+        attribs[k] = primitive->attribs[k]
+            + primitive->attribs_dx[k] * dx
+            + primitive->attribs_dy[k] * dy;
+    }
+
+    for (int i = 0; i < count; i++, dst += 4) {
+        unsigned char color[4];
+        unsigned char src[4];
+
+        if (primitive->flat) {
+            memcpy(color, primitive->color, 4);
+        } else {
+            for (int k = 0; k < 4; k++) {
+                color[k] = to_byte(attribs[ATTRIB_R + k]);
+            }
+        }
+
+        if (primitive->program_id == PROGRAM_COLORED) {
+            memcpy(src, color, 4);
+        } else {
+            // Incomplete textures are sampled as opaque black.
+            unsigned char texel[4] = { 0, 0, 0, 255 };
+
+            if (texture) {
+                sample_texture(texture, attribs[ATTRIB_S], attribs[ATTRIB_T], texel);
+            }
+
+            if (primitive->program_id == PROGRAM_FONT) {
+                texel[3] = texel[0];
+                texel[0] = texel[1] = texel[2] = 255;
+            }
+
+            for (int k = 0; k < 4; k++) {
+                src[k] = (unsigned char) div255(texel[k] * color[k]);
+            }
+        }
+
+        if (alpha_blend) {
+            for (int k = 0; k < 4; k++) {
+                dst[k] = (unsigned char) div255(dst[k] * (255 - src[3]) + src[k] * src[3]);
+            }
+        } else {
+            blend_pixel(dst, src, &primitive->blend_mode);
+        }
+
+        for (int k = 0; k < ATTRIB_COUNT; k++) {
+            attribs[k] += primitive->attribs_dx[k];
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Rasterization
+
+/**
+ * Rasterize part of a triangle inside the given rectangle.
+ * For each row, the covered span is found directly from the edge
+ * functions, so no per-pixel coverage tests are needed.
+ */
+static void rasterize_triangle(struct soft_primitive const *primitive,
+    int x0, int y0, int x1, int y1)
+{
+    int min_x = TQ_MAX(x0, primitive->min_x);
+    int max_x = TQ_MIN(x1, primitive->max_x);
+    int min_y = TQ_MAX(y0, primitive->min_y);
+    int max_y = TQ_MIN(y1, primitive->max_y);
+
+    for (int y = min_y; y <= max_y; y++) {
+        int64_t py = (int64_t) y * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+        int64_t lo = min_x;
+        int64_t hi = max_x;
+
+        for (int e = 0; e < 3; e++) {
+            int64_t a = primitive->edge_a[e];
+            int64_t k = primitive->edge_b[e] * py + primitive->edge_c[e];
+
+            // a * (x * ONE + ONE / 2) + k >= 0
+            if (a > 0) {
+                lo = TQ_MAX(lo, ceil_div(-k - a * (SUBPIXEL_ONE / 2), a * SUBPIXEL_ONE));
+            } else if (a < 0) {
+                hi = TQ_MIN(hi, floor_div(k + a * (SUBPIXEL_ONE / 2), -a * SUBPIXEL_ONE));
+            } else if (k < 0) {
+                hi = lo - 1;
+            }
+        }
+
+        if (lo > hi) {
+            continue;
+        }
+
+        unsigned char *row = priv.target + 4 * ((size_t) y * priv.target_width + lo);
+        shade_span(primitive, row, (int) lo, y, (int) (hi - lo + 1));
+    }
+}
+
+static void rasterize_tile(int tile)
+{
+    struct soft_bin const *bin = &priv.bins[tile];
+
+    int x0 = (tile % priv.tiles_x) * TILE_SIZE;
+    int y0 = (tile / priv.tiles_x) * TILE_SIZE;
+    int x1 = TQ_MIN(x0 + TILE_SIZE, priv.target_width) - 1;
+    int y1 = TQ_MIN(y0 + TILE_SIZE, priv.target_height) - 1;
+
+    for (int i = 0; i < bin->count; i++) {
+        struct soft_primitive const *primitive = &priv.primitives[bin->primitives[i]];
+
+        if (primitive->kind == PRIMITIVE_CLEAR) {
+            for (int y = y0; y <= y1; y++) {
+                unsigned char *row = priv.target + 4 * ((size_t) y * priv.target_width + x0);
+                fill_span(row, x1 - x0 + 1, primitive->color);
+            }
+        } else {
+            rasterize_triangle(primitive, x0, y0, x1, y1);
+        }
+    }
+}
+
+/**
+ * Take tiles one by one until none are left.
+ * Each tile is processed by a single thread, and primitives
+ * within a tile are drawn in submission order.
+ */
+static int rasterize_tiles(void *data)
+{
+    int tile_count = priv.tiles_x * priv.tiles_y;
+
+    while (true) {
+        libtq_lock_mutex(priv.mutex);
+        int tile = priv.next_tile++;
+        libtq_unlock_mutex(priv.mutex);
+
+        if (tile >= tile_count) {
+            break;
+        }
+
+        if (priv.bins[tile].count > 0) {
+            rasterize_tile(tile);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Wait for a new flush, help with it, repeat.
+ */
+static int raster_worker(void *data)
+{
+    unsigned int generation = 0;
+
+    libtq_lock_mutex(priv.mutex);
+
+    while (true) {
+        while (!priv.quit && priv.generation == generation) {
+            libtq_wait_cond(priv.work_cond, priv.mutex);
+        }
+
+        if (priv.quit) {
+            break;
+        }
+
+        generation = priv.generation;
+        libtq_unlock_mutex(priv.mutex);
+
+        rasterize_tiles(NULL);
+
+        libtq_lock_mutex(priv.mutex);
+
+        if (--priv.busy_workers == 0) {
+            libtq_signal_cond(priv.done_cond);
+        }
+    }
+
+    libtq_unlock_mutex(priv.mutex);
+
+    return 0;
+}
+
+static void add_to_bin(int tile, int primitive_id)
+{
+    struct soft_bin *bin = &priv.bins[tile];
+
+    bin->primitives = grow_array(bin->primitives, &bin->capacity,
+        bin->count + 1, sizeof(int), INITIAL_PRIMITIVE_COUNT);
+
+    bin->primitives[bin->count++] = primitive_id;
+}
+
+/**
+ * Rasterize all queued primitives to the current target.
+ * Primitives are sorted into screen tiles which are then
+ * processed in parallel.
+ */
+static void flush_primitives(void)
+{
+    if (priv.primitive_count == 0) {
+        return;
+    }
+
+    priv.target = get_target(&priv.target_width, &priv.target_height);
+    priv.tiles_x = (priv.target_width + TILE_SIZE - 1) / TILE_SIZE;
+    priv.tiles_y = (priv.target_height + TILE_SIZE - 1) / TILE_SIZE;
+
+    int tile_count = priv.tiles_x * priv.tiles_y;
+    int old_capacity = priv.bin_capacity;
+
+    priv.bins = grow_array(priv.bins, &priv.bin_capacity, tile_count, sizeof(struct soft_bin), 16);
+    memset(priv.bins + old_capacity, 0, (priv.bin_capacity - old_capacity) * sizeof(struct soft_bin));
+
+    for (int i = 0; i < priv.primitive_count; i++) {
+        struct soft_primitive const *primitive = &priv.primitives[i];
+
+        if (primitive->kind == PRIMITIVE_CLEAR) {
+            for (int tile = 0; tile < tile_count; tile++) {
+                add_to_bin(tile, i);
+            }
+
+            continue;
+        }
+
+        int tx0 = primitive->min_x / TILE_SIZE;
+        int ty0 = primitive->min_y / TILE_SIZE;
+        int tx1 = TQ_MIN(primitive->max_x / TILE_SIZE, priv.tiles_x - 1);
+        int ty1 = TQ_MIN(primitive->max_y / TILE_SIZE, priv.tiles_y - 1);
+
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                add_to_bin(ty * priv.tiles_x + tx, i);
+            }
+        }
+    }
+
+    bool parallel = (priv.worker_count > 0)
+        && (tile_count >= MIN_PARALLEL_TILES)
+        && (priv.primitive_count >= MIN_PARALLEL_PRIMITIVES);
+
+    if (parallel) {
+        libtq_lock_mutex(priv.mutex);
+        priv.next_tile = 0;
+        priv.busy_workers = priv.worker_count;
+        priv.generation++;
+        libtq_broadcast_cond(priv.work_cond);
+        libtq_unlock_mutex(priv.mutex);
+    } else {
+        priv.next_tile = 0;
+    }
+
+    rasterize_tiles(NULL);
+
+    if (parallel) {
+        libtq_lock_mutex(priv.mutex);
+
+        while (priv.busy_workers > 0) {
+            libtq_wait_cond(priv.done_cond, priv.mutex);
+        }
+
+        libtq_unlock_mutex(priv.mutex);
+    }
+
+    for (int tile = 0; tile < tile_count; tile++) {
+        priv.bins[tile].count = 0;
+    }
+
+    priv.primitive_count = 0;
+    priv.stats.batch_count++;
+}
+
+static struct soft_primitive *add_primitive(int kind)
+{
+    priv.primitives = grow_array(priv.primitives, &priv.primitive_capacity,
+        priv.primitive_count + 1, sizeof(struct soft_primitive), INITIAL_PRIMITIVE_COUNT);
+
+    struct soft_primitive *primitive = &priv.primitives[priv.primitive_count++];
+
+    primitive->kind = kind;
+    primitive->blend_mode = priv.blend_mode;
+    primitive->texture_id = priv.bound_texture_id;
+
+    return primitive;
+}
+
+//------------------------------------------------------------------------------
+// Primitive setup
+
+static int64_t snap(float value)
+{
+    return (int64_t) floorf(value * SUBPIXEL_ONE + 0.5f);
+}
+
+/**
+ * Compute edge functions, bounding box and attribute planes
+ * of a triangle and queue it.
+ */
+static void setup_triangle(int program_id, struct soft_vertex const *v0,
+    struct soft_vertex const *v1, struct soft_vertex const *v2)
+{
+    int64_t x[3] = { snap(v0->x), snap(v1->x), snap(v2->x) };
+    int64_t y[3] = { snap(v0->y), snap(v1->y), snap(v2->y) };
+
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+    if (area == 0) {
+        return;
+    }
+
+    struct soft_vertex const *v[3] = { v0, v1, v2 };
+
+    // Make the winding counter-clockwise, so the inside is positive.
+    if (area < 0) {
+        int64_t tx = x[1], ty = y[1];
+        x[1] = x[2]; y[1] = y[2];
+        x[2] = tx; y[2] = ty;
+
+        v[1] = v2;
+        v[2] = v1;
+    }
+
+    int64_t min_x = TQ_MIN(x[0], TQ_MIN(x[1], x[2]));
+    int64_t min_y = TQ_MIN(y[0], TQ_MIN(y[1], y[2]));
+    int64_t max_x = TQ_MAX(x[0], TQ_MAX(x[1], x[2]));
+    int64_t max_y = TQ_MAX(y[0], TQ_MAX(y[1], y[2]));
+
+    int px0 = TQ_MAX(0, (int) floor_div(min_x, SUBPIXEL_ONE));
+    int py0 = TQ_MAX(0, (int) floor_div(min_y, SUBPIXEL_ONE));
+    int px1 = TQ_MIN(priv.target_width - 1, (int) floor_div(max_x, SUBPIXEL_ONE));
+    int py1 = TQ_MIN(priv.target_height - 1, (int) floor_div(max_y, SUBPIXEL_ONE));
+
+    if (px0 > px1 || py0 > py1) {
+        return;
+    }
+
+    struct soft_primitive *primitive = add_primitive(PRIMITIVE_TRIANGLE);
+
+    primitive->program_id = program_id;
+    primitive->min_x = px0;
+    primitive->min_y = py0;
+    primitive->max_x = px1;
+    primitive->max_y = py1;
+
+    for (int e = 0; e < 3; e++) {
+        int i = (e + 1) % 3;
+        int j = (e + 2) % 3;
+
+        int64_t a = y[i] - y[j];
+        int64_t b = x[j] - x[i];
+
+        // Pixels exactly on an edge belong to only one of the two
+        // triangles sharing it.
+        bool inclusive = (a > 0) || (a == 0 && b < 0);
+
+        primitive->edge_a[e] = a;
+        primitive->edge_b[e] = b;
+        primitive->edge_c[e] = x[i] * y[j] - x[j] * y[i] - (inclusive ? 0 : 1);
+    }
+
+    float fx[3], fy[3];
+
+    for (int i = 0; i < 3; i++) {
+        fx[i] = x[i] / (float) SUBPIXEL_ONE;
+        fy[i] = y[i] / (float) SUBPIXEL_ONE;
+    }
+
+    float dx1 = fx[1] - fx[0], dy1 = fy[1] - fy[0];
+    float dx2 = fx[2] - fx[0], dy2 = fy[2] - fy[0];
+    float det = dx1 * dy2 - dx2 * dy1;
+
+    primitive->origin_x = fx[0];
+    primitive->origin_y = fy[0];
+
+    for (int k = 0; k < ATTRIB_COUNT; k++) {
+        float a0 = v[0]->attribs[k];
+        float da1 = v[1]->attribs[k] - a0;
+        float da2 = v[2]->attribs[k] - a0;
+
+        primitive->attribs[k] = a0;
+        primitive->attribs_dx[k] = (da1 * dy2 - da2 * dy1) / det;
+        primitive->attribs_dy[k] = (da2 * dx1 - da1 * dx2) / det;
+    }
+
+    primitive->flat = true;
+
+    for (int k = ATTRIB_R; k <= ATTRIB_A; k++) {
+        if (v[0]->attribs[k] != v[1]->attribs[k] || v[0]->attribs[k] != v[2]->attribs[k]) {
+            primitive->flat = false;
+        }
+
+        primitive->color[k - ATTRIB_R] = to_byte(v[0]->attribs[k]);
+    }
+}
+
+static void lerp_vertex(struct soft_vertex *dst, struct soft_vertex const *a,
+    struct soft_vertex const *b, float t)
+{
+    dst->x = a->x + (b->x - a->x) * t;
+    dst->y = a->y + (b->y - a->y) * t;
+
+    for (int k = 0; k < ATTRIB_COUNT; k++) {
+        dst->attribs[k] = a->attribs[k] + (b->attribs[k] - a->attribs[k]) * t;
+    }
+}
+
+/**
+ * Clip polygon by one side of the guard band.
+ * Returns number of resulting vertices.
+ */
+static int clip_polygon(struct soft_vertex *dst, struct soft_vertex const *src, int count,
+    int axis, float sign, float limit)
+{
+    int result = 0;
+
+    for (int i = 0; i < count; i++) {
+        struct soft_vertex const *a = &src[i];
+        struct soft_vertex const *b = &src[(i + 1) % count];
+
+        float da = sign * ((axis == 0) ? a->x : a->y) - limit;
+        float db = sign * ((axis == 0) ? b->x : b->y) - limit;
+
+        if (da <= 0.0f) {
+            dst[result++] = *a;
+        }
+
+        if ((da < 0.0f && db > 0.0f) || (da > 0.0f && db < 0.0f)) {
+            lerp_vertex(&dst[result++], a, b, da / (da - db));
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Queue a triangle. Triangles that reach far outside the target are
+ * clipped first to keep fixed point coordinates in range.
+ */
+static void add_triangle(int program_id, struct soft_vertex const *v0,
+    struct soft_vertex const *v1, struct soft_vertex const *v2)
+{
+    float x0 = -GUARD_BAND;
+    float y0 = -GUARD_BAND;
+    float x1 = priv.target_width + GUARD_BAND;
+    float y1 = priv.target_height + GUARD_BAND;
+
+    struct soft_vertex const *v[3] = { v0, v1, v2 };
+    bool inside = true;
+
+    for (int i = 0; i < 3; i++) {
+        if (!(v[i]->x >= x0 && v[i]->x <= x1 && v[i]->y >= y0 && v[i]->y <= y1)) {
+            inside = false;
+        }
+    }
+
+    if (inside) {
+        setup_triangle(program_id, v0, v1, v2);
+        return;
+    }
+
+    struct soft_vertex polygon[MAX_CLIP_VERTICES];
+    struct soft_vertex temp[MAX_CLIP_VERTICES];
+
+    polygon[0] = *v0;
+    polygon[1] = *v1;
+    polygon[2] = *v2;
+
+    int count = 3;
+
+    count = clip_polygon(temp, polygon, count, 0, -1.0f, -x0);
+    count = clip_polygon(polygon, temp, count, 0, 1.0f, x1);
+    count = clip_polygon(temp, polygon, count, 1, -1.0f, -y0);
+    count = clip_polygon(polygon, temp, count, 1, 1.0f, y1);
+
+    for (int i = 1; i < count - 1; i++) {
+        setup_triangle(program_id, &polygon[0], &polygon[i], &polygon[i + 1]);
+    }
+}
+
+/**
+ * Expand a point to a pixel-sized square.
+ */
+static void add_point(struct soft_vertex const *v)
+{
+    struct soft_vertex corners[4];
+
+    for (int i = 0; i < 4; i++) {
+        corners[i] = *v;
+        corners[i].x += (i == 1 || i == 2) ? 0.5f : -0.5f;
+        corners[i].y += (i >= 2) ? 0.5f : -0.5f;
+    }
+
+    add_triangle(PROGRAM_COLORED, &corners[0], &corners[1], &corners[2]);
+    add_triangle(PROGRAM_COLORED, &corners[0], &corners[2], &corners[3]);
+}
+
+/**
+ * Expand a line to a parallelogram one pixel thick along its minor
+ * axis, which covers one pixel per column (or row), like OpenGL does.
+ */
+static void add_line(struct soft_vertex const *a, struct soft_vertex const *b)
+{
+    bool x_major = fabsf(b->x - a->x) >= fabsf(b->y - a->y);
+    struct soft_vertex corners[4] = { *a, *b, *b, *a };
+
+    for (int i = 0; i < 4; i++) {
+        float offset = (i < 2) ? -0.5f : 0.5f;
+
+        if (x_major) {
+            corners[i].y += offset;
+        } else {
+            corners[i].x += offset;
+        }
+    }
+
+    add_triangle(PROGRAM_COLORED, &corners[0], &corners[1], &corners[2]);
+    add_triangle(PROGRAM_COLORED, &corners[0], &corners[2], &corners[3]);
+}
+
+/**
+ * Transform vertices to window coordinates.
+ * Input vertices are (x, y), (x, y, r, g, b, a) or (x, y, s, t).
+ */
+static struct soft_vertex *process_vertices(float const *data, int num_vertices,
+    int stride, bool colored, bool textured, unsigned char const *color)
+{
+    priv.vertices = grow_array(priv.vertices, &priv.vertex_capacity,
+        num_vertices, sizeof(struct soft_vertex), INITIAL_VERTEX_COUNT);
+
+    priv.target = get_target(&priv.target_width, &priv.target_height);
+
+    float const *m = priv.transform;
+    float half_width = priv.target_width * 0.5f;
+    float half_height = priv.target_height * 0.5f;
+
+    for (int i = 0; i < num_vertices; i++, data += stride) {
+        struct soft_vertex *v = &priv.vertices[i];
+
+        float x = m[0] * data[0] + m[1] * data[1] + m[3];
+        float y = m[4] * data[0] + m[5] * data[1] + m[7];
+        float w = m[12] * data[0] + m[13] * data[1] + m[15];
+
+        v->x = (x / w + 1.0f) * half_width;
+        v->y = (y / w + 1.0f) * half_height;
+
+        v->attribs[ATTRIB_S] = textured ? data[2] : 0.0f;
+        v->attribs[ATTRIB_T] = textured ? data[3] : 0.0f;
+
+        for (int k = 0; k < 4; k++) {
+            v->attribs[ATTRIB_R + k] = colored ? (data[2 + k] * 255.0f) : color[k];
+        }
+    }
+
+    return priv.vertices;
+}
+
+static void add_primitive_vertices(int program_id, int mode, struct soft_vertex const *v, int count)
+{
+    priv.stats.vertex_count += count;
+
+    switch (mode) {
+    case TQ_PRIMITIVE_POINTS:
+        for (int i = 0; i < count; i++) {
+            add_point(&v[i]);
+        }
+        break;
+    case TQ_PRIMITIVE_LINE_STRIP:
+    case TQ_PRIMITIVE_LINE_LOOP:
+        for (int i = 0; i < count - 1; i++) {
+            add_line(&v[i], &v[i + 1]);
+        }
+
+        if (mode == TQ_PRIMITIVE_LINE_LOOP && count > 2) {
+            add_line(&v[count - 1], &v[0]);
+        }
+        break;
+    case TQ_PRIMITIVE_TRIANGLES:
+        for (int i = 0; i + 2 < count; i += 3) {
+            add_triangle(program_id, &v[i], &v[i + 1], &v[i + 2]);
+        }
+        break;
+    case TQ_PRIMITIVE_TRIANGLE_FAN:
+        for (int i = 1; i + 1 < count; i++) {
+            add_triangle(program_id, &v[0], &v[i], &v[i + 1]);
+        }
+        break;
+    }
+}
+
+static void add_quads(int program_id, float const *data, int num_quads, unsigned char const *color)
+{
+    struct soft_vertex const *v = process_vertices(data, 4 * num_quads, 4, false, true, color);
+    priv.stats.vertex_count += 4 * num_quads;
+
+    for (int i = 0; i < num_quads; i++, v += 4) {
+        add_triangle(program_id, &v[0], &v[1], &v[2]);
+        add_triangle(program_id, &v[0], &v[2], &v[3]);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void initialize(void)
+{
+    soft_texture_array_initialize(&textures, 16, soft_texture_dtor);
+    soft_surface_array_initialize(&surfaces, 8, soft_surface_dtor);
+
+    mat4_identity(priv.projection);
+    mat4_identity(priv.model_view);
+    mat4_identity(priv.transform);
+
+    memset(priv.draw_color, 255, 4);
+    priv.blend_mode = TQ_BLEND_MODE_ALPHA;
+    priv.bound_texture_id = -1;
+    priv.bound_surface_id = -1;
+
+    priv.mutex = libtq_create_mutex();
+    priv.work_cond = libtq_create_cond();
+    priv.done_cond = libtq_create_cond();
+
+    for (int i = 0; i < NUM_WORKERS - 1; i++) {
+        libtq_thread worker = libtq_create_thread("tq-raster", raster_worker, NULL);
+
+        if (worker) {
+            priv.workers[priv.worker_count++] = worker;
+        }
+    }
+
+    update_display();
+
+    libtq_log(0, "Software renderer initialized (%d threads).\n", priv.worker_count + 1);
+}
+
+static void terminate(void)
+{
+    libtq_lock_mutex(priv.mutex);
+    priv.quit = true;
+    libtq_broadcast_cond(priv.work_cond);
+    libtq_unlock_mutex(priv.mutex);
+
+    for (int i = 0; i < priv.worker_count; i++) {
+        libtq_wait_thread(priv.workers[i]);
+    }
+
+    soft_surface_array_terminate(&surfaces);
+    soft_texture_array_terminate(&textures);
+
+    for (int i = 0; i < priv.bin_capacity; i++) {
+        libtq_free(priv.bins[i].primitives);
+    }
+
+    libtq_free(priv.bins);
+    libtq_free(priv.primitives);
+    libtq_free(priv.vertices);
+    libtq_free(priv.display);
+    libtq_destroy_cond(priv.done_cond);
+    libtq_destroy_cond(priv.work_cond);
+    libtq_destroy_mutex(priv.mutex);
+
+    memset(&priv, 0, sizeof(priv));
+}
+
+static void process(void)
+{
+    flush_primitives();
+}
+
+static void post_process(void)
+{
+    flush_primitives();
+
+    priv.last_stats = priv.stats;
+    memset(&priv.stats, 0, sizeof(priv.stats));
+}
+
+static int request_antialiasing_level(int level)
+{
+    return 1;
+}
+
+static void update_transform(void)
+{
+    mat4_copy(priv.transform, priv.projection);
+    mat4_multiply(priv.transform, priv.model_view);
+}
+
+static void update_projection(float const *mat4)
+{
+    mat4_copy(priv.projection, mat4);
+    update_transform();
+}
+
+static void update_model_view(float const *mat3)
+{
+    mat4_expand(priv.model_view, mat3);
+    update_transform();
+}
+
+static int create_texture(int width, int height, int channels)
+{
+    if ((width < 0) || (height < 0) || (channels < 1) || (channels > 4)) {
+        return -1;
+    }
+
+    struct soft_texture texture = {
+        .width = width,
+        .height = height,
+        .channels = channels,
+        .pixels = libtq_calloc((size_t) TQ_MAX(1, width) * TQ_MAX(1, height), 4),
+        .smooth = false,
+        .mipmapped = false,
+        .surface_id = -1,
+    };
+
+    if (!texture.pixels) {
+        libtq_out_of_memory();
+    }
+
+    return soft_texture_array_add(&textures, &texture);
+}
+
+static void delete_texture(int texture_id)
+{
+    flush_primitives();
+    soft_texture_array_remove(&textures, texture_id);
+}
+
+static bool is_texture_smooth(int texture_id)
+{
+    if (!soft_texture_array_check(&textures, texture_id)) {
+        return false;
+    }
+
+    return textures.data[texture_id].smooth;
+}
+
+static void set_texture_smooth(int texture_id, bool smooth)
+{
+    if (!soft_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    flush_primitives();
+    textures.data[texture_id].smooth = smooth;
+}
+
+static void set_texture_mipmapped(int texture_id, bool mipmapped)
+{
+    if (!soft_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    textures.data[texture_id].mipmapped = mipmapped;
+}
+
+static void get_texture_size(int texture_id, int *width, int *height)
+{
+    if (!soft_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    *width = textures.data[texture_id].width;
+    *height = textures.data[texture_id].height;
+}
+
+static void update_texture(int texture_id, int x_offset, int y_offset,
+    int width, int height, unsigned char *pixels)
+{
+    if (!soft_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    if (!pixels) {
+        return;
+    }
+
+    flush_primitives();
+
+    struct soft_texture *texture = &textures.data[texture_id];
+
+    if (width == -1 && height == -1) {
+        width = texture->width;
+        height = texture->height;
+    }
+
+    if (x_offset < 0 || y_offset < 0 || x_offset + width > texture->width
+            || y_offset + height > texture->height) {
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        expand_pixels(texture->pixels + 4 * ((y_offset + y) * texture->width + x_offset),
+            pixels + (size_t) y * width * texture->channels, width, texture->channels);
+    }
+
+    priv.stats.texture_upload_bytes += (long) width * height * texture->channels;
+}
+
+/**
+ * Textures are stored expanded to RGBA, so pixels can't be written
+ * in place. Callers use update_texture() instead.
+ */
+static unsigned char *map_texture(int texture_id, int x_offset, int y_offset,
+    int width, int height)
+{
+    return NULL;
+}
+
+static void unmap_texture(void)
+{
+}
+
+static void resize_texture(int texture_id, int width, int height, int channels)
+{
+    if (!soft_texture_array_check(&textures, texture_id)) {
+        return;
+    }
+
+    if ((width < 0) || (height < 0) || (channels < 1) || (channels > 4)) {
+        return;
+    }
+
+    flush_primitives();
+
+    struct soft_texture *texture = &textures.data[texture_id];
+    unsigned char *pixels = libtq_calloc((size_t) TQ_MAX(1, width) * TQ_MAX(1, height), 4);
+
+    if (!pixels) {
+        libtq_out_of_memory();
+    }
+
+    libtq_free(texture->pixels);
+
+    texture->pixels = pixels;
+    texture->width = width;
+    texture->height = height;
+    texture->channels = channels;
+}
+
+static bool is_compressed_format_supported(int format)
+{
+    return false;
+}
+
+static void upload_compressed_texture(int texture_id, int width, int height,
+    int format, void const *data, size_t size)
+{
+    // Never called: no compressed format is reported as supported,
+    // so such textures are decompressed before upload.
+}
+
+static void bind_texture(int texture_id)
+{
+    if (priv.bound_texture_id != texture_id) {
+        priv.bound_texture_id = texture_id;
+        priv.stats.texture_binds++;
+    }
+}
+
+static int create_surface(int width, int height)
+{
+    int texture_id = create_texture(width, height, 4);
+
+    if (texture_id == -1) {
+        return -1;
+    }
+
+    struct soft_surface surface = {
+        .texture_id = texture_id,
+    };
+
+    int surface_id = soft_surface_array_add(&surfaces, &surface);
+
+    textures.data[texture_id].smooth = true;
+    textures.data[texture_id].surface_id = surface_id;
+
+    return surface_id;
+}
+
+static void delete_surface(int surface_id)
+{
+    flush_primitives();
+    soft_surface_array_remove(&surfaces, surface_id);
+}
+
+static int get_surface_texture_id(int surface_id)
+{
+    if (!soft_surface_array_check(&surfaces, surface_id)) {
+        return -1;
+    }
+
+    return surfaces.data[surface_id].texture_id;
+}
+
+static void bind_surface(int surface_id)
+{
+    if (priv.bound_surface_id == surface_id) {
+        return;
+    }
+
+    flush_primitives();
+    priv.bound_surface_id = surface_id;
+    priv.stats.surface_switches++;
+}
+
+static void set_clear_color(tq_color color)
+{
+    priv.clear_color[0] = color.r;
+    priv.clear_color[1] = color.g;
+    priv.clear_color[2] = color.b;
+    priv.clear_color[3] = 255;
+}
+
+static void set_draw_color(tq_color color)
+{
+    priv.draw_color[0] = color.r;
+    priv.draw_color[1] = color.g;
+    priv.draw_color[2] = color.b;
+    priv.draw_color[3] = color.a;
+}
+
+static void set_blend_mode(tq_blend_mode mode)
+{
+    priv.blend_mode = mode;
+}
+
+static void clear(void)
+{
+    // Everything queued before is overwritten anyway.
+    priv.primitive_count = 0;
+
+    struct soft_primitive *primitive = add_primitive(PRIMITIVE_CLEAR);
+    memcpy(primitive->color, priv.clear_color, 4);
+}
+
+static void draw_solid(int mode, float const *data, int num_vertices)
+{
+    struct soft_vertex const *v = process_vertices(data, num_vertices, 2, false, false, priv.draw_color);
+    add_primitive_vertices(PROGRAM_COLORED, mode, v, num_vertices);
+}
+
+static void draw_colored(int mode, float const *data, int num_vertices)
+{
+    struct soft_vertex const *v = process_vertices(data, num_vertices, 6, true, false, NULL);
+    add_primitive_vertices(PROGRAM_COLORED, mode, v, num_vertices);
+}
+
+static void draw_textured(int mode, float const *data, int num_vertices)
+{
+    static unsigned char const white[4] = { 255, 255, 255, 255 };
+
+    struct soft_vertex const *v = process_vertices(data, num_vertices, 4, false, true, white);
+    add_primitive_vertices(PROGRAM_TEXTURED, mode, v, num_vertices);
+}
+
+static void draw_quads(float const *data, int num_quads)
+{
+    static unsigned char const white[4] = { 255, 255, 255, 255 };
+
+    add_quads(PROGRAM_TEXTURED, data, num_quads, white);
+}
+
+static void draw_font(float const *data, int num_quads)
+{
+    add_quads(PROGRAM_FONT, data, num_quads, priv.draw_color);
+}
+
+/**
+ * Sprites are expanded to quads the same way the instancing
+ * vertex shader of the OpenGL renderer does it.
+ */
+static void draw_sprites_instanced(tq_sprite_instance const *sprites, int count)
+{
+    float quad[16];
+
+    for (int i = 0; i < count; i++) {
+        tq_sprite_instance const *sprite = &sprites[i];
+
+        float c = cosf(RADIANS(sprite->rotation));
+        float s = sinf(RADIANS(sprite->rotation));
+        float center_x = sprite->dst.x + 0.5f * sprite->dst.w;
+        float center_y = sprite->dst.y + 0.5f * sprite->dst.h;
+
+        for (int corner = 0; corner < 4; corner++) {
+            float u = (corner == 1 || corner == 2) ? 1.0f : 0.0f;
+            float v = (corner >= 2) ? 1.0f : 0.0f;
+            float offset_x = (u - 0.5f) * sprite->dst.w;
+            float offset_y = (v - 0.5f) * sprite->dst.h;
+
+            quad[4 * corner + 0] = center_x + c * offset_x - s * offset_y;
+            quad[4 * corner + 1] = center_y + s * offset_x + c * offset_y;
+            quad[4 * corner + 2] = sprite->uv.x + u * sprite->uv.w;
+            quad[4 * corner + 3] = sprite->uv.y + v * sprite->uv.h;
+        }
+
+        unsigned char tint[4] = { sprite->tint.r, sprite->tint.g, sprite->tint.b, sprite->tint.a };
+        add_quads(PROGRAM_TEXTURED, quad, 1, tint);
+    }
+}
+
+/**
+ * Copy the canvas surface to the display, like glBlitFramebuffer().
+ */
+static void draw_canvas(float x0, float y0, float x1, float y1)
+{
+    flush_primitives();
+
+    if (!soft_texture_array_check(&textures, priv.bound_texture_id)) {
+        return;
+    }
+
+    struct soft_texture const *texture = &textures.data[priv.bound_texture_id];
+
+    update_display();
+
+    int width = priv.display_width;
+    int height = priv.display_height;
+
+    int dst_x0 = (int) (0.5f + (x0 + 1.0f) * 0.5f * width);
+    int dst_y0 = (int) (0.5f + (y0 + 1.0f) * 0.5f * height);
+    int dst_x1 = (int) (0.5f + (x1 + 1.0f) * 0.5f * width);
+    int dst_y1 = (int) (0.5f + (y1 + 1.0f) * 0.5f * height);
+
+    if (dst_x1 <= dst_x0 || dst_y1 <= dst_y0) {
+        return;
+    }
+
+    // Letterbox bars.
+    if (dst_x0 > 0 || dst_y0 > 0 || dst_x1 < width || dst_y1 < height) {
+        unsigned char const black[4] = { 0, 0, 0, 255 };
+
+        for (int y = 0; y < height; y++) {
+            fill_span(priv.display + 4 * (size_t) y * width, width, black);
+        }
+    }
+
+    bool scaled = (dst_x1 - dst_x0 != texture->width) || (dst_y1 - dst_y0 != texture->height);
+    struct soft_texture sampler = *texture;
+
+    sampler.smooth = scaled && texture->smooth;
+
+    for (int y = TQ_MAX(0, dst_y0); y < TQ_MIN(height, dst_y1); y++) {
+        float t = (y + 0.5f - dst_y0) / (dst_y1 - dst_y0);
+        unsigned char *row = priv.display + 4 * (size_t) y * width;
+
+        for (int x = TQ_MAX(0, dst_x0); x < TQ_MIN(width, dst_x1); x++) {
+            float s = (x + 0.5f - dst_x0) / (dst_x1 - dst_x0);
+            sample_texture(&sampler, s, t, row + 4 * x);
+        }
+    }
+}
+
+static void read_pixels(int surface_id, unsigned char *pixels)
+{
+    flush_primitives();
+
+    if (soft_surface_array_check(&surfaces, surface_id)) {
+        struct soft_texture const *texture = &textures.data[surfaces.data[surface_id].texture_id];
+        memcpy(pixels, texture->pixels, (size_t) texture->width * texture->height * 4);
+    } else {
+        update_display();
+        memcpy(pixels, priv.display, (size_t) priv.display_width * priv.display_height * 4);
+    }
+}
+
+static void get_stats(tq_frame_stats *stats)
+{
+    stats->batch_count = priv.last_stats.batch_count;
+    stats->vertex_count = priv.last_stats.vertex_count;
+    stats->texture_binds = priv.last_stats.texture_binds;
+    stats->surface_switches = priv.last_stats.surface_switches;
+    stats->texture_upload_bytes = priv.last_stats.texture_upload_bytes;
+}
+
+//------------------------------------------------------------------------------
+// Module constructor
+
+void tq_construct_soft_renderer(tq_renderer_impl *impl)
+{
+    *impl = (tq_renderer_impl) {
+        .initialize = initialize,
+        .terminate = terminate,
+        .process = process,
+        .post_process = post_process,
+
+        .request_antialiasing_level = request_antialiasing_level,
+
+        .update_projection = update_projection,
+        .update_model_view = update_model_view,
+
+        .create_texture = create_texture,
+        .delete_texture = delete_texture,
+        .is_texture_smooth = is_texture_smooth,
+        .set_texture_smooth = set_texture_smooth,
+        .set_texture_mipmapped = set_texture_mipmapped,
+        .get_texture_size = get_texture_size,
+        .update_texture = update_texture,
+        .map_texture = map_texture,
+        .unmap_texture = unmap_texture,
+        .resize_texture = resize_texture,
+        .is_compressed_format_supported = is_compressed_format_supported,
+        .upload_compressed_texture = upload_compressed_texture,
+        .bind_texture = bind_texture,
+
+        .create_surface = create_surface,
+        .delete_surface = delete_surface,
+        .get_surface_texture_id = get_surface_texture_id,
+        .bind_surface = bind_surface,
+
+        .set_clear_color = set_clear_color,
+        .set_draw_color = set_draw_color,
+        .set_blend_mode = set_blend_mode,
+
+        .clear = clear,
+        .draw_solid = draw_solid,
+        .draw_colored = draw_colored,
+        .draw_textured = draw_textured,
+        .draw_quads = draw_quads,
+        .draw_font = draw_font,
+        .draw_sprites_instanced = draw_sprites_instanced,
+        .draw_canvas = draw_canvas,
+        .read_pixels = read_pixels,
+
+        .get_stats = get_stats,
+    };
+}
@@ -332,7 +332,7 @@ libtq_stream *libtq_open_memory_stream(void const *buffer, size_t size)
         },
     };
 
-    snprintf("%p", STREAM_NAME_LENGTH, stream->info.memory.repr, buffer);
+    snprintf(stream->info.memory.repr, STREAM_NAME_LENGTH, "%p", buffer);
 
     libtq_log(0, "Opened memory stream: %s\n", stream->repr(stream));
     return stream;
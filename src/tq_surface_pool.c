@@ -0,0 +1,219 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#include <string.h>
+
+#include "tq_handle_list.h"
+#include "tq_surface_pool.h"
+
+//------------------------------------------------------------------------------
+
+/**
+ * Released surface is deleted if it wasn't acquired again
+ * during this number of frames.
+ */
+#define MAX_IDLE_FRAMES             4
+
+//------------------------------------------------------------------------------
+
+/**
+ * Surface kept by the pool. Surfaces are interchangeable
+ * if their size and antialiasing level are the same.
+ * All surfaces are RGBA, so there is no need to compare formats.
+ */
+struct pooled_surface
+{
+    int surface_id;
+    int width;
+    int height;
+    int samples;
+    bool in_use;
+    unsigned int release_frame;
+};
+
+DECLARE_FLEXIBLE_ARRAY(pooled_surface)
+
+/**
+ * Private data for [surface_pool] module.
+ */
+struct tq_surface_pool_priv
+{
+    tq_renderer_impl *renderer;
+    bool initialized;
+
+    unsigned int frame;
+    struct pooled_surface_array surfaces;
+};
+
+static struct tq_surface_pool_priv priv;
+
+//------------------------------------------------------------------------------
+
+static void pooled_surface_dtor(struct pooled_surface *surface)
+{
+    priv.renderer->delete_surface(surface->surface_id);
+}
+
+static int find_pooled_surface(int surface_id)
+{
+    for (int i = 0; i < priv.surfaces.count; i++) {
+        if (priv.surfaces.init[i] && priv.surfaces.data[i].surface_id == surface_id) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+
+void tq_initialize_surface_pool(tq_renderer_impl *renderer)
+{
+    priv.renderer = renderer;
+    priv.frame = 0;
+
+    pooled_surface_array_initialize(&priv.surfaces, 8, pooled_surface_dtor);
+
+    priv.initialized = true;
+}
+
+void tq_terminate_surface_pool(void)
+{
+    if (!priv.initialized) {
+        return;
+    }
+
+    pooled_surface_array_terminate(&priv.surfaces);
+    priv.initialized = false;
+}
+
+/**
+ * Should be called once per frame. Deletes surfaces that
+ * stayed unused for too long.
+ */
+void tq_process_surface_pool(void)
+{
+    if (!priv.initialized) {
+        return;
+    }
+
+    priv.frame++;
+
+    for (int i = 0; i < priv.surfaces.count; i++) {
+        if (!priv.surfaces.init[i] || priv.surfaces.data[i].in_use) {
+            continue;
+        }
+
+        if ((priv.frame - priv.surfaces.data[i].release_frame) > MAX_IDLE_FRAMES) {
+            pooled_surface_array_remove(&priv.surfaces, i);
+        }
+    }
+}
+
+/**
+ * Get a free surface of given size and antialiasing level,
+ * creating a new one if there is none.
+ * Contents of the reused surface are undefined.
+ */
+int tq_acquire_pooled_surface(int width, int height, int samples)
+{
+    if (!priv.initialized) {
+        return -1;
+    }
+
+    for (int i = 0; i < priv.surfaces.count; i++) {
+        struct pooled_surface *surface = &priv.surfaces.data[i];
+
+        if (!priv.surfaces.init[i] || surface->in_use) {
+            continue;
+        }
+
+        if (surface->width != width || surface->height != height || surface->samples != samples) {
+            continue;
+        }
+
+        // Settings of the previous user shouldn't leak.
+        int texture_id = priv.renderer->get_surface_texture_id(surface->surface_id);
+        priv.renderer->set_texture_smooth(texture_id, true);
+        priv.renderer->set_texture_mipmapped(texture_id, false);
+
+        surface->in_use = true;
+        return surface->surface_id;
+    }
+
+    int surface_id = priv.renderer->create_surface(width, height);
+
+    if (surface_id == -1) {
+        return -1;
+    }
+
+    struct pooled_surface surface = {
+        .surface_id = surface_id,
+        .width = width,
+        .height = height,
+        .samples = samples,
+        .in_use = true,
+    };
+
+    pooled_surface_array_add(&priv.surfaces, &surface);
+
+    return surface_id;
+}
+
+/**
+ * Return the surface to the pool. It's not deleted immediately,
+ * so it can be reused by the next frames.
+ */
+void tq_release_pooled_surface(int surface_id)
+{
+    int index = find_pooled_surface(surface_id);
+
+    if (index == -1) {
+        return;
+    }
+
+    priv.surfaces.data[index].in_use = false;
+    priv.surfaces.data[index].release_frame = priv.frame;
+}
+
+/**
+ * Check if the surface is owned by the pool.
+ */
+bool tq_is_pooled_surface(int surface_id)
+{
+    return priv.initialized && (find_pooled_surface(surface_id) != -1);
+}
+
+/**
+ * Number of surfaces kept by the pool, both used and free.
+ */
+int tq_get_surface_pool_size(void)
+{
+    int size = 0;
+
+    for (int i = 0; i < priv.surfaces.count; i++) {
+        if (priv.surfaces.init[i]) {
+            size++;
+        }
+    }
+
+    return size;
+}
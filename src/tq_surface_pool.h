@@ -0,0 +1,43 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#ifndef TQ_SURFACE_POOL_H_INC
+#define TQ_SURFACE_POOL_H_INC
+
+//------------------------------------------------------------------------------
+
+#include "tq_graphics.h"
+
+//------------------------------------------------------------------------------
+
+void tq_initialize_surface_pool(tq_renderer_impl *renderer);
+void tq_terminate_surface_pool(void);
+void tq_process_surface_pool(void);
+
+int tq_acquire_pooled_surface(int width, int height, int samples);
+void tq_release_pooled_surface(int surface_id);
+bool tq_is_pooled_surface(int surface_id);
+
+int tq_get_surface_pool_size(void);
+
+//------------------------------------------------------------------------------
+
+#endif // TQ_SURFACE_POOL_H_INC
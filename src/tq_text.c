@@ -28,6 +28,7 @@
 #include "tq_error.h"
 #include "tq_log.h"
 #include "tq_mem.h"
+#include "tq_profiler.h"
 #include "tq_text.h"
 
 //------------------------------------------------------------------------------
@@ -538,7 +539,11 @@ tq_font tq_load_font_from_file(char const *path, float pt, int weight)
         return (tq_font) { -1 };
     }
 
-    return (tq_font) { load_font(stream, pt, weight) };
+    TQ_PROFILE_BEGIN("load_font");
+    int font_id = load_font(stream, pt, weight);
+    TQ_PROFILE_END();
+
+    return (tq_font) { font_id };
 }
 
 /**
@@ -552,7 +557,11 @@ tq_font tq_load_font_from_memory(uint8_t const *buffer, size_t size, float pt, i
         return (tq_font) { -1 };
     }
 
-    return (tq_font) { load_font(stream, pt, weight) };
+    TQ_PROFILE_BEGIN("load_font");
+    int font_id = load_font(stream, pt, weight);
+    TQ_PROFILE_END();
+
+    return (tq_font) { font_id };
 }
 
 /**
@@ -640,7 +649,7 @@ void tq_draw_text(tq_font font, tq_vec2f position, char const *text)
     float x_current = position.x + x_offset;
     float y_current = position.y;
 
-    float *v = maintain_vertex_buffer(24 * length);
+    float *v = maintain_vertex_buffer(16 * length);
 
     for (unsigned int i = 0; i < length; i++) {
         // Special case for newline character.
@@ -681,9 +690,7 @@ void tq_draw_text(tq_font font, tq_vec2f position, char const *text)
         *v++ = x0;  *v++ = y0;  *v++ = s0;  *v++ = t0;
         *v++ = x1;  *v++ = y0;  *v++ = s1;  *v++ = t0;
         *v++ = x1;  *v++ = y1;  *v++ = s1;  *v++ = t1;
-        *v++ = x1;  *v++ = y1;  *v++ = s1;  *v++ = t1;
         *v++ = x0;  *v++ = y1;  *v++ = s0;  *v++ = t1;
-        *v++ = x0;  *v++ = y0;  *v++ = s0;  *v++ = t0;
 
         x_current += glyph->x_advance;
         y_current += glyph->y_advance;
@@ -695,9 +702,11 @@ void tq_draw_text(tq_font font, tq_vec2f position, char const *text)
     hb_buffer_destroy(buffer);
 #endif
 
+    tq_transform_vertices(priv.vertex_buffer, 4 * quad_count, 4);
+
     priv.renderer->bind_texture(fontp->atlas.texture_id);
     priv.renderer->set_draw_color(priv.text_color);
-    priv.renderer->draw_font(priv.vertex_buffer, 6 * quad_count);
+    priv.renderer->draw_font(priv.vertex_buffer, quad_count);
 }
 
 /**
@@ -0,0 +1,482 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "tq_compressed_image.h"
+#include "tq_core.h"
+#include "tq_error.h"
+#include "tq_image_loader.h"
+#include "tq_log.h"
+#include "tq_mem.h"
+#include "tq_texture_loader.h"
+
+//------------------------------------------------------------------------------
+
+#define UPLOAD_BUDGET               (4 * 1024 * 1024)   // bytes per frame
+
+//------------------------------------------------------------------------------
+
+/**
+ * Stages of texture loading.
+ */
+enum
+{
+    REQUEST_QUEUED,             // waiting for the worker thread
+    REQUEST_DECODING,           // image is being decoded by the worker
+    REQUEST_DECODED,            // image is ready to be uploaded
+    REQUEST_UPLOADING,          // image is partially uploaded
+    REQUEST_FAILED,             // image couldn't be decoded
+};
+
+/**
+ * State of a texture, as seen by draw calls.
+ */
+enum
+{
+    TEXTURE_READY,              // not loaded in background or already uploaded
+    TEXTURE_PENDING,            // still being loaded
+    TEXTURE_FAILED,             // couldn't be loaded, never drawn
+};
+
+/**
+ * Texture that is being loaded.
+ * Requests are allocated separately so the worker thread
+ * can keep a pointer while the array is resized.
+ */
+struct request
+{
+    int texture_id;
+    int stage;
+    bool cancelled;             // texture was deleted while decoding
+    char *path;
+    bool color_key_enabled;
+    tq_color color_key;
+    libtq_image *image;
+    libtq_compressed_image *compressed;     // uploaded as is, instead of image
+    int uploaded_rows;
+};
+
+/**
+ * Private data for [texture loader] module.
+ */
+struct tq_texture_loader_priv
+{
+    tq_renderer_impl *renderer;
+
+    libtq_mutex mutex;
+    libtq_cond cond;            // signaled when a request is queued
+    libtq_thread worker;
+    bool quit;                  // tells the worker thread to exit
+
+    struct request **requests;
+    int request_count;
+    int request_capacity;
+
+    // Indexed by texture identifier. Only the main thread
+    // touches it, so it's read without locking.
+    unsigned char *texture_states;
+    int texture_state_capacity;
+};
+
+static struct tq_texture_loader_priv priv;
+
+//------------------------------------------------------------------------------
+
+static void free_request(struct request *request)
+{
+    libtq_free(request->image);
+    libtq_free(request->compressed);
+    libtq_free(request->path);
+    libtq_free(request);
+}
+
+/**
+ * Remove request from the array. Mutex should be locked.
+ */
+static void remove_request(int index)
+{
+    free_request(priv.requests[index]);
+
+    priv.request_count--;
+    priv.requests[index] = priv.requests[priv.request_count];
+}
+
+/**
+ * Find request by texture identifier. Mutex should be locked.
+ */
+static int find_request(int texture_id)
+{
+    for (int i = 0; i < priv.request_count; i++) {
+        if (priv.requests[i]->texture_id == texture_id) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void set_texture_state(int texture_id, int state)
+{
+    if (texture_id >= priv.texture_state_capacity) {
+        if (state == TEXTURE_READY) {
+            return;
+        }
+
+        int next_capacity = TQ_MAX(16, priv.texture_state_capacity);
+
+        while (next_capacity <= texture_id) {
+            next_capacity *= 2;
+        }
+
+        unsigned char *next_states = libtq_realloc(priv.texture_states, next_capacity);
+
+        if (!next_states) {
+            libtq_out_of_memory();
+        }
+
+        memset(next_states + priv.texture_state_capacity, TEXTURE_READY,
+            next_capacity - priv.texture_state_capacity);
+
+        priv.texture_states = next_states;
+        priv.texture_state_capacity = next_capacity;
+    }
+
+    priv.texture_states[texture_id] = (unsigned char) state;
+}
+
+/**
+ * Find a request waiting for the worker. Mutex should be locked.
+ */
+static struct request *find_queued_request(void)
+{
+    for (int i = 0; i < priv.request_count; i++) {
+        if (priv.requests[i]->stage == REQUEST_QUEUED) {
+            return priv.requests[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Worker thread: decodes queued images one by one.
+ * Sleeps until there is something to decode.
+ */
+static int worker_main(void *data)
+{
+    while (true) {
+        struct request *request = NULL;
+
+        libtq_lock_mutex(priv.mutex);
+        {
+            while (!priv.quit && !(request = find_queued_request())) {
+                libtq_wait_cond(priv.cond, priv.mutex);
+            }
+
+            if (priv.quit) {
+                libtq_unlock_mutex(priv.mutex);
+                break;
+            }
+
+            request->stage = REQUEST_DECODING;
+        }
+        libtq_unlock_mutex(priv.mutex);
+
+        libtq_image *image = NULL;
+        libtq_compressed_image *compressed = NULL;
+        libtq_stream *stream = libtq_open_file_stream(request->path);
+
+        if (stream) {
+            if (libtq_is_compressed_image(stream)) {
+                compressed = libtq_load_compressed_image(stream);
+
+                // Decode here if the GPU can't take it, so that
+                // the main thread doesn't have to.
+                if (compressed && !priv.renderer->is_compressed_format_supported(compressed->format)) {
+                    image = libtq_decompress_image(compressed);
+                    libtq_free(compressed);
+                    compressed = NULL;
+                }
+            } else if (request->color_key_enabled) {
+                image = libtq_load_image_with_key(stream, request->color_key);
+            } else {
+                image = libtq_load_image(stream);
+            }
+
+            libtq_stream_close(stream);
+        }
+
+        libtq_lock_mutex(priv.mutex);
+        {
+            request->image = image;
+            request->compressed = compressed;
+            request->stage = (image || compressed) ? REQUEST_DECODED : REQUEST_FAILED;
+        }
+        libtq_unlock_mutex(priv.mutex);
+    }
+
+    return 0;
+}
+
+/**
+ * Upload a part of the decoded image, no more than `budget` bytes
+ * (but at least one row). Returns number of bytes uploaded.
+ */
+static int upload_rows(struct request *request, int budget)
+{
+    libtq_image *image = request->image;
+
+    if (request->stage == REQUEST_DECODED) {
+        priv.renderer->resize_texture(request->texture_id,
+            image->width, image->height, image->channels);
+        request->stage = REQUEST_UPLOADING;
+    }
+
+    int row_size = image->width * image->channels;
+    int row_count = TQ_MAX(1, budget / TQ_MAX(1, row_size));
+
+    row_count = TQ_MIN(row_count, image->height - request->uploaded_rows);
+
+    unsigned char *src = image->pixels + request->uploaded_rows * row_size;
+    unsigned char *dst = priv.renderer->map_texture(request->texture_id,
+        0, request->uploaded_rows, image->width, row_count);
+
+    // Rows go straight to the staging buffer if the renderer
+    // has one, otherwise they are uploaded from the image.
+    if (dst) {
+        memcpy(dst, src, (size_t) row_count * row_size);
+        priv.renderer->unmap_texture();
+    } else {
+        priv.renderer->update_texture(request->texture_id,
+            0, request->uploaded_rows, image->width, row_count, src);
+    }
+
+    request->uploaded_rows += row_count;
+
+    return row_count * row_size;
+}
+
+//------------------------------------------------------------------------------
+
+void tq_initialize_texture_loader(tq_renderer_impl *renderer)
+{
+    priv.renderer = renderer;
+    priv.mutex = libtq_create_mutex();
+    priv.cond = libtq_create_cond();
+    priv.worker = NULL;
+    priv.quit = false;
+
+    priv.requests = NULL;
+    priv.request_count = 0;
+    priv.request_capacity = 0;
+
+    priv.texture_states = NULL;
+    priv.texture_state_capacity = 0;
+}
+
+void tq_terminate_texture_loader(void)
+{
+    if (priv.worker) {
+        libtq_lock_mutex(priv.mutex);
+        priv.quit = true;
+        libtq_signal_cond(priv.cond);
+        libtq_unlock_mutex(priv.mutex);
+
+        libtq_wait_thread(priv.worker);
+        priv.worker = NULL;
+    }
+
+    for (int i = 0; i < priv.request_count; i++) {
+        free_request(priv.requests[i]);
+    }
+
+    libtq_free(priv.requests);
+    libtq_free(priv.texture_states);
+    libtq_destroy_cond(priv.cond);
+    libtq_destroy_mutex(priv.mutex);
+
+    memset(&priv, 0, sizeof(priv));
+}
+
+/**
+ * Upload decoded images to the renderer. Called once per frame.
+ * Large images are uploaded over several frames.
+ */
+void tq_process_texture_loader(void)
+{
+    if (priv.request_count == 0) {
+        return;
+    }
+
+    int budget = UPLOAD_BUDGET;
+
+    libtq_lock_mutex(priv.mutex);
+
+    for (int i = 0; i < priv.request_count && budget > 0; i++) {
+        struct request *request = priv.requests[i];
+
+        if (request->stage == REQUEST_QUEUED || request->stage == REQUEST_DECODING) {
+            continue;
+        }
+
+        if (request->cancelled) {
+            remove_request(i--);
+            continue;
+        }
+
+        if (request->stage == REQUEST_FAILED) {
+            // The texture is never reported as ready.
+            libtq_log(LIBTQ_ERROR, "Failed to load texture from \"%s\".\n", request->path);
+            set_texture_state(request->texture_id, TEXTURE_FAILED);
+            remove_request(i--);
+            continue;
+        }
+
+        // Compressed data can't be uploaded in parts.
+        if (request->compressed) {
+            libtq_compressed_image *compressed = request->compressed;
+
+            priv.renderer->upload_compressed_texture(request->texture_id,
+                compressed->width, compressed->height,
+                compressed->format, compressed->data, compressed->size);
+
+            budget -= (int) compressed->size;
+            set_texture_state(request->texture_id, TEXTURE_READY);
+            remove_request(i--);
+            continue;
+        }
+
+        budget -= upload_rows(request, budget);
+
+        if (request->uploaded_rows == request->image->height) {
+            set_texture_state(request->texture_id, TEXTURE_READY);
+            remove_request(i--);
+        }
+    }
+
+    libtq_unlock_mutex(priv.mutex);
+}
+
+/**
+ * Create a placeholder texture and queue the file for decoding.
+ */
+int tq_load_texture_in_background(char const *path, bool color_key_enabled, tq_color color_key)
+{
+    int texture_id = priv.renderer->create_texture(1, 1, LIBTQ_RGBA);
+
+    if (texture_id == -1) {
+        return -1;
+    }
+
+    unsigned char pixel[4] = {0};
+    priv.renderer->update_texture(texture_id, 0, 0, -1, -1, pixel);
+
+    struct request *request = libtq_malloc(sizeof(struct request));
+    size_t path_size = strlen(path) + 1;
+
+    if (!request || !(request->path = libtq_malloc(path_size))) {
+        libtq_out_of_memory();
+    }
+
+    memcpy(request->path, path, path_size);
+
+    request->texture_id = texture_id;
+    request->stage = REQUEST_QUEUED;
+    request->cancelled = false;
+    request->color_key_enabled = color_key_enabled;
+    request->color_key = color_key;
+    request->image = NULL;
+    request->compressed = NULL;
+    request->uploaded_rows = 0;
+
+    libtq_lock_mutex(priv.mutex);
+    {
+        if (priv.request_count == priv.request_capacity) {
+            int next_capacity = TQ_MAX(8, priv.request_capacity * 2);
+            struct request **next_requests = libtq_realloc(priv.requests,
+                next_capacity * sizeof(struct request *));
+
+            if (!next_requests) {
+                libtq_out_of_memory();
+            }
+
+            priv.requests = next_requests;
+            priv.request_capacity = next_capacity;
+        }
+
+        priv.requests[priv.request_count++] = request;
+        libtq_signal_cond(priv.cond);
+    }
+    libtq_unlock_mutex(priv.mutex);
+
+    set_texture_state(texture_id, TEXTURE_PENDING);
+
+    if (!priv.worker) {
+        priv.worker = libtq_create_thread("texture-loader", worker_main, NULL);
+    }
+
+    return texture_id;
+}
+
+/**
+ * Forget about the texture. Called when it's deleted.
+ */
+void tq_cancel_texture_loading(int texture_id)
+{
+    if (texture_id >= 0 && texture_id < priv.texture_state_capacity) {
+        priv.texture_states[texture_id] = TEXTURE_READY;
+    }
+
+    if (priv.request_count == 0) {
+        return;
+    }
+
+    libtq_lock_mutex(priv.mutex);
+    {
+        int index = find_request(texture_id);
+
+        if (index != -1) {
+            if (priv.requests[index]->stage == REQUEST_DECODING) {
+                // The worker still uses it, let it finish.
+                priv.requests[index]->cancelled = true;
+                priv.requests[index]->texture_id = -1;
+            } else {
+                remove_request(index);
+            }
+        }
+    }
+    libtq_unlock_mutex(priv.mutex);
+}
+
+/**
+ * Check if the texture is still loading or failed to load.
+ * Called for every draw, so it doesn't lock anything.
+ */
+bool tq_is_texture_pending(int texture_id)
+{
+    if (texture_id < 0 || texture_id >= priv.texture_state_capacity) {
+        return false;
+    }
+
+    return priv.texture_states[texture_id] != TEXTURE_READY;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,998 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2021-2023 tuorqai
+// 
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// 
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tq_compressed_image.h"
+#include "tq_core.h"
+#include "tq_error.h"
+#include "tq_log.h"
+#include "tq_mem.h"
+#include "tq_stream.h"
+#include "tq_trace.h"
+
+//------------------------------------------------------------------------------
+
+#define TRACE_MAGIC                 "TQTRACE1"
+#define TRACE_VERSION               1
+#define MAX_RECORD_ARGS             8
+#define INITIAL_ID_COUNT            64
+
+//------------------------------------------------------------------------------
+
+/**
+ * Recorded renderer calls. Queries (texture size, stats, etc.)
+ * don't change anything, so they aren't recorded.
+ */
+enum
+{
+    OP_PROCESS = 1,
+    OP_POST_PROCESS,
+    OP_REQUEST_ANTIALIASING_LEVEL,
+    OP_UPDATE_PROJECTION,
+    OP_UPDATE_MODEL_VIEW,
+    OP_CREATE_TEXTURE,
+    OP_DELETE_TEXTURE,
+    OP_SET_TEXTURE_SMOOTH,
+    OP_SET_TEXTURE_MIPMAPPED,
+    OP_UPDATE_TEXTURE,
+    OP_RESIZE_TEXTURE,
+    OP_UPLOAD_COMPRESSED_TEXTURE,
+    OP_BIND_TEXTURE,
+    OP_CREATE_SURFACE,
+    OP_DELETE_SURFACE,
+    OP_BIND_SURFACE,
+    OP_SET_CLEAR_COLOR,
+    OP_SET_DRAW_COLOR,
+    OP_SET_BLEND_MODE,
+    OP_CLEAR,
+    OP_DRAW_SOLID,
+    OP_DRAW_COLORED,
+    OP_DRAW_TEXTURED,
+    OP_DRAW_QUADS,
+    OP_DRAW_FONT,
+    OP_DRAW_SPRITES_INSTANCED,
+    OP_DRAW_CANVAS,
+};
+
+/**
+ * Trace file starts with this header.
+ */
+struct trace_header
+{
+    char magic[8];
+    uint32_t version;
+    int32_t display_width;
+    int32_t display_height;
+};
+
+/**
+ * Each record starts with this header, followed by `argc` 32-bit
+ * arguments and the payload, which is padded to 4 bytes.
+ */
+struct record_header
+{
+    uint32_t opcode;
+    uint32_t argc;
+    uint32_t payload_size;
+};
+
+/**
+ * Texture size is needed to know how many pixels are passed
+ * to update_texture().
+ */
+struct trace_texture
+{
+    int width;
+    int height;
+    int channels;
+};
+
+/**
+ * Sizes of textures, indexed by recorded texture id.
+ */
+struct texture_table
+{
+    struct trace_texture *data;
+    int capacity;
+};
+
+/**
+ * Recorded texture and surface ids are not necessarily the same
+ * as the ones the replaying renderer returns.
+ */
+struct id_map
+{
+    int *ids;
+    int capacity;
+};
+
+/**
+ * State of a single replay pass.
+ */
+struct replay
+{
+    struct id_map textures;
+    struct id_map surfaces;
+    struct id_map surface_textures;     // recorded surface id -> recorded texture id
+    struct texture_table texture_info;
+};
+
+/**
+ * Private data for [trace] module.
+ */
+struct tq_trace_priv
+{
+    bool recording;
+    FILE *file;
+    tq_renderer_impl backend;       // the actual renderer
+    struct texture_table textures;
+};
+
+static struct tq_trace_priv priv;
+
+//------------------------------------------------------------------------------
+
+static int32_t pack_color(tq_color color)
+{
+    int32_t value;
+    memcpy(&value, &color, sizeof(value));
+    return value;
+}
+
+static tq_color unpack_color(int32_t value)
+{
+    tq_color color;
+    memcpy(&color, &value, sizeof(color));
+    return color;
+}
+
+static void write_record(int opcode, int32_t const *args, int argc,
+    void const *payload, size_t size)
+{
+    static uint8_t const padding[4];
+
+    struct record_header header = {
+        .opcode = opcode,
+        .argc = argc,
+        .payload_size = (uint32_t) size,
+    };
+
+    fwrite(&header, sizeof(header), 1, priv.file);
+    fwrite(args, sizeof(int32_t), argc, priv.file);
+
+    if (size > 0) {
+        fwrite(payload, 1, size, priv.file);
+        fwrite(padding, 1, (4 - size % 4) % 4, priv.file);
+    }
+}
+
+static void set_texture_info(struct texture_table *table, int texture_id,
+    int width, int height, int channels)
+{
+    if (texture_id < 0) {
+        return;
+    }
+
+    if (texture_id >= table->capacity) {
+        int capacity = TQ_MAX(INITIAL_ID_COUNT, table->capacity);
+
+        while (capacity <= texture_id) {
+            capacity *= 2;
+        }
+
+        struct trace_texture *data = libtq_realloc(table->data,
+            capacity * sizeof(struct trace_texture));
+
+        if (!data) {
+            libtq_out_of_memory();
+        }
+
+        memset(data + table->capacity, 0,
+            (capacity - table->capacity) * sizeof(struct trace_texture));
+
+        table->data = data;
+        table->capacity = capacity;
+    }
+
+    table->data[texture_id] = (struct trace_texture) {
+        .width = width,
+        .height = height,
+        .channels = channels,
+    };
+}
+
+/**
+ * Number of bytes passed to update_texture(), zero if the
+ * texture is unknown.
+ */
+static size_t get_update_size(struct texture_table const *table, int texture_id,
+    int width, int height)
+{
+    if (texture_id < 0 || texture_id >= table->capacity) {
+        return 0;
+    }
+
+    struct trace_texture const *texture = &table->data[texture_id];
+
+    if (width == -1 && height == -1) {
+        return (size_t) texture->width * texture->height * texture->channels;
+    }
+
+    if (width < 0 || height < 0) {
+        return 0;
+    }
+
+    return (size_t) width * height * texture->channels;
+}
+
+//------------------------------------------------------------------------------
+// Recording wrappers
+
+static void initialize(void)
+{
+    priv.backend.initialize();
+}
+
+static void terminate(void)
+{
+    priv.backend.terminate();
+}
+
+static void process(void)
+{
+    write_record(OP_PROCESS, NULL, 0, NULL, 0);
+    priv.backend.process();
+}
+
+static void post_process(void)
+{
+    priv.backend.post_process();
+    write_record(OP_POST_PROCESS, NULL, 0, NULL, 0);
+
+    // Keep the trace usable if the application crashes later.
+    fflush(priv.file);
+}
+
+static int request_antialiasing_level(int level)
+{
+    write_record(OP_REQUEST_ANTIALIASING_LEVEL, (int32_t[]) { level }, 1, NULL, 0);
+    return priv.backend.request_antialiasing_level(level);
+}
+
+static void update_projection(float const *mat4)
+{
+    write_record(OP_UPDATE_PROJECTION, NULL, 0, mat4, 16 * sizeof(float));
+    priv.backend.update_projection(mat4);
+}
+
+static void update_model_view(float const *mat3)
+{
+    write_record(OP_UPDATE_MODEL_VIEW, NULL, 0, mat3, 9 * sizeof(float));
+    priv.backend.update_model_view(mat3);
+}
+
+static int create_texture(int width, int height, int channels)
+{
+    int texture_id = priv.backend.create_texture(width, height, channels);
+
+    set_texture_info(&priv.textures, texture_id, width, height, channels);
+    write_record(OP_CREATE_TEXTURE,
+        (int32_t[]) { width, height, channels, texture_id }, 4, NULL, 0);
+
+    return texture_id;
+}
+
+static void delete_texture(int32_t texture_id)
+{
+    write_record(OP_DELETE_TEXTURE, (int32_t[]) { texture_id }, 1, NULL, 0);
+    priv.backend.delete_texture(texture_id);
+}
+
+static bool is_texture_smooth(int texture_id)
+{
+    return priv.backend.is_texture_smooth(texture_id);
+}
+
+static void set_texture_smooth(int texture_id, bool smooth)
+{
+    write_record(OP_SET_TEXTURE_SMOOTH, (int32_t[]) { texture_id, smooth }, 2, NULL, 0);
+    priv.backend.set_texture_smooth(texture_id, smooth);
+}
+
+static void set_texture_mipmapped(int texture_id, bool mipmapped)
+{
+    write_record(OP_SET_TEXTURE_MIPMAPPED, (int32_t[]) { texture_id, mipmapped }, 2, NULL, 0);
+    priv.backend.set_texture_mipmapped(texture_id, mipmapped);
+}
+
+static void get_texture_size(int texture_id, int *width, int *height)
+{
+    priv.backend.get_texture_size(texture_id, width, height);
+}
+
+static void update_texture(int texture_id, int x_offset, int y_offset,
+    int width, int height, unsigned char *pixels)
+{
+    size_t size = pixels ? get_update_size(&priv.textures, texture_id, width, height) : 0;
+
+    write_record(OP_UPDATE_TEXTURE,
+        (int32_t[]) { texture_id, x_offset, y_offset, width, height }, 5,
+        pixels, size);
+
+    priv.backend.update_texture(texture_id, x_offset, y_offset, width, height, pixels);
+}
+
+/**
+ * Pixels written to a mapped buffer can't be recorded, so
+ * mapping is refused and callers use update_texture() instead.
+ */
+static unsigned char *map_texture(int texture_id, int x_offset, int y_offset,
+    int width, int height)
+{
+    return NULL;
+}
+
+static void unmap_texture(void)
+{
+}
+
+static void resize_texture(int texture_id, int width, int height, int channels)
+{
+    set_texture_info(&priv.textures, texture_id, width, height, channels);
+    write_record(OP_RESIZE_TEXTURE,
+        (int32_t[]) { texture_id, width, height, channels }, 4, NULL, 0);
+
+    priv.backend.resize_texture(texture_id, width, height, channels);
+}
+
+static bool is_compressed_format_supported(int format)
+{
+    return priv.backend.is_compressed_format_supported(format);
+}
+
+static void upload_compressed_texture(int texture_id, int width, int height,
+    int format, void const *data, size_t size)
+{
+    write_record(OP_UPLOAD_COMPRESSED_TEXTURE,
+        (int32_t[]) { texture_id, width, height, format }, 4, data, size);
+
+    priv.backend.upload_compressed_texture(texture_id, width, height, format, data, size);
+}
+
+static void bind_texture(int texture_id)
+{
+    write_record(OP_BIND_TEXTURE, (int32_t[]) { texture_id }, 1, NULL, 0);
+    priv.backend.bind_texture(texture_id);
+}
+
+static int create_surface(int width, int height)
+{
+    int surface_id = priv.backend.create_surface(width, height);
+    int texture_id = priv.backend.get_surface_texture_id(surface_id);
+
+    set_texture_info(&priv.textures, texture_id, width, height, 4);
+    write_record(OP_CREATE_SURFACE,
+        (int32_t[]) { width, height, surface_id, texture_id }, 4, NULL, 0);
+
+    return surface_id;
+}
+
+static void delete_surface(int surface_id)
+{
+    write_record(OP_DELETE_SURFACE, (int32_t[]) { surface_id }, 1, NULL, 0);
+    priv.backend.delete_surface(surface_id);
+}
+
+static int get_surface_texture_id(int surface_id)
+{
+    return priv.backend.get_surface_texture_id(surface_id);
+}
+
+static void bind_surface(int surface_id)
+{
+    write_record(OP_BIND_SURFACE, (int32_t[]) { surface_id }, 1, NULL, 0);
+    priv.backend.bind_surface(surface_id);
+}
+
+static void set_clear_color(tq_color color)
+{
+    write_record(OP_SET_CLEAR_COLOR, (int32_t[]) { pack_color(color) }, 1, NULL, 0);
+    priv.backend.set_clear_color(color);
+}
+
+static void set_draw_color(tq_color color)
+{
+    write_record(OP_SET_DRAW_COLOR, (int32_t[]) { pack_color(color) }, 1, NULL, 0);
+    priv.backend.set_draw_color(color);
+}
+
+static void set_blend_mode(tq_blend_mode mode)
+{
+    int32_t args[] = {
+        mode.color_src_factor,
+        mode.color_dst_factor,
+        mode.color_equation,
+        mode.alpha_src_factor,
+        mode.alpha_dst_factor,
+        mode.alpha_equation,
+    };
+
+    write_record(OP_SET_BLEND_MODE, args, 6, NULL, 0);
+    priv.backend.set_blend_mode(mode);
+}
+
+static void clear(void)
+{
+    write_record(OP_CLEAR, NULL, 0, NULL, 0);
+    priv.backend.clear();
+}
+
+static void draw_solid(int mode, float const *data, int num_vertices)
+{
+    write_record(OP_DRAW_SOLID, (int32_t[]) { mode, num_vertices }, 2,
+        data, num_vertices * 2 * sizeof(float));
+    priv.backend.draw_solid(mode, data, num_vertices);
+}
+
+static void draw_colored(int mode, float const *data, int num_vertices)
+{
+    write_record(OP_DRAW_COLORED, (int32_t[]) { mode, num_vertices }, 2,
+        data, num_vertices * 6 * sizeof(float));
+    priv.backend.draw_colored(mode, data, num_vertices);
+}
+
+static void draw_textured(int mode, float const *data, int num_vertices)
+{
+    write_record(OP_DRAW_TEXTURED, (int32_t[]) { mode, num_vertices }, 2,
+        data, num_vertices * 4 * sizeof(float));
+    priv.backend.draw_textured(mode, data, num_vertices);
+}
+
+static void draw_quads(float const *data, int num_quads)
+{
+    write_record(OP_DRAW_QUADS, (int32_t[]) { num_quads }, 1,
+        data, num_quads * 16 * sizeof(float));
+    priv.backend.draw_quads(data, num_quads);
+}
+
+static void draw_font(float const *data, int num_quads)
+{
+    write_record(OP_DRAW_FONT, (int32_t[]) { num_quads }, 1,
+        data, num_quads * 16 * sizeof(float));
+    priv.backend.draw_font(data, num_quads);
+}
+
+static void draw_sprites_instanced(tq_sprite_instance const *sprites, int count)
+{
+    write_record(OP_DRAW_SPRITES_INSTANCED, (int32_t[]) { count }, 1,
+        sprites, count * sizeof(tq_sprite_instance));
+    priv.backend.draw_sprites_instanced(sprites, count);
+}
+
+static void draw_canvas(float x0, float y0, float x1, float y1)
+{
+    float rect[] = { x0, y0, x1, y1 };
+
+    write_record(OP_DRAW_CANVAS, NULL, 0, rect, sizeof(rect));
+    priv.backend.draw_canvas(x0, y0, x1, y1);
+}
+
+static void read_pixels(int surface_id, unsigned char *pixels)
+{
+    priv.backend.read_pixels(surface_id, pixels);
+}
+
+static void get_stats(tq_frame_stats *stats)
+{
+    priv.backend.get_stats(stats);
+}
+
+//------------------------------------------------------------------------------
+// Replay
+
+static void map_id(struct id_map *map, int from, int to)
+{
+    if (from < 0) {
+        return;
+    }
+
+    if (from >= map->capacity) {
+        int capacity = TQ_MAX(INITIAL_ID_COUNT, map->capacity);
+
+        while (capacity <= from) {
+            capacity *= 2;
+        }
+
+        int *ids = libtq_realloc(map->ids, capacity * sizeof(int));
+
+        if (!ids) {
+            libtq_out_of_memory();
+        }
+
+        for (int index = map->capacity; index < capacity; index++) {
+            ids[index] = -1;
+        }
+
+        map->ids = ids;
+        map->capacity = capacity;
+    }
+
+    map->ids[from] = to;
+}
+
+/**
+ * Unknown ids (e.g. -1 for the display) are passed as is.
+ */
+static int get_mapped_id(struct id_map const *map, int id)
+{
+    if (id >= 0 && id < map->capacity && map->ids[id] != -1) {
+        return map->ids[id];
+    }
+
+    return id;
+}
+
+/**
+ * Recorded id of the surface texture, -1 if the surface is unknown.
+ */
+static int get_surface_texture(struct replay const *replay, int surface_id)
+{
+    struct id_map const *map = &replay->surface_textures;
+
+    if (surface_id >= 0 && surface_id < map->capacity) {
+        return map->ids[surface_id];
+    }
+
+    return -1;
+}
+
+/**
+ * Check that the record has as many arguments and as much payload
+ * as the replayed call reads. Returns false on mismatch, which
+ * means the trace is corrupted.
+ */
+static bool is_record_valid(struct replay const *replay, int opcode,
+    int32_t const *args, int argc, size_t size)
+{
+    static int const argcs[] = {
+        [OP_PROCESS] = 0,
+        [OP_POST_PROCESS] = 0,
+        [OP_REQUEST_ANTIALIASING_LEVEL] = 1,
+        [OP_UPDATE_PROJECTION] = 0,
+        [OP_UPDATE_MODEL_VIEW] = 0,
+        [OP_CREATE_TEXTURE] = 4,
+        [OP_DELETE_TEXTURE] = 1,
+        [OP_SET_TEXTURE_SMOOTH] = 2,
+        [OP_SET_TEXTURE_MIPMAPPED] = 2,
+        [OP_UPDATE_TEXTURE] = 5,
+        [OP_RESIZE_TEXTURE] = 4,
+        [OP_UPLOAD_COMPRESSED_TEXTURE] = 4,
+        [OP_BIND_TEXTURE] = 1,
+        [OP_CREATE_SURFACE] = 4,
+        [OP_DELETE_SURFACE] = 1,
+        [OP_BIND_SURFACE] = 1,
+        [OP_SET_CLEAR_COLOR] = 1,
+        [OP_SET_DRAW_COLOR] = 1,
+        [OP_SET_BLEND_MODE] = 6,
+        [OP_CLEAR] = 0,
+        [OP_DRAW_SOLID] = 2,
+        [OP_DRAW_COLORED] = 2,
+        [OP_DRAW_TEXTURED] = 2,
+        [OP_DRAW_QUADS] = 1,
+        [OP_DRAW_FONT] = 1,
+        [OP_DRAW_SPRITES_INSTANCED] = 1,
+        [OP_DRAW_CANVAS] = 0,
+    };
+
+    if (opcode < OP_PROCESS || opcode > OP_DRAW_CANVAS || argc != argcs[opcode]) {
+        return false;
+    }
+
+    switch (opcode) {
+    case OP_UPDATE_PROJECTION:
+        return size == 16 * sizeof(float);
+    case OP_UPDATE_MODEL_VIEW:
+        return size == 9 * sizeof(float);
+    case OP_UPDATE_TEXTURE:
+        return size == 0 || size == get_update_size(&replay->texture_info,
+            args[0], args[3], args[4]);
+    case OP_UPLOAD_COMPRESSED_TEXTURE:
+        return args[1] > 0 && args[2] > 0
+            && args[3] >= 0 && args[3] < LIBTQ_COMPRESSED_FORMAT_COUNT
+            && size == libtq_get_compressed_size(args[1], args[2], args[3]);
+    case OP_DRAW_SOLID:
+        return args[1] >= 0 && size == (size_t) args[1] * 2 * sizeof(float);
+    case OP_DRAW_COLORED:
+        return args[1] >= 0 && size == (size_t) args[1] * 6 * sizeof(float);
+    case OP_DRAW_TEXTURED:
+        return args[1] >= 0 && size == (size_t) args[1] * 4 * sizeof(float);
+    case OP_DRAW_QUADS:
+    case OP_DRAW_FONT:
+        return args[0] >= 0 && size == (size_t) args[0] * 16 * sizeof(float);
+    case OP_DRAW_SPRITES_INSTANCED:
+        return args[0] >= 0 && size == (size_t) args[0] * sizeof(tq_sprite_instance);
+    case OP_DRAW_CANVAS:
+        return size == 4 * sizeof(float);
+    }
+
+    return size == 0;
+}
+
+/**
+ * Trace may have been recorded with a renderer that supports
+ * more compressed formats than the replaying one, so decode
+ * the data on the CPU like texture loading does.
+ */
+static void upload_decompressed_texture(tq_renderer_impl *renderer, int texture_id,
+    int width, int height, int format, void const *data, size_t size)
+{
+    libtq_compressed_image *compressed = libtq_malloc(sizeof(libtq_compressed_image) + size);
+
+    if (!compressed) {
+        libtq_out_of_memory();
+    }
+
+    compressed->width = width;
+    compressed->height = height;
+    compressed->format = format;
+    compressed->size = size;
+    memcpy(compressed->data, data, size);
+
+    libtq_image *image = libtq_decompress_image(compressed);
+    libtq_free(compressed);
+
+    if (!image) {
+        return;
+    }
+
+    renderer->resize_texture(texture_id, image->width, image->height, LIBTQ_RGBA);
+    renderer->update_texture(texture_id, 0, 0, image->width, image->height, image->pixels);
+
+    libtq_free(image);
+}
+
+static void replay_record(tq_renderer_impl *renderer, struct replay *replay,
+    int opcode, int32_t const *args, void const *payload, size_t size)
+{
+    struct id_map *textures = &replay->textures;
+    struct id_map *surfaces = &replay->surfaces;
+    float const *floats = payload;
+
+    switch (opcode) {
+    case OP_PROCESS:
+        renderer->process();
+        break;
+    case OP_POST_PROCESS:
+        renderer->post_process();
+        break;
+    case OP_REQUEST_ANTIALIASING_LEVEL:
+        renderer->request_antialiasing_level(args[0]);
+        break;
+    case OP_UPDATE_PROJECTION:
+        renderer->update_projection(floats);
+        break;
+    case OP_UPDATE_MODEL_VIEW:
+        renderer->update_model_view(floats);
+        break;
+    case OP_CREATE_TEXTURE:
+        map_id(textures, args[3], renderer->create_texture(args[0], args[1], args[2]));
+        set_texture_info(&replay->texture_info, args[3], args[0], args[1], args[2]);
+        break;
+    case OP_DELETE_TEXTURE:
+        renderer->delete_texture(get_mapped_id(textures, args[0]));
+        map_id(textures, args[0], -1);
+        break;
+    case OP_SET_TEXTURE_SMOOTH:
+        renderer->set_texture_smooth(get_mapped_id(textures, args[0]), args[1]);
+        break;
+    case OP_SET_TEXTURE_MIPMAPPED:
+        renderer->set_texture_mipmapped(get_mapped_id(textures, args[0]), args[1]);
+        break;
+    case OP_UPDATE_TEXTURE:
+        renderer->update_texture(get_mapped_id(textures, args[0]),
+            args[1], args[2], args[3], args[4],
+            (size > 0) ? (unsigned char *) payload : NULL);
+        break;
+    case OP_RESIZE_TEXTURE:
+        renderer->resize_texture(get_mapped_id(textures, args[0]), args[1], args[2], args[3]);
+        set_texture_info(&replay->texture_info, args[0], args[1], args[2], args[3]);
+        break;
+    case OP_UPLOAD_COMPRESSED_TEXTURE:
+        if (renderer->is_compressed_format_supported(args[3])) {
+            renderer->upload_compressed_texture(get_mapped_id(textures, args[0]),
+                args[1], args[2], args[3], payload, size);
+        } else {
+            upload_decompressed_texture(renderer, get_mapped_id(textures, args[0]),
+                args[1], args[2], args[3], payload, size);
+        }
+        break;
+    case OP_BIND_TEXTURE:
+        renderer->bind_texture(get_mapped_id(textures, args[0]));
+        break;
+    case OP_CREATE_SURFACE: {
+        int surface_id = renderer->create_surface(args[0], args[1]);
+        map_id(surfaces, args[2], surface_id);
+        map_id(textures, args[3], renderer->get_surface_texture_id(surface_id));
+        map_id(&replay->surface_textures, args[2], args[3]);
+        set_texture_info(&replay->texture_info, args[3], args[0], args[1], 4);
+        break;
+    }
+    case OP_DELETE_SURFACE:
+        renderer->delete_surface(get_mapped_id(surfaces, args[0]));
+        map_id(surfaces, args[0], -1);
+        map_id(textures, get_surface_texture(replay, args[0]), -1);
+        break;
+    case OP_BIND_SURFACE:
+        renderer->bind_surface(get_mapped_id(surfaces, args[0]));
+        break;
+    case OP_SET_CLEAR_COLOR:
+        renderer->set_clear_color(unpack_color(args[0]));
+        break;
+    case OP_SET_DRAW_COLOR:
+        renderer->set_draw_color(unpack_color(args[0]));
+        break;
+    case OP_SET_BLEND_MODE:
+        renderer->set_blend_mode((tq_blend_mode) {
+            .color_src_factor = args[0],
+            .color_dst_factor = args[1],
+            .color_equation = args[2],
+            .alpha_src_factor = args[3],
+            .alpha_dst_factor = args[4],
+            .alpha_equation = args[5],
+        });
+        break;
+    case OP_CLEAR:
+        renderer->clear();
+        break;
+    case OP_DRAW_SOLID:
+        renderer->draw_solid(args[0], floats, args[1]);
+        break;
+    case OP_DRAW_COLORED:
+        renderer->draw_colored(args[0], floats, args[1]);
+        break;
+    case OP_DRAW_TEXTURED:
+        renderer->draw_textured(args[0], floats, args[1]);
+        break;
+    case OP_DRAW_QUADS:
+        renderer->draw_quads(floats, args[0]);
+        break;
+    case OP_DRAW_FONT:
+        renderer->draw_font(floats, args[0]);
+        break;
+    case OP_DRAW_SPRITES_INSTANCED:
+        renderer->draw_sprites_instanced(payload, args[0]);
+        break;
+    case OP_DRAW_CANVAS:
+        renderer->draw_canvas(floats[0], floats[1], floats[2], floats[3]);
+        break;
+    }
+}
+
+/**
+ * Delete everything the replay has created, so that repeated
+ * replays don't pile up resources. Surface textures are deleted
+ * along with their surfaces.
+ */
+static void delete_replay_resources(tq_renderer_impl *renderer, struct replay *replay)
+{
+    for (int id = 0; id < replay->surfaces.capacity; id++) {
+        if (replay->surfaces.ids[id] != -1) {
+            renderer->delete_surface(replay->surfaces.ids[id]);
+            map_id(&replay->textures, get_surface_texture(replay, id), -1);
+        }
+    }
+
+    for (int id = 0; id < replay->textures.capacity; id++) {
+        if (replay->textures.ids[id] != -1) {
+            renderer->delete_texture(replay->textures.ids[id]);
+        }
+    }
+
+    libtq_free(replay->textures.ids);
+    libtq_free(replay->surfaces.ids);
+    libtq_free(replay->surface_textures.ids);
+    libtq_free(replay->texture_info.data);
+}
+
+//------------------------------------------------------------------------------
+
+bool tq_is_trace_recording(void)
+{
+    return priv.recording;
+}
+
+void tq_begin_trace_recording(tq_renderer_impl *renderer, char const *path)
+{
+    if (priv.recording) {
+        return;
+    }
+
+    priv.file = fopen(path, "wb");
+
+    if (!priv.file) {
+        libtq_log(LIBTQ_LOG_ERROR, "Failed to open trace file for writing: %s\n", path);
+        return;
+    }
+
+    tq_vec2i display_size = tq_get_display_size();
+
+    struct trace_header header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .display_width = display_size.x,
+        .display_height = display_size.y,
+    };
+
+    fwrite(&header, sizeof(header), 1, priv.file);
+
+    priv.recording = true;
+    priv.backend = *renderer;
+
+    renderer->initialize = initialize;
+    renderer->terminate = terminate;
+    renderer->process = process;
+    renderer->post_process = post_process;
+    renderer->request_antialiasing_level = request_antialiasing_level;
+    renderer->update_projection = update_projection;
+    renderer->update_model_view = update_model_view;
+    renderer->create_texture = create_texture;
+    renderer->delete_texture = delete_texture;
+    renderer->is_texture_smooth = is_texture_smooth;
+    renderer->set_texture_smooth = set_texture_smooth;
+    renderer->set_texture_mipmapped = set_texture_mipmapped;
+    renderer->get_texture_size = get_texture_size;
+    renderer->update_texture = update_texture;
+    renderer->map_texture = map_texture;
+    renderer->unmap_texture = unmap_texture;
+    renderer->resize_texture = resize_texture;
+    renderer->is_compressed_format_supported = is_compressed_format_supported;
+    renderer->upload_compressed_texture = upload_compressed_texture;
+    renderer->bind_texture = bind_texture;
+    renderer->create_surface = create_surface;
+    renderer->delete_surface = delete_surface;
+    renderer->get_surface_texture_id = get_surface_texture_id;
+    renderer->bind_surface = bind_surface;
+    renderer->set_clear_color = set_clear_color;
+    renderer->set_draw_color = set_draw_color;
+    renderer->set_blend_mode = set_blend_mode;
+    renderer->clear = clear;
+    renderer->draw_solid = draw_solid;
+    renderer->draw_colored = draw_colored;
+    renderer->draw_textured = draw_textured;
+    renderer->draw_quads = draw_quads;
+    renderer->draw_font = draw_font;
+    renderer->draw_sprites_instanced = draw_sprites_instanced;
+    renderer->draw_canvas = draw_canvas;
+    renderer->read_pixels = read_pixels;
+    renderer->get_stats = get_stats;
+
+    libtq_log(0, "Recording renderer trace to %s\n", path);
+}
+
+void tq_end_trace_recording(tq_renderer_impl *renderer)
+{
+    if (!priv.recording) {
+        return;
+    }
+
+    *renderer = priv.backend;
+
+    fclose(priv.file);
+    libtq_free(priv.textures.data);
+
+    memset(&priv, 0, sizeof(priv));
+}
+
+/**
+ * Play a trace against `renderer`. Frames end at post_process():
+ * at that point the display is presented and the frame time is
+ * reported. Returns the number of played frames or -1 on error.
+ */
+int tq_replay_trace_file(tq_renderer_impl *renderer, char const *path,
+    tq_trace_frame_callback callback)
+{
+    libtq_stream *stream = libtq_open_file_stream(path);
+
+    if (!stream) {
+        return -1;
+    }
+
+    // The whole trace is loaded beforehand, so file reads
+    // don't get into frame times.
+    uint8_t const *data = libtq_stream_buffer(stream);
+    size_t size = (size_t) libtq_stream_size(stream);
+
+    struct trace_header header;
+
+    if (!data || size < sizeof(header)) {
+        libtq_log(LIBTQ_LOG_ERROR, "Not a trace file: %s\n", path);
+        libtq_stream_close(stream);
+        return -1;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+            || header.version != TRACE_VERSION) {
+        libtq_log(LIBTQ_LOG_ERROR, "Not a trace file or unsupported version: %s\n", path);
+        libtq_stream_close(stream);
+        return -1;
+    }
+
+    tq_set_display_size((tq_vec2i) { header.display_width, header.display_height });
+
+    struct replay replay = {0};
+
+    size_t position = sizeof(header);
+    int frame = 0;
+    double frame_start = tq_get_time_highp();
+
+    while (position + sizeof(struct record_header) <= size) {
+        struct record_header record;
+        memcpy(&record, data + position, sizeof(record));
+
+        size_t payload_offset = position + sizeof(record) + record.argc * sizeof(int32_t);
+        size_t next_position = payload_offset + ((record.payload_size + 3) & ~((size_t) 3));
+
+        if (record.argc > MAX_RECORD_ARGS || next_position > size) {
+            libtq_log(LIBTQ_LOG_ERROR, "Trace file is truncated or corrupted: %s\n", path);
+            frame = -1;
+            break;
+        }
+
+        int32_t args[MAX_RECORD_ARGS] = {0};
+        memcpy(args, data + position + sizeof(record), record.argc * sizeof(int32_t));
+
+        if (!is_record_valid(&replay, record.opcode, args, record.argc, record.payload_size)) {
+            libtq_log(LIBTQ_LOG_ERROR, "Trace file is corrupted: %s\n", path);
+            frame = -1;
+            break;
+        }
+
+        replay_record(renderer, &replay, record.opcode, args,
+            data + payload_offset, record.payload_size);
+
+        position = next_position;
+
+        if (record.opcode == OP_POST_PROCESS) {
+            bool running = tq_process_core();
+            double frame_end = tq_get_time_highp();
+
+            if (callback) {
+                callback(frame, frame_end - frame_start);
+            }
+
+            frame++;
+            frame_start = frame_end;
+
+            if (!running) {
+                break;
+            }
+        }
+    }
+
+    delete_replay_resources(renderer, &replay);
+    libtq_stream_close(stream);
+
+    return frame;
+}
@@ -197,6 +197,38 @@ static void unlock_mutex(libtq_mutex mutex)
     LeaveCriticalSection((LPCRITICAL_SECTION) mutex);
 }
 
+//------------------------------------------------------------------------------
+// Condition variables
+
+static libtq_cond create_cond(void)
+{
+    PCONDITION_VARIABLE cond = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CONDITION_VARIABLE));
+    InitializeConditionVariable(cond);
+
+    return (libtq_cond) cond;
+}
+
+static void destroy_cond(libtq_cond cond)
+{
+    // Condition variables don't need to be deleted on Windows.
+    HeapFree(GetProcessHeap(), 0, cond);
+}
+
+static void wait_cond(libtq_cond cond, libtq_mutex mutex)
+{
+    SleepConditionVariableCS((PCONDITION_VARIABLE) cond, (LPCRITICAL_SECTION) mutex, INFINITE);
+}
+
+static void signal_cond(libtq_cond cond)
+{
+    WakeConditionVariable((PCONDITION_VARIABLE) cond);
+}
+
+static void broadcast_cond(libtq_cond cond)
+{
+    WakeAllConditionVariable((PCONDITION_VARIABLE) cond);
+}
+
 //------------------------------------------------------------------------------
 
 void libtq_construct_win32_threads(struct libtq_threads_impl *threads)
@@ -212,6 +244,11 @@ void libtq_construct_win32_threads(struct libtq_threads_impl *threads)
         .destroy_mutex          = destroy_mutex,
         .lock_mutex             = lock_mutex,
         .unlock_mutex           = unlock_mutex,
+        .create_cond            = create_cond,
+        .destroy_cond           = destroy_cond,
+        .wait_cond              = wait_cond,
+        .signal_cond            = signal_cond,
+        .broadcast_cond         = broadcast_cond,
     };
 }
 
@@ -0,0 +1,287 @@
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tq/tq.h>
+
+#include "tq_compressed_image.h"
+#include "tq_mem.h"
+#include "tq_stream.h"
+
+//------------------------------------------------------------------------------
+// [tq_decoder_test]
+// Decodes single 4x4 blocks of every compressed format supported
+// by the CPU decoder and compares them with pixels worked out by
+// hand from the format specifications. Blocks are wrapped into
+// KTX files, so container parsing is checked as well.
+//
+// usage: tq_decoder_test
+//------------------------------------------------------------------------------
+
+#define KTX_HEADER_SIZE             64
+
+#define KTX_RGB_S3TC_DXT1           0x83F0
+#define KTX_RGBA_S3TC_DXT1          0x83F1
+#define KTX_RGBA_S3TC_DXT5          0x83F3
+#define KTX_RGB8_ETC2               0x9274
+#define KTX_RGBA8_ETC2_EAC          0x9278
+
+//------------------------------------------------------------------------------
+
+struct test
+{
+    char const *name;
+    unsigned int ktx_format;
+    int format;                         // expected LIBTQ_* format
+    unsigned char block[16];
+    int block_size;
+    unsigned char pixels[16][4];        // expected RGBA, row by row
+};
+
+//------------------------------------------------------------------------------
+
+#define RED         { 255, 0, 0, 255 }
+#define BLUE        { 0, 0, 255, 255 }
+
+static struct test const tests[] = {
+    {
+        // c0 > c1: four colors, the middle ones are interpolated.
+        // Each row uses indices 0, 1, 2, 3.
+        "bc1-four-colors",
+        KTX_RGBA_S3TC_DXT1, LIBTQ_BC1_RGBA,
+        { 0x00, 0xf8, 0x1f, 0x00, 0xe4, 0xe4, 0xe4, 0xe4 }, 8,
+        {
+            RED, BLUE, { 170, 0, 85, 255 }, { 85, 0, 170, 255 },
+            RED, BLUE, { 170, 0, 85, 255 }, { 85, 0, 170, 255 },
+            RED, BLUE, { 170, 0, 85, 255 }, { 85, 0, 170, 255 },
+            RED, BLUE, { 170, 0, 85, 255 }, { 85, 0, 170, 255 },
+        },
+    },
+    {
+        // c0 <= c1: three colors, index 3 is transparent black.
+        "bc1-rgba-three-colors",
+        KTX_RGBA_S3TC_DXT1, LIBTQ_BC1_RGBA,
+        { 0x1f, 0x00, 0x00, 0xf8, 0xe4, 0xe4, 0xe4, 0xe4 }, 8,
+        {
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 0 },
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 0 },
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 0 },
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 0 },
+        },
+    },
+    {
+        // Same block without alpha: index 3 is opaque black.
+        "bc1-rgb-three-colors",
+        KTX_RGB_S3TC_DXT1, LIBTQ_BC1_RGB,
+        { 0x1f, 0x00, 0x00, 0xf8, 0xe4, 0xe4, 0xe4, 0xe4 }, 8,
+        {
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 255 },
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 255 },
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 255 },
+            BLUE, RED, { 127, 0, 127, 255 }, { 0, 0, 0, 255 },
+        },
+    },
+    {
+        // a0 > a1: eight alpha values, pixel p uses index p % 8.
+        // Color block is the four-color one from above.
+        "bc3",
+        KTX_RGBA_S3TC_DXT5, LIBTQ_BC3,
+        {
+            0xff, 0x00, 0x88, 0xc6, 0xfa, 0x88, 0xc6, 0xfa,
+            0x00, 0xf8, 0x1f, 0x00, 0xe4, 0xe4, 0xe4, 0xe4,
+        }, 16,
+        {
+            { 255, 0, 0, 255 }, { 0, 0, 255, 0 }, { 170, 0, 85, 218 }, { 85, 0, 170, 182 },
+            { 255, 0, 0, 145 }, { 0, 0, 255, 109 }, { 170, 0, 85, 72 }, { 85, 0, 170, 36 },
+            { 255, 0, 0, 255 }, { 0, 0, 255, 0 }, { 170, 0, 85, 218 }, { 85, 0, 170, 182 },
+            { 255, 0, 0, 145 }, { 0, 0, 255, 109 }, { 170, 0, 85, 72 }, { 85, 0, 170, 36 },
+        },
+    },
+    {
+        // Individual mode, subblocks side by side: red on the left,
+        // green on the right, table 0 (+-2, +-8). Pixel (0, 0) uses
+        // +8 and pixel (3, 3) uses -2, the rest use +2.
+        "etc2-individual",
+        KTX_RGB8_ETC2, LIBTQ_ETC2_RGB,
+        { 0xf0, 0x0f, 0x00, 0x00, 0x80, 0x00, 0x00, 0x01 }, 8,
+        {
+            { 255, 8, 8, 255 }, { 255, 2, 2, 255 }, { 2, 255, 2, 255 }, { 2, 255, 2, 255 },
+            { 255, 2, 2, 255 }, { 255, 2, 2, 255 }, { 2, 255, 2, 255 }, { 2, 255, 2, 255 },
+            { 255, 2, 2, 255 }, { 255, 2, 2, 255 }, { 2, 255, 2, 255 }, { 2, 255, 2, 255 },
+            { 255, 2, 2, 255 }, { 255, 2, 2, 255 }, { 2, 255, 2, 255 }, { 0, 253, 0, 255 },
+        },
+    },
+    {
+        // Differential mode: red 16 and 16 + 1, which extend
+        // to 132 and 140; all pixels use +2.
+        "etc2-differential",
+        KTX_RGB8_ETC2, LIBTQ_ETC2_RGB,
+        { 0x81, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00 }, 8,
+        {
+            { 134, 2, 2, 255 }, { 134, 2, 2, 255 }, { 142, 2, 2, 255 }, { 142, 2, 2, 255 },
+            { 134, 2, 2, 255 }, { 134, 2, 2, 255 }, { 142, 2, 2, 255 }, { 142, 2, 2, 255 },
+            { 134, 2, 2, 255 }, { 134, 2, 2, 255 }, { 142, 2, 2, 255 }, { 142, 2, 2, 255 },
+            { 134, 2, 2, 255 }, { 134, 2, 2, 255 }, { 142, 2, 2, 255 }, { 142, 2, 2, 255 },
+        },
+    },
+    {
+        // EAC alpha: base 128, multiplier 1, table 0 (-3 ... 14).
+        // Pixel (0, 0) uses index 0 (-3), the rest use index 4 (+2).
+        // Color is the differential block from above.
+        "etc2-eac",
+        KTX_RGBA8_ETC2_EAC, LIBTQ_ETC2_RGBA,
+        {
+            0x80, 0x10, 0x12, 0x49, 0x24, 0x92, 0x49, 0x24,
+            0x81, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+        }, 16,
+        {
+            { 134, 2, 2, 125 }, { 134, 2, 2, 130 }, { 142, 2, 2, 130 }, { 142, 2, 2, 130 },
+            { 134, 2, 2, 130 }, { 134, 2, 2, 130 }, { 142, 2, 2, 130 }, { 142, 2, 2, 130 },
+            { 134, 2, 2, 130 }, { 134, 2, 2, 130 }, { 142, 2, 2, 130 }, { 142, 2, 2, 130 },
+            { 134, 2, 2, 130 }, { 134, 2, 2, 130 }, { 142, 2, 2, 130 }, { 142, 2, 2, 130 },
+        },
+    },
+};
+
+//------------------------------------------------------------------------------
+
+static void write_u32(unsigned char *dst, unsigned int value)
+{
+    dst[0] = (value >> 0) & 0xff;
+    dst[1] = (value >> 8) & 0xff;
+    dst[2] = (value >> 16) & 0xff;
+    dst[3] = (value >> 24) & 0xff;
+}
+
+/**
+ * Wrap a single 4x4 block into a little-endian KTX file.
+ * Returns size of the file.
+ */
+static size_t make_ktx(unsigned char *dst, struct test const *test)
+{
+    static unsigned char const magic[12] = {
+        0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n',
+    };
+
+    memset(dst, 0, KTX_HEADER_SIZE);
+    memcpy(dst, magic, sizeof(magic));
+
+    write_u32(dst + 12, 0x04030201);        // endianness
+    write_u32(dst + 20, 1);                 // glTypeSize
+    write_u32(dst + 28, test->ktx_format);  // glInternalFormat
+    write_u32(dst + 36, 4);                 // width
+    write_u32(dst + 40, 4);                 // height
+    write_u32(dst + 52, 1);                 // faces
+    write_u32(dst + 56, 1);                 // mipmap levels
+
+    write_u32(dst + KTX_HEADER_SIZE, test->block_size);
+    memcpy(dst + KTX_HEADER_SIZE + 4, test->block, test->block_size);
+
+    return KTX_HEADER_SIZE + 4 + test->block_size;
+}
+
+static bool run_test(struct test const *test)
+{
+    unsigned char file[KTX_HEADER_SIZE + 4 + 16];
+    size_t size = make_ktx(file, test);
+
+    libtq_stream *stream = libtq_open_memory_stream(file, size);
+    libtq_compressed_image *compressed = libtq_load_compressed_image(stream);
+    libtq_stream_close(stream);
+
+    if (!compressed) {
+        fprintf(stderr, "tq_decoder_test: %s: can't load KTX file\n", test->name);
+        return false;
+    }
+
+    bool passed = true;
+
+    if (compressed->format != test->format) {
+        fprintf(stderr, "tq_decoder_test: %s: format %d, expected %d\n",
+            test->name, compressed->format, test->format);
+        passed = false;
+    }
+
+    libtq_image *image = libtq_decompress_image(compressed);
+
+    if (!image) {
+        fprintf(stderr, "tq_decoder_test: %s: can't decode\n", test->name);
+        passed = false;
+    } else {
+        for (int p = 0; p < 16; p++) {
+            unsigned char const *actual = image->pixels + 4 * p;
+            unsigned char const *expected = test->pixels[p];
+
+            if (memcmp(actual, expected, 4) != 0) {
+                fprintf(stderr, "tq_decoder_test: %s: pixel (%d, %d) is "
+                    "(%d, %d, %d, %d), expected (%d, %d, %d, %d)\n",
+                    test->name, p % 4, p / 4,
+                    actual[0], actual[1], actual[2], actual[3],
+                    expected[0], expected[1], expected[2], expected[3]);
+                passed = false;
+            }
+        }
+    }
+
+    libtq_free(image);
+    libtq_free(compressed);
+
+    return passed;
+}
+
+/**
+ * Huge dimensions in the header must be rejected
+ * rather than overflow the size computation.
+ */
+static bool run_size_test(unsigned int width, unsigned int height)
+{
+    unsigned char file[KTX_HEADER_SIZE + 4 + 16];
+    size_t size = make_ktx(file, &tests[0]);
+
+    write_u32(file + 36, width);
+    write_u32(file + 40, height);
+
+    libtq_stream *stream = libtq_open_memory_stream(file, size);
+    libtq_compressed_image *compressed = libtq_load_compressed_image(stream);
+    libtq_stream_close(stream);
+
+    if (compressed) {
+        fprintf(stderr, "tq_decoder_test: %ux%u image wasn't rejected\n", width, height);
+        libtq_free(compressed);
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    // Nothing is drawn, but logging needs the library initialized.
+    tq_set_renderer_type(TQ_RENDERER_NULL);
+    tq_set_headless(true);
+    tq_initialize();
+
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (!run_test(&tests[i])) {
+            failed++;
+        }
+    }
+
+    if (!run_size_test(0x7ffffffd, 4) || !run_size_test(0x40000000, 0x40000000)
+            || !run_size_test(0xffffffff, 0xffffffff)) {
+        failed++;
+    }
+
+    fprintf(stderr, "tq_decoder_test: %d of %d tests failed\n",
+        failed, (int) (sizeof(tests) / sizeof(tests[0])) + 1);
+
+    tq_terminate();
+
+    return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
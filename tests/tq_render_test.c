@@ -0,0 +1,278 @@
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tq/tq.h>
+
+#include "tq_image_loader.h"
+#include "tq_mem.h"
+#include "tq_stream.h"
+
+//------------------------------------------------------------------------------
+// [tq_render_test]
+// Renders a fixed scene with the software renderer and compares
+// the canvas with a reference image. Small per-channel differences
+// are tolerated, since rounding may vary between compilers.
+// If the images don't match or there is no reference yet, the
+// rendered one is written to <scene>.ppm in the current directory.
+//
+// usage: tq_render_test scene [assets-directory [reference-directory]]
+//------------------------------------------------------------------------------
+
+#define CANVAS_WIDTH        256
+#define CANVAS_HEIGHT       192
+#define CHANNEL_TOLERANCE   2
+#define MAX_BAD_PIXELS      16
+
+#ifndef TQ_TEST_ASSETS_DIR
+#define TQ_TEST_ASSETS_DIR "assets"
+#endif
+
+#ifndef TQ_TEST_REFERENCE_DIR
+#define TQ_TEST_REFERENCE_DIR "tests/reference"
+#endif
+
+//------------------------------------------------------------------------------
+
+struct scene
+{
+    char const *name;
+    void (*draw)(void);
+};
+
+//------------------------------------------------------------------------------
+
+static char const *assets_dir = TQ_TEST_ASSETS_DIR;
+static char const *reference_dir = TQ_TEST_REFERENCE_DIR;
+
+static tq_texture load_texture(char const *name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/textures/%s", assets_dir, name);
+
+    return tq_load_texture_from_file(path);
+}
+
+//------------------------------------------------------------------------------
+// Scenes
+
+static void draw_primitives(void)
+{
+    tq_set_clear_color(tq_c24(20, 30, 40));
+    tq_clear();
+
+    tq_set_draw_color(tq_c24(255, 64, 0));
+    tq_fill_rectangle((tq_rectf) { 8, 8, 64, 40 });
+    tq_fill_circle((tq_vec2f) { 120, 32 }, 24);
+    tq_fill_triangle((tq_vec2f) { 160, 56 }, (tq_vec2f) { 200, 8 }, (tq_vec2f) { 240, 56 });
+
+    tq_set_outline_color(tq_c24(255, 255, 0));
+    tq_outline_rectangle((tq_rectf) { 8, 72, 64, 40 });
+    tq_outline_circle((tq_vec2f) { 120, 92 }, 24);
+    tq_outline_triangle((tq_vec2f) { 160, 116 }, (tq_vec2f) { 200, 68 }, (tq_vec2f) { 240, 116 });
+
+    tq_set_draw_color(tq_c32(0, 255, 128, 128));
+    tq_fill_rectangle((tq_rectf) { 40, 130, 120, 50 });
+
+    tq_set_draw_color(tq_c32(128, 0, 255, 128));
+    tq_fill_circle((tq_vec2f) { 170, 155 }, 30);
+
+    tq_set_draw_color(tq_c24(255, 255, 255));
+    tq_draw_line((tq_vec2f) { 0, 191 }, (tq_vec2f) { 255, 124 });
+    tq_draw_point((tq_vec2f) { 250, 8 });
+}
+
+static void draw_textures(void)
+{
+    tq_texture moon = load_texture("moon.png");
+    tq_texture glow = load_texture("glow.png");
+
+    tq_set_clear_color(tq_c24(0, 0, 0));
+    tq_clear();
+
+    // Enough sprites to have them rasterized in parallel.
+    for (int i = 0; i < 96; i++) {
+        float x = (float) ((i % 12) * 20);
+        float y = (float) ((i / 12) * 20);
+
+        tq_draw_texture((i % 2) ? moon : glow, (tq_rectf) { x, y, 32, 32 });
+    }
+
+    tq_draw_subtexture(moon, (tq_rectf) { 0, 0, 16, 16 }, (tq_rectf) { 192, 128, 48, 48 });
+
+    tq_push_matrix();
+    tq_translate_matrix((tq_vec2f) { 128, 96 });
+    tq_rotate_matrix(30.0f);
+    tq_scale_matrix((tq_vec2f) { 1.5f, 0.75f });
+    tq_set_draw_color(tq_c32(255, 255, 255, 160));
+    tq_draw_texture(moon, (tq_rectf) { -24, -24, 48, 48 });
+    tq_pop_matrix();
+
+    tq_set_blend_mode(TQ_BLEND_MODE_ADD);
+    tq_set_draw_color(tq_c24(255, 128, 64));
+    tq_draw_texture(glow, (tq_rectf) { 32, 96, 64, 64 });
+    tq_set_blend_mode(TQ_BLEND_MODE_ALPHA);
+
+    tq_set_draw_color(tq_c24(255, 255, 255));
+}
+
+static void draw_surfaces(void)
+{
+    tq_texture moon = load_texture("moon.png");
+    tq_surface surface = tq_create_surface((tq_vec2i) { 64, 64 });
+
+    tq_set_surface(surface);
+    tq_set_clear_color(tq_c24(100, 0, 100));
+    tq_clear();
+    tq_set_draw_color(tq_c24(255, 255, 255));
+    tq_fill_rectangle((tq_rectf) { 8, 8, 48, 48 });
+    tq_draw_texture(moon, (tq_rectf) { 16, 16, 32, 32 });
+    tq_reset_surface();
+
+    tq_set_clear_color(tq_c24(40, 40, 40));
+    tq_clear();
+
+    tq_texture texture = tq_get_surface_texture(surface);
+
+    tq_draw_texture(texture, (tq_rectf) { 16, 16, 64, 64 });
+    tq_draw_texture(texture, (tq_rectf) { 96, 32, 128, 128 });
+}
+
+static struct scene const scenes[] = {
+    { "primitives",     draw_primitives },
+    { "textures",       draw_textures },
+    { "surfaces",       draw_surfaces },
+};
+
+//------------------------------------------------------------------------------
+
+static void write_ppm(char const *path, unsigned char const *pixels)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (!file) {
+        return;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", CANVAS_WIDTH, CANVAS_HEIGHT);
+
+    for (int i = 0; i < CANVAS_WIDTH * CANVAS_HEIGHT; i++) {
+        fwrite(pixels + 4 * i, 1, 3, file);
+    }
+
+    fclose(file);
+}
+
+/**
+ * Count pixels whose color differs from the reference by more
+ * than the tolerance. Alpha isn't compared: canvas is opaque.
+ */
+static int count_bad_pixels(unsigned char const *pixels, libtq_image const *reference)
+{
+    int bad_pixels = 0;
+
+    for (int i = 0; i < CANVAS_WIDTH * CANVAS_HEIGHT; i++) {
+        unsigned char const *a = pixels + 4 * i;
+        unsigned char const *b = reference->pixels + reference->channels * i;
+
+        for (int c = 0; c < 3; c++) {
+            if (abs(a[c] - b[c]) > CHANNEL_TOLERANCE) {
+                bad_pixels++;
+                break;
+            }
+        }
+    }
+
+    return bad_pixels;
+}
+
+static int run_scene(struct scene const *scene)
+{
+    static unsigned char pixels[CANVAS_WIDTH * CANVAS_HEIGHT * 4];
+
+    tq_process();
+    scene->draw();
+    tq_read_canvas_pixels(pixels);
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.png", reference_dir, scene->name);
+
+    libtq_stream *stream = libtq_open_file_stream(path);
+    libtq_image *reference = libtq_load_image(stream);
+
+    if (stream) {
+        libtq_stream_close(stream);
+    }
+
+    int result = EXIT_SUCCESS;
+
+    if (!reference) {
+        fprintf(stderr, "tq_render_test: can't load %s\n", path);
+        result = EXIT_FAILURE;
+    } else if (reference->width != CANVAS_WIDTH || reference->height != CANVAS_HEIGHT
+            || reference->channels < 3) {
+        fprintf(stderr, "tq_render_test: %s has unexpected format\n", path);
+        result = EXIT_FAILURE;
+    } else {
+        int bad_pixels = count_bad_pixels(pixels, reference);
+
+        fprintf(stderr, "tq_render_test: %s: %d pixels differ\n", scene->name, bad_pixels);
+
+        if (bad_pixels > MAX_BAD_PIXELS) {
+            result = EXIT_FAILURE;
+        }
+    }
+
+    if (result != EXIT_SUCCESS) {
+        snprintf(path, sizeof(path), "%s.ppm", scene->name);
+        write_ppm(path, pixels);
+    }
+
+    libtq_free(reference);
+
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: tq_render_test scene [assets-directory [reference-directory]]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (argc > 2) {
+        assets_dir = argv[2];
+    }
+
+    if (argc > 3) {
+        reference_dir = argv[3];
+    }
+
+    struct scene const *scene = NULL;
+
+    for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+        if (strcmp(scenes[i].name, argv[1]) == 0) {
+            scene = &scenes[i];
+        }
+    }
+
+    if (!scene) {
+        fprintf(stderr, "tq_render_test: unknown scene %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    tq_set_renderer_type(TQ_RENDERER_SOFTWARE);
+    tq_set_headless(true);
+    tq_set_display_size((tq_vec2i) { CANVAS_WIDTH, CANVAS_HEIGHT });
+    tq_initialize();
+
+    int result = run_scene(scene);
+
+    tq_terminate();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
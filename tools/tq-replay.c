@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tq/tq.h>
+
+//------------------------------------------------------------------------------
+// [tools/tq-replay]
+// Plays a renderer trace recorded with TQ_TRACE=<path> (or
+// tq_set_trace_path()) as fast as possible and prints frame times.
+// Backend is chosen as usual: set TQ_RENDERER to pick the renderer
+// and TQ_HEADLESS=1 to run without a window and vsync.
+//------------------------------------------------------------------------------
+
+static bool quiet;
+static double total_time;
+static double min_time = 1e9;
+static double max_time;
+
+static void on_frame(int frame, double time)
+{
+    total_time += time;
+    min_time = (time < min_time) ? time : min_time;
+    max_time = (time > max_time) ? time : max_time;
+
+    if (!quiet) {
+        tq_frame_stats stats;
+        tq_get_frame_stats(&stats);
+
+        printf("frame %d: %.3f ms (gpu %.3f ms, %d batches)\n",
+            frame, time * 1000.0, stats.gpu_time, stats.batch_count);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char const *path = NULL;
+    int repeat = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[i], "-n") == 0 && (i + 1) < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (!path || repeat < 1) {
+        fprintf(stderr, "usage: tq-replay [-q] [-n repeat] trace-file\n");
+        return EXIT_FAILURE;
+    }
+
+    tq_set_title("tq-replay");
+    tq_initialize();
+
+    int frames = 0;
+
+    for (int i = 0; i < repeat; i++) {
+        int count = tq_replay_trace(path, on_frame);
+
+        if (count < 0) {
+            tq_terminate();
+            return EXIT_FAILURE;
+        }
+
+        frames += count;
+    }
+
+    if (frames > 0) {
+        printf("%d frames: avg %.3f ms, min %.3f ms, max %.3f ms\n",
+            frames, total_time * 1000.0 / frames, min_time * 1000.0, max_time * 1000.0);
+    }
+
+    tq_terminate();
+
+    return EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------